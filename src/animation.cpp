@@ -6,6 +6,7 @@
 #include "camera.h"
 #include "shader.h"
 #include "mesh.h"
+#include "textscanner.h"
 
 #include <sys/stat.h>
 
@@ -22,9 +23,9 @@ Skeleton::Bone* Skeleton::getBone(const char* name)
 	return &bones[it->second];
 }
 
-Matrix44& Skeleton::getBoneMatrix(const char* name, bool local )
+Matrix34& Skeleton::getBoneMatrix(const char* name, bool local )
 {
-	static Matrix44 none;
+	static Matrix34 none;
 	auto it = bones_by_name.find(name);
 	if (it == bones_by_name.end())
 		return none;
@@ -40,11 +41,11 @@ void Skeleton::computeFinalBoneMatrices( std::vector<Matrix44>& bone_matrices, M
 	updateGlobalMatrices();
 
 	bone_matrices.resize(mesh->bones_info.size());
-	#pragma omp for  
 	for (int i = 0; i < mesh->bones_info.size(); ++i)
 	{
 		BoneInfo& bone_info = mesh->bones_info[i];
-		bone_matrices[i] = mesh->bind_matrix * bone_info.bind_pose * getBoneMatrix( bone_info.name, false ); //use globals
+		Matrix34 bind = mesh->bind_matrix * bone_info.bind_pose;
+		bone_matrices[i] = (bind * getBoneMatrix( bone_info.name, false )).toMatrix44(); //use globals
 	}
 }
 
@@ -79,7 +80,6 @@ void blendSkeleton(Skeleton* a, Skeleton* b, float w, Skeleton* result, uint8 la
 	}
 
 	//blend bones locally
-	#pragma omp for  
 	for (int i = 0; i < result->num_bones; ++i)
 	{
 		Skeleton::Bone& bone = result->bones[i];
@@ -87,8 +87,7 @@ void blendSkeleton(Skeleton* a, Skeleton* b, float w, Skeleton* result, uint8 la
 		Skeleton::Bone& boneB = b->bones[i];
 		if ( layer != 0xFF && !(bone.layer & layer) ) //not in the same layer
 			continue;
-		#pragma omp for  
-		for (int j = 0; j < 16; ++j)
+		for (int j = 0; j < 12; ++j)
 			bone.model.m[j] = lerp( boneA.model.m[j], boneB.model.m[j], w);
 	}
 }
@@ -102,8 +101,8 @@ void Skeleton::renderSkeleton(Camera* camera, Matrix44 model, Vector4 color, boo
 		Bone& bone = bones[i];
 		Vector3 v1;
 		Vector3 v2;
-		Matrix44 parent_global_matrix = global_bone_matrices[ bone.parent ];
-		Matrix44 global_matrix = global_bone_matrices[i];
+		Matrix34& parent_global_matrix = global_bone_matrices[ bone.parent ];
+		Matrix34& global_matrix = global_bone_matrices[i];
 		v1 = global_matrix * v1;
 		v2 = parent_global_matrix * v2;
 		m.vertices.push_back(v1);
@@ -131,7 +130,7 @@ void Skeleton::applyTransformToBones(const char* root, Matrix44 transform)
 	Bone* bone = getBone(root);
 	if (!bone)
 		return;
-	bone->model = bone->model * transform;
+	bone->model = bone->model * Matrix34(transform);
 }
 
 void Skeleton::updateGlobalMatrices()
@@ -194,18 +193,17 @@ void Animation::assignTime(float t, bool loop, bool interpolate, uint8 layers)
 		index2 = 0;
 	float f = v - floor(v);
 
-	Matrix44* k = keyframes + index * num_animated_bones;
-	Matrix44* k2 = keyframes + index2 * num_animated_bones;
+	Matrix34* k = keyframes + index * num_animated_bones;
+	Matrix34* k2 = keyframes + index2 * num_animated_bones;
 
 	//compute local bones
-	#pragma omp for  
 	for (int i = 0; i < num_animated_bones; ++i)
 	{
 		int bone_index = bones_map[i];
 		Skeleton::Bone& bone = skeleton.bones[bone_index];
 		if (layers != 0xFF && !(bone.layer & layers))
 			continue;
-		for (int j = 0; j < 16; ++j)
+		for (int j = 0; j < 12; ++j)
 			bone.model.m[j] = lerp(k[i].m[j], k2[i].m[j], f);
 	}
 
@@ -237,7 +235,7 @@ bool Animation::load(const char* filename)
 	else //not a bin
 	{
 		std::string binfilename = name + ".abin";
-		if (!loadABIN(binfilename.c_str())) //not found
+		if (!loadABIN(binfilename.c_str(), filename)) //not found or the SKANIM changed
 		{
 			//try to load in ASCII
 			if (!loadSKANIM(filename))
@@ -264,6 +262,7 @@ struct sAnimHeader {
 	int num_keyframes;
 	int num_bones;
 	int8 bones_map[128];
+	sSourceInfo source; //the SKANIM it was cooked from
 	char extra[16];
 };
 
@@ -291,6 +290,7 @@ bool Animation::writeABIN(const char* filename)
 	header.num_keyframes = num_keyframes;
 	header.num_bones = skeleton.num_bones;
 	memcpy( header.bones_map, bones_map, sizeof(bones_map)  );
+	getSourceInfo(filename, header.source);
 
 	//write header
 	fwrite((void*)&header, sizeof(sAnimHeader), 1, f);
@@ -299,13 +299,13 @@ bool Animation::writeABIN(const char* filename)
 	fwrite((void*)skeleton.bones, sizeof(skeleton.bones), 1, f);
 
 	//write keyframes
-	fwrite((void*)keyframes, sizeof(Matrix44) * num_keyframes * num_animated_bones, 1, f);
+	fwrite((void*)keyframes, sizeof(Matrix34) * num_keyframes * num_animated_bones, 1, f);
 
 	fclose(f);
 	return true;
 }
 
-bool Animation::loadABIN(const char* filename)
+bool Animation::loadABIN(const char* filename, const char* source)
 {
 	FILE *f;
 	assert(filename);
@@ -337,9 +337,16 @@ bool Animation::loadABIN(const char* filename)
 	if (header.version != ANIM_BIN_VERSION || header.header_bytes != sizeof(sAnimHeader))
 	{
 		std::cout << "[WARN] loading BIN: old version: " << filename << std::endl;
+		delete[] data;
 		return false;
 	}
 
+	if (source && !isSourceUnchanged(source, header.source))
+	{
+		delete[] data;
+		return false; //cooked again from the source
+	}
+
 	//extract header
 	duration = header.duration;
 	samples_per_second = header.samples_per_second;
@@ -354,9 +361,9 @@ bool Animation::loadABIN(const char* filename)
 
 	//extract keyframes
 	assert(keyframes == NULL);
-	keyframes = new Matrix44[num_keyframes * num_animated_bones];
-	memcpy( keyframes, pos, sizeof(Matrix44)*num_keyframes * num_animated_bones );
-	pos += sizeof(Matrix44) * num_keyframes * num_animated_bones;
+	keyframes = new Matrix34[num_keyframes * num_animated_bones];
+	memcpy( keyframes, pos, sizeof(Matrix34)*num_keyframes * num_animated_bones );
+	pos += sizeof(Matrix34) * num_keyframes * num_animated_bones;
 
 	//compute bone names map
 	for (int i = 0; i < skeleton.num_bones; ++i)
@@ -368,53 +375,33 @@ bool Animation::loadABIN(const char* filename)
 
 bool Animation::loadSKANIM(const char* filename)
 {
-	struct stat stbuffer;
-
-	//duration in seconds, samples per second, num. samples, number of bones in the skeleton, number of animated bones
-	FILE* f = fopen(filename, "rb");
-	if (f == NULL)
+	TextScanner scanner;
+	if (!scanner.open(filename))
 		return false;
-	stat(filename, &stbuffer);
-
-	unsigned int size = (unsigned int)stbuffer.st_size;
-	char* data = new char[size + 1];
-	fread(data, size, 1, f);
-	fclose(f);
-	data[size] = 0;
-	char* pos = data;
 	char word[255];
 	memset(&skeleton.bones, 0, sizeof(skeleton.bones)); //clear
 
 	//duration in seconds, samples per second, num. samples, number of bones in the skeleton, number of animated bones
-	std::vector<float> header;
-	pos = fetchBufferFloat(pos, header, 5);
+	float header[5];
+	scanner.getFloats(header, 5);
 	duration = header[0];
 	samples_per_second = header[1];
-	num_keyframes = header[2];
-	skeleton.num_bones = header[3];
+	num_keyframes = (int)header[2];
+	skeleton.num_bones = (int)header[3];
 	assert(skeleton.num_bones < 128); //MAX_BONES
 	num_animated_bones = 0;
 
 	int current_keyframe = 0;
 
-	while (*pos)
+	while (!scanner.eof())
 	{
-		char type = *pos;
-
-		//memcpy(word, pos, 32 );
-		//word[31] = 0;
-		//std::cout << word << std::endl << std::flush;
-
-		pos++;
+		char type = scanner.getChar();
 		if (type == 'B') //bone
 		{
-			pos = fetchWord(pos, word);
-			int index = atof(word);
+			int index = scanner.getInt();
 			Skeleton::Bone& bone = skeleton.bones[index];
-			pos = fetchWord(pos, bone.name);
-			//std::cout << bone.name << std::endl;
-			pos = fetchWord(pos, word);
-			int parent_index = atof(word);
+			scanner.getField(bone.name, sizeof(bone.name));
+			int parent_index = scanner.getInt();
 			bone.parent = parent_index;
 			if (bone.parent != -1)
 			{
@@ -423,26 +410,30 @@ bool Animation::loadSKANIM(const char* filename)
 				parent_bone.children[parent_bone.num_children++] = index;
 			}
 
-			pos = fetchMatrix44(pos, bone.model);
+			Matrix44 bone_model;
+			scanner.getFloats(bone_model.m, 16);
+			bone.model = bone_model;
 		}
 		else if (type == '@')
 		{
-			std::vector<float> bones_map_info;
-			pos = fetchBufferFloat(pos, bones_map_info);
-			for (int j = 0; j < (int)bones_map_info.size(); ++j)
-				bones_map[j] = bones_map_info[j];
-			num_animated_bones = (int)bones_map_info.size();
+			num_animated_bones = scanner.getInt();
+			for (int j = 0; j < num_animated_bones; ++j)
+				bones_map[j] = (int8)scanner.getInt();
 			assert(keyframes == NULL);
-			keyframes = new Matrix44[num_animated_bones * num_keyframes];
+			keyframes = new Matrix34[num_animated_bones * num_keyframes];
 		}
 		else if (type == 'K')
 		{
-			pos = fetchWord(pos, word);
-			//float time = atof(word);
-			Matrix44* k = keyframes + current_keyframe * num_animated_bones;
+			scanner.getWord(word, sizeof(word)); //time
+			assert(current_keyframe < num_keyframes);
+			Matrix34* k = keyframes + current_keyframe * num_animated_bones;
 			current_keyframe++;
+			Matrix44 keyframe;
 			for (int j = 0; j < num_animated_bones; ++j)
-				pos = fetchMatrix44(pos, *(k + j));
+			{
+				scanner.getFloats(keyframe.m, 16);
+				k[j] = keyframe;
+			}
 		}
 		else
 			break; //end of file probably
@@ -470,7 +461,6 @@ bool Animation::loadSKANIM(const char* filename)
 
 	assignTime(0); //reset pose
 
-	delete[] data;
 	return true;
 }
 
@@ -9,7 +9,7 @@
 
 class Camera;
 
-#define ANIM_BIN_VERSION 3
+#define ANIM_BIN_VERSION 5
 
 //defined layers for every body
 enum BODY_LAYERS {
@@ -34,7 +34,7 @@ public:
 	struct Bone {
 		int8 parent;	//id of the parent bone
 		char name[32];	//fixed size bone name
-		Matrix44 model; //local transformation (according to its parent bone)
+		Matrix34 model; //local transformation (according to its parent bone)
 		uint8 layer;	//which layers are assigned to this bone (UPPER_BODY, RIGHT_ARM, etc)
 		uint8 num_children;	//how many child bones
 		int8 children[16]; //list of child bone ids (max 16 children )
@@ -42,13 +42,13 @@ public:
 	Bone bones[128]; //max 128 bones
 	int num_bones;	//number of bones
 
-	Matrix44 global_bone_matrices[128]; //transform of every bone in global coordinates (according to the 0,0,0 and not the parent)
+	Matrix34 global_bone_matrices[128]; //transform of every bone in global coordinates (according to the 0,0,0 and not the parent)
 	std::map<const char*, int, cmp_str> bones_by_name;	//map to get the bone index from its name, required to extract the final bones array
 
 	Skeleton();
 
 	Bone* getBone(const char* name); //returns the bone pointer
-	Matrix44& getBoneMatrix(const char* name, bool local = true); //returns the local matrix of a bone
+	Matrix34& getBoneMatrix(const char* name, bool local = true); //returns the local matrix of a bone
 	void applyTransformToBones(const char* root, Matrix44 transform); //given a bone name and matrix, it multiplies the matrix to the bone
 	void updateGlobalMatrices(); //updates the list of global matrices according to the local matrices
 
@@ -72,7 +72,7 @@ public:
 	int num_keyframes;
 	int8 bones_map[128]; //maps from keyframe data index to bone
 
-	Matrix44* keyframes;
+	Matrix34* keyframes;
 
 	Animation();
 	~Animation();	//we need the dtor to remove the keyframes memory
@@ -83,7 +83,7 @@ public:
 	//storage
 	bool load(const char* filename);
 	bool loadSKANIM(const char* filename);
-	bool loadABIN(const char* filename);
+	bool loadABIN(const char* filename, const char* source = NULL); //source is the SKANIM, the ABIN is ignored if it changed
 	bool writeABIN(const char* filename);
 
 	static std::map<std::string, Animation*> sAnimationsLoaded;
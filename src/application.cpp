@@ -10,6 +10,13 @@
 #include "prefab.h"
 #include "gltf_loader.h"
 #include "renderer.h"
+#include "drawcapture.h"
+#include "jobs.h"
+#include "asyncloader.h"
+#include "texturestreamer.h"
+#include "assetmanager.h"
+#include "meshoptdecoder.h"
+#include "bcencoder.h"
 
 #include <cmath>
 #include <string>
@@ -47,6 +54,12 @@ Application::Application(int window_width, int window_height, SDL_Window* window
 	elapsed_time = 0.0f;
 	mouse_locked = false;
 
+	//worker threads for the loaders and the per frame tasks
+	JobSystem::init();
+	AsyncLoader::init();
+	Texture::checkCompressionSupport();
+	Texture::getWhiteTexture(); //placeholder of the textures being loaded, must be created by this thread
+
 	//loads and compiles several shaders from one single file
     //change to "data/shader_atlas_osx.txt" if you are in XCODE
 #ifdef __APPLE__
@@ -91,6 +104,13 @@ void Application::render(void)
 	//be sure no errors present in opengl before start
 	checkGLErrors();
 
+	//finish the assets loaded in the workers (GL uploads), limited per frame
+	AsyncLoader::processUploads(AsyncLoader::upload_budget);
+	//stream in the mips requested last frame, evict if over the budget
+	TextureStreamer::update();
+	//keep the assets within their memory budgets
+	AssetManager::update();
+
 	//set the camera as default (used by some functions in the framework)
 	camera->enable();
 
@@ -259,11 +279,23 @@ void Application::renderDebugGUI(void)
 
 	//System stats
 	ImGui::Text(getGPUStats().c_str());					   // Display some text (you can use a format strings too)
+	if (AsyncLoader::num_loading > 0)
+		ImGui::Text("Loading: %d assets, %d uploads pending", (int)AsyncLoader::num_loading, AsyncLoader::getPendingUploads());
+	ImGui::SliderFloat("Upload budget (ms)", &AsyncLoader::upload_budget, 0.5f, 16.0f);
+	ImGui::Checkbox("Stream mips", &TextureStreamer::enabled);
+	ImGui::SliderFloat("VRAM budget (MB)", &TextureStreamer::vram_budget, 16.0f, 2048.0f);
+	ImGui::Text("Streamed: %d textures, %.1f / %.0f MB", TextureStreamer::getNumTextures(), TextureStreamer::vram_used / (1024.0f * 1024.0f), TextureStreamer::vram_budget);
 
 	ImGui::Checkbox("Wireframe", &render_wireframe);
 	ImGui::ColorEdit3("BG color", scene->background_color.v);
 	ImGui::ColorEdit3("Ambient Light", scene->ambient_light.v);
 	ImGui::Checkbox("Show ShadowMaps", &renderer->show_shadowmap);
+	ImGui::Checkbox("Use LODs", &renderer->use_lods);
+	ImGui::SliderFloat("LOD error (px)", &renderer->lod_pixel_error, 0.25f, 8.0f);
+	ImGui::SliderFloat("LOD hysteresis", &renderer->lod_hysteresis, 0.0f, 0.9f);
+	ImGui::SliderInt("Shadow LOD bias", &renderer->shadow_lod_bias, 0, 3);
+	ImGui::Checkbox("Use impostors", &renderer->use_impostors);
+	ImGui::SliderFloat("Impostor size (px)", &renderer->impostor_pixels, 0.0f, 128.0f);
 
 	//add info to the debug panel about the camera
 	if (ImGui::TreeNode(camera, "Camera")) {
@@ -271,6 +303,12 @@ void Application::renderDebugGUI(void)
 		ImGui::TreePop();
 	}
 
+	//memory used by the loaded assets and their budgets
+	if (ImGui::TreeNode("Assets")) {
+		AssetManager::renderInMenu();
+		ImGui::TreePop();
+	}
+
 	ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.75f, 0.75f, 0.75f, 1.0f));
 
 	//example to show prefab info: first param must be unique!
@@ -319,6 +357,9 @@ void Application::onKeyDown( SDL_KeyboardEvent event )
 		case SDLK_4: renderer->render_mode = GTR::eRenderMode::SINGLE_PATH; break;
 		case SDLK_6: renderer->render_mode = GTR::eRenderMode::MULTI_PATH; break;
 		case SDLK_7: renderer->show_shadowmap = !renderer->show_shadowmap; break;
+		case SDLK_F9: renderer->capture_frames = 1; break;	//capture the draw commands of the next frame
+		case SDLK_F10: GTR::DrawCapture::replayFile(GTR::capture_filename); break; //replay them and show the time per frame
+		case SDLK_F11: JobSystem::benchmark(); Matrix44::benchmark(); Mesh::benchmarkOBJ(); Mesh::benchmarkBin(); MeshoptDecoder::benchmark(); BCEncoder::benchmark(); break;
 	}
 }
 
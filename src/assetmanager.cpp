@@ -0,0 +1,289 @@
+#include "assetmanager.h"
+#include "texture.h"
+#include "mesh.h"
+#include "material.h"
+#include "prefab.h"
+#include "asyncloader.h"
+#include "includes.h"
+
+#include <vector>
+#include <algorithm>
+
+bool AssetManager::enabled = true;
+long AssetManager::frame = 0;
+
+//count, evicted, cpu, vram, cpu budget, vram budget (MB), evictions
+sAssetStats AssetManager::stats[NUM_ASSET_TYPES] = {
+	{ 0, 0, 0, 0, 512.0f, 1024.0f, 0 },	//textures
+	{ 0, 0, 0, 0, 512.0f, 512.0f, 0 },	//meshes
+	{ 0, 0, 0, 0, 8.0f, 0.0f, 0 },		//materials
+	{ 0, 0, 0, 0, 64.0f, 0.0f, 0 },		//prefabs
+};
+
+//the assets used in the last frames are on screen, evicting them would only reload them again
+const long PROTECTED_FRAMES = 2;
+
+const char* AssetManager::getTypeName(eAssetType type)
+{
+	switch (type)
+	{
+		case ASSET_TEXTURE: return "Textures";
+		case ASSET_MESH: return "Meshes";
+		case ASSET_MATERIAL: return "Materials";
+		case ASSET_PREFAB: return "Prefabs";
+		default: return "";
+	}
+}
+
+void AssetManager::use(Texture* texture)
+{
+	if (!texture)
+		return;
+	texture->last_used = frame;
+	if (texture->evicted)
+		texture->reload();
+}
+
+void AssetManager::use(Mesh* mesh)
+{
+	if (!mesh)
+		return;
+	mesh->last_used = frame;
+	if (mesh->evicted)
+		mesh->reload();
+}
+
+void AssetManager::use(GTR::Material* material)
+{
+	if (material)
+		material->last_used = frame;
+}
+
+static void measure()
+{
+	for (int i = 0; i < NUM_ASSET_TYPES; ++i)
+	{
+		sAssetStats& s = AssetManager::stats[i];
+		s.count = s.evicted = 0;
+		s.cpu_bytes = s.vram_bytes = 0;
+	}
+
+	sAssetStats& textures = AssetManager::stats[ASSET_TEXTURE];
+	for (auto it : Texture::sTexturesLoaded)
+	{
+		Texture* texture = it.second;
+		textures.count++;
+		textures.evicted += texture->evicted ? 1 : 0;
+		textures.cpu_bytes += texture->getCPUSize();
+		textures.vram_bytes += texture->getVRAMSize();
+	}
+
+	sAssetStats& meshes = AssetManager::stats[ASSET_MESH];
+	for (auto it : Mesh::sMeshesLoaded)
+	{
+		Mesh* mesh = it.second;
+		meshes.count++;
+		meshes.evicted += mesh->evicted ? 1 : 0;
+		meshes.cpu_bytes += mesh->getCPUSize();
+		meshes.vram_bytes += mesh->getVRAMSize();
+	}
+
+	sAssetStats& materials = AssetManager::stats[ASSET_MATERIAL];
+	materials.count = (int)GTR::Material::sMaterials.size();
+	materials.cpu_bytes = materials.count * sizeof(GTR::Material);
+
+	sAssetStats& prefabs = AssetManager::stats[ASSET_PREFAB];
+	for (auto it : GTR::Prefab::sPrefabsLoaded)
+	{
+		prefabs.count++;
+		prefabs.cpu_bytes += it.second->getCPUSize();
+	}
+}
+
+//bytes over the budget, 0 if within it or without limit
+static size_t getExcess(size_t bytes, float budget)
+{
+	size_t limit = (size_t)(budget * 1024 * 1024);
+	return (budget > 0 && bytes > limit) ? bytes - limit : 0;
+}
+
+//the unreferenced assets go first, then the least recently used
+static bool compareLRU(Asset* a, Asset* b)
+{
+	if ((a->ref_count > 0) != (b->ref_count > 0))
+		return a->ref_count == 0;
+	return a->last_used < b->last_used;
+}
+
+template<typename T>
+static void sortCandidates(std::vector<T*>& candidates)
+{
+	std::sort(candidates.begin(), candidates.end(), [](T* a, T* b) { return compareLRU(a, b); });
+}
+
+static bool isProtected(Asset* asset)
+{
+	return asset->last_used >= AssetManager::frame - PROTECTED_FRAMES;
+}
+
+//the deleted assets can be in use by a prefab being loaded in a worker (found by name but not referenced yet)
+static bool canDelete(Asset* asset)
+{
+	return asset->ref_count == 0 && !isProtected(asset) && AsyncLoader::num_loading == 0;
+}
+
+static void evictPrefabs()
+{
+	sAssetStats& s = AssetManager::stats[ASSET_PREFAB];
+	size_t excess = getExcess(s.cpu_bytes, s.cpu_budget);
+	if (!excess)
+		return;
+
+	std::vector<GTR::Prefab*> candidates;
+	for (auto it : GTR::Prefab::sPrefabsLoaded)
+		if (canDelete(it.second))
+			candidates.push_back(it.second);
+	sortCandidates(candidates);
+
+	for (int i = 0; i < candidates.size() && excess; ++i)
+	{
+		size_t size = candidates[i]->getCPUSize();
+		delete candidates[i]; //releases its meshes and materials
+		excess -= std::min(excess, size);
+		s.cpu_bytes -= std::min(s.cpu_bytes, size);
+		s.count--;
+		s.num_evictions++;
+	}
+}
+
+static void evictMaterials()
+{
+	sAssetStats& s = AssetManager::stats[ASSET_MATERIAL];
+	size_t excess = getExcess(s.cpu_bytes, s.cpu_budget);
+	if (!excess)
+		return;
+
+	std::vector<GTR::Material*> candidates;
+	for (auto it : GTR::Material::sMaterials)
+		if (canDelete(it.second))
+			candidates.push_back(it.second);
+	sortCandidates(candidates);
+
+	for (int i = 0; i < candidates.size() && excess; ++i)
+	{
+		delete candidates[i]; //releases its textures
+		excess -= std::min(excess, sizeof(GTR::Material));
+		s.cpu_bytes -= sizeof(GTR::Material);
+		s.count--;
+		s.num_evictions++;
+	}
+}
+
+//the meshes loaded from a file free their data and stay in the manager (the app can keep pointers to them),
+//the ones from a gltf cannot be loaded alone so they are deleted once no node uses them
+static void evictMeshes()
+{
+	sAssetStats& s = AssetManager::stats[ASSET_MESH];
+	size_t cpu_excess = getExcess(s.cpu_bytes, s.cpu_budget);
+	size_t vram_excess = getExcess(s.vram_bytes, s.vram_budget);
+	if (!cpu_excess && !vram_excess)
+		return;
+
+	std::vector<Mesh*> candidates;
+	for (auto it : Mesh::sMeshesLoaded)
+	{
+		Mesh* mesh = it.second;
+		if (!mesh->getNumVertices() || isProtected(mesh))
+			continue;
+		if (mesh->filename.size() || canDelete(mesh))
+			candidates.push_back(mesh);
+	}
+	sortCandidates(candidates);
+
+	for (int i = 0; i < candidates.size() && (cpu_excess || vram_excess); ++i)
+	{
+		Mesh* mesh = candidates[i];
+		size_t cpu = mesh->getCPUSize();
+		size_t vram = mesh->getVRAMSize();
+		if (mesh->filename.size())
+		{
+			mesh->evict();
+			s.evicted++;
+		}
+		else
+		{
+			delete mesh;
+			s.count--;
+		}
+		cpu_excess -= std::min(cpu_excess, cpu);
+		vram_excess -= std::min(vram_excess, vram);
+		s.cpu_bytes -= std::min(s.cpu_bytes, cpu);
+		s.vram_bytes -= std::min(s.vram_bytes, vram);
+		s.num_evictions++;
+	}
+}
+
+//textures are never deleted, only the ones with a cooked file free their memory
+static void evictTextures()
+{
+	sAssetStats& s = AssetManager::stats[ASSET_TEXTURE];
+	size_t cpu_excess = getExcess(s.cpu_bytes, s.cpu_budget);
+	size_t vram_excess = getExcess(s.vram_bytes, s.vram_budget);
+	if (!cpu_excess && !vram_excess)
+		return;
+
+	std::vector<Texture*> candidates;
+	for (auto it : Texture::sTexturesLoaded)
+		if (it.second->canEvict() && !isProtected(it.second))
+			candidates.push_back(it.second);
+	sortCandidates(candidates);
+
+	for (int i = 0; i < candidates.size() && (cpu_excess || vram_excess); ++i)
+	{
+		Texture* texture = candidates[i];
+		size_t cpu = texture->getCPUSize();
+		size_t vram = texture->getVRAMSize();
+		texture->evict();
+		cpu_excess -= std::min(cpu_excess, cpu);
+		vram_excess -= std::min(vram_excess, vram);
+		s.cpu_bytes -= std::min(s.cpu_bytes, cpu);
+		s.vram_bytes -= std::min(s.vram_bytes, vram);
+		s.evicted++;
+		s.num_evictions++;
+	}
+}
+
+void AssetManager::update()
+{
+	assert(AsyncLoader::isMainThread());
+	frame++;
+
+	std::lock_guard<std::recursive_mutex> lock(AsyncLoader::manager_mutex);
+	measure();
+	if (!enabled)
+		return;
+
+	//in order of ownership: prefabs release meshes and materials, materials release textures
+	evictPrefabs();
+	evictMaterials();
+	evictMeshes();
+	evictTextures();
+}
+
+void AssetManager::renderInMenu()
+{
+#ifndef SKIP_IMGUI
+	ImGui::Checkbox("Enabled", &enabled);
+	for (int i = 0; i < NUM_ASSET_TYPES; ++i)
+	{
+		sAssetStats& s = stats[i];
+		ImGui::Text("%s: %d (%d evicted, %ld evictions)", getTypeName((eAssetType)i), s.count, s.evicted, s.num_evictions);
+		ImGui::Text("  CPU %.1f MB  VRAM %.1f MB", s.cpu_bytes / (1024.0f * 1024.0f), s.vram_bytes / (1024.0f * 1024.0f));
+		ImGui::PushID(i);
+		ImGui::SliderFloat("CPU budget (MB)", &s.cpu_budget, 0.0f, 4096.0f);
+		if (i == ASSET_TEXTURE || i == ASSET_MESH)
+			ImGui::SliderFloat("VRAM budget (MB)", &s.vram_budget, 0.0f, 4096.0f);
+		ImGui::PopID();
+	}
+#endif
+}
@@ -0,0 +1,70 @@
+#pragma once
+#ifndef ASSETMANAGER_H
+#define ASSETMANAGER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cassert>
+
+class Texture;
+class Mesh;
+namespace GTR { class Material; class Prefab; }
+
+//reference count and last use of the assets kept by the managers (Texture, Mesh, Material, Prefab)
+class Asset {
+public:
+	std::atomic<int> ref_count; //handles held by the materials, the nodes and the entities
+	long last_used; //AssetManager::frame of the last use, for the LRU
+	bool evicted; //its data was freed to fit the budget, it is loaded again when used
+
+	Asset() : ref_count(0), last_used(0), evicted(false) {}
+	Asset(const Asset& other) : ref_count(0), last_used(other.last_used), evicted(false) {}
+	Asset& operator = (const Asset& other) { last_used = other.last_used; return *this; }
+
+	void addRef() { ref_count++; }
+	void release() { assert(ref_count > 0); ref_count--; } //never deletes, the manager frees it when over budget
+};
+
+enum eAssetType {
+	ASSET_TEXTURE,
+	ASSET_MESH,
+	ASSET_MATERIAL,
+	ASSET_PREFAB,
+	NUM_ASSET_TYPES
+};
+
+struct sAssetStats {
+	int count;
+	int evicted;
+	size_t cpu_bytes;
+	size_t vram_bytes;
+	float cpu_budget; //in MB, 0 for no limit
+	float vram_budget;
+	long num_evictions; //since the start
+};
+
+//Accounts the memory of the assets in the managers (sTexturesLoaded, sMeshesLoaded, sMaterials, sPrefabsLoaded)
+//and keeps every type within its budgets. When a budget is exceeded the unreferenced assets go first and then
+//the least recently used ones: the textures and the meshes loaded from a file free their data and are loaded
+//again when the renderer uses them, the unreferenced prefabs, materials and gltf meshes are deleted
+//(loading the prefab again creates them). Assets used in the last frames are never evicted.
+class AssetManager {
+public:
+	static bool enabled;
+	static long frame;
+	static sAssetStats stats[NUM_ASSET_TYPES];
+
+	static const char* getTypeName(eAssetType type);
+
+	//called by the renderer for every asset it uses: updates the LRU and reloads the evicted ones
+	static void use(Texture* texture);
+	static void use(Mesh* mesh);
+	static void use(GTR::Material* material);
+
+	//once per frame from the main thread: measures the usage and evicts when over budget
+	static void update();
+
+	static void renderInMenu();
+};
+
+#endif
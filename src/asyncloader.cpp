@@ -0,0 +1,64 @@
+#include "asyncloader.h"
+#include "utils.h"
+
+#include <deque>
+#include <thread>
+
+float AsyncLoader::upload_budget = 2.0f;
+std::atomic<int> AsyncLoader::num_loading(0);
+std::recursive_mutex AsyncLoader::manager_mutex;
+
+static std::thread::id main_thread_id;
+static bool main_thread_set = false;
+static std::mutex queue_mutex;
+static std::deque<AsyncLoader::Task> upload_queue;
+
+void AsyncLoader::init()
+{
+	main_thread_id = std::this_thread::get_id();
+	main_thread_set = true;
+}
+
+bool AsyncLoader::isMainThread()
+{
+	return !main_thread_set || std::this_thread::get_id() == main_thread_id;
+}
+
+void AsyncLoader::enqueue(const Task& task)
+{
+	if (isMainThread())
+	{
+		task();
+		return;
+	}
+	std::lock_guard<std::mutex> lock(queue_mutex);
+	upload_queue.push_back(task);
+}
+
+int AsyncLoader::processUploads(double budget_ms)
+{
+	double start = getTimeHighRes();
+	int num = 0;
+	while (true)
+	{
+		Task task;
+		{
+			std::lock_guard<std::mutex> lock(queue_mutex);
+			if (upload_queue.empty())
+				break;
+			task = std::move(upload_queue.front());
+			upload_queue.pop_front();
+		}
+		task();
+		num++;
+		if (getTimeHighRes() - start >= budget_ms)
+			break;
+	}
+	return num;
+}
+
+int AsyncLoader::getPendingUploads()
+{
+	std::lock_guard<std::mutex> lock(queue_mutex);
+	return (int)upload_queue.size();
+}
@@ -0,0 +1,34 @@
+#pragma once
+#ifndef ASYNCLOADER_H
+#define ASYNCLOADER_H
+
+#include <functional>
+#include <mutex>
+#include <atomic>
+
+//Loads assets in the worker threads of the JobSystem. GL can only be used from the main thread,
+//so the GL work (buffers and textures upload) is queued and executed by the main thread during
+//the frame, limited to a time budget so loading never freezes the rendering.
+class AsyncLoader {
+public:
+	typedef std::function<void()> Task;
+
+	static float upload_budget; //ms per frame spent executing uploads
+	static std::atomic<int> num_loading; //async loads not finished yet
+
+	//protects the managers (sMeshesLoaded, sTexturesLoaded, sMaterials, sPrefabsLoaded) when loading from several threads
+	static std::recursive_mutex manager_mutex;
+
+	//must be called from the thread that owns the GL context
+	static void init();
+	static bool isMainThread();
+
+	//queues GL work for the main thread, executed immediately if called from the main thread
+	static void enqueue(const Task& task);
+
+	//executes queued tasks until the budget (in ms) is spent, at least one per call, returns the number executed
+	static int processUploads(double budget_ms);
+	static int getPendingUploads();
+};
+
+#endif
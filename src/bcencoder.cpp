@@ -0,0 +1,831 @@
+#include "bcencoder.h"
+#include "jobs.h"
+#include "utils.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <iostream>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#define BCENCODER_SSE
+	#include <xmmintrin.h>
+#endif
+
+//the 16 pixels of a block, one array per channel so four pixels can be processed at once
+struct sBlock {
+	float c[4][16];
+};
+
+//weights of the 16 interpolated colors of BC7 (4 bits indices)
+static const int bc7_weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+//and of the 4 of the 2 bits indices
+static const int bc7_weights2[4] = { 0, 21, 43, 64 };
+
+static void fetchBlock(const uint8* pixels, int width, int height, int num_channels, int bx, int by, sBlock& block)
+{
+	for (int i = 0; i < 16; ++i)
+	{
+		//the blocks on the borders repeat the last pixel
+		int x = std::min(bx * 4 + (i & 3), width - 1);
+		int y = std::min(by * 4 + (i >> 2), height - 1);
+		const uint8* p = pixels + (y * width + x) * num_channels;
+		block.c[0][i] = p[0];
+		block.c[1][i] = p[1];
+		block.c[2][i] = p[2];
+		block.c[3][i] = num_channels == 4 ? p[3] : 255.0f;
+	}
+}
+
+//closest palette entry for every pixel using the first num_channels channels, returns the squared error
+static float findIndices(const sBlock& block, const float palette[][4], int palette_size, int num_channels, int* indices)
+{
+#ifdef BCENCODER_SSE
+	float total = 0;
+	for (int g = 0; g < 16; g += 4)
+	{
+		__m128 best = _mm_set1_ps(1e30f);
+		__m128 best_index = _mm_setzero_ps();
+		for (int k = 0; k < palette_size; ++k)
+		{
+			__m128 dist = _mm_setzero_ps();
+			for (int c = 0; c < num_channels; ++c)
+			{
+				__m128 d = _mm_sub_ps(_mm_loadu_ps(&block.c[c][g]), _mm_set1_ps(palette[k][c]));
+				dist = _mm_add_ps(dist, _mm_mul_ps(d, d));
+			}
+			__m128 mask = _mm_cmplt_ps(dist, best);
+			best = _mm_min_ps(dist, best);
+			best_index = _mm_or_ps(_mm_and_ps(mask, _mm_set1_ps((float)k)), _mm_andnot_ps(mask, best_index));
+		}
+		float b[4], bi[4];
+		_mm_storeu_ps(b, best);
+		_mm_storeu_ps(bi, best_index);
+		for (int i = 0; i < 4; ++i)
+		{
+			indices[g + i] = (int)bi[i];
+			total += b[i];
+		}
+	}
+	return total;
+#else
+	float total = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		float best = 1e30f;
+		int best_index = 0;
+		for (int k = 0; k < palette_size; ++k)
+		{
+			float dist = 0;
+			for (int c = 0; c < num_channels; ++c)
+			{
+				float d = block.c[c][i] - palette[k][c];
+				dist += d * d;
+			}
+			if (dist < best)
+			{
+				best = dist;
+				best_index = k;
+			}
+		}
+		indices[i] = best_index;
+		total += best;
+	}
+	return total;
+#endif
+}
+
+//endpoints on the principal axis of the colors, slightly inset to reduce the error of the extremes
+static void fitPrincipalAxis(const sBlock& block, int num_channels, float endpoints[2][4])
+{
+	float mean[4] = { 0,0,0,0 };
+	float minv[4], maxv[4];
+	for (int c = 0; c < num_channels; ++c)
+	{
+		minv[c] = maxv[c] = block.c[c][0];
+		for (int i = 0; i < 16; ++i)
+		{
+			mean[c] += block.c[c][i];
+			minv[c] = std::min(minv[c], block.c[c][i]);
+			maxv[c] = std::max(maxv[c], block.c[c][i]);
+		}
+		mean[c] /= 16.0f;
+	}
+
+	float cov[4][4];
+	for (int a = 0; a < num_channels; ++a)
+		for (int b = a; b < num_channels; ++b)
+		{
+			float sum = 0;
+			for (int i = 0; i < 16; ++i)
+				sum += (block.c[a][i] - mean[a]) * (block.c[b][i] - mean[b]);
+			cov[a][b] = cov[b][a] = sum;
+		}
+
+	//power iteration
+	float axis[4];
+	for (int c = 0; c < num_channels; ++c)
+		axis[c] = maxv[c] - minv[c];
+	for (int it = 0; it < 8; ++it)
+	{
+		float next[4];
+		float len = 0;
+		for (int a = 0; a < num_channels; ++a)
+		{
+			next[a] = 0;
+			for (int b = 0; b < num_channels; ++b)
+				next[a] += cov[a][b] * axis[b];
+			len = std::max(len, fabsf(next[a]));
+		}
+		if (len < 1e-6f)
+			break;
+		for (int c = 0; c < num_channels; ++c)
+			axis[c] = next[c] / len;
+	}
+	float len2 = 0;
+	for (int c = 0; c < num_channels; ++c)
+		len2 += axis[c] * axis[c];
+	if (len2 < 1e-6f) //flat block
+	{
+		for (int c = 0; c < num_channels; ++c)
+			endpoints[0][c] = endpoints[1][c] = mean[c];
+		return;
+	}
+
+	float tmin = 1e30f, tmax = -1e30f;
+	for (int i = 0; i < 16; ++i)
+	{
+		float t = 0;
+		for (int c = 0; c < num_channels; ++c)
+			t += (block.c[c][i] - mean[c]) * axis[c];
+		tmin = std::min(tmin, t);
+		tmax = std::max(tmax, t);
+	}
+	float inset = (tmax - tmin) / 16.0f;
+	tmin = (tmin + inset) / len2;
+	tmax = (tmax - inset) / len2;
+	for (int c = 0; c < num_channels; ++c)
+	{
+		endpoints[0][c] = clamp(mean[c] + axis[c] * tmin, 0.0f, 255.0f);
+		endpoints[1][c] = clamp(mean[c] + axis[c] * tmax, 0.0f, 255.0f);
+	}
+}
+
+//best endpoints for the current indices, weights[i] is how much of the second endpoint uses the pixel i
+static bool fitLeastSquares(const sBlock& block, const float* weights, int num_channels, float endpoints[2][4])
+{
+	float aa = 0, ab = 0, bb = 0;
+	float ax[4] = { 0,0,0,0 }, bx[4] = { 0,0,0,0 };
+	for (int i = 0; i < 16; ++i)
+	{
+		float b = weights[i];
+		float a = 1.0f - b;
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for (int c = 0; c < num_channels; ++c)
+		{
+			ax[c] += a * block.c[c][i];
+			bx[c] += b * block.c[c][i];
+		}
+	}
+	float det = aa * bb - ab * ab;
+	if (fabsf(det) < 1e-6f)
+		return false;
+	float inv = 1.0f / det;
+	for (int c = 0; c < num_channels; ++c)
+	{
+		endpoints[0][c] = clamp((ax[c] * bb - bx[c] * ab) * inv, 0.0f, 255.0f);
+		endpoints[1][c] = clamp((bx[c] * aa - ax[c] * ab) * inv, 0.0f, 255.0f);
+	}
+	return true;
+}
+
+// BC1 *****************************
+
+static inline uint16 packRGB565(const float* color)
+{
+	int r = (int)(color[0] * 31.0f / 255.0f + 0.5f);
+	int g = (int)(color[1] * 63.0f / 255.0f + 0.5f);
+	int b = (int)(color[2] * 31.0f / 255.0f + 0.5f);
+	return (uint16)((r << 11) | (g << 5) | b);
+}
+
+static inline void unpackRGB565(uint16 c, int* color)
+{
+	int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+//4 colors mode (c0 > c1), in the same order than the indices
+static void buildPaletteBC1(uint16 c0, uint16 c1, int palette[4][3])
+{
+	unpackRGB565(c0, palette[0]);
+	unpackRGB565(c1, palette[1]);
+	for (int c = 0; c < 3; ++c)
+	{
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+}
+
+static float evaluateBC1(const sBlock& block, uint16& c0, uint16& c1, int* indices)
+{
+	if (c0 < c1)
+		std::swap(c0, c1);
+	int palette[4][3];
+	buildPaletteBC1(c0, c1, palette);
+	float fpalette[4][4];
+	for (int k = 0; k < 4; ++k)
+		for (int c = 0; c < 3; ++c)
+			fpalette[k][c] = (float)palette[k][c];
+	return findIndices(block, fpalette, c0 == c1 ? 1 : 4, 3, indices);
+}
+
+static void encodeBC1(const sBlock& block, uint8* out)
+{
+	static const float index_weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+	float endpoints[2][4];
+	fitPrincipalAxis(block, 3, endpoints);
+	uint16 c0 = packRGB565(endpoints[1]);
+	uint16 c1 = packRGB565(endpoints[0]);
+	int indices[16];
+	float error = evaluateBC1(block, c0, c1, indices);
+
+	//refine the endpoints once with the indices found
+	float weights[16];
+	for (int i = 0; i < 16; ++i)
+		weights[i] = index_weights[indices[i]];
+	if (error > 0 && fitLeastSquares(block, weights, 3, endpoints))
+	{
+		uint16 r0 = packRGB565(endpoints[0]);
+		uint16 r1 = packRGB565(endpoints[1]);
+		int refined[16];
+		float refined_error = evaluateBC1(block, r0, r1, refined);
+		if (refined_error < error)
+		{
+			c0 = r0;
+			c1 = r1;
+			memcpy(indices, refined, sizeof(indices));
+		}
+	}
+
+	unsigned int bits = 0;
+	for (int i = 0; i < 16; ++i)
+		bits |= (unsigned int)indices[i] << (i * 2);
+	out[0] = c0 & 255;
+	out[1] = c0 >> 8;
+	out[2] = c1 & 255;
+	out[3] = c1 >> 8;
+	memcpy(out + 4, &bits, 4);
+}
+
+// BC4 (one channel, used for the alpha of BC3 and both channels of BC5) *****************************
+
+static void encodeBC4(const float* values, uint8* out)
+{
+	float minv = values[0], maxv = values[0];
+	for (int i = 1; i < 16; ++i)
+	{
+		minv = std::min(minv, values[i]);
+		maxv = std::max(maxv, values[i]);
+	}
+	int a0 = (int)(maxv + 0.5f);
+	int a1 = (int)(minv + 0.5f);
+	out[0] = (uint8)a0;
+	out[1] = (uint8)a1;
+
+	//8 values mode, equally spaced so the closest one is the rounded position
+	unsigned long long bits = 0;
+	if (a0 > a1)
+	{
+		float scale = 7.0f / (float)(a0 - a1);
+		for (int i = 0; i < 16; ++i)
+		{
+			int pos = (int)((values[i] - a1) * scale + 0.5f);
+			pos = clamp(pos, 0, 7);
+			int index = pos == 7 ? 0 : (pos == 0 ? 1 : 8 - pos);
+			bits |= (unsigned long long)index << (i * 3);
+		}
+	}
+	for (int i = 0; i < 6; ++i)
+		out[2 + i] = (uint8)(bits >> (i * 8));
+}
+
+static void decodeBC4(const uint8* in, uint8* values, int stride)
+{
+	int a0 = in[0], a1 = in[1];
+	int palette[8] = { a0, a1 };
+	if (a0 > a1)
+		for (int i = 2; i < 8; ++i)
+			palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+	else
+	{
+		for (int i = 2; i < 6; ++i)
+			palette[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+	unsigned long long bits = 0;
+	for (int i = 0; i < 6; ++i)
+		bits |= (unsigned long long)in[2 + i] << (i * 8);
+	for (int i = 0; i < 16; ++i)
+		values[i * stride] = (uint8)palette[(bits >> (i * 3)) & 7];
+}
+
+// BC7 mode 6 *****************************
+
+//7 bits per channel plus a shared lowest bit per endpoint, picks the p-bit with less error
+static void quantizeMode6(const float* endpoint, int* q, int& pbit)
+{
+	float best_error = 1e30f;
+	for (int p = 0; p < 2; ++p)
+	{
+		int candidate[4];
+		float error = 0;
+		for (int c = 0; c < 4; ++c)
+		{
+			candidate[c] = clamp((int)((endpoint[c] - p) * 0.5f + 0.5f), 0, 127);
+			float d = (float)(candidate[c] * 2 + p) - endpoint[c];
+			error += d * d;
+		}
+		if (error < best_error)
+		{
+			best_error = error;
+			pbit = p;
+			memcpy(q, candidate, sizeof(candidate));
+		}
+	}
+}
+
+static float evaluateMode6(const sBlock& block, int q[2][4], int pbits[2], int* indices)
+{
+	float palette[16][4];
+	for (int k = 0; k < 16; ++k)
+		for (int c = 0; c < 4; ++c)
+		{
+			int e0 = q[0][c] * 2 + pbits[0];
+			int e1 = q[1][c] * 2 + pbits[1];
+			palette[k][c] = (float)(((64 - bc7_weights[k]) * e0 + bc7_weights[k] * e1 + 32) >> 6);
+		}
+	return findIndices(block, palette, 16, 4, indices);
+}
+
+struct sBitWriter {
+	unsigned long long bits[2];
+	int pos;
+	sBitWriter() { bits[0] = bits[1] = 0; pos = 0; }
+	void write(unsigned int value, int count)
+	{
+		for (int i = 0; i < count; ++i, ++pos)
+			bits[pos >> 6] |= (unsigned long long)((value >> i) & 1) << (pos & 63);
+	}
+};
+
+struct sBitReader {
+	const uint8* data;
+	int pos;
+	sBitReader(const uint8* data) : data(data), pos(0) {}
+	unsigned int read(int count)
+	{
+		unsigned int value = 0;
+		for (int i = 0; i < count; ++i, ++pos)
+			value |= ((data[pos >> 3] >> (pos & 7)) & 1) << i;
+		return value;
+	}
+};
+
+//returns the squared error of the block
+static float encodeMode6(const sBlock& block, uint8* out)
+{
+	float endpoints[2][4];
+	fitPrincipalAxis(block, 4, endpoints);
+	int q[2][4], pbits[2];
+	quantizeMode6(endpoints[0], q[0], pbits[0]);
+	quantizeMode6(endpoints[1], q[1], pbits[1]);
+	int indices[16];
+	float error = evaluateMode6(block, q, pbits, indices);
+
+	float weights[16];
+	for (int i = 0; i < 16; ++i)
+		weights[i] = bc7_weights[indices[i]] / 64.0f;
+	if (error > 0 && fitLeastSquares(block, weights, 4, endpoints))
+	{
+		int rq[2][4], rpbits[2], refined[16];
+		quantizeMode6(endpoints[0], rq[0], rpbits[0]);
+		quantizeMode6(endpoints[1], rq[1], rpbits[1]);
+		float refined_error = evaluateMode6(block, rq, rpbits, refined);
+		if (refined_error < error)
+		{
+			error = refined_error;
+			memcpy(q, rq, sizeof(q));
+			memcpy(pbits, rpbits, sizeof(pbits));
+			memcpy(indices, refined, sizeof(indices));
+		}
+	}
+
+	//the first index is stored with 3 bits, its highest bit must be 0
+	if (indices[0] & 8)
+	{
+		for (int c = 0; c < 4; ++c)
+			std::swap(q[0][c], q[1][c]);
+		std::swap(pbits[0], pbits[1]);
+		for (int i = 0; i < 16; ++i)
+			indices[i] = 15 - indices[i];
+	}
+
+	sBitWriter writer;
+	writer.write(1 << 6, 7); //mode 6
+	for (int c = 0; c < 4; ++c)
+	{
+		writer.write(q[0][c], 7);
+		writer.write(q[1][c], 7);
+	}
+	writer.write(pbits[0], 1);
+	writer.write(pbits[1], 1);
+	writer.write(indices[0], 3);
+	for (int i = 1; i < 16; ++i)
+		writer.write(indices[i], 4);
+	memcpy(out, writer.bits, 16);
+	return error;
+}
+
+// BC7 mode 5 *****************************
+
+//the endpoints are stored expanded to 8 bits, 7 bits values repeat their highest bit
+static void quantizeMode5(const float endpoints[2][4], int num_channels, int bits, int e[2][4])
+{
+	for (int j = 0; j < 2; ++j)
+		for (int c = 0; c < num_channels; ++c)
+		{
+			int v = clamp((int)(endpoints[j][c] + 0.5f), 0, 255);
+			if (bits == 7)
+			{
+				v = clamp((int)(endpoints[j][c] * 127.0f / 255.0f + 0.5f), 0, 127);
+				v = (v << 1) | (v >> 6);
+			}
+			e[j][c] = v;
+		}
+}
+
+static float evaluateMode5(const sBlock& block, const int e[2][4], int num_channels, int* indices)
+{
+	float palette[4][4];
+	for (int k = 0; k < 4; ++k)
+		for (int c = 0; c < num_channels; ++c)
+			palette[k][c] = (float)(((64 - bc7_weights2[k]) * e[0][c] + bc7_weights2[k] * e[1][c] + 32) >> 6);
+	return findIndices(block, palette, 4, num_channels, indices);
+}
+
+//endpoints and 2 bits indices of the first num_channels channels, with the first index below 2, returns the squared error
+static float fitMode5(const sBlock& block, int num_channels, int bits, int e[2][4], int* indices)
+{
+	float endpoints[2][4];
+	fitPrincipalAxis(block, num_channels, endpoints);
+	quantizeMode5(endpoints, num_channels, bits, e);
+	float error = evaluateMode5(block, e, num_channels, indices);
+
+	float weights[16];
+	for (int i = 0; i < 16; ++i)
+		weights[i] = bc7_weights2[indices[i]] / 64.0f;
+	if (error > 0 && fitLeastSquares(block, weights, num_channels, endpoints))
+	{
+		int re[2][4], refined[16];
+		quantizeMode5(endpoints, num_channels, bits, re);
+		float refined_error = evaluateMode5(block, re, num_channels, refined);
+		if (refined_error < error)
+		{
+			error = refined_error;
+			memcpy(e, re, sizeof(re));
+			memcpy(indices, refined, sizeof(refined));
+		}
+	}
+
+	if (indices[0] & 2)
+	{
+		for (int c = 0; c < num_channels; ++c)
+			std::swap(e[0][c], e[1][c]);
+		for (int i = 0; i < 16; ++i)
+			indices[i] = 3 - indices[i];
+	}
+	return error;
+}
+
+//rgb and alpha with their own indices, so the alpha doesnt have to follow the colors. The rotation
+//swaps the alpha with one of the colors (1 red, 2 green, 3 blue), the one fitted alone. Returns the squared error
+static float encodeMode5(const sBlock& block, uint8* out)
+{
+	float best_error = 1e30f;
+	int best_rotation = 0;
+	int color[2][4], alpha[2][4], color_indices[16], alpha_indices[16];
+	for (int rotation = 0; rotation < 4; ++rotation)
+	{
+		sBlock rotated = block;
+		if (rotation)
+			memcpy(rotated.c[rotation - 1], block.c[3], sizeof(rotated.c[0]));
+		sBlock single;
+		memcpy(single.c[0], block.c[rotation ? rotation - 1 : 3], sizeof(single.c[0]));
+
+		int e[2][4], a[2][4], ci[16], ai[16];
+		float error = fitMode5(rotated, 3, 7, e, ci);
+		if (rotation && error >= best_error)
+			continue;
+		error += fitMode5(single, 1, 8, a, ai);
+		if (!rotation || error < best_error) //the first rotation is always kept, the outputs are never left unset
+		{
+			best_error = error;
+			best_rotation = rotation;
+			memcpy(color, e, sizeof(e));
+			memcpy(alpha, a, sizeof(a));
+			memcpy(color_indices, ci, sizeof(ci));
+			memcpy(alpha_indices, ai, sizeof(ai));
+		}
+	}
+
+	sBitWriter writer;
+	writer.write(1 << 5, 6); //mode 5
+	writer.write(best_rotation, 2);
+	for (int c = 0; c < 3; ++c)
+	{
+		writer.write(color[0][c] >> 1, 7);
+		writer.write(color[1][c] >> 1, 7);
+	}
+	writer.write(alpha[0][0], 8);
+	writer.write(alpha[1][0], 8);
+	for (int i = 0; i < 16; ++i)
+		writer.write(color_indices[i], i ? 2 : 1);
+	for (int i = 0; i < 16; ++i)
+		writer.write(alpha_indices[i], i ? 2 : 1);
+	memcpy(out, writer.bits, 16);
+	return best_error;
+}
+
+//*****************************
+
+//mode 6 fits the four channels on one line, mode 5 separates the alpha (or another channel), the one with less error is kept
+static void encodeBC7(const sBlock& block, uint8* out)
+{
+	float error = encodeMode6(block, out);
+	if (error <= 0)
+		return;
+	uint8 mode5[16];
+	if (encodeMode5(block, mode5) < error)
+		memcpy(out, mode5, 16);
+}
+
+static void decodeBC7(const uint8* in, uint8* rgba)
+{
+	sBitReader reader(in);
+	int mode = 0;
+	while (mode < 8 && !reader.read(1))
+		++mode;
+
+	if (mode == 5)
+	{
+		int rotation = reader.read(2);
+		int e[2][4];
+		for (int c = 0; c < 3; ++c)
+			for (int j = 0; j < 2; ++j)
+			{
+				int v = reader.read(7);
+				e[j][c] = (v << 1) | (v >> 6);
+			}
+		e[0][3] = reader.read(8);
+		e[1][3] = reader.read(8);
+		int color_indices[16];
+		for (int i = 0; i < 16; ++i)
+			color_indices[i] = reader.read(i ? 2 : 1);
+		for (int i = 0; i < 16; ++i)
+		{
+			int weights[4];
+			weights[0] = weights[1] = weights[2] = bc7_weights2[color_indices[i]];
+			weights[3] = bc7_weights2[reader.read(i ? 2 : 1)];
+			uint8* pixel = rgba + i * 4;
+			for (int c = 0; c < 4; ++c)
+				pixel[c] = (uint8)(((64 - weights[c]) * e[0][c] + weights[c] * e[1][c] + 32) >> 6);
+			if (rotation)
+				std::swap(pixel[3], pixel[rotation - 1]);
+		}
+		return;
+	}
+
+	if (mode != 6) //only modes 5 and 6 are generated
+	{
+		for (int i = 0; i < 16; ++i)
+		{
+			rgba[i * 4 + 0] = 255; rgba[i * 4 + 1] = 0; rgba[i * 4 + 2] = 255; rgba[i * 4 + 3] = 255;
+		}
+		return;
+	}
+	int e[2][4];
+	for (int c = 0; c < 4; ++c)
+	{
+		e[0][c] = reader.read(7) << 1;
+		e[1][c] = reader.read(7) << 1;
+	}
+	int p0 = reader.read(1), p1 = reader.read(1);
+	for (int c = 0; c < 4; ++c)
+	{
+		e[0][c] |= p0;
+		e[1][c] |= p1;
+	}
+	for (int i = 0; i < 16; ++i)
+	{
+		int w = bc7_weights[reader.read(i == 0 ? 3 : 4)];
+		for (int c = 0; c < 4; ++c)
+			rgba[i * 4 + c] = (uint8)(((64 - w) * e[0][c] + w * e[1][c] + 32) >> 6);
+	}
+}
+
+//*****************************
+
+int BCEncoder::getBlockBytes(eBCFormat format)
+{
+	return format == BC1 ? 8 : 16;
+}
+
+unsigned int BCEncoder::getGLFormat(eBCFormat format)
+{
+	switch (format)
+	{
+		case BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		case BC5: return GL_COMPRESSED_RG_RGTC2;
+		case BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+		default: return 0;
+	}
+}
+
+unsigned int BCEncoder::getCompressedSize(eBCFormat format, int width, int height)
+{
+	return ((width + 3) / 4) * ((height + 3) / 4) * getBlockBytes(format);
+}
+
+void BCEncoder::compress(eBCFormat format, const uint8* pixels, int width, int height, int num_channels, uint8* out)
+{
+	int blocks_x = (width + 3) / 4;
+	int blocks_y = (height + 3) / 4;
+	int block_bytes = getBlockBytes(format);
+	int grain = std::max(1, blocks_y / (JobSystem::getNumThreads() * 4));
+
+	JobSystem::parallelFor(blocks_y, grain, [=](int start, int end) {
+		sBlock block;
+		for (int by = start; by < end; ++by)
+			for (int bx = 0; bx < blocks_x; ++bx)
+			{
+				uint8* dst = out + (by * blocks_x + bx) * block_bytes;
+				fetchBlock(pixels, width, height, num_channels, bx, by, block);
+				switch (format)
+				{
+					case BC1: encodeBC1(block, dst); break;
+					case BC3: encodeBC4(block.c[3], dst); encodeBC1(block, dst + 8); break;
+					case BC5: encodeBC4(block.c[0], dst); encodeBC4(block.c[1], dst + 8); break;
+					case BC7: encodeBC7(block, dst); break;
+					default: break;
+				}
+			}
+	});
+}
+
+void BCEncoder::decompress(eBCFormat format, const uint8* blocks, int width, int height, uint8* rgba)
+{
+	int blocks_x = (width + 3) / 4;
+	int blocks_y = (height + 3) / 4;
+	int block_bytes = getBlockBytes(format);
+	uint8 pixels[16 * 4];
+
+	for (int by = 0; by < blocks_y; ++by)
+		for (int bx = 0; bx < blocks_x; ++bx)
+		{
+			const uint8* in = blocks + (by * blocks_x + bx) * block_bytes;
+			switch (format)
+			{
+				case BC1:
+				case BC3:
+				{
+					const uint8* color = format == BC3 ? in + 8 : in;
+					uint16 c0 = color[0] | (color[1] << 8);
+					uint16 c1 = color[2] | (color[3] << 8);
+					int palette[4][3];
+					buildPaletteBC1(c0, c1, palette);
+					if (c0 <= c1 && format == BC1) //3 colors mode
+						for (int c = 0; c < 3; ++c)
+						{
+							palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+							palette[3][c] = 0;
+						}
+					unsigned int bits;
+					memcpy(&bits, color + 4, 4);
+					for (int i = 0; i < 16; ++i)
+					{
+						int index = (bits >> (i * 2)) & 3;
+						for (int c = 0; c < 3; ++c)
+							pixels[i * 4 + c] = (uint8)palette[index][c];
+						pixels[i * 4 + 3] = 255;
+					}
+					if (format == BC3)
+						decodeBC4(in, pixels + 3, 4);
+					break;
+				}
+				case BC5:
+					decodeBC4(in, pixels, 4);
+					decodeBC4(in + 8, pixels + 1, 4);
+					for (int i = 0; i < 16; ++i)
+					{
+						pixels[i * 4 + 2] = 0;
+						pixels[i * 4 + 3] = 255;
+					}
+					break;
+				case BC7:
+					decodeBC7(in, pixels);
+					break;
+				default:
+					memset(pixels, 0, sizeof(pixels));
+			}
+
+			for (int i = 0; i < 16; ++i)
+			{
+				int x = bx * 4 + (i & 3);
+				int y = by * 4 + (i >> 2);
+				if (x < width && y < height)
+					memcpy(rgba + (y * width + x) * 4, pixels + i * 4, 4);
+			}
+		}
+}
+
+float BCEncoder::computePSNR(eBCFormat format, const uint8* pixels, int width, int height, int num_channels, const uint8* blocks)
+{
+	std::vector<uint8> decoded(width * height * 4);
+	decompress(format, blocks, width, height, &decoded[0]);
+
+	int channels = format == BC5 ? 2 : (format == BC1 ? 3 : num_channels);
+	double error = 0;
+	for (int i = 0; i < width * height; ++i)
+		for (int c = 0; c < channels; ++c)
+		{
+			double d = (double)pixels[i * num_channels + c] - (double)decoded[i * 4 + c];
+			error += d * d;
+		}
+	double mse = error / ((double)width * height * channels);
+	if (mse <= 0)
+		return 99.0f; //lossless
+	return (float)(10.0 * log10(255.0 * 255.0 / mse));
+}
+
+void BCEncoder::benchmark()
+{
+	std::cout << " + Block compression benchmark (" << JobSystem::getNumThreads() << " threads)" << std::endl;
+
+	//512x512 RGBA: gradients with the alpha going across the colors, and waves with a cutout in the alpha
+	const int size = 512;
+	const char* names[2] = { "gradients", "waves" };
+	std::vector<uint8> pixels(size * size * 4);
+	std::vector<uint8> blocks(getCompressedSize(BC7, size, size));
+	const eBCFormat formats[3] = { BC1, BC3, BC7 };
+	for (int image = 0; image < 2; ++image)
+	{
+		for (int y = 0; y < size; ++y)
+			for (int x = 0; x < size; ++x)
+			{
+				uint8* p = &pixels[(y * size + x) * 4];
+				float u = x / (float)(size - 1), v = y / (float)(size - 1);
+				if (image == 0)
+				{
+					p[0] = (uint8)(u * 255.0f);
+					p[1] = (uint8)(v * 255.0f);
+					p[2] = (uint8)((1.0f - u) * 255.0f);
+					p[3] = (uint8)((1.0f - v * 0.5f - u * 0.5f) * 255.0f);
+				}
+				else
+				{
+					p[0] = (uint8)(127.5f + 127.5f * sinf(u * 40.0f));
+					p[1] = (uint8)(127.5f + 127.5f * sinf(v * 25.0f + u * 10.0f));
+					p[2] = (uint8)(127.5f + 127.5f * cosf((u + v) * 30.0f));
+					p[3] = sinf(u * 12.0f) * cosf(v * 12.0f) > 0 ? 255 : 0;
+				}
+			}
+
+		float psnr[3];
+		for (int f = 0; f < 3; ++f)
+		{
+			const int repetitions = 3;
+			double time = 0;
+			for (int i = 0; i < repetitions; ++i)
+			{
+				double start = getTimeHighRes();
+				compress(formats[f], &pixels[0], size, size, 4, &blocks[0]);
+				double elapsed = getTimeHighRes() - start;
+				time = i ? std::min(time, elapsed) : elapsed;
+			}
+			psnr[f] = computePSNR(formats[f], &pixels[0], size, size, 4, &blocks[0]);
+			std::cout << "\t " << names[image] << " BC" << formats[f] << ": " << psnr[f] << "dB, " << time << "ms, " << size * size / (time * 0.001) / 1e6 << " Mpixels/s" << std::endl;
+		}
+		//BC7 is picked instead of BC3 for the images with alpha
+		if (psnr[2] < psnr[1])
+			std::cout << "\t [ERROR] " << names[image] << ": BC7 below BC3" << std::endl;
+	}
+}
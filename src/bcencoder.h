@@ -0,0 +1,44 @@
+#pragma once
+#ifndef BCENCODER_H
+#define BCENCODER_H
+
+#include "framework.h"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+	#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+	#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RG_RGTC2
+	#define GL_COMPRESSED_RG_RGTC2 0x8DBD
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+	#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+enum eBCFormat {
+	BC_NONE = 0,
+	BC1 = 1, //RGB, 4 bits per pixel
+	BC3 = 3, //RGBA (BC1 color + BC4 alpha), 8 bits per pixel
+	BC5 = 5, //RG (two BC4 channels) for normalmaps, 8 bits per pixel
+	BC7 = 7  //RGBA, modes 5 (separate alpha) and 6 (one subset, 7 bits endpoints and 4 bits indices), 8 bits per pixel
+};
+
+//CPU block compression of 4x4 pixel blocks. It doesnt use GL, so it can run in any thread
+//and its quality can be checked comparing the decompressed pixels against the source.
+class BCEncoder {
+public:
+	static int getBlockBytes(eBCFormat format); //8 for BC1, 16 the rest
+	static unsigned int getGLFormat(eBCFormat format);
+	static unsigned int getCompressedSize(eBCFormat format, int width, int height);
+
+	//pixels are rows of width * num_channels bytes (3 or 4), out must have getCompressedSize bytes, the block rows are compressed in parallel
+	static void compress(eBCFormat format, const uint8* pixels, int width, int height, int num_channels, uint8* out);
+	//writes width * height RGBA pixels, BC5 stores 0 in blue and 255 in alpha
+	static void decompress(eBCFormat format, const uint8* blocks, int width, int height, uint8* rgba);
+	//in dB, only of the channels stored by the format
+	static float computePSNR(eBCFormat format, const uint8* pixels, int width, int height, int num_channels, const uint8* blocks);
+
+	static void benchmark(); //PSNR and speed of BC1, BC3 and BC7 on generated RGBA images, BC7 must not be below BC3
+};
+
+#endif
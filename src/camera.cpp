@@ -55,9 +55,9 @@ void Camera::updateProjectionMatrix()
 
 Vector3 Camera::getLocalVector(const Vector3& v)
 {
+	//the view matrix is always rotation + translation
 	Matrix44 iV = view_matrix;
-	if (iV.inverse() == false)
-		std::cout << "Matrix Inverse error" << std::endl;
+	iV.inverseRigid();
 	Vector3 result = iV.rotateVector(v);
 	return result;
 }
@@ -322,6 +322,12 @@ float Camera::getProjectedScale(Vector3 pos3D, float radius) {
 	return ((float)sin(fov*DEG2RAD) / dist) * radius * 200.0f; //100 is to compensate width in pixels
 }
 
+//getProjectedScale is proportional to the size on screen, this converts it to the pixels of the viewport
+float Camera::getScreenRadius(Vector3 pos3D, float radius, float viewport_height) {
+	float angle = fov * DEG2RAD;
+	return getProjectedScale(pos3D, radius) / ((float)sin(angle) * 200.0f) * (viewport_height * 0.5f) / (float)tan(angle * 0.5f);
+}
+
 
 char Camera::testSphereInFrustum( const Vector3& v, float radius)
 {
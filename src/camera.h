@@ -73,6 +73,7 @@ public:
 	Vector3 project(Vector3 pos3d, float window_width, float window_height); //to project 3D points to screen coordinates
 	Vector3 unproject( Vector3 coord2d, float window_width, float window_height ); //to project screen coordinates to world coordinates
 	float getProjectedScale(Vector3 pos3D, float radius); //used to know how big one unit will look at this distance
+	float getScreenRadius(Vector3 pos3D, float radius, float viewport_height); //in pixels, for the perspective cameras
 	Vector3 getRayDirection(int mouse_x, int mouse_y, float window_width, float window_height);
 
 	//culling
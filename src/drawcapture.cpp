@@ -0,0 +1,392 @@
+#include "drawcapture.h"
+
+#include "includes.h"
+#include "shader.h"
+#include "mesh.h"
+#include "texture.h"
+#include "utils.h"
+
+#include <cassert>
+#include <iostream>
+#include <cstdio>
+#include <sys/stat.h>
+
+using namespace GTR;
+
+DrawCapture* DrawCapture::recording = NULL;
+
+DrawCapture::DrawCapture()
+{
+	num_frames = 0;
+	has_state = false;
+}
+
+int DrawCapture::getStringIndex(const std::string& str)
+{
+	auto it = strings_index.find(str);
+	if (it != strings_index.end())
+		return it->second;
+	int index = (int)strings.size();
+	strings.push_back(str);
+	strings_index[str] = index;
+	return index;
+}
+
+void DrawCapture::recordShader(Shader* shader)
+{
+	sCaptureCommand cmd = { CAP_SHADER, 0, 0, 0, getStringIndex(shader->name), -1, 0, 0 };
+	commands.push_back(cmd);
+}
+
+void DrawCapture::recordUniform(const char* varname, eCaptureUniform type, int components, int count, const void* values)
+{
+	sCaptureCommand cmd = { CAP_UNIFORM, (uint8)type, (uint8)components, 0, getStringIndex(varname), -1, count, (int)data.size() };
+	int words = components * count;
+	data.resize(data.size() + words);
+	memcpy(&data[cmd.data], values, words * sizeof(uint32));
+	commands.push_back(cmd);
+}
+
+void DrawCapture::recordTexture(const char* varname, Texture* texture, int slot)
+{
+	//textures are referenced by name, the ones without name (fbos...) fall back to the white texture on replay
+	std::string name = texture->filename;
+	if (texture == Texture::getWhiteTexture())
+		name = "@white";
+	else if (texture == Texture::getBlackTexture())
+		name = "@black";
+	sCaptureCommand cmd = { CAP_TEXTURE, 0, 0, (uint8)slot, getStringIndex(varname), getStringIndex(name), 0, 0 };
+	commands.push_back(cmd);
+}
+
+//only stores the state that changed since the previous draw
+void DrawCapture::recordState()
+{
+	int state[7];
+	state[0] = glIsEnabled(GL_BLEND);
+	glGetIntegerv(GL_BLEND_SRC_RGB, &state[1]);
+	glGetIntegerv(GL_BLEND_DST_RGB, &state[2]);
+	state[3] = glIsEnabled(GL_CULL_FACE);
+	state[4] = glIsEnabled(GL_DEPTH_TEST);
+	glGetIntegerv(GL_DEPTH_FUNC, &state[5]);
+	GLboolean depth_mask;
+	glGetBooleanv(GL_DEPTH_WRITEMASK, &depth_mask);
+	state[6] = depth_mask;
+
+	if (has_state && memcmp(state, last_state, sizeof(state)) == 0)
+		return;
+	memcpy(last_state, state, sizeof(state));
+	has_state = true;
+
+	sCaptureCommand cmd = { CAP_STATE, 0, 7, 0, -1, -1, 1, (int)data.size() };
+	data.resize(data.size() + 7);
+	memcpy(&data[cmd.data], state, sizeof(state));
+	commands.push_back(cmd);
+}
+
+void DrawCapture::recordDraw(Mesh* mesh, unsigned int primitive, int submesh_id, int lod)
+{
+	recordState();
+	sCaptureCommand cmd = { CAP_DRAW, (uint8)primitive, (uint8)lod, 0, getStringIndex(mesh->name), -1, submesh_id, 0 };
+	commands.push_back(cmd);
+}
+
+void DrawCapture::endFrame()
+{
+	sCaptureCommand cmd = { CAP_FRAME, 0, 0, 0, -1, -1, 0, 0 };
+	commands.push_back(cmd);
+	num_frames++;
+	has_state = false; //first draw of every frame stores the full state
+}
+
+bool DrawCapture::save(const char* filename)
+{
+	FILE* f = fopen(filename, "wb");
+	if (f == NULL)
+	{
+		std::cout << "[ERROR] cannot write capture: " << filename << std::endl;
+		return false;
+	}
+
+	//watermark
+	fwrite("RCAP", sizeof(char), 4, f);
+
+	sCaptureHeader header;
+	memset(&header, 0, sizeof(header));
+	header.version = CAPTURE_BIN_VERSION;
+	header.header_bytes = sizeof(sCaptureHeader);
+	header.num_frames = num_frames;
+	header.num_commands = (int)commands.size();
+	header.num_strings = (int)strings.size();
+	header.data_size = (int)data.size();
+	fwrite(&header, sizeof(sCaptureHeader), 1, f);
+
+	for (int i = 0; i < strings.size(); ++i)
+	{
+		int len = (int)strings[i].size();
+		fwrite(&len, sizeof(int), 1, f);
+		fwrite(strings[i].c_str(), sizeof(char), len, f);
+	}
+
+	if (commands.size())
+		fwrite(&commands[0], sizeof(sCaptureCommand), commands.size(), f);
+	if (data.size())
+		fwrite(&data[0], sizeof(uint32), data.size(), f);
+
+	fclose(f);
+	return true;
+}
+
+bool DrawCapture::isValid(const sCaptureCommand& cmd) const
+{
+	int num_strings = (int)strings.size();
+	switch (cmd.type)
+	{
+	case CAP_SHADER:
+	case CAP_DRAW:
+		return cmd.name >= 0 && cmd.name < num_strings;
+	case CAP_TEXTURE:
+		return cmd.name >= 0 && cmd.name < num_strings && cmd.asset >= 0 && cmd.asset < num_strings;
+	case CAP_UNIFORM:
+	case CAP_STATE:
+	{
+		if (cmd.type == CAP_UNIFORM && (cmd.name < 0 || cmd.name >= num_strings))
+			return false;
+		long long words = (long long)cmd.components * cmd.count;
+		if (cmd.type == CAP_STATE && words < 7)
+			return false;
+		return cmd.count >= 0 && cmd.data >= 0 && cmd.data + words <= (long long)data.size();
+	}
+	case CAP_FRAME:
+		return true;
+	}
+	return false;
+}
+
+bool DrawCapture::load(const char* filename)
+{
+	std::vector<unsigned char> buffer;
+	if (!readFileBin(filename, buffer) || buffer.size() < 4 + sizeof(sCaptureHeader))
+	{
+		std::cout << "[ERROR] capture not found: " << filename << std::endl;
+		return false;
+	}
+
+	//watermark
+	if (memcmp(&buffer[0], "RCAP", 4) != 0)
+	{
+		std::cout << "[ERROR] loading capture: invalid content: " << filename << std::endl;
+		return false;
+	}
+
+	unsigned char* pos = &buffer[0] + 4;
+	unsigned char* end = &buffer[0] + buffer.size();
+	sCaptureHeader header;
+	memcpy(&header, pos, sizeof(sCaptureHeader));
+	pos += sizeof(sCaptureHeader);
+
+	if (header.version != CAPTURE_BIN_VERSION || header.header_bytes != sizeof(sCaptureHeader))
+	{
+		std::cout << "[WARN] loading capture: old version: " << filename << std::endl;
+		return false;
+	}
+
+	//the sizes are checked against the file before copying anything
+	if (header.num_frames < 0 || header.num_strings < 0 || header.num_commands < 0 || header.data_size < 0 ||
+		(size_t)header.num_strings > (end - pos) / sizeof(int)) //every string stores its length
+	{
+		std::cout << "[ERROR] loading capture: corrupted header: " << filename << std::endl;
+		return false;
+	}
+
+	num_frames = header.num_frames;
+	strings.resize(header.num_strings);
+	bool truncated = false;
+	for (int i = 0; i < header.num_strings; ++i)
+	{
+		int len = -1;
+		if ((size_t)(end - pos) >= sizeof(int))
+		{
+			memcpy(&len, pos, sizeof(int));
+			pos += sizeof(int);
+		}
+		if (len < 0 || end - pos < len)
+		{
+			truncated = true;
+			break;
+		}
+		strings[i].assign((char*)pos, len);
+		pos += len;
+	}
+
+	size_t tables_size = sizeof(sCaptureCommand) * (size_t)header.num_commands + sizeof(uint32) * (size_t)header.data_size;
+	if (truncated || (size_t)(end - pos) < tables_size)
+	{
+		std::cout << "[ERROR] loading capture: truncated file: " << filename << std::endl;
+		return false;
+	}
+
+	commands.resize(header.num_commands);
+	if (header.num_commands)
+		memcpy(&commands[0], pos, sizeof(sCaptureCommand) * header.num_commands);
+	pos += sizeof(sCaptureCommand) * header.num_commands;
+
+	data.resize(header.data_size);
+	if (header.data_size)
+		memcpy(&data[0], pos, sizeof(uint32) * header.data_size);
+
+	for (int i = 0; i < commands.size(); ++i)
+		if (!isValid(commands[i]))
+		{
+			std::cout << "[ERROR] loading capture: command " << i << " out of the tables: " << filename << std::endl;
+			return false;
+		}
+	return true;
+}
+
+void DrawCapture::replay(int iterations)
+{
+	//resolve every asset name once, so the loop only measures the submission
+	std::vector<Shader*> shaders(strings.size(), NULL);
+	std::vector<Mesh*> meshes(strings.size(), NULL);
+	std::vector<Texture*> textures(strings.size(), NULL);
+	int missing = 0;
+	for (int i = 0; i < commands.size(); ++i)
+	{
+		sCaptureCommand& cmd = commands[i];
+		if (!isValid(cmd))
+		{
+			std::cout << "[ERROR] capture replay: command " << i << " out of the tables" << std::endl;
+			return;
+		}
+		if (cmd.type == CAP_SHADER && !shaders[cmd.name])
+		{
+			shaders[cmd.name] = Shader::Get(strings[cmd.name].c_str());
+			missing += shaders[cmd.name] ? 0 : 1;
+		}
+		else if (cmd.type == CAP_DRAW && !meshes[cmd.name])
+		{
+			meshes[cmd.name] = Mesh::Get(strings[cmd.name].c_str(), false, true);
+			missing += meshes[cmd.name] ? 0 : 1;
+		}
+		else if (cmd.type == CAP_TEXTURE && !textures[cmd.asset])
+		{
+			const std::string& name = strings[cmd.asset];
+			Texture* tex = name == "@black" ? Texture::getBlackTexture() : Texture::Find(name.c_str());
+			textures[cmd.asset] = tex ? tex : Texture::getWhiteTexture();
+		}
+	}
+	if (missing)
+		std::cout << "[WARN] capture replay: " << missing << " shaders or meshes not found, their commands will be skipped" << std::endl;
+
+	glFinish();
+	double start = getTimeHighRes();
+	double submit_time = 0;
+	for (int it = 0; it < iterations; ++it)
+	{
+		double frame_start = getTimeHighRes();
+		Shader* shader = NULL;
+		for (int i = 0; i < commands.size(); ++i)
+		{
+			sCaptureCommand& cmd = commands[i];
+			switch (cmd.type)
+			{
+			case CAP_SHADER:
+				shader = shaders[cmd.name];
+				if (shader)
+					shader->enable();
+				break;
+			case CAP_UNIFORM:
+			{
+				if (!shader)
+					break;
+				const char* varname = strings[cmd.name].c_str();
+				void* values = &data[cmd.data];
+				if (cmd.subtype == CAP_MATRIX44)
+					shader->setMatrix44Array(varname, (Matrix44*)values, cmd.count);
+				else if (cmd.subtype == CAP_FLOAT)
+				{
+					if (cmd.components == 1) shader->setUniform1Array(varname, (float*)values, cmd.count);
+					else if (cmd.components == 2) shader->setUniform2Array(varname, (float*)values, cmd.count);
+					else if (cmd.components == 3) shader->setUniform3Array(varname, (float*)values, cmd.count);
+					else shader->setUniform4Array(varname, (float*)values, cmd.count);
+				}
+				else
+				{
+					if (cmd.components == 1) shader->setUniform1Array(varname, (int*)values, cmd.count);
+					else if (cmd.components == 2) shader->setUniform2Array(varname, (int*)values, cmd.count);
+					else if (cmd.components == 3) shader->setUniform3Array(varname, (int*)values, cmd.count);
+					else shader->setUniform4Array(varname, (int*)values, cmd.count);
+				}
+				break;
+			}
+			case CAP_TEXTURE:
+				if (shader)
+					shader->setTexture(strings[cmd.name].c_str(), textures[cmd.asset], cmd.slot);
+				break;
+			case CAP_STATE:
+			{
+				int* state = (int*)&data[cmd.data];
+				if (state[0]) glEnable(GL_BLEND); else glDisable(GL_BLEND);
+				glBlendFunc(state[1], state[2]);
+				if (state[3]) glEnable(GL_CULL_FACE); else glDisable(GL_CULL_FACE);
+				if (state[4]) glEnable(GL_DEPTH_TEST); else glDisable(GL_DEPTH_TEST);
+				glDepthFunc(state[5]);
+				glDepthMask(state[6] ? GL_TRUE : GL_FALSE);
+				break;
+			}
+			case CAP_DRAW:
+				if (shader && meshes[cmd.name])
+					meshes[cmd.name]->render(cmd.subtype, cmd.count, 0, cmd.components);
+				break;
+			case CAP_FRAME:
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				break;
+			}
+		}
+		if (shader)
+			shader->disable();
+		submit_time += getTimeHighRes() - frame_start;
+		glFinish();
+	}
+	double total = getTimeHighRes() - start;
+
+	//restore default state
+	glDisable(GL_BLEND);
+	glEnable(GL_CULL_FACE);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+
+	int replayed_frames = iterations * num_frames;
+	std::cout << " + Capture replay: " << replayed_frames << " frames, " << commands.size() << " commands per pass" << std::endl;
+	std::cout << "\t submit: " << submit_time / replayed_frames << "ms/frame  total (with glFinish): " << total / replayed_frames << "ms/frame" << std::endl;
+}
+
+void DrawCapture::start()
+{
+	if (!recording)
+		recording = new DrawCapture();
+}
+
+bool DrawCapture::stop(const char* filename)
+{
+	if (!recording)
+		return false;
+	DrawCapture* capture = recording;
+	recording = NULL;
+	bool saved = capture->save(filename);
+	if (saved)
+		std::cout << " + Capture saved: " << filename << " Frames: " << capture->num_frames << " Commands: " << capture->commands.size() << std::endl;
+	delete capture;
+	return saved;
+}
+
+bool DrawCapture::replayFile(const char* filename, int iterations)
+{
+	DrawCapture capture;
+	if (!capture.load(filename) || !capture.num_frames)
+		return false;
+	capture.replay(iterations);
+	return true;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#ifndef DRAWCAPTURE_H
+#define DRAWCAPTURE_H
+
+#include "framework.h"
+#include <vector>
+#include <string>
+#include <map>
+
+//forward declarations
+class Mesh;
+class Shader;
+class Texture;
+
+#define CAPTURE_BIN_VERSION 1 //this is used to reject captures if the format changes
+
+namespace GTR {
+
+	enum eCaptureCommand {
+		CAP_SHADER,		//enable shader (by name)
+		CAP_UNIFORM,	//uniform upload (by uniform name)
+		CAP_TEXTURE,	//bind texture (by asset name) to a slot
+		CAP_STATE,		//blend/cull/depth state that changed since the last draw
+		CAP_DRAW,		//mesh->render (by asset name)
+		CAP_FRAME		//end of frame marker
+	};
+
+	enum eCaptureUniform {
+		CAP_INT,
+		CAP_FLOAT,
+		CAP_MATRIX44
+	};
+
+	struct sCaptureHeader {
+		int version;
+		int header_bytes;
+		int num_frames;
+		int num_commands;
+		int num_strings;
+		int data_size; //in 4 bytes words
+	};
+
+	struct sCaptureCommand {
+		uint8 type;			//eCaptureCommand
+		uint8 subtype;		//eCaptureUniform for uniforms, primitive for draws
+		uint8 components;	//1..4 for vectors, 16 for matrices, LOD for draws
+		uint8 slot;			//texture slot
+		int name;			//index in the string table (shader, uniform or asset name)
+		int asset;			//index in the string table (texture name), -1 if none
+		int count;			//array size for uniforms, submesh for draws
+		int data;			//offset inside the data block (in 4 bytes words)
+	};
+
+	//Records the commands sent to the GL backend during renderRenderCall so they can be replayed
+	//in a tight loop without scene traversal (to benchmark only the submission cost)
+	class DrawCapture {
+	public:
+		static DrawCapture* recording; //capture receiving commands, NULL when not capturing
+
+		int num_frames;
+		std::vector<std::string> strings;
+		std::vector<sCaptureCommand> commands;
+		std::vector<uint32> data;
+
+		DrawCapture();
+
+		//called from the Shader and Mesh hooks
+		void recordShader(Shader* shader);
+		void recordUniform(const char* varname, eCaptureUniform type, int components, int count, const void* values);
+		void recordTexture(const char* varname, Texture* texture, int slot);
+		void recordDraw(Mesh* mesh, unsigned int primitive, int submesh_id, int lod = 0);
+		void endFrame();
+
+		bool save(const char* filename);
+		bool load(const char* filename);
+
+		//reissues all the frames iterations times and prints the time per frame
+		void replay(int iterations);
+
+		//start recording (if not already) and finish it storing it to disk
+		static void start();
+		static bool stop(const char* filename);
+		static bool replayFile(const char* filename, int iterations = 100);
+
+	private:
+		std::map<std::string, int> strings_index;
+		int last_state[7];
+		bool has_state;
+
+		int getStringIndex(const std::string& str);
+		void recordState();
+		bool isValid(const sCaptureCommand& cmd) const; //its strings and data are inside the tables
+	};
+
+};
+
+#endif
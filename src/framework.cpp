@@ -9,9 +9,20 @@
 #include <cstring>
 #include <algorithm>
 #include <iostream>
+#include <limits>
+#include <chrono>
 
 #define M_PI_2 1.57079632679489661923
 
+//SIMD versions of the matrix operations, with a scalar fallback
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#define FRAMEWORK_SSE
+	#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#define FRAMEWORK_NEON
+	#include <arm_neon.h>
+#endif
+
 //**************************************
 float Vector2::distance(const Vector2& v)
 {
@@ -441,6 +452,34 @@ Matrix44 Matrix44::operator*(const Matrix44& matrix) const
 {
 	Matrix44 ret;
 
+#if defined(FRAMEWORK_SSE)
+	//every row of the result is a linear combination of the rows of the second matrix
+	__m128 b0 = _mm_loadu_ps(matrix.m);
+	__m128 b1 = _mm_loadu_ps(matrix.m + 4);
+	__m128 b2 = _mm_loadu_ps(matrix.m + 8);
+	__m128 b3 = _mm_loadu_ps(matrix.m + 12);
+	for (int i = 0; i < 4; ++i)
+	{
+		__m128 r = _mm_mul_ps(_mm_set1_ps(M[i][0]), b0);
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(M[i][1]), b1));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(M[i][2]), b2));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(M[i][3]), b3));
+		_mm_storeu_ps(ret.m + i * 4, r);
+	}
+#elif defined(FRAMEWORK_NEON)
+	float32x4_t b0 = vld1q_f32(matrix.m);
+	float32x4_t b1 = vld1q_f32(matrix.m + 4);
+	float32x4_t b2 = vld1q_f32(matrix.m + 8);
+	float32x4_t b3 = vld1q_f32(matrix.m + 12);
+	for (int i = 0; i < 4; ++i)
+	{
+		float32x4_t r = vmulq_n_f32(b0, M[i][0]);
+		r = vmlaq_n_f32(r, b1, M[i][1]);
+		r = vmlaq_n_f32(r, b2, M[i][2]);
+		r = vmlaq_n_f32(r, b3, M[i][3]);
+		vst1q_f32(ret.m + i * 4, r);
+	}
+#else
 	unsigned int i,j,k;
 	for (i=0;i<4;i++) 	
 	{
@@ -451,6 +490,7 @@ Matrix44 Matrix44::operator*(const Matrix44& matrix) const
 				ret.M[i][j] += M[i][k] * matrix.M[k][j];
 		}
 	}
+#endif
 
 	return ret;
 }
@@ -474,6 +514,51 @@ Vector4 operator * (const Matrix44& matrix, const Vector4& v)
 	return Vector4(x, y, z, w);
 }
 
+//Transforms an array of points (w = 1), in and out can be the same array
+void transformPoints(const Matrix44& matrix, const Vector3* in, Vector3* out, int num)
+{
+#if defined(FRAMEWORK_SSE)
+	__m128 r0 = _mm_loadu_ps(matrix.m);
+	__m128 r1 = _mm_loadu_ps(matrix.m + 4);
+	__m128 r2 = _mm_loadu_ps(matrix.m + 8);
+	__m128 r3 = _mm_loadu_ps(matrix.m + 12);
+	for (int i = 0; i < num; ++i)
+	{
+		const Vector3& v = in[i];
+		__m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(v.x), r0), r3);
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(v.y), r1));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(v.z), r2));
+		_mm_storel_pi((__m64*)out[i].v, r);
+		_mm_store_ss(&out[i].z, _mm_movehl_ps(r, r));
+	}
+#else
+	for (int i = 0; i < num; ++i)
+		out[i] = matrix * in[i];
+#endif
+}
+
+//Transforms an array of directions (w = 0), in and out can be the same array
+void transformVectors(const Matrix44& matrix, const Vector3* in, Vector3* out, int num)
+{
+#if defined(FRAMEWORK_SSE)
+	__m128 r0 = _mm_loadu_ps(matrix.m);
+	__m128 r1 = _mm_loadu_ps(matrix.m + 4);
+	__m128 r2 = _mm_loadu_ps(matrix.m + 8);
+	for (int i = 0; i < num; ++i)
+	{
+		const Vector3& v = in[i];
+		__m128 r = _mm_mul_ps(_mm_set1_ps(v.x), r0);
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(v.y), r1));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(v.z), r2));
+		_mm_storel_pi((__m64*)out[i].v, r);
+		_mm_store_ss(&out[i].z, _mm_movehl_ps(r, r));
+	}
+#else
+	for (int i = 0; i < num; ++i)
+		out[i] = matrix.rotateVector(in[i]);
+#endif
+}
+
 void Matrix44::setUpAndOrthonormalize(Vector3 up)
 {
 	up.normalize();
@@ -547,79 +632,406 @@ void Matrix44::setFrontAndOrthonormalize(Vector3 front)
 	
 }
 
+#define MATRIX_SINGULAR_THRESHOLD 0.00001 //change this if you experience problems with matrices
+
+//the closed forms have no pivots to compare with the threshold like the Gauss-Jordan elimination did, the determinant
+//is compared as if every row was divided by its largest element, so it doesnt depend on the scale of the matrix
+//(a 0.01 scale has a 1e-6 determinant). Matrix44::benchmark counts the cases where both methods disagree
+static bool isSingular(const float* m, int size, float det)
+{
+	float scale = 1.0f;
+	for (int i = 0; i < size; ++i)
+	{
+		float row = 0;
+		for (int j = 0; j < size; ++j)
+			row = std::max(row, fabsf(m[i * 4 + j]));
+		scale *= row;
+	}
+	return fabs(det) <= MATRIX_SINGULAR_THRESHOLD * scale;
+}
+
+#if defined(FRAMEWORK_SSE)
+//helpers for the 2x2 blocks of the SSE inverse, every __m128 stores a 2x2 matrix (row major)
+#define SHUFFLE_MASK(x,y,z,w) ((x) | ((y) << 2) | ((z) << 4) | ((w) << 6))
+#define SWIZZLE(v,x,y,z,w) _mm_shuffle_ps(v, v, SHUFFLE_MASK(x,y,z,w))
+#define SHUFFLE(a,b,x,y,z,w) _mm_shuffle_ps(a, b, SHUFFLE_MASK(x,y,z,w))
+
+//A * B
+static inline __m128 mat2Mul(__m128 a, __m128 b)
+{
+	return _mm_add_ps(_mm_mul_ps(a, SWIZZLE(b, 0,3,0,3)), _mm_mul_ps(SWIZZLE(a, 1,0,3,2), SWIZZLE(b, 2,1,2,1)));
+}
+//adjugate(A) * B
+static inline __m128 mat2AdjMul(__m128 a, __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(SWIZZLE(a, 3,3,0,0), b), _mm_mul_ps(SWIZZLE(a, 1,1,2,2), SWIZZLE(b, 2,3,0,1)));
+}
+//A * adjugate(B)
+static inline __m128 mat2MulAdj(__m128 a, __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(a, SWIZZLE(b, 3,0,3,0)), _mm_mul_ps(SWIZZLE(a, 1,0,3,2), SWIZZLE(b, 2,1,2,1)));
+}
+#endif
+
+//closed form inverse (block-wise cofactors), returns false if the matrix is singular
 bool Matrix44::inverse()
 {
-   unsigned int i, j, k, swap;
-   float t;
-   Matrix44 temp, final;
-   final.setIdentity();
+#if defined(FRAMEWORK_SSE)
+	__m128 row0 = _mm_loadu_ps(m);
+	__m128 row1 = _mm_loadu_ps(m + 4);
+	__m128 row2 = _mm_loadu_ps(m + 8);
+	__m128 row3 = _mm_loadu_ps(m + 12);
+
+	//2x2 sub matrices
+	__m128 A = _mm_movelh_ps(row0, row1);
+	__m128 B = _mm_movehl_ps(row1, row0);
+	__m128 C = _mm_movelh_ps(row2, row3);
+	__m128 D = _mm_movehl_ps(row3, row2);
+
+	//determinants of the sub matrices (|A| |B| |C| |D|)
+	__m128 det_sub = _mm_sub_ps(
+		_mm_mul_ps(SHUFFLE(row0, row2, 0,2,0,2), SHUFFLE(row1, row3, 1,3,1,3)),
+		_mm_mul_ps(SHUFFLE(row0, row2, 1,3,1,3), SHUFFLE(row1, row3, 0,2,0,2)));
+	__m128 det_A = SWIZZLE(det_sub, 0,0,0,0);
+	__m128 det_B = SWIZZLE(det_sub, 1,1,1,1);
+	__m128 det_C = SWIZZLE(det_sub, 2,2,2,2);
+	__m128 det_D = SWIZZLE(det_sub, 3,3,3,3);
+
+	__m128 D_C = mat2AdjMul(D, C);
+	__m128 A_B = mat2AdjMul(A, B);
+	__m128 X = _mm_sub_ps(_mm_mul_ps(det_D, A), mat2Mul(B, D_C));
+	__m128 W = _mm_sub_ps(_mm_mul_ps(det_A, D), mat2Mul(C, A_B));
+	__m128 Y = _mm_sub_ps(_mm_mul_ps(det_B, C), mat2MulAdj(D, A_B));
+	__m128 Z = _mm_sub_ps(_mm_mul_ps(det_C, B), mat2MulAdj(A, D_C));
+
+	//|M| = |A|*|D| + |B|*|C| - trace(A#B * D#C)
+	__m128 tr = _mm_mul_ps(A_B, SWIZZLE(D_C, 0,2,1,3));
+	tr = _mm_add_ps(tr, SWIZZLE(tr, 2,3,0,1));
+	tr = _mm_add_ps(tr, SWIZZLE(tr, 1,0,3,2));
+	__m128 det_M = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_A, det_D), _mm_mul_ps(det_B, det_C)), tr);
+
+	float det = _mm_cvtss_f32(det_M);
+	if (isSingular(m, 4, det))
+		return false;
 
-   temp = (*this);
+	__m128 inv_det = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det_M);
+	X = _mm_mul_ps(X, inv_det);
+	Y = _mm_mul_ps(Y, inv_det);
+	Z = _mm_mul_ps(Z, inv_det);
+	W = _mm_mul_ps(W, inv_det);
+
+	//apply the adjugate while storing
+	_mm_storeu_ps(m, SHUFFLE(X, Y, 3,1,3,1));
+	_mm_storeu_ps(m + 4, SHUFFLE(X, Y, 2,0,2,0));
+	_mm_storeu_ps(m + 8, SHUFFLE(Z, W, 3,1,3,1));
+	_mm_storeu_ps(m + 12, SHUFFLE(Z, W, 2,0,2,0));
+	return true;
+#else
+	//2x2 determinants of the first two rows and of the last two
+	float s0 = m[0] * m[5] - m[4] * m[1];
+	float s1 = m[0] * m[6] - m[4] * m[2];
+	float s2 = m[0] * m[7] - m[4] * m[3];
+	float s3 = m[1] * m[6] - m[5] * m[2];
+	float s4 = m[1] * m[7] - m[5] * m[3];
+	float s5 = m[2] * m[7] - m[6] * m[3];
+
+	float c5 = m[10] * m[15] - m[14] * m[11];
+	float c4 = m[9] * m[15] - m[13] * m[11];
+	float c3 = m[9] * m[14] - m[13] * m[10];
+	float c2 = m[8] * m[15] - m[12] * m[11];
+	float c1 = m[8] * m[14] - m[12] * m[10];
+	float c0 = m[8] * m[13] - m[12] * m[9];
+
+	float det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+	if (isSingular(m, 4, det))
+		return false;
+	float inv_det = 1.0f / det;
+
+	Matrix44 r;
+	r.m[0] = ( m[5] * c5 - m[6] * c4 + m[7] * c3) * inv_det;
+	r.m[1] = (-m[1] * c5 + m[2] * c4 - m[3] * c3) * inv_det;
+	r.m[2] = ( m[13] * s5 - m[14] * s4 + m[15] * s3) * inv_det;
+	r.m[3] = (-m[9] * s5 + m[10] * s4 - m[11] * s3) * inv_det;
+
+	r.m[4] = (-m[4] * c5 + m[6] * c2 - m[7] * c1) * inv_det;
+	r.m[5] = ( m[0] * c5 - m[2] * c2 + m[3] * c1) * inv_det;
+	r.m[6] = (-m[12] * s5 + m[14] * s2 - m[15] * s1) * inv_det;
+	r.m[7] = ( m[8] * s5 - m[10] * s2 + m[11] * s1) * inv_det;
+
+	r.m[8] = ( m[4] * c4 - m[5] * c2 + m[7] * c0) * inv_det;
+	r.m[9] = (-m[0] * c4 + m[1] * c2 - m[3] * c0) * inv_det;
+	r.m[10] = ( m[12] * s4 - m[13] * s2 + m[15] * s0) * inv_det;
+	r.m[11] = (-m[8] * s4 + m[9] * s2 - m[11] * s0) * inv_det;
+
+	r.m[12] = (-m[4] * c3 + m[5] * c1 - m[6] * c0) * inv_det;
+	r.m[13] = ( m[0] * c3 - m[1] * c1 + m[2] * c0) * inv_det;
+	r.m[14] = (-m[12] * s3 + m[13] * s1 - m[14] * s0) * inv_det;
+	r.m[15] = ( m[8] * s3 - m[9] * s1 + m[10] * s0) * inv_det;
+
+	*this = r;
+	return true;
+#endif
+}
 
-   unsigned int m,n;
-   m = n = 4;
-	
-   for (i = 0; i < m; i++)
-   {
-      // Look for largest element in column
-
-      swap = i;
-      for (j = i + 1; j < m; j++)// m or n
-	  {
-		 if ( fabs(temp.M[j][i]) > fabs( temp.M[swap][i]) )
-            swap = j;
-	  }
-   
-      if (swap != i)
-      {
-         // Swap rows.
-         for (k = 0; k < n; k++)
-         {
-			 std::swap( temp.M[i][k],temp.M[swap][k]);
-			 std::swap( final.M[i][k], final.M[swap][k]);
-         }
-      }
-
-      // No non-zero pivot.  The CMatrix is singular, which shouldn't
-      // happen.  This means the user gave us a bad CMatrix.
+//inverse for matrices with the last column (0,0,0,1): inverts the 3x3 part and the translation
+bool Matrix44::inverseAffine()
+{
+	//cofactors of the 3x3 part
+	float c00 = M[1][1] * M[2][2] - M[1][2] * M[2][1];
+	float c01 = M[1][2] * M[2][0] - M[1][0] * M[2][2];
+	float c02 = M[1][0] * M[2][1] - M[1][1] * M[2][0];
+	float det = M[0][0] * c00 + M[0][1] * c01 + M[0][2] * c02;
+	if (isSingular(m, 3, det))
+		return false;
+	float inv_det = 1.0f / det;
+
+	Matrix44 r;
+	r.M[0][0] = c00 * inv_det;
+	r.M[0][1] = (M[0][2] * M[2][1] - M[0][1] * M[2][2]) * inv_det;
+	r.M[0][2] = (M[0][1] * M[1][2] - M[0][2] * M[1][1]) * inv_det;
+	r.M[1][0] = c01 * inv_det;
+	r.M[1][1] = (M[0][0] * M[2][2] - M[0][2] * M[2][0]) * inv_det;
+	r.M[1][2] = (M[0][2] * M[1][0] - M[0][0] * M[1][2]) * inv_det;
+	r.M[2][0] = c02 * inv_det;
+	r.M[2][1] = (M[0][1] * M[2][0] - M[0][0] * M[2][1]) * inv_det;
+	r.M[2][2] = (M[0][0] * M[1][1] - M[0][1] * M[1][0]) * inv_det;
+
+	//translation = -t * inverse(R)
+	for (int j = 0; j < 3; ++j)
+		r.M[3][j] = -(M[3][0] * r.M[0][j] + M[3][1] * r.M[1][j] + M[3][2] * r.M[2][j]);
+	r.M[0][3] = r.M[1][3] = r.M[2][3] = 0.0f;
+	r.M[3][3] = 1.0f;
+
+	*this = r;
+	return true;
+}
 
+//inverse for matrices with only rotation and translation (no scale): transposes the rotation
+void Matrix44::inverseRigid()
+{
+	Matrix44 r;
+	for (int i = 0; i < 3; ++i)
+		for (int j = 0; j < 3; ++j)
+			r.M[i][j] = M[j][i];
+	for (int j = 0; j < 3; ++j)
+		r.M[3][j] = -(M[3][0] * r.M[0][j] + M[3][1] * r.M[1][j] + M[3][2] * r.M[2][j]);
+	r.M[0][3] = r.M[1][3] = r.M[2][3] = 0.0f;
+	r.M[3][3] = 1.0f;
+	*this = r;
+}
 
-#define MATRIX_SINGULAR_THRESHOLD 0.00001 //change this if you experience problems with matrices
+//references of the benchmark: the Gauss-Jordan elimination (partial pivoting) and the loops used before the closed forms
+static bool inverseGaussJordan(const Matrix44& matrix, Matrix44& result)
+{
+	Matrix44 temp = matrix;
+	result.setIdentity();
+	for (int i = 0; i < 4; ++i)
+	{
+		int swap = i;
+		for (int j = i + 1; j < 4; ++j)
+			if (fabs(temp.M[j][i]) > fabs(temp.M[swap][i]))
+				swap = j;
+		if (swap != i)
+			for (int k = 0; k < 4; ++k)
+			{
+				std::swap(temp.M[i][k], temp.M[swap][k]);
+				std::swap(result.M[i][k], result.M[swap][k]);
+			}
+		if (fabsf(temp.M[i][i]) <= MATRIX_SINGULAR_THRESHOLD)
+			return false;
 
-      if ( fabsf(temp.M[i][i]) <= MATRIX_SINGULAR_THRESHOLD)
-	  {
-		  final.setIdentity();
-         return false;
-	  }
-#undef MATRIX_SINGULAR_THRESHOLD
+		float t = 1.0f / temp.M[i][i];
+		for (int k = 0; k < 4; ++k)
+		{
+			temp.M[i][k] *= t;
+			result.M[i][k] *= t;
+		}
+		for (int j = 0; j < 4; ++j)
+			if (j != i)
+			{
+				t = temp.M[j][i];
+				for (int k = 0; k < 4; ++k)
+				{
+					temp.M[j][k] -= temp.M[i][k] * t;
+					result.M[j][k] -= result.M[i][k] * t;
+				}
+			}
+	}
+	return true;
+}
 
-      t = 1.0f/temp.M[i][i];
+static Matrix44 multiplyLoops(const Matrix44& a, const Matrix44& b)
+{
+	Matrix44 ret;
+	for (int i = 0; i < 4; ++i)
+		for (int j = 0; j < 4; ++j)
+		{
+			ret.M[i][j] = 0.0f;
+			for (int k = 0; k < 4; ++k)
+				ret.M[i][j] += a.M[i][k] * b.M[k][j];
+		}
+	return ret;
+}
 
-      for (k = 0; k < n; k++)//m or n
-      {
-         temp.M[i][k] *= t;
-         final.M[i][k] *= t;
-      }
+//largest difference relative to the largest value of the reference
+static float relativeError(const float* values, const float* reference, int num)
+{
+	float error = 0, scale = 0;
+	for (int i = 0; i < num; ++i)
+	{
+		error = std::max(error, fabsf(values[i] - reference[i]));
+		scale = std::max(scale, fabsf(reference[i]));
+	}
+	return scale > 0 ? error / scale : error;
+}
 
-      for (j = 0; j < m; j++) // m or n
-      {
-         if (j != i)
-         {
-            t = temp.M[j][i];
-            for (k = 0; k < n; k++)//m or n
-            {
-               temp.M[j][k] -= (temp.M[i][k] * t);
-               final.M[j][k] -= (final.M[i][k] * t);
-            }
-         }
-      }
-   }
+static double getBenchmarkTime()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
 
-   *this = final;
+//min of some repetitions, in ms
+template<typename F>
+static double measureMatrices(F func)
+{
+	double best = 0;
+	for (int i = 0; i < 5; ++i)
+	{
+		double start = getBenchmarkTime();
+		func();
+		double time = getBenchmarkTime() - start;
+		best = i ? std::min(best, time) : time;
+	}
+	return best;
+}
+
+void Matrix44::benchmark()
+{
+#if defined(FRAMEWORK_SSE)
+	const char* path = "SSE";
+#elif defined(FRAMEWORK_NEON)
+	const char* path = "NEON";
+#else
+	const char* path = "scalar";
+#endif
+	const int num = 100000;
+	std::cout << " + Matrix benchmark (" << path << "), " << num << " matrices" << std::endl;
 
-   return true;
+	//random TRS matrices with scales from 0.01 to 10, one of every 8 is a view projection
+	srand(1);
+	std::vector<Matrix44> matrices(num), others(num), results(num), references(num);
+	for (int i = 0; i < num; ++i)
+	{
+		Matrix44& matrix = matrices[i];
+		Vector3 axis(random(2.0f, -1), random(2.0f, -1), random(2.0f, -1));
+		if (axis.length() < 0.01f)
+			axis.set(0, 1, 0);
+		matrix.setTranslation(random(200.0f, -100), random(200.0f, -100), random(200.0f, -100));
+		matrix.rotate(random(2.0f * (float)PI), normalize(axis));
+		float scale = powf(10.0f, random(3.0f, -2));
+		matrix.scale(scale, scale * random(1.0f) + scale * 0.5f, scale);
+		if (i % 8 == 7)
+		{
+			Matrix44 projection;
+			projection.perspective(random(60.0f) + 30.0f, 16.0f / 9.0f, 0.1f, 1000.0f);
+			matrix = matrix * projection;
+		}
+		others[(i + 1) % num] = matrix;
+	}
+
+	//inverse
+	double time = measureMatrices([&]() {
+		for (int i = 0; i < num; ++i)
+		{
+			results[i] = matrices[i];
+			results[i].inverse();
+		}
+	});
+	double reference_time = measureMatrices([&]() {
+		for (int i = 0; i < num; ++i)
+			inverseGaussJordan(matrices[i], references[i]);
+	});
+	//the view projections with a small scale are badly conditioned, both methods lose precision there
+	float errors[2] = { 0, 0 };
+	int mismatches = 0;
+	for (int i = 0; i < num; ++i)
+	{
+		Matrix44 inverse = matrices[i];
+		if (inverse.inverse() != inverseGaussJordan(matrices[i], references[i]))
+			++mismatches;
+		float& error = errors[i % 8 == 7 ? 1 : 0];
+		error = std::max(error, relativeError(results[i].m, references[i].m, 16));
+	}
+	std::cout << "\t inverse: " << time << "ms, Gauss-Jordan " << reference_time << "ms, max relative error " << errors[0] << " (TRS) " << errors[1] << " (view projection), " << mismatches << " singular mismatches" << std::endl;
+
+	//inverseAffine, only the matrices without projection
+	time = measureMatrices([&]() {
+		for (int i = 0; i < num; ++i)
+		{
+			results[i] = matrices[i];
+			results[i].inverseAffine();
+		}
+	});
+	float error = 0;
+	for (int i = 0; i < num; ++i)
+		if (i % 8 != 7)
+			error = std::max(error, relativeError(results[i].m, references[i].m, 16));
+	std::cout << "\t inverseAffine: " << time << "ms, max relative error " << error << std::endl;
+
+	//multiply
+	time = measureMatrices([&]() {
+		for (int i = 0; i < num; ++i)
+			results[i] = matrices[i] * others[i];
+	});
+	reference_time = measureMatrices([&]() {
+		for (int i = 0; i < num; ++i)
+			references[i] = multiplyLoops(matrices[i], others[i]);
+	});
+	error = 0;
+	for (int i = 0; i < num; ++i)
+		error = std::max(error, relativeError(results[i].m, references[i].m, 16));
+	std::cout << "\t multiply: " << time << "ms, loops " << reference_time << "ms, max relative error " << error << std::endl;
+
+	//points
+	std::vector<Vector3> points(num), transformed(num), expected(num);
+	for (int i = 0; i < num; ++i)
+		points[i].random(100.0f);
+	const Matrix44& transform = matrices[0];
+	time = measureMatrices([&]() { transformPoints(transform, &points[0], &transformed[0], num); });
+	reference_time = measureMatrices([&]() {
+		for (int i = 0; i < num; ++i)
+			expected[i] = transform * points[i];
+	});
+	error = relativeError(transformed[0].v, expected[0].v, num * 3);
+	std::cout << "\t transformPoints: " << time << "ms, one by one " << reference_time << "ms, max relative error " << error << std::endl;
+
+	//boxes: |M| applied to the halfsize against the 8 corners
+	error = 0;
+	for (int i = 0; i < num; ++i)
+	{
+		if (i % 8 == 7)
+			continue;
+		BoundingBox box(points[i], Vector3(1.0f, 2.0f, 3.0f));
+		BoundingBox result = transformBoundingBox(matrices[i], box);
+		Vector3 bbmin, bbmax;
+		for (int c = 0; c < 8; ++c)
+		{
+			Vector3 corner = box.center + Vector3(c & 1 ? 1.0f : -1.0f, c & 2 ? 1.0f : -1.0f, c & 4 ? 1.0f : -1.0f) * box.halfsize;
+			corner = matrices[i] * corner;
+			if (!c)
+				bbmin = bbmax = corner;
+			bbmin.setMin(corner);
+			bbmax.setMax(corner);
+		}
+		Vector3 found[2] = { result.center - result.halfsize, result.center + result.halfsize };
+		Vector3 corners[2] = { bbmin, bbmax };
+		error = std::max(error, relativeError(found[0].v, corners[0].v, 6));
+	}
+	std::cout << "\t transformBoundingBox: max relative error " << error << " against the 8 corners" << std::endl;
 }
 
+#undef MATRIX_SINGULAR_THRESHOLD
+
 #ifdef FIXEDPIPELINE
 void Matrix44::multGL()
 {
@@ -632,6 +1044,110 @@ void Matrix44::loadGL()
 }
 #endif
 
+//****************************
+Matrix34::Matrix34()
+{
+	setIdentity();
+}
+
+Matrix34::Matrix34(const Matrix44& matrix)
+{
+	for (int i = 0; i < 3; ++i)
+		for (int k = 0; k < 4; ++k)
+			M[i][k] = matrix.M[k][i];
+}
+
+void Matrix34::setIdentity()
+{
+	memset(m, 0, sizeof(m));
+	M[0][0] = M[1][1] = M[2][2] = 1.0f;
+}
+
+Matrix44 Matrix34::toMatrix44() const
+{
+	Matrix44 r;
+	for (int i = 0; i < 3; ++i)
+		for (int k = 0; k < 4; ++k)
+			r.M[k][i] = M[i][k];
+	r.M[0][3] = r.M[1][3] = r.M[2][3] = 0.0f;
+	r.M[3][3] = 1.0f;
+	return r;
+}
+
+//same as Matrix44: the result applies this transform first and then the other one
+Matrix34 Matrix34::operator*(const Matrix34& matrix) const
+{
+	Matrix34 ret;
+#if defined(FRAMEWORK_SSE)
+	__m128 a0 = _mm_loadu_ps(m);
+	__m128 a1 = _mm_loadu_ps(m + 4);
+	__m128 a2 = _mm_loadu_ps(m + 8);
+	for (int i = 0; i < 3; ++i)
+	{
+		const float* b = matrix.M[i];
+		__m128 r = _mm_mul_ps(_mm_set1_ps(b[0]), a0);
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(b[1]), a1));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(b[2]), a2));
+		r = _mm_add_ps(r, _mm_setr_ps(0.0f, 0.0f, 0.0f, b[3]));
+		_mm_storeu_ps(ret.m + i * 4, r);
+	}
+#else
+	for (int i = 0; i < 3; ++i)
+	{
+		const float* b = matrix.M[i];
+		for (int k = 0; k < 4; ++k)
+			ret.M[i][k] = b[0] * M[0][k] + b[1] * M[1][k] + b[2] * M[2][k];
+		ret.M[i][3] += b[3];
+	}
+#endif
+	return ret;
+}
+
+Vector3 operator * (const Matrix34& matrix, const Vector3& v)
+{
+	const float (*M)[4] = matrix.M;
+	return Vector3(M[0][0] * v.x + M[0][1] * v.y + M[0][2] * v.z + M[0][3],
+		M[1][0] * v.x + M[1][1] * v.y + M[1][2] * v.z + M[1][3],
+		M[2][0] * v.x + M[2][1] * v.y + M[2][2] * v.z + M[2][3]);
+}
+
+Vector3 Matrix34::rotateVector(const Vector3& v) const
+{
+	return Vector3(M[0][0] * v.x + M[0][1] * v.y + M[0][2] * v.z,
+		M[1][0] * v.x + M[1][1] * v.y + M[1][2] * v.z,
+		M[2][0] * v.x + M[2][1] * v.y + M[2][2] * v.z);
+}
+
+bool Matrix34::inverse()
+{
+	//cofactors of the 3x3 part
+	float c00 = M[1][1] * M[2][2] - M[1][2] * M[2][1];
+	float c01 = M[1][2] * M[2][0] - M[1][0] * M[2][2];
+	float c02 = M[1][0] * M[2][1] - M[1][1] * M[2][0];
+	float det = M[0][0] * c00 + M[0][1] * c01 + M[0][2] * c02;
+	if (isSingular(m, 3, det))
+		return false;
+	float inv_det = 1.0f / det;
+
+	Matrix34 r;
+	r.M[0][0] = c00 * inv_det;
+	r.M[0][1] = (M[0][2] * M[2][1] - M[0][1] * M[2][2]) * inv_det;
+	r.M[0][2] = (M[0][1] * M[1][2] - M[0][2] * M[1][1]) * inv_det;
+	r.M[1][0] = c01 * inv_det;
+	r.M[1][1] = (M[0][0] * M[2][2] - M[0][2] * M[2][0]) * inv_det;
+	r.M[1][2] = (M[0][2] * M[1][0] - M[0][0] * M[1][2]) * inv_det;
+	r.M[2][0] = c02 * inv_det;
+	r.M[2][1] = (M[0][1] * M[2][0] - M[0][0] * M[2][1]) * inv_det;
+	r.M[2][2] = (M[0][0] * M[1][1] - M[0][1] * M[1][0]) * inv_det;
+
+	//translation = -inverse(R) * t
+	for (int i = 0; i < 3; ++i)
+		r.M[i][3] = -(r.M[i][0] * M[0][3] + r.M[i][1] * M[1][3] + r.M[i][2] * M[2][3]);
+
+	*this = r;
+	return true;
+}
+
 
 Quaternion::Quaternion()
 {
@@ -1306,25 +1822,23 @@ float signedDistanceToPlane( const Vector4& plane, const Vector3& point )
 	return dot(plane.xyz(), point) + plane.w;
 }
 
-const Vector3 corners[] = { {1,1,1},  {1,1,-1},  {1,-1,1},  {1,-1,-1},  {-1,1,1},  {-1,1,-1},  {-1,-1,1},  {-1,-1,-1} };
-
-BoundingBox transformBoundingBox(const Matrix44 m, const BoundingBox& box)
+//uses the absolute value of the matrix to transform the halfsize, same result as transforming the 8 corners
+BoundingBox transformBoundingBox(const Matrix44& m, const BoundingBox& box)
 {
-	Vector3 box_min(10000000.0f,1000000.0f, 1000000.0f);
-	Vector3 box_max(-10000000.0f, -1000000.0f, -1000000.0f);
-
-	for (int i = 0; i < 8; ++i)
-	{
-		Vector3 corner = corners[i];
-		corner = box.halfsize * corner;
-		corner = corner + box.center;
-		corner = m * corner;
-		box_min.setMin(corner);
-		box_max.setMax(corner);
-	}
+	Vector3 center = m * box.center;
+	Vector3 halfsize;
+	for (int j = 0; j < 3; ++j)
+		halfsize.v[j] = fabs(m.M[0][j]) * box.halfsize.x + fabs(m.M[1][j]) * box.halfsize.y + fabs(m.M[2][j]) * box.halfsize.z;
+	return BoundingBox(center, halfsize);
+}
 
-	Vector3 halfsize = (box_max - box_min) * 0.5;
-	return BoundingBox(box_max - halfsize, halfsize );
+BoundingBox transformBoundingBox(const Matrix34& m, const BoundingBox& box)
+{
+	Vector3 center = m * box.center;
+	Vector3 halfsize;
+	for (int i = 0; i < 3; ++i)
+		halfsize.v[i] = fabs(m.M[i][0]) * box.halfsize.x + fabs(m.M[i][1]) * box.halfsize.y + fabs(m.M[i][2]) * box.halfsize.z;
+	return BoundingBox(center, halfsize);
 }
 
 BoundingBox mergeBoundingBoxes(const BoundingBox& a, const BoundingBox& b)
@@ -1448,4 +1962,77 @@ bool BoundingBoxSphereOverlap(const BoundingBox& box, const Vector3& center, flo
 	}
 
 	return false; //OUTSIDE;
-}
\ No newline at end of file
+}
+
+unsigned short floatToHalf(float value)
+{
+	unsigned int f;
+	memcpy(&f, &value, sizeof(f));
+	unsigned int sign = (f >> 16) & 0x8000;
+	unsigned int mantissa = f & 0x7FFFFF;
+	if (((f >> 23) & 0xFF) == 0xFF) //inf and nan
+		return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+	int exponent = (int)((f >> 23) & 0xFF) - 127 + 15;
+	if (exponent >= 31)
+		return sign | 0x7C00;
+	if (exponent <= 0) //denormal
+	{
+		if (exponent < -10)
+			return sign;
+		mantissa |= 0x800000;
+		int shift = 14 - exponent;
+		unsigned int half = mantissa >> shift;
+		if ((mantissa >> (shift - 1)) & 1)
+			half++;
+		return sign | half;
+	}
+	unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+	if (mantissa & 0x1000)
+		half++; //the carry goes to the exponent, that is still the nearest
+	return half;
+}
+
+float halfToFloat(unsigned short half)
+{
+	int exponent = (half >> 10) & 0x1F;
+	int mantissa = half & 0x3FF;
+	float value;
+	if (exponent == 0)
+		value = ldexpf((float)mantissa, -24);
+	else if (exponent == 31)
+		value = mantissa ? std::numeric_limits<float>::quiet_NaN() : std::numeric_limits<float>::infinity();
+	else
+		value = ldexpf(1.0f + mantissa / 1024.0f, exponent - 15);
+	return (half & 0x8000) ? -value : value;
+}
+
+short quantizeSnorm16(float v)
+{
+	return (short)floorf(clamp(v, -1.0f, 1.0f) * 32767.0f + 0.5f);
+}
+
+void encodeOctahedral(Vector3 n, short* result)
+{
+	n = n * (1.0f / (fabsf(n.x) + fabsf(n.y) + fabsf(n.z)));
+	float x = n.x, y = n.y;
+	if (n.z < 0)
+	{
+		x = (1.0f - fabsf(n.y)) * (n.x >= 0 ? 1.0f : -1.0f);
+		y = (1.0f - fabsf(n.x)) * (n.y >= 0 ? 1.0f : -1.0f);
+	}
+	result[0] = quantizeSnorm16(x);
+	result[1] = quantizeSnorm16(y);
+}
+
+Vector3 decodeOctahedral(const short* v)
+{
+	Vector3 n(v[0] / 32767.0f, v[1] / 32767.0f, 0.0f);
+	n.z = 1.0f - fabsf(n.x) - fabsf(n.y);
+	if (n.z < 0)
+	{
+		float x = n.x;
+		n.x = (1.0f - fabsf(n.y)) * (x >= 0 ? 1.0f : -1.0f);
+		n.y = (1.0f - fabsf(x)) * (n.y >= 0 ? 1.0f : -1.0f);
+	}
+	return n.normalize();
+}
@@ -229,6 +229,8 @@ class Matrix44
 		Vector3 frontVector() { return Vector3(m[8],m[9],m[10]); }
 
 		bool inverse();
+		bool inverseAffine(); //faster, only for matrices without projection
+		void inverseRigid(); //fastest, only for rotation + translation (no scale)
 		void setUpAndOrthonormalize(Vector3 up);
 		void setFrontAndOrthonormalize(Vector3 front);
 
@@ -266,6 +268,8 @@ class Matrix44
 		void loadGL();
 
 		Matrix44 operator * (const Matrix44& matrix) const;
+
+		static void benchmark(); //speed and error of the inverses, the multiply and transformPoints against the old loops
 };
 
 //Operators, they are our friends
@@ -273,6 +277,41 @@ class Matrix44
 Vector3 operator * (const Matrix44& matrix, const Vector3& v);
 Vector4 operator * (const Matrix44& matrix, const Vector4& v); 
 
+//batched versions (SIMD when available)
+void transformPoints(const Matrix44& matrix, const Vector3* in, Vector3* out, int num);
+void transformVectors(const Matrix44& matrix, const Vector3* in, Vector3* out, int num);
+
+//****************************
+//Matrix34 class
+//affine transform (no projection) in 48 bytes, same conventions than Matrix44 (a * b applies a and then b)
+//it stores the first three columns of the Matrix44 as rows, so every row is (axis_coef, axis_coef, axis_coef, translation)
+class Matrix34
+{
+	public:
+		union {
+			float M[3][4]; //[column of the Matrix44][row of the Matrix44]
+			float m[12];
+		};
+
+		Matrix34(); //identity
+		Matrix34(const Matrix44& matrix); //drops the last column
+
+		void setIdentity();
+		Matrix44 toMatrix44() const; //to upload to the shaders
+
+		Vector3 rightVector() const { return Vector3(M[0][0], M[1][0], M[2][0]); }
+		Vector3 topVector() const { return Vector3(M[0][1], M[1][1], M[2][1]); }
+		Vector3 frontVector() const { return Vector3(M[0][2], M[1][2], M[2][2]); }
+		Vector3 getTranslation() const { return Vector3(M[0][3], M[1][3], M[2][3]); }
+
+		bool inverse(); //returns false if singular
+		Vector3 rotateVector(const Vector3& v) const;
+
+		Matrix34 operator * (const Matrix34& matrix) const;
+};
+
+Vector3 operator * (const Matrix34& matrix, const Vector3& v);
+
 
 class Quaternion
 {
@@ -372,7 +411,8 @@ public:
 
 //applies a transform to a AABB from object to world
 BoundingBox mergeBoundingBoxes(const BoundingBox& a, const BoundingBox& b);
-BoundingBox transformBoundingBox(const Matrix44 m, const BoundingBox& box);
+BoundingBox transformBoundingBox(const Matrix44& m, const BoundingBox& box);
+BoundingBox transformBoundingBox(const Matrix34& m, const BoundingBox& box);
 
 float signedDistanceToPlane(const Vector4& plane, const Vector3& point);
 int planeBoxOverlap( const Vector4& plane, const Vector3& center, const Vector3& halfsize );
@@ -383,6 +423,13 @@ bool RayBoundingBoxCollision(const BoundingBox& box, const Vector3& ray_origin,
 bool BoundingBoxSphereOverlap(const BoundingBox& box, const Vector3& center, float radius );
 Vector3 reflect(const Vector3& I, const Vector3& N);
 
+//compact encodings of the quantized vertices
+unsigned short floatToHalf(float value); //rounded to nearest
+float halfToFloat(unsigned short half);
+short quantizeSnorm16(float v);
+void encodeOctahedral(Vector3 n, short* result); //the sphere mapped to an octahedron unfolded in a square, decodeOctahedral in the shaders does the inverse
+Vector3 decodeOctahedral(const short* v);
+
 //value between 0 and 1
 inline float random(float range = 1.0f, int offset = 0) { return ((rand() % 1000) / (1000.0f)) * range + offset; }
 
@@ -10,11 +10,15 @@
 #include "material.h"
 #include "prefab.h"
 #include "utils.h"
+#include "jobs.h"
+#include "meshoptdecoder.h"
 
 #include <iostream>
+#include <atomic>
+#include <set>
 
 //** PARSING GLTF IS UGLY
-std::string base_folder;
+thread_local std::string base_folder; //prefabs can be loaded from several threads at once
 
 #ifdef _DEBUG2		//si es treu el 2 no es carreguen les textures en DEBUG
 	bool load_textures = false; //must textures be loadead?
@@ -22,111 +26,238 @@ std::string base_folder;
 	bool load_textures = true; //must textures be loadead?
 #endif
 
-void parseGLTFBufferVector3(std::vector<Vector3>& container, cgltf_accessor* acc, cgltf_accessor* indices_acc = NULL)
+//the views compressed with EXT_meshopt_compression are read from their decoded data
+const unsigned char* getGLTFAccessorData(cgltf_accessor* acc)
 {
-	int i = 0;
+	const unsigned char* data = acc->buffer_view ? cgltf_buffer_view_data(acc->buffer_view) : NULL;
+	return data ? data + acc->offset : NULL;
+}
+
+//decodes a EXT_meshopt_compression view in dst, index_size is the size of the indices written (the codec doesnt depend on it)
+bool decodeGLTFMeshoptView(cgltf_buffer_view* view, void* dst, size_t index_size)
+{
+	cgltf_meshopt_compression& mc = view->meshopt_compression;
+	if (!mc.buffer || !mc.buffer->data || mc.offset + mc.size > mc.buffer->size)
+		return false;
+	const unsigned char* src = (const unsigned char*)mc.buffer->data + mc.offset;
 
-	assert(acc->buffer_view->buffer->data);
-	unsigned char* data = (unsigned char*)(acc->buffer_view->buffer->data) + acc->buffer_view->offset + acc->offset;
-	if (acc->normalized)
+	switch (mc.mode)
 	{
-		//denormalize
-		assert(!"TO DO");
+	case cgltf_meshopt_compression_mode_attributes:
+		if (!MeshoptDecoder::decodeVertexBuffer(dst, mc.count, mc.stride, src, mc.size))
+			return false;
+		break;
+	case cgltf_meshopt_compression_mode_triangles:
+		return MeshoptDecoder::decodeIndexBuffer(dst, mc.count, index_size, src, mc.size);
+	case cgltf_meshopt_compression_mode_indices:
+		return MeshoptDecoder::decodeIndexSequence(dst, mc.count, index_size, src, mc.size);
+	default:
+		return false;
 	}
-	int num_elements = acc->count;
-	std::vector<Vector3> unindexed;
-	unindexed.resize(num_elements);
-	assert(acc->component_type == cgltf_component_type_r_32f && acc->type == cgltf_type_vec3);
-	if (acc->stride == sizeof(Vector3))
-		memcpy(&unindexed[0], data, num_elements * sizeof(Vector3));
-	else
+
+	switch (mc.filter)
 	{
-		for (int i = 0; i < num_elements; ++i)
+	case cgltf_meshopt_compression_filter_octahedral: MeshoptDecoder::decodeFilterOct(dst, mc.count, mc.stride); break;
+	case cgltf_meshopt_compression_filter_quaternion: MeshoptDecoder::decodeFilterQuat(dst, mc.count, mc.stride); break;
+	case cgltf_meshopt_compression_filter_exponential: MeshoptDecoder::decodeFilterExp(dst, mc.count, mc.stride); break;
+	default: break;
+	}
+	return true;
+}
+
+//the indices of a primitive that use all its view are decoded directly in the mesh
+bool isGLTFMeshoptIndices(cgltf_accessor* acc)
+{
+	cgltf_buffer_view* view = acc->buffer_view;
+	return view && view->has_meshopt_compression && !view->data && !acc->is_sparse && acc->offset == 0 && acc->count == view->meshopt_compression.count &&
+		view->meshopt_compression.mode != cgltf_meshopt_compression_mode_attributes;
+}
+
+//decodes in parallel the compressed views read by the accessors (and images) in view->data, freed by cgltf_free,
+//the views only used as indices of the primitives are left for parseGLTFBufferIndices
+bool decodeGLTFMeshopt(cgltf_data* data)
+{
+	std::set<cgltf_accessor*> indices;
+	for (int i = 0; i < data->meshes_count; ++i)
+		for (int j = 0; j < data->meshes[i].primitives_count; ++j)
+			if (data->meshes[i].primitives[j].indices)
+				indices.insert(data->meshes[i].primitives[j].indices);
+
+	std::set<cgltf_buffer_view*> needed;
+	for (int i = 0; i < data->accessors_count; ++i)
+	{
+		cgltf_accessor* acc = &data->accessors[i];
+		if (acc->buffer_view && acc->buffer_view->has_meshopt_compression && (!indices.count(acc) || !isGLTFMeshoptIndices(acc)))
+			needed.insert(acc->buffer_view);
+		if (acc->is_sparse)
 		{
-			memcpy(&unindexed[i], data, sizeof(Vector3));
-			data += acc->stride;
+			needed.insert(acc->sparse.indices_buffer_view);
+			needed.insert(acc->sparse.values_buffer_view);
 		}
 	}
+	for (int i = 0; i < data->images_count; ++i)
+		needed.insert(data->images[i].buffer_view);
 
-	if (!indices_acc)
+	std::vector<cgltf_buffer_view*> views;
+	size_t decoded_size = 0;
+	size_t encoded_size = 0;
+	for (cgltf_buffer_view* view : needed)
 	{
-		container = unindexed;
-		return;
+		if (!view || !view->has_meshopt_compression || view->data)
+			continue;
+		view->data = data->memory.alloc(data->memory.user_data, view->meshopt_compression.count * view->meshopt_compression.stride);
+		if (!view->data)
+			return false;
+		views.push_back(view);
+		decoded_size += view->meshopt_compression.count * view->meshopt_compression.stride;
+		encoded_size += view->meshopt_compression.size;
 	}
+	if (views.empty())
+		return true;
+
+	double start = getTimeHighRes();
+	std::atomic<bool> failed(false);
+	JobSystem::parallelFor((int)views.size(), 1, [&views, &failed](int first, int last) {
+		for (int i = first; i < last; ++i)
+			if (!decodeGLTFMeshoptView(views[i], views[i]->data, views[i]->meshopt_compression.stride))
+				failed = true;
+	});
+	double time = getTimeHighRes() - start;
+	std::cout << "\t meshopt views: " << views.size() << ", " << encoded_size / 1024 << "KB to " << decoded_size / 1024 << "KB in " << time << "ms" << std::endl;
+	return !failed;
+}
 
-	container.resize(indices_acc->count);
-
-	unsigned char* indices = (unsigned char*)indices_acc->buffer_view->buffer->data + indices_acc->offset;
-	int stride = indices_acc->stride;
-	for (int i = 0; i < indices_acc->count; ++i)
+//normalized integers are scaled to [0,1] or [-1,1], min_value clamps the lowest signed value
+template<typename T>
+void readGLTFComponents(const unsigned char* src, size_t src_stride, size_t count, int num_components, float scale, float min_value, unsigned char* dst, size_t dst_stride)
+{
+	for (size_t i = 0; i < count; ++i)
 	{
-		int index = 0;
-		unsigned char* pos = indices + i * stride;
-		switch (indices_acc->component_type)
-		{
-		case cgltf_component_type_r_8u: index = (int)*pos; break;
-		case cgltf_component_type_r_16u: index = (int)*(unsigned short*)pos; break;
-		case cgltf_component_type_r_32u: index = (int)*(unsigned int*)pos; break;
-		}
-		if (index < unindexed.size()) //sometimes indices are out of bounds
-			container[i] = unindexed[index];
-		else
-			std::cout << "index out of bounds:" << index << std::endl;
+		const T* in = (const T*)(src + i * src_stride);
+		float* out = (float*)(dst + i * dst_stride);
+		for (int j = 0; j < num_components; ++j)
+			out[j] = std::max(in[j] * scale, min_value);
 	}
 }
 
-void parseGLTFBufferVector2(std::vector<Vector2>& container, cgltf_accessor* acc, cgltf_accessor* indices_acc = NULL)
+//converts the elements [first, first + count) of any component type to floats, writing them every dst_stride bytes so
+//they can go straight to the interleaved vertices. The components missing in the accessor are not written.
+bool readGLTFAccessorFloats(cgltf_accessor* acc, size_t first, size_t count, float* dst, size_t dst_stride, int num_components)
 {
-	assert(acc->buffer_view->buffer->data);
-	unsigned char* data = (unsigned char*)(acc->buffer_view->buffer->data) + acc->offset + acc->buffer_view->offset;
-	if (acc->normalized)
-	{
-		//denormalize
-		assert(!"TO DO");
-	}
-	int num_elements = acc->count;
-	std::vector<Vector2> unindexed;
-	unindexed.resize(num_elements);
-	assert(acc->component_type == cgltf_component_type_r_32f && acc->type == cgltf_type_vec2);
-	if (acc->stride == sizeof(Vector2))
-		memcpy(&unindexed[0], data, num_elements * sizeof(Vector2));
-	else
+	int components = std::min(num_components, (int)cgltf_num_components(acc->type));
+	unsigned char* out = (unsigned char*)dst;
+	const unsigned char* src = getGLTFAccessorData(acc);
+
+	//sparse accessors are unpacked by cgltf, they are rare in vertex streams
+	if (acc->is_sparse || !src)
 	{
-		for (int i = 0; i < num_elements; ++i)
-		{
-			memcpy(&unindexed[i], data, sizeof(Vector2));
-			data += acc->stride;
-		}
+		size_t size = cgltf_num_components(acc->type);
+		std::vector<float> unpacked(acc->count * size);
+		if (!unpacked.size() || !cgltf_accessor_unpack_floats(acc, &unpacked[0], unpacked.size()))
+			return false;
+		for (size_t i = 0; i < count; ++i)
+			memcpy(out + i * dst_stride, &unpacked[(first + i) * size], components * sizeof(float));
+		return true;
 	}
 
-	if (!indices_acc)
+	src += first * acc->stride;
+	bool normalized = acc->normalized != 0;
+	switch (acc->component_type)
 	{
-		container = unindexed;
-		return;
+		case cgltf_component_type_r_32f:
+			if (acc->stride == dst_stride && dst_stride == components * sizeof(float))
+				memcpy(out, src, count * dst_stride);
+			else
+				for (size_t i = 0; i < count; ++i)
+					memcpy(out + i * dst_stride, src + i * acc->stride, components * sizeof(float));
+			break;
+		case cgltf_component_type_r_8: readGLTFComponents<signed char>(src, acc->stride, count, components, normalized ? 1.0f / 127.0f : 1.0f, normalized ? -1.0f : -128.0f, out, dst_stride); break;
+		case cgltf_component_type_r_8u: readGLTFComponents<unsigned char>(src, acc->stride, count, components, normalized ? 1.0f / 255.0f : 1.0f, 0.0f, out, dst_stride); break;
+		case cgltf_component_type_r_16: readGLTFComponents<short>(src, acc->stride, count, components, normalized ? 1.0f / 32767.0f : 1.0f, normalized ? -1.0f : -32768.0f, out, dst_stride); break;
+		case cgltf_component_type_r_16u: readGLTFComponents<unsigned short>(src, acc->stride, count, components, normalized ? 1.0f / 65535.0f : 1.0f, 0.0f, out, dst_stride); break;
+		case cgltf_component_type_r_32u: readGLTFComponents<unsigned int>(src, acc->stride, count, components, 1.0f, 0.0f, out, dst_stride); break;
+		default:
+			std::cout << "[ERROR] glTF accessor of unknown type" << std::endl;
+			return false;
 	}
+	return true;
+}
 
-	container.resize(indices_acc->count);
+template<typename T>
+void parseGLTFStream(std::vector<T>& container, cgltf_accessor* acc, int num_components)
+{
+	container.resize(acc->count);
+	if (acc->count)
+		readGLTFAccessorFloats(acc, 0, acc->count, (float*)&container[0], sizeof(T), num_components);
+}
 
-	assert(indices_acc->sparse.count == 0); //sparse not supported yet
+//the integers are copied as they are, value = (integer - bias) * scale + bias * scale
+template<typename T>
+void readGLTFQuantizedPositions(const unsigned char* src, size_t stride, std::vector<Mesh::tQuantized>& vertices, int bias)
+{
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		const T* in = (const T*)(src + i * stride);
+		short* out = vertices[i].vertex;
+		out[0] = (short)(in[0] - bias);
+		out[1] = (short)(in[1] - bias);
+		out[2] = (short)(in[2] - bias);
+		out[3] = 0;
+	}
+}
 
-	unsigned char* indices = (unsigned char*)indices_acc->buffer_view->buffer->data + indices_acc->offset;
-	int stride = indices_acc->stride;
-	for (int i = 0; i < indices_acc->count; ++i)
+//KHR_mesh_quantization: the integer positions go to the tQuantized vertices without converting them to floats and
+//the scale rebuilds them (the node transforms of the file do the dequantization). Only normals and uvs are read
+//as floats, by blocks, to encode them. False if the positions are floats or any stream is sparse.
+bool parseGLTFQuantizedVertices(Mesh* mesh, cgltf_accessor* position, cgltf_accessor* normal, cgltf_accessor* uv)
+{
+	const unsigned char* src = getGLTFAccessorData(position);
+	if (!src || position->is_sparse || normal->is_sparse || uv->is_sparse || position->type != cgltf_type_vec3)
+		return false;
+
+	size_t count = position->count;
+	std::vector<Mesh::tQuantized>& vertices = mesh->quantized_vertices;
+	vertices.resize(count);
+	bool normalized = position->normalized != 0;
+	float scale = 1.0f;
+	int bias = 0;
+	switch (position->component_type)
 	{
-		unsigned int index = 0;
-		unsigned char* pos = indices + i * stride;
-		switch (indices_acc->component_type)
+		case cgltf_component_type_r_8: scale = normalized ? 1.0f / 127.0f : 1.0f; readGLTFQuantizedPositions<signed char>(src, position->stride, vertices, bias); break;
+		case cgltf_component_type_r_8u: scale = normalized ? 1.0f / 255.0f : 1.0f; readGLTFQuantizedPositions<unsigned char>(src, position->stride, vertices, bias); break;
+		case cgltf_component_type_r_16: scale = normalized ? 1.0f / 32767.0f : 1.0f; readGLTFQuantizedPositions<short>(src, position->stride, vertices, bias); break;
+		case cgltf_component_type_r_16u: scale = normalized ? 1.0f / 65535.0f : 1.0f; bias = 32768; readGLTFQuantizedPositions<unsigned short>(src, position->stride, vertices, bias); break;
+		default:
+			vertices.clear();
+			return false;
+	}
+	mesh->quantized_scale.set(scale, scale, scale);
+	mesh->quantized_offset.set(bias * scale, bias * scale, bias * scale);
+
+	const size_t BLOCK_SIZE = 1024;
+	Vector3 normals[BLOCK_SIZE];
+	Vector2 uvs[BLOCK_SIZE];
+	for (size_t first = 0; first < count; first += BLOCK_SIZE)
+	{
+		size_t num = std::min(BLOCK_SIZE, count - first);
+		if (!readGLTFAccessorFloats(normal, first, num, normals[0].v, sizeof(Vector3), 3) ||
+			!readGLTFAccessorFloats(uv, first, num, uvs[0].value, sizeof(Vector2), 2))
 		{
-		case cgltf_component_type_r_8u: index = static_cast<unsigned int>(*pos); break;
-		case cgltf_component_type_r_16u: index = static_cast<unsigned int>(*(unsigned short*)pos); break;
-		case cgltf_component_type_r_32u: index = static_cast<unsigned int>(*(unsigned int*)pos); break;
+			vertices.clear();
+			return false;
+		}
+		for (size_t i = 0; i < num; ++i)
+		{
+			Mesh::tQuantized& q = vertices[first + i];
+			if (normals[i].x || normals[i].y || normals[i].z)
+				encodeOctahedral(normals[i], q.normal);
+			else
+				q.normal[0] = q.normal[1] = 0;
+			q.uv[0] = floatToHalf(uvs[i].x);
+			q.uv[1] = floatToHalf(uvs[i].y);
 		}
-		if (index < unindexed.size())  //sometimes indices are out of bounds
-			container[i] = unindexed[index];
-		else
-			std::cout << "index out of bounds:" << index << std::endl;
 	}
-
+	return true;
 }
 
 void parseGLTFBufferIndices(std::vector<unsigned int>& container, cgltf_accessor* acc)
@@ -136,12 +267,27 @@ void parseGLTFBufferIndices(std::vector<unsigned int>& container, cgltf_accessor
 
 	assert(acc->sparse.count == 0); //sparse not supported yet
 
-	unsigned char* indices = (unsigned char*)acc->buffer_view->buffer->data + acc->buffer_view->offset + acc->offset;
+	if (isGLTFMeshoptIndices(acc))
+	{
+		if (!decodeGLTFMeshoptView(acc->buffer_view, final_indices, sizeof(unsigned int)))
+		{
+			std::cout << "[ERROR] corrupted meshopt indices" << std::endl;
+			container.clear();
+		}
+		return;
+	}
+
+	const unsigned char* indices = getGLTFAccessorData(acc);
+	if (!indices)
+	{
+		container.clear();
+		return;
+	}
 	int stride = acc->stride;
 	for (int i = 0; i < acc->count; ++i)
 	{
 		unsigned int index = 0;
-		unsigned char* pos = indices + i * stride;
+		const unsigned char* pos = indices + i * stride;
 		switch (acc->component_type)
 		{
 		case cgltf_component_type_r_8u: index = static_cast<unsigned int>(*pos); break;
@@ -152,83 +298,318 @@ void parseGLTFBufferIndices(std::vector<unsigned int>& container, cgltf_accessor
 	}
 }
 
+//meshes of the file being loaded, every cgltf_mesh is parsed once however many nodes use it
+thread_local cgltf_data* gltf_data = NULL;
+thread_local std::string gltf_filename;
+thread_local std::map<cgltf_mesh*, std::vector<Mesh*>> gltf_parsed_meshes;
+
 std::vector<Mesh*> parseGLTFMesh(cgltf_mesh* meshdata)
 {
+	auto parsed = gltf_parsed_meshes.find(meshdata);
+	if (parsed != gltf_parsed_meshes.end())
+		return parsed->second;
+
 	std::vector<Mesh*> result;
 
 	if (meshdata->name)
 		stdlog( std::string("\t<- MESH: ") + meshdata->name);
 
+	//registered as file::name#index::primitive, the names are not unique (or not there) and other files use the same ones
+	std::string mesh_key = gltf_filename + "::" + (meshdata->name ? meshdata->name : "") + "#" + std::to_string(meshdata - gltf_data->meshes);
+
     //submeshes
 	for (int i = 0; i < meshdata->primitives_count; ++i)
 	{
 		cgltf_primitive* primitive = &meshdata->primitives[i];
 		Mesh* mesh = NULL;
 
-		std::string submesh_name;
-		if (meshdata->name)
+		//already loaded by a previous load of the file
+		std::string submesh_name = mesh_key + "::" + std::to_string(i);
+		mesh = Mesh::Get(submesh_name.c_str(), false, true);
+		if (mesh)
 		{
-			submesh_name = std::string(meshdata->name) + std::string("::") + std::to_string(i);
-			mesh = Mesh::Get(submesh_name.c_str(), true);
-			if (mesh)
-			{
-				result.push_back(mesh);
-				continue;
-			}
+			result.push_back(mesh);
+			continue;
 		}
 
 		mesh = new Mesh();
 
         //streams
+		cgltf_accessor* position = NULL;
+		cgltf_accessor* normal = NULL;
+		cgltf_accessor* uv = NULL;
+		cgltf_accessor* uv1 = NULL;
 		for (int j = 0; j < primitive->attributes_count; ++j)
 		{
 			cgltf_attribute* attr = &primitive->attributes[j];
-
-            //std::string attrname = attr->name;
 			if (attr->type == cgltf_attribute_type_position)
+				position = attr->data;
+			else if (attr->type == cgltf_attribute_type_normal)
+				normal = attr->data;
+			else if (attr->type == cgltf_attribute_type_texcoord)
 			{
-				parseGLTFBufferVector3(mesh->vertices, attr->data);
-				if (attr->data->has_min && attr->data->has_max)
-				{
-					mesh->aabb_min = attr->data->min;
-					mesh->aabb_max = attr->data->max;
-					mesh->box.center = (mesh->aabb_max + mesh->aabb_min) * 0.5f;
-					mesh->box.halfsize = mesh->aabb_max - mesh->box.center;
-				}
-				else
-					mesh->updateBoundingBox();
+				if (strcmp(attr->name, "TEXCOORD_1") == 0) //secondary UV set
+					uv1 = attr->data;
+				else if (strcmp(attr->name, "TEXCOORD_0") == 0)
+					uv = attr->data;
+			}
+		}
+
+		//the vertices are written from the buffers in their final layout: tQuantized when the file is quantized, else interleaved
+		size_t num_vertices = position ? position->count : 0;
+		bool complete = num_vertices && normal && uv && normal->count == num_vertices && uv->count == num_vertices;
+		if (complete && Mesh::quantize_vertices && parseGLTFQuantizedVertices(mesh, position, normal, uv))
+			mesh->updateBoundingBox();
+		else if (position)
+		{
+			if (complete && Mesh::interleave_meshes)
+			{
+				mesh->interleaved.resize(num_vertices);
+				Mesh::tInterleaved* vertex = &mesh->interleaved[0];
+				readGLTFAccessorFloats(position, 0, num_vertices, vertex->vertex.v, sizeof(Mesh::tInterleaved), 3);
+				readGLTFAccessorFloats(normal, 0, num_vertices, vertex->normal.v, sizeof(Mesh::tInterleaved), 3);
+				readGLTFAccessorFloats(uv, 0, num_vertices, vertex->uv.value, sizeof(Mesh::tInterleaved), 2);
 			}
 			else
-			if (attr->type == cgltf_attribute_type_normal)
-				parseGLTFBufferVector3(mesh->normals, attr->data);
-			else
-			if (attr->type == cgltf_attribute_type_texcoord)
 			{
-				if (strcmp(attr->name,"TEXCOORD_1") == 0) //secondary UV set
-					parseGLTFBufferVector2(mesh->m_uvs1, attr->data);
-				else
-					parseGLTFBufferVector2(mesh->uvs, attr->data);
+				parseGLTFStream(mesh->vertices, position, 3);
+				if (normal)
+					parseGLTFStream(mesh->normals, normal, 3);
+				if (uv)
+					parseGLTFStream(mesh->uvs, uv, 2);
 			}
 
-			if (primitive->indices && primitive->indices->count)
-				parseGLTFBufferIndices(mesh->m_indices, primitive->indices);
+			//the min and max of the integer accessors are not normalized
+			if (position->has_min && position->has_max && position->component_type == cgltf_component_type_r_32f)
+			{
+				mesh->aabb_min = position->min;
+				mesh->aabb_max = position->max;
+				mesh->box.center = (mesh->aabb_max + mesh->aabb_min) * 0.5f;
+				mesh->box.halfsize = mesh->aabb_max - mesh->box.center;
+			}
+			else
+				mesh->updateBoundingBox();
 		}
-		mesh->uploadToVRAM();
-		if (meshdata->name)
-			mesh->registerMesh(submesh_name);
+		if (uv1)
+			parseGLTFStream(mesh->m_uvs1, uv1, 2);
+
+		if (primitive->indices && primitive->indices->count)
+			parseGLTFBufferIndices(mesh->m_indices, primitive->indices);
+
+		//the authored order is rarely optimized for the caches, the .pbin stores the result and the LODs
+		if ((Mesh::optimize_meshes || Mesh::generate_lods) && primitive->type == cgltf_primitive_type_triangles)
+		{
+			std::cout << "\t\t ";
+			if (Mesh::optimize_meshes)
+				mesh->optimize();
+			if (Mesh::generate_lods)
+				mesh->generateLODs();
+			std::cout << std::endl;
+		}
+		mesh->uploadToVRAM(Mesh::quantize_vertices);
+		mesh->registerMesh(submesh_name);
 		result.push_back(mesh);
 	}
 
+	gltf_parsed_meshes[meshdata] = result;
 	return result;
 }
 
-int GLTF_TEXTURE_LAST_ID = 1;
+std::atomic<int> GLTF_TEXTURE_LAST_ID(1);
+
+//textures of the embedded images of the prefab being loaded, created by decodeGLTFImages
+thread_local std::map<cgltf_image*, Texture*> gltf_embedded_textures;
+
+struct sGLTFImageDecode {
+	cgltf_image* image;		//first image using this source
+	std::string fullpath;	//for images in files
+	Image decoded;
+	std::string source;		//file with the pixels, validates the cooked version
+	std::string binfilename; //only for the embedded images, the files use their own name
+	sMipOptions mip_options; //normalmaps, linear data and alpha tested colors are filtered differently
+	bool reused;			//the cooked file was valid, nothing to decode
+	std::shared_ptr<MappedFile> cooked; //.tbin of the image
+	float psnr;				//of the compression when cooked
+	double time;			//decode time in ms
+};
+
+//decodes all the images of the glTF in parallel before parsing the materials, images sharing a uri or a buffer view are decoded once
+void decodeGLTFImages(cgltf_data* data, const char* filename)
+{
+	gltf_embedded_textures.clear();
+	if (!load_textures || !data->images_count)
+		return;
+
+	//collect unique sources
+	std::vector<sGLTFImageDecode> decodes;
+	decodes.reserve(data->images_count); //Image cannot be copied once it has data
+	std::map<std::string, int> by_uri;
+	std::map<cgltf_buffer_view*, int> by_view;
+	std::vector<int> source(data->images_count, -1);
+	std::vector<int> image_decode(data->images_count, -1);
+	for (int i = 0; i < data->images_count; ++i)
+	{
+		cgltf_image* image = &data->images[i];
+		if (image->uri)
+		{
+			if (strncmp(image->uri, "data:", 5) == 0)
+				continue; //not supported
+			std::string fullpath = std::string(base_folder) + "/" + image->uri;
+			if (Texture::Find(fullpath.c_str()))
+				continue; //already loaded by another prefab
+			auto it = by_uri.find(fullpath);
+			if (it != by_uri.end())
+			{
+				image_decode[i] = it->second;
+				continue;
+			}
+			by_uri[fullpath] = (int)decodes.size();
+		}
+		else if (image->buffer_view && image->mime_type)
+		{
+			auto it = by_view.find(image->buffer_view);
+			if (it != by_view.end())
+			{
+				source[i] = image_decode[i] = it->second;
+				continue;
+			}
+			by_view[image->buffer_view] = (int)decodes.size();
+			source[i] = (int)decodes.size();
+		}
+		else
+			continue;
+		image_decode[i] = (int)decodes.size();
+		decodes.resize(decodes.size() + 1);
+		sGLTFImageDecode& decode = decodes.back();
+		decode.image = image;
+		decode.reused = false;
+		decode.psnr = 0;
+		decode.time = 0;
+		if (image->uri)
+			decode.source = decode.fullpath = std::string(base_folder) + "/" + image->uri;
+		else
+		{
+			//embedded images are cooked next to the file that contains them (the .bin or the .glb)
+			cgltf_buffer* buffer = image->buffer_view->buffer;
+			if (buffer->uri && strncmp(buffer->uri, "data:", 5) != 0)
+				decode.source = std::string(base_folder) + "/" + buffer->uri;
+			else
+				decode.source = filename;
+			std::stringstream ss;
+			ss << filename << ".image" << i << ".tbin";
+			decode.binfilename = ss.str();
+		}
+	}
+	if (decodes.empty())
+		return;
+
+	//the use of every image changes the mips filtering
+	auto getDecode = [&](cgltf_texture* texture) -> sGLTFImageDecode* {
+		if (!texture || !texture->image || image_decode[texture->image - data->images] == -1)
+			return NULL;
+		return &decodes[image_decode[texture->image - data->images]];
+	};
+	for (int i = 0; i < data->materials_count; ++i)
+	{
+		cgltf_material& material = data->materials[i];
+		if (sGLTFImageDecode* decode = getDecode(material.normal_texture.texture))
+			decode->mip_options.normalmap = true;
+		if (sGLTFImageDecode* decode = getDecode(material.occlusion_texture.texture))
+			decode->mip_options.srgb = false;
+		if (sGLTFImageDecode* decode = getDecode(material.pbr_metallic_roughness.metallic_roughness_texture.texture))
+			decode->mip_options.srgb = false;
+		if (material.alpha_mode == cgltf_alpha_mode_mask)
+			if (sGLTFImageDecode* decode = getDecode(material.pbr_metallic_roughness.base_color_texture.texture))
+				decode->mip_options.alpha_cutoff = material.alpha_cutoff;
+	}
+
+	//decode (cpu only, so it can run in any thread)
+	double start = getTimeHighRes();
+	JobSystem::parallelFor((int)decodes.size(), 1, [&decodes](int first, int last) {
+		for (int i = first; i < last; ++i)
+		{
+			sGLTFImageDecode& decode = decodes[i];
+			double decode_start = getTimeHighRes();
+			const char* binfilename = decode.binfilename.size() ? decode.binfilename.c_str() : NULL;
+			if (Texture::use_binary)
+				decode.cooked = Texture::readBin(decode.source.c_str(), binfilename);
+			decode.reused = decode.cooked != NULL;
+			if (!decode.cooked)
+			{
+				if (decode.fullpath.size())
+					decode.decoded.load(decode.fullpath.c_str());
+				else
+				{
+					cgltf_buffer_view* view = decode.image->buffer_view;
+					const unsigned char* view_data = cgltf_buffer_view_data(view);
+					std::vector<unsigned char> buffer(view_data, view_data + view->size);
+					if (!strcmp(decode.image->mime_type, "image/png"))
+						decode.decoded.loadPNG(buffer);
+					else if (!strcmp(decode.image->mime_type, "image/jpeg"))
+						decode.decoded.loadJPG(buffer);
+				}
+				//once cooked it is uploaded from the file, the mips are already there
+				if (decode.decoded.width && Texture::use_binary && Texture::writeBin(decode.source.c_str(), &decode.decoded, decode.mip_options, binfilename, &decode.psnr))
+					decode.cooked = Texture::readBin(decode.source.c_str(), binfilename);
+			}
+			decode.time = getTimeHighRes() - decode_start;
+		}
+	});
+	double wall_time = getTimeHighRes() - start;
+
+	//create the textures, the ones that failed are left to parseGLTFTexture (which reports the error)
+	double cpu_time = 0;
+	int num_cooked = 0;
+	float min_psnr = 0;
+	std::vector<Texture*> textures(decodes.size(), NULL);
+	for (int i = 0; i < decodes.size(); ++i)
+	{
+		sGLTFImageDecode& decode = decodes[i];
+		cpu_time += decode.time;
+		if (decode.reused)
+			num_cooked++;
+		if (decode.psnr && (!min_psnr || decode.psnr < min_psnr))
+			min_psnr = decode.psnr;
+		if (!decode.decoded.width && !decode.cooked)
+			continue;
+		Texture* tex = new Texture();
+		if (decode.cooked)
+			tex->loadFromBin(decode.cooked);
+		else
+			tex->loadFromImage(&decode.decoded, true, true, GL_UNSIGNED_BYTE, decode.mip_options);
+		if (decode.fullpath.size())
+			tex->setName(decode.fullpath.c_str());
+		textures[i] = tex;
+	}
+	for (int i = 0; i < data->images_count; ++i)
+		if (source[i] != -1 && textures[source[i]])
+			gltf_embedded_textures[&data->images[i]] = textures[source[i]];
+
+	std::cout << " + Textures decoded: " << decodes.size() - num_cooked << " cooked: " << num_cooked << " (" << data->images_count << " images) wall: " << wall_time << "ms cpu: " << cpu_time << "ms";
+	if (min_psnr)
+		std::cout << " worst PSNR: " << min_psnr << "dB";
+	std::cout << std::endl;
+}
 
 Texture* parseGLTFTexture(cgltf_image* image, const char* filename)
 {
 	if (!load_textures || !image )
 		return NULL;
 
+	//already decoded embedded image
+	auto it = gltf_embedded_textures.find(image);
+	if (it != gltf_embedded_textures.end())
+	{
+		Texture* tex = it->second;
+		if (filename && tex->filename.empty())
+		{
+			std::string fullpath = std::string(base_folder) + "/" + filename;
+			tex->setName(fullpath.c_str());
+			stdlog(std::string("\t<- TEXTURE: ") + fullpath);
+		}
+		return tex;
+	}
+
 	std::string fullpath = filename ? filename : "";
 
 	if (image->uri)
@@ -253,7 +634,7 @@ Texture* parseGLTFTexture(cgltf_image* image, const char* filename)
 		Image img;
 		std::vector<unsigned char> buffer;
 		buffer.resize(image->buffer_view->size);
-		memcpy(&buffer[0], (char*)image->buffer_view->buffer->data + image->buffer_view->offset, image->buffer_view->size);
+		memcpy(&buffer[0], cgltf_buffer_view_data(image->buffer_view), image->buffer_view->size);
 
 		if (!strcmp(image->mime_type, "image/png"))
 			img.loadPNG(buffer);
@@ -303,7 +684,7 @@ GTR::Material* parseGLTFMaterial(cgltf_material* matdata)
 	//normalmap
 	if (matdata->normal_texture.texture)
 	{
-		material->normal_texture.texture = parseGLTFTexture( matdata->normal_texture.texture->image, matdata->normal_texture.texture->name);
+		material->normal_texture.setTexture(parseGLTFTexture( matdata->normal_texture.texture->image, matdata->normal_texture.texture->name));
 		material->normal_texture.uv_channel = matdata->normal_texture.texcoord;
 	}
 
@@ -311,7 +692,7 @@ GTR::Material* parseGLTFMaterial(cgltf_material* matdata)
 	material->emissive_factor = matdata->emissive_factor;
 	if (matdata->emissive_texture.texture)
 	{
-		material->emissive_texture.texture = parseGLTFTexture(matdata->emissive_texture.texture->image, matdata->emissive_texture.texture->name);
+		material->emissive_texture.setTexture(parseGLTFTexture(matdata->emissive_texture.texture->image, matdata->emissive_texture.texture->name));
 		material->emissive_texture.uv_channel = matdata->emissive_texture.texcoord;
 	}
 
@@ -320,7 +701,7 @@ GTR::Material* parseGLTFMaterial(cgltf_material* matdata)
 	if (matdata->has_pbr_specular_glossiness)
 	{
 		if (matdata->pbr_specular_glossiness.diffuse_texture.texture)
-			material->color_texture.texture = parseGLTFTexture(matdata->pbr_specular_glossiness.diffuse_texture.texture->image, matdata->pbr_specular_glossiness.diffuse_texture.texture->name);
+			material->color_texture.setTexture(parseGLTFTexture(matdata->pbr_specular_glossiness.diffuse_texture.texture->image, matdata->pbr_specular_glossiness.diffuse_texture.texture->name));
 	}
 	if (matdata->has_pbr_metallic_roughness)
 	{
@@ -332,12 +713,12 @@ GTR::Material* parseGLTFMaterial(cgltf_material* matdata)
 		{
 			if (matdata->pbr_metallic_roughness.base_color_texture.texture)
 			{
-				material->color_texture.texture = parseGLTFTexture(matdata->pbr_metallic_roughness.base_color_texture.texture->image, matdata->pbr_metallic_roughness.base_color_texture.texture->name);
+				material->color_texture.setTexture(parseGLTFTexture(matdata->pbr_metallic_roughness.base_color_texture.texture->image, matdata->pbr_metallic_roughness.base_color_texture.texture->name));
 				material->color_texture.uv_channel = matdata->pbr_metallic_roughness.base_color_texture.texcoord;
 			}
 			if (matdata->pbr_metallic_roughness.metallic_roughness_texture.texture)
 			{
-				material->metallic_roughness_texture.texture = parseGLTFTexture(matdata->pbr_metallic_roughness.metallic_roughness_texture.texture->image, matdata->pbr_metallic_roughness.metallic_roughness_texture.texture->name);
+				material->metallic_roughness_texture.setTexture(parseGLTFTexture(matdata->pbr_metallic_roughness.metallic_roughness_texture.texture->image, matdata->pbr_metallic_roughness.metallic_roughness_texture.texture->name));
 				material->metallic_roughness_texture.uv_channel = matdata->pbr_metallic_roughness.metallic_roughness_texture.texcoord;
 			}
 		}
@@ -345,7 +726,7 @@ GTR::Material* parseGLTFMaterial(cgltf_material* matdata)
 
 	if (matdata->occlusion_texture.texture)
 	{
-		material->occlusion_texture.texture = parseGLTFTexture(matdata->occlusion_texture.texture->image, matdata->occlusion_texture.texture->name);
+		material->occlusion_texture.setTexture(parseGLTFTexture(matdata->occlusion_texture.texture->image, matdata->occlusion_texture.texture->name));
 		material->occlusion_texture.uv_channel = matdata->occlusion_texture.texcoord;
 	}
 
@@ -384,7 +765,9 @@ GTR::Node* parseGLTFNode(cgltf_node* node, GTR::Node* scenenode = NULL)
 
     stdlog("\t\t* prefab node: " + scenenode->name );
 
-	parseGLTFTransform(node, scenenode->model);
+	Matrix44 node_model;
+	parseGLTFTransform(node, node_model);
+	scenenode->model = node_model;
 
     if (node->mesh)
 	{
@@ -397,29 +780,23 @@ GTR::Node* parseGLTFNode(cgltf_node* node, GTR::Node* scenenode = NULL)
 			for (int i = 0; i < node->mesh->primitives_count; ++i)
 			{
 				GTR::Node* subnode = new GTR::Node();
-				subnode->mesh = meshes[i];
+				subnode->setMesh(meshes[i]);
 				if (node->mesh->primitives[i].material)
-					subnode->material = parseGLTFMaterial(node->mesh->primitives[i].material);
+					subnode->setMaterial(parseGLTFMaterial(node->mesh->primitives[i].material));
 				scenenode->addChild(subnode);
 			}
 		}
 		else //single primitive
 		{
-			if (node->mesh->name)
-				scenenode->mesh = Mesh::Get(node->mesh->name, true);
-
-			if (!scenenode->mesh)
-			{
-				std::vector<Mesh*> meshes;
-				meshes = parseGLTFMesh(node->mesh);
-				//printf("Parsed GLTF mesh %s (success)\n", node->name);
-				//return nullptr;
-				if(meshes.size())
-					scenenode->mesh = meshes[0];
-			}
+			std::vector<Mesh*> meshes;
+			meshes = parseGLTFMesh(node->mesh);
+			//printf("Parsed GLTF mesh %s (success)\n", node->name);
+			//return nullptr;
+			if(meshes.size())
+				scenenode->setMesh(meshes[0]);
 
 			if (node->mesh->primitives->material)
-				scenenode->material = parseGLTFMaterial(node->mesh->primitives->material);
+				scenenode->setMaterial(parseGLTFMaterial(node->mesh->primitives->material));
 		}
 	}
 
@@ -429,31 +806,52 @@ GTR::Node* parseGLTFNode(cgltf_node* node, GTR::Node* scenenode = NULL)
 	return scenenode;
 }
 
+//the files read by cgltf are mapped instead of copied: the .gltf or .glb is parsed from the mapping and the buffers
+//(the .bin files and the bin chunk of the .glb) are used from it until cgltf_free releases them
+thread_local std::map<void*, std::shared_ptr<MappedFile>> gltf_mapped_files;
+
 cgltf_result internalOpenFile(const struct cgltf_memory_options* memory_options, const struct cgltf_file_options* file_options, const char* path, cgltf_size* size, void** data)
 {
 	stdlog(std::string(" <- ") + path);
-    std::vector<unsigned char> buffer;
-    if (!readFileBin(path, buffer))
-        return cgltf_result_file_not_found;
-    *size = buffer.size();
-    char* file_data = new char[*size];
-    memcpy(file_data, &buffer[0], *size);
-    *data = file_data;
-    return cgltf_result_success;
+	std::shared_ptr<MappedFile> file(new MappedFile());
+	if (!file->open(path))
+		return cgltf_result_file_not_found;
+	*size = file->size;
+	*data = file->data;
+	gltf_mapped_files[file->data] = file;
+	return cgltf_result_success;
 }
 
-std::vector<unsigned char> g_buffer;
-
-cgltf_result internalOpenMemory(const struct cgltf_memory_options* memory_options, const struct cgltf_file_options* file_options, const char* path, cgltf_size* size, void** data)
+void internalReleaseFile(const struct cgltf_memory_options* memory_options, const struct cgltf_file_options* file_options, void* data)
 {
-	stdlog(std::string(" <- ") + path);
-	*size = g_buffer.size();
-	char* file_data = new char[*size];
-	memcpy(file_data, &g_buffer[0], *size);
-	*data = file_data;
-
-	g_buffer.clear();
+	auto it = gltf_mapped_files.find(data);
+	if (it != gltf_mapped_files.end())
+	{
+		gltf_mapped_files.erase(it); //unmaps it
+		return;
+	}
+	//the base64 buffers are allocated by cgltf
+	if (memory_options->free)
+		memory_options->free(memory_options->user_data, data);
+	else
+		free(data);
+}
 
+//like cgltf_parse_file, but a failed parse releases the mapping (cgltf would free it)
+cgltf_result parseGLTFFile(cgltf_options& options, const char* filename, cgltf_data** data)
+{
+	cgltf_size size = 0;
+	void* file_data = NULL;
+	cgltf_result result = internalOpenFile(&options.memory, &options.file, filename, &size, &file_data);
+	if (result != cgltf_result_success)
+		return result;
+	result = cgltf_parse(&options, file_data, size, data);
+	if (result != cgltf_result_success)
+	{
+		internalReleaseFile(&options.memory, &options.file, file_data);
+		return result;
+	}
+	(*data)->file_data = file_data;
 	return cgltf_result_success;
 }
 
@@ -477,10 +875,24 @@ GTR::Prefab* loadGLTF(const char *filename, cgltf_data *data, cgltf_options& opt
 		result = cgltf_load_buffers(&options, data, filename);
 		if (result != cgltf_result_success) {
 			stdlog(std::string("[BIN NOT FOUND]:") + filename);
+			cgltf_free(data);
 			return NULL;
 		}
 	}
 
+	if (!decodeGLTFMeshopt(data))
+	{
+		std::cout << "[ERROR] corrupted meshopt buffer views: " << filename << std::endl;
+		cgltf_free(data);
+		return NULL;
+	}
+
+	decodeGLTFImages(data, filename);
+
+	gltf_data = data;
+	gltf_filename = filename;
+	gltf_parsed_meshes.clear();
+
 	GTR::Prefab* prefab = new GTR::Prefab();
 
 	{
@@ -522,6 +934,9 @@ GTR::Prefab* loadGLTF(const char *filename, cgltf_data *data, cgltf_options& opt
 	prefab->updateBounding();
 
 	//frees all data, including bin
+	gltf_embedded_textures.clear();
+	gltf_parsed_meshes.clear();
+	gltf_data = NULL;
 	cgltf_free(data);
 
     stdlog( std::string(" - Loaded ") + filename );
@@ -535,9 +950,11 @@ GTR::Prefab* loadGLTF(const std::vector<unsigned char>& dat, const std::string&
 	memset(&options, 0, sizeof(cgltf_options));
 	cgltf_data *data = NULL;
 
-	g_buffer = dat;
-	options.file.read = internalOpenMemory;
-	cgltf_result result = cgltf_parse_file(&options, path.c_str(), &data);
+	options.file.read = internalOpenFile; //for the external buffers
+	options.file.release = internalReleaseFile;
+
+	//parsed in place, dat outlives the cgltf_data (freed at the end of loadGLTF)
+	cgltf_result result = dat.size() ? cgltf_parse(&options, &dat[0], dat.size(), &data) : cgltf_result_data_too_short;
 
 	if (result != cgltf_result_success) {
 		std::cout << "[NOT FOUND]" << std::endl;
@@ -555,7 +972,8 @@ GTR::Prefab* loadGLTF(const char* filename)
 
 	{
 		options.file.read = internalOpenFile;
-		cgltf_result result = cgltf_parse_file(&options, filename, &data);
+		options.file.release = internalReleaseFile;
+		cgltf_result result = parseGLTFFile(options, filename, &data);
 
 		if (result != cgltf_result_success) {
 			std::cout << "[NOT FOUND]" << std::endl;
@@ -0,0 +1,254 @@
+#include "impostor.h"
+
+#include "includes.h"
+#include "prefab.h"
+#include "material.h"
+#include "mesh.h"
+#include "fbo.h"
+#include "texture.h"
+#include "shader.h"
+#include "camera.h"
+#include "assetmanager.h"
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+using namespace GTR;
+
+const int IMPOSTOR_COLUMNS = 8; //yaw steps around the prefab
+const int IMPOSTOR_ROWS = 3; //elevation steps, from the horizon up
+const float IMPOSTOR_ROW_ANGLE = 30.0f * DEG2RAD;
+const int IMPOSTOR_TILE_SIZE = 128; //pixels of every capture
+
+//direction from the center of the prefab to the camera of a capture, in prefab space
+static Vector3 getCaptureDirection(int column, int row)
+{
+	float yaw = column * 2.0f * PI / IMPOSTOR_COLUMNS;
+	float elevation = row * IMPOSTOR_ROW_ANGLE;
+	return Vector3(cos(elevation) * sin(yaw), sin(elevation), cos(elevation) * cos(yaw));
+}
+
+//right and up of a capture, the elevations never reach the vertical
+static void getCaptureBasis(const Vector3& direction, Vector3& right, Vector3& up)
+{
+	right = normalize(cross(Vector3(0, 1, 0), direction));
+	up = cross(direction, right);
+}
+
+static void gatherNodes(Node* node, std::vector<Node*>& nodes)
+{
+	if (!node->visible)
+		return;
+	if (node->mesh && node->material)
+		nodes.push_back(node);
+	for (int i = 0; i < node->children.size(); ++i)
+		gatherNodes(node->children[i], nodes);
+}
+
+Impostor::Impostor(Prefab* prefab)
+{
+	this->prefab = prefab;
+	fbo = NULL;
+	radius = 0;
+	baked_version = 0;
+	baked = false;
+	batch = new Mesh();
+}
+
+Impostor::~Impostor()
+{
+	if (fbo)
+		delete fbo;
+	delete batch;
+}
+
+bool Impostor::isReady()
+{
+	return baked && baked_version == prefab->transform_version;
+}
+
+bool Impostor::bake()
+{
+	assert(glGetError() == GL_NO_ERROR);
+	baked = false;
+
+	//the async prefabs receive their nodes later and the meshes and textures can still be loading, the captures would miss them
+	std::vector<Node*> nodes;
+	gatherNodes(&prefab->root, nodes);
+	if (!nodes.size())
+		return false;
+	bool loading = false;
+	for (int i = 0; i < nodes.size(); ++i)
+	{
+		AssetManager::use(nodes[i]->mesh); //reloads it if it was evicted
+		AssetManager::use(nodes[i]->material);
+		if (!nodes[i]->mesh->getNumVertices())
+			loading = true;
+		Material* material = nodes[i]->material;
+		Texture* textures[] = { material->color_texture.texture, material->metallic_roughness_texture.texture, material->normal_texture.texture };
+		for (int j = 0; j < 3; ++j)
+		{
+			AssetManager::use(textures[j]);
+			if (textures[j] && (textures[j]->placeholder || textures[j]->evicted))
+				loading = true;
+		}
+	}
+	if (loading)
+		return false;
+
+	Shader* shader = Shader::Get("impostor_bake");
+	if (!shader)
+		return false;
+
+	prefab->updateTransforms();
+	center = prefab->bounding.center;
+	radius = (float)prefab->bounding.halfsize.length();
+	if (radius <= 0)
+		return false;
+
+	if (!fbo)
+	{
+		fbo = new FBO();
+		fbo->create(IMPOSTOR_COLUMNS * IMPOSTOR_TILE_SIZE, IMPOSTOR_ROWS * IMPOSTOR_TILE_SIZE, 2, GL_RGBA, GL_UNSIGNED_BYTE, true);
+		//the captures are minified on screen
+		for (int i = 0; i < 2; ++i)
+		{
+			Texture* texture = fbo->color_textures[i];
+			glBindTexture(texture->texture_type, texture->texture_id);
+			glTexParameteri(texture->texture_type, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(texture->texture_type, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	float clear_color[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
+
+	fbo->bind();
+	glClearColor(0, 0, 0, 0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+
+	shader->enable();
+	Camera camera;
+	for (int row = 0; row < IMPOSTOR_ROWS; ++row)
+		for (int column = 0; column < IMPOSTOR_COLUMNS; ++column)
+		{
+			glViewport(column * IMPOSTOR_TILE_SIZE, row * IMPOSTOR_TILE_SIZE, IMPOSTOR_TILE_SIZE, IMPOSTOR_TILE_SIZE);
+
+			//orthographic around the bounding sphere, the depth goes from its front (0) to its back (1)
+			Vector3 direction = getCaptureDirection(column, row);
+			Vector3 right, up;
+			getCaptureBasis(direction, right, up);
+			camera.lookAt(center + direction * (radius * 2.0f), center, Vector3(0, 1, 0));
+			camera.setOrthographic(-radius, radius, -radius, radius, radius, radius * 3.0f);
+
+			shader->setUniform("u_viewprojection", camera.viewprojection_matrix);
+			shader->setUniform("u_impostor_right", right);
+			shader->setUniform("u_impostor_up", up);
+			shader->setUniform("u_impostor_direction", direction);
+
+			for (int i = 0; i < nodes.size(); ++i)
+			{
+				Node* node = nodes[i];
+				Material* material = node->material;
+
+				Texture* color_texture = material->color_texture.texture;
+				if (!color_texture)
+					color_texture = Texture::getWhiteTexture();
+				Texture* metallic_roughness_texture = material->metallic_roughness_texture.texture;
+				if (!metallic_roughness_texture)
+					metallic_roughness_texture = Texture::getWhiteTexture();
+				Texture* normal_texture = material->normal_texture.texture;
+				int normalmap_flag = normal_texture ? 1 : 0;
+				if (!normal_texture)
+					normal_texture = Texture::getWhiteTexture();
+
+				if (material->two_sided)
+					glDisable(GL_CULL_FACE);
+				else
+					glEnable(GL_CULL_FACE);
+
+				shader->setUniform("u_model", node->getGlobalMatrix().toMatrix44());
+				shader->setUniform("u_color", material->color);
+				shader->setUniform("u_texture", color_texture, 0);
+				shader->setUniform("u_metallic_roughness_texture", metallic_roughness_texture, 1);
+				shader->setUniform("u_normalmap_texture", normal_texture, 2);
+				shader->setUniform("u_normalmap_flag", normalmap_flag);
+				shader->setUniform("u_alpha_cutoff", material->alpha_mode == GTR::eAlphaMode::MASK ? material->alpha_cutoff : 0);
+				shader->setUniform("u_blend", material->alpha_mode == GTR::eAlphaMode::BLEND ? 1 : 0);
+
+				node->mesh->render(GL_TRIANGLES);
+			}
+		}
+	shader->disable();
+
+	fbo->unbind();
+	glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+
+	baked = true;
+	baked_version = prefab->transform_version;
+	return true;
+}
+
+void Impostor::addInstance(const Matrix44& model, Camera* camera)
+{
+	//the axes of the model can be scaled, the quad covers the sphere with the largest scale
+	Vector3 axis_x = Vector3(model.m[0], model.m[1], model.m[2]);
+	Vector3 axis_y = Vector3(model.m[4], model.m[5], model.m[6]);
+	Vector3 axis_z = Vector3(model.m[8], model.m[9], model.m[10]);
+	float scale = (float)std::max(axis_x.length(), std::max(axis_y.length(), axis_z.length()));
+	axis_x.normalize();
+	axis_y.normalize();
+	axis_z.normalize();
+
+	//the view direction in prefab space chooses the capture
+	Vector3 world_center = model * center;
+	Vector3 to_eye = camera->eye - world_center;
+	Vector3 view = normalize(Vector3(dot(to_eye, axis_x), dot(to_eye, axis_y), dot(to_eye, axis_z)));
+	float yaw = atan2(view.x, view.z);
+	float elevation = asin(clamp(view.y, -1.0f, 1.0f));
+	int column = (int)floor(yaw * IMPOSTOR_COLUMNS / (2.0f * PI) + 0.5f);
+	column = ((column % IMPOSTOR_COLUMNS) + IMPOSTOR_COLUMNS) % IMPOSTOR_COLUMNS;
+	int row = std::max(0, std::min((int)floor(elevation / IMPOSTOR_ROW_ANGLE + 0.5f), IMPOSTOR_ROWS - 1));
+
+	//the quad lies in the plane of the capture through the center, facing its camera
+	Vector3 direction = getCaptureDirection(column, row);
+	Vector3 right, up;
+	getCaptureBasis(direction, right, up);
+	Vector3 world_direction = normalize(axis_x * direction.x + axis_y * direction.y + axis_z * direction.z);
+	Vector3 world_right = normalize(axis_x * right.x + axis_y * right.y + axis_z * right.z);
+	Vector3 world_up = normalize(cross(world_direction, world_right));
+	float world_radius = radius * scale;
+
+	static const float corners[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+	unsigned int first = (unsigned int)batch->vertices.size();
+	for (int i = 0; i < 4; ++i)
+	{
+		float x = corners[i][0];
+		float y = corners[i][1];
+		batch->vertices.push_back(world_center + (world_right * x + world_up * y) * world_radius);
+		batch->uvs.push_back(Vector2((column + x * 0.5f + 0.5f) / IMPOSTOR_COLUMNS, (row + y * 0.5f + 0.5f) / IMPOSTOR_ROWS));
+		batch->normals.push_back(world_direction * world_radius); //depth axis of the capture
+		batch->colors.push_back(Vector4(world_right.x, world_right.y, world_right.z, 0.0f));
+	}
+	static const unsigned int quad[6] = { 0, 1, 2, 0, 2, 3 };
+	for (int i = 0; i < 6; ++i)
+		batch->m_indices.push_back(first + quad[i]);
+}
+
+int Impostor::getNumInstances()
+{
+	return (int)batch->vertices.size() / 4;
+}
+
+void Impostor::clearBatch()
+{
+	batch->vertices.clear();
+	batch->uvs.clear();
+	batch->normals.clear();
+	batch->colors.clear();
+	batch->m_indices.clear();
+}
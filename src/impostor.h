@@ -0,0 +1,47 @@
+#pragma once
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include "framework.h"
+
+//forward declarations
+class Mesh;
+class FBO;
+class Camera;
+
+namespace GTR {
+
+	class Prefab;
+
+	//Billboard captures of a prefab from IMPOSTOR_COLUMNS x IMPOSTOR_ROWS directions around it (yaw and elevation),
+	//rendered once into the tiles of an atlas. The distant instances are drawn as quads showing the capture closest
+	//to their view direction, all the quads of a prefab in one draw call, lit with the captured normals and with
+	//their depth rebuilt from the captured one.
+	class Impostor {
+	public:
+		Prefab* prefab;
+		FBO* fbo; //color 0: albedo and alpha, color 1: normal (in the basis of the capture) and occlusion, depth
+		Vector3 center; //bounding sphere of the prefab, in prefab space
+		float radius;
+		unsigned int baked_version; //transform_version of the prefab when it was captured
+		bool baked;
+
+		Mesh* batch; //quads of the instances of this frame in world space, from the vectors (no VBO)
+
+		Impostor(Prefab* prefab);
+		~Impostor();
+
+		//the captures match the current nodes of the prefab
+		bool isReady();
+		//renders the captures (GL, main thread), false if the prefab or its meshes are still loading
+		bool bake();
+
+		//adds the quad of an instance with the capture closest to the camera
+		void addInstance(const Matrix44& model, Camera* camera);
+		int getNumInstances();
+		void clearBatch();
+	};
+
+};
+
+#endif
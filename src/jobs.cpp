@@ -0,0 +1,283 @@
+#include "jobs.h"
+#include "utils.h"
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <iostream>
+#include <cmath>
+
+struct sQueuedJob {
+	JobSystem::Job job;
+	JobCounter* counter;
+};
+
+//one per thread (index 0 is the main thread), protected by its own mutex so stealing only blocks one queue
+struct sJobQueue {
+	std::mutex mutex;
+	std::deque<sQueuedJob> jobs;
+};
+
+static std::vector<std::thread*> workers;
+static sJobQueue* queues = NULL;
+static sJobQueue* load_queues = NULL; //jobs launched inside the background jobs, the main thread never takes them
+static int num_queues = 0;
+static sJobQueue background_queue; //only taken by the idle workers
+static std::atomic<bool> running(false);
+static std::atomic<int> queued_jobs(0);
+static std::atomic<int> load_jobs(0);
+static std::atomic<int> background_jobs(0);
+static std::atomic<int> sleeping_workers(0);
+static std::mutex sleep_mutex;
+static std::condition_variable wake_condition;
+static thread_local int thread_index = 0;
+static thread_local bool in_background = false; //executing a background job or one of its jobs
+
+//takes a job from the own queue (newest first) or steals from another one (oldest first)
+static bool popJob(sJobQueue* queues, int index, sQueuedJob& result)
+{
+	{
+		sJobQueue& queue = queues[index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty())
+		{
+			result = std::move(queue.jobs.back());
+			queue.jobs.pop_back();
+			return true;
+		}
+	}
+	for (int i = 1; i < num_queues; ++i)
+	{
+		sJobQueue& queue = queues[(index + i) % num_queues];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty())
+		{
+			result = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+//load is true for the queues of the jobs launched by the background jobs (the decodes of a load)
+static bool executeJob(int index, bool load)
+{
+	std::atomic<int>& count = load ? load_jobs : queued_jobs;
+	if (count.load(std::memory_order_relaxed) == 0)
+		return false;
+	sQueuedJob job;
+	if (!popJob(load ? load_queues : queues, index, job))
+		return false;
+	count--;
+	bool was_background = in_background;
+	in_background = load; //so the jobs it launches go to the same queues
+	job.job();
+	in_background = was_background;
+	if (job.counter)
+		job.counter->pending.fetch_sub(1, std::memory_order_release);
+	return true;
+}
+
+static bool executeBackgroundJob()
+{
+	if (background_jobs.load(std::memory_order_relaxed) == 0)
+		return false;
+	JobSystem::Job job;
+	{
+		std::lock_guard<std::mutex> lock(background_queue.mutex);
+		if (background_queue.jobs.empty())
+			return false;
+		job = std::move(background_queue.jobs.front().job);
+		background_queue.jobs.pop_front();
+	}
+	background_jobs--;
+	in_background = true;
+	job();
+	in_background = false;
+	return true;
+}
+
+static bool hasJobs()
+{
+	return queued_jobs.load(std::memory_order_relaxed) > 0 || load_jobs.load(std::memory_order_relaxed) > 0 || background_jobs.load(std::memory_order_relaxed) > 0;
+}
+
+static void workerLoop(int index)
+{
+	thread_index = index;
+	while (running)
+	{
+		//the frame jobs first, then the ones of the loads already started, a new background job can take long
+		if (executeJob(index, false) || executeJob(index, true) || executeBackgroundJob())
+			continue;
+
+		//spin a little before sleeping, jobs usually come in bursts during the frame
+		bool found = false;
+		for (int i = 0; i < 64 && !found; ++i)
+		{
+			std::this_thread::yield();
+			found = hasJobs();
+		}
+		if (found)
+			continue;
+
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		sleeping_workers++;
+		wake_condition.wait(lock, []() { return hasJobs() || !running; });
+		sleeping_workers--;
+	}
+}
+
+static void wakeWorker()
+{
+	if (sleeping_workers > 0)
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		wake_condition.notify_one();
+	}
+}
+
+void JobSystem::init(int num_threads)
+{
+	if (running)
+		return;
+	if (num_threads <= 0)
+		num_threads = (int)std::thread::hardware_concurrency() - 1;
+	if (num_threads < 1)
+		num_threads = 1;
+
+	num_queues = num_threads + 1;
+	queues = new sJobQueue[num_queues];
+	load_queues = new sJobQueue[num_queues];
+	running = true;
+	for (int i = 1; i < num_queues; ++i)
+		workers.push_back(new std::thread(workerLoop, i));
+	std::cout << " + Job system: " << num_threads << " worker threads" << std::endl;
+}
+
+void JobSystem::release()
+{
+	if (!running)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		running = false;
+	}
+	wake_condition.notify_all();
+	for (int i = 0; i < workers.size(); ++i)
+	{
+		workers[i]->join();
+		delete workers[i];
+	}
+	workers.clear();
+	background_queue.jobs.clear(); //the loads not started are dropped
+	background_jobs = 0;
+	delete[] queues;
+	delete[] load_queues;
+	queues = load_queues = NULL;
+	queued_jobs = load_jobs = 0;
+	num_queues = 0;
+}
+
+bool JobSystem::isReady()
+{
+	return running;
+}
+
+int JobSystem::getNumThreads()
+{
+	return num_queues ? num_queues : 1;
+}
+
+int JobSystem::getThreadIndex()
+{
+	return thread_index;
+}
+
+void JobSystem::run(const Job& job, JobCounter* counter)
+{
+	if (!running)
+	{
+		job();
+		return;
+	}
+
+	if (counter)
+		counter->pending++;
+	{
+		sJobQueue& queue = (in_background ? load_queues : queues)[thread_index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		sQueuedJob queued = { job, counter };
+		queue.jobs.push_back(std::move(queued));
+	}
+	(in_background ? load_jobs : queued_jobs)++;
+	wakeWorker();
+}
+
+void JobSystem::runBackground(const Job& job)
+{
+	if (!running)
+	{
+		job();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(background_queue.mutex);
+		sQueuedJob queued = { job, NULL };
+		background_queue.jobs.push_back(std::move(queued));
+	}
+	background_jobs++;
+	wakeWorker();
+}
+
+void JobSystem::wait(JobCounter* counter)
+{
+	//the main thread (and the frame jobs) only help with frame jobs, a load waits for its own jobs
+	while (!counter->isDone())
+	{
+		if (!running || !(executeJob(thread_index, in_background) || (in_background && executeJob(thread_index, false))))
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::benchmark()
+{
+	std::cout << " + Job system benchmark (" << getNumThreads() << " threads)" << std::endl;
+
+	//overhead: empty jobs
+	const int num_jobs = 100000;
+	JobCounter counter;
+	double start = getTimeHighRes();
+	for (int i = 0; i < num_jobs; ++i)
+		run([]() {}, &counter);
+	wait(&counter);
+	double time = getTimeHighRes() - start;
+	std::cout << "\t empty jobs: " << num_jobs << " in " << time << "ms, " << (time * 1000.0 / num_jobs) << "us per job" << std::endl;
+
+	//scaling: independent work split in chunks
+	const int count = 1 << 22;
+	std::vector<float> data(count);
+	auto work = [&data](int start, int end) {
+		for (int i = start; i < end; ++i)
+			data[i] = sqrtf((float)i) * sinf((float)i);
+	};
+	start = getTimeHighRes();
+	work(0, count);
+	double serial = getTimeHighRes() - start;
+	start = getTimeHighRes();
+	parallelFor(count, count / (getNumThreads() * 8), work);
+	double parallel = getTimeHighRes() - start;
+	std::cout << "\t parallelFor " << count << " items: serial " << serial << "ms, parallel " << parallel << "ms, speedup x" << (serial / parallel) << std::endl;
+
+	//small per frame task
+	const int frames = 1000;
+	start = getTimeHighRes();
+	for (int f = 0; f < frames; ++f)
+		parallelFor(1024, 64, work);
+	time = getTimeHighRes() - start;
+	std::cout << "\t parallelFor 1024 items (16 jobs): " << (time * 1000.0 / frames) << "us per call" << std::endl;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <cstddef>
+#include <atomic>
+#include <functional>
+
+//counts the jobs that are still pending, jobs launched with a counter decrement it when they finish
+//use it as a dependency: JobSystem::wait(&counter) before using the results
+struct JobCounter {
+	std::atomic<int> pending;
+	JobCounter() : pending(0) {}
+	bool isDone() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+//Work-stealing thread pool: every worker owns a queue, takes jobs from its back and
+//steals from the front of the others when empty. The threads that wait for a counter
+//execute jobs meanwhile, so jobs can launch and wait for other jobs without deadlocks.
+//Long jobs (asset loads) go to a separate background queue that only the idle workers
+//take, never a wait, so they cannot stall the per frame jobs of the main thread. The jobs
+//launched inside them (parallelFor of a decode) go to other queues the main thread never takes.
+class JobSystem {
+public:
+	typedef std::function<void()> Job;
+
+	//num_threads is the number of workers (0 = one less than the number of cores)
+	static void init(int num_threads = 0);
+	static void release();
+	static bool isReady();
+	static int getNumThreads(); //workers + the main thread
+	static int getThreadIndex(); //0 for the main thread (and any thread not owned by the pool)
+
+	//launch a job, if the system is not initialized it is executed immediately
+	static void run(const Job& job, JobCounter* counter = NULL);
+	//launch a long job in the background queue, executed immediately if the system is not initialized
+	static void runBackground(const Job& job);
+	//blocks until the counter reaches zero, executing pending jobs meanwhile (not background ones, nor their jobs in the main thread)
+	static void wait(JobCounter* counter);
+
+	//calls func(start, end) for chunks of [0, count), at most grain elements per chunk
+	template<typename T>
+	static void parallelFor(int count, int grain, const T& func)
+	{
+		if (count <= 0)
+			return;
+		if (grain < 1)
+			grain = 1;
+		if (count <= grain || !isReady())
+		{
+			func(0, count);
+			return;
+		}
+		JobCounter counter;
+		//the first chunk is executed by this thread
+		for (int start = grain; start < count; start += grain)
+		{
+			int end = start + grain < count ? start + grain : count;
+			run([&func, start, end]() { func(start, end); }, &counter);
+		}
+		func(0, grain);
+		wait(&counter);
+	}
+
+	//measures the overhead per job and the scaling of a parallelFor, shows the results in the console
+	static void benchmark();
+};
+
+#endif
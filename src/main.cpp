@@ -15,6 +15,7 @@
 #include "utils.h"
 #include "input.h"
 #include "application.h"
+#include "jobs.h"
 
 #include <iostream> //to output
 
@@ -252,6 +253,7 @@ int main(int argc, char **argv)
 
 	//save state and free memory
 	// Cleanup
+	JobSystem::release();
 	#ifndef SKIP_IMGUI
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplSDL2_Shutdown();
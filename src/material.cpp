@@ -3,14 +3,25 @@
 
 #include "includes.h"
 #include "texture.h"
+#include "asyncloader.h"
 
 using namespace GTR;
 
 std::map<std::string, Material*> Material::sMaterials;
 
+void Sampler::setTexture(Texture* texture)
+{
+	if (texture)
+		texture->addRef();
+	if (this->texture)
+		this->texture->release();
+	this->texture = texture;
+}
+
 Material* Material::Get(const char* name)
 {
 	assert(name);
+	std::lock_guard<std::recursive_mutex> lock(AsyncLoader::manager_mutex);
 	std::map<std::string, Material*>::iterator it = sMaterials.find(name);
 	if (it != sMaterials.end())
 		return it->second;
@@ -19,6 +30,7 @@ Material* Material::Get(const char* name)
 
 void Material::registerMaterial(const char* name)
 {
+	std::lock_guard<std::recursive_mutex> lock(AsyncLoader::manager_mutex);
 	this->name = name;
 	sMaterials[name] = this;
 
@@ -32,8 +44,16 @@ void Material::registerMaterial(const char* name)
 
 Material::~Material()
 {
+	color_texture.setTexture(NULL);
+	emissive_texture.setTexture(NULL);
+	opacity_texture.setTexture(NULL);
+	metallic_roughness_texture.setTexture(NULL);
+	occlusion_texture.setTexture(NULL);
+	normal_texture.setTexture(NULL);
+
 	if (name.size())
 	{
+		std::lock_guard<std::recursive_mutex> lock(AsyncLoader::manager_mutex);
 		auto it = sMaterials.find(name);
 		if (it != sMaterials.end())
 			sMaterials.erase(it);
@@ -42,6 +62,7 @@ Material::~Material()
 
 void Material::Release()
 {
+	std::lock_guard<std::recursive_mutex> lock(AsyncLoader::manager_mutex);
 	std::vector<Material *>mats;
 
 	for (auto mp : sMaterials)
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "framework.h"
+#include "assetmanager.h"
 #include <cassert>
 #include <map>
 #include <string>
@@ -32,10 +33,11 @@ namespace GTR {
 		int uv_channel;
 
 		Sampler() { texture = NULL; uv_channel = 0; }
+		void setTexture(Texture* texture); //keeps a reference
 	};
 
 	//this class contains all info relevant of how something must be rendered
-	class Material {
+	class Material : public Asset {
 	public:
 		//static manager to reuse materials
 		static std::map<std::string, Material*> sMaterials;
@@ -68,7 +70,7 @@ namespace GTR {
 		Material() : alpha_mode(NO_ALPHA), alpha_cutoff(0.5), color(1, 1, 1, 1), _zMin(0.0f), _zMax(1.0f), two_sided(false), roughness_factor(1), metallic_factor(0) {
 			//color_texture = emissive_texture = metallic_roughness_texture = occlusion_texture = normal_texture = NULL;
 		}
-		Material(Texture* texture) : Material() { color_texture.texture = texture; }
+		Material(Texture* texture) : Material() { color_texture.setTexture(texture); }
 		virtual ~Material();
 
 		static void Release();
@@ -1,5 +1,5 @@
 #include "mesh.h"
-#include "extra/textparser.h"
+#include "textscanner.h"
 #include "utils.h"
 #include "shader.h"
 #include "includes.h"
@@ -12,16 +12,26 @@
 
 #include "camera.h"
 #include "texture.h"
+#include "drawcapture.h"
+#include "asyncloader.h"
+#include "jobs.h"
+#include "meshoptimizer.h"
 //#include "animation.h"
 #include "extra/coldet/coldet.h"
 
 //#include "engine/application.h"
 
-bool Mesh::use_binary = false;			//checks if there is .wbin, it there is one tries to read it instead of the other file
+bool Mesh::use_binary = true;			//checks if there is .mbin, it there is one tries to read it instead of the other file
 bool Mesh::auto_upload_to_vram = true;	//uploads the mesh to the GPU VRAM to speed up rendering
 bool Mesh::interleave_meshes = true;	//places the geometry in an interleaved array
+bool Mesh::use_mapped_bin = true;		//uploads the .mbin streams from the mapped file without copying them
+bool Mesh::quantize_vertices = true;	//half the vertex memory in VRAM, the shaders must decode it (see basic.vs)
+bool Mesh::optimize_meshes = true;		//the .mbin stores the optimized mesh, so it is only done once
+bool Mesh::optimize_stats = false;		//the overdraw is rasterized from 6 directions, some ms per mesh
+bool Mesh::generate_lods = true;		//stored in the .mbin too, the renderer picks them by the size on screen
 
 std::map<std::string, Mesh*> Mesh::sMeshesLoaded;
+unsigned int Mesh::data_version = 0;
 long Mesh::num_meshes_rendered = 0;
 long Mesh::num_triangles_rendered = 0;
 
@@ -33,6 +43,7 @@ long Mesh::num_triangles_rendered = 0;
 Mesh::Mesh()
 {
 	radius = 0;
+	uv_density = -1;
 	vertices_vbo_id = uvs_vbo_id = uvs1_vbo_id = normals_vbo_id = colors_vbo_id = interleaved_vbo_id = indices_vbo_id = bones_vbo_id = weights_vbo_id = 0;
 	collision_model = NULL;
 
@@ -42,6 +53,15 @@ Mesh::Mesh()
 Mesh::~Mesh()
 {
 	clear();
+
+	//the AssetManager deletes the unreferenced ones
+	if (name.size())
+	{
+		std::lock_guard<std::recursive_mutex> lock(AsyncLoader::manager_mutex);
+		auto it = sMeshesLoaded.find(name);
+		if (it != sMeshesLoaded.end() && it->second == this)
+			sMeshesLoaded.erase(it);
+	}
 }
 
 
@@ -91,6 +111,8 @@ void Mesh::clear()
 
 	//VBOs ids
 	vertices_vbo_id = uvs_vbo_id = normals_vbo_id = colors_vbo_id = interleaved_vbo_id = indices_vbo_id = weights_vbo_id = bones_vbo_id = uvs1_vbo_id = 0;
+	quantized = false;
+	indices_type = GL_UNSIGNED_INT;
 
 	//buffers
 	vertices.clear();
@@ -98,13 +120,19 @@ void Mesh::clear()
 	uvs.clear();
 	colors.clear();
 	interleaved.clear();
+	quantized_vertices.clear();
 	m_indices.clear();
+	lod_indices.clear();
 	bones.clear();
 	weights.clear();
 	m_uvs1.clear();
+	bin_file.reset();
+	bin_offset = bin_size = 0;
+	bin_num_vertices = bin_num_indices = 0;
 
 	if (collision_model)
 		delete (CollisionModel3D*)collision_model;
+	collision_model = NULL;
 }
 
 int vertex_location = -1;
@@ -124,32 +152,57 @@ void Mesh::enableBuffers(Shader* sh)
 		return;
 	*/
 
+	//not uploaded yet, the client arrays need the vectors
+	if (bin_file && !interleaved_vbo_id && !vertices_vbo_id)
+		unpackBin();
+
 	int spacing = 0;
 	int offset_normal = 0;
 	int offset_uv = 0;
 
-	if (interleaved.size())
+	//without VBOs the quantized vertices are used from the vector
+	bool packed = quantized || quantized_vertices.size();
+	if (packed)
+	{
+		spacing = sizeof(tQuantized);
+		offset_normal = offsetof(tQuantized, normal);
+		offset_uv = offsetof(tQuantized, uv);
+	}
+	else if (hasStream(MESH_STREAM_INTERLEAVED))
 	{
 		spacing = sizeof(tInterleaved);
 		offset_normal = sizeof(Vector3);
 		offset_uv = sizeof(Vector3) + sizeof(Vector3);
 	}
 
+	//set for every mesh, the shader keeps them from the previous one (not captured, they depend on the mesh)
+	int loc = sh->getUniformLocation("u_vertex_scale");
+	if (loc != -1)
+		glUniform3fv(loc, 1, packed ? quantized_scale.v : Vector3(1, 1, 1).v);
+	loc = sh->getUniformLocation("u_vertex_offset");
+	if (loc != -1)
+		glUniform3fv(loc, 1, packed ? quantized_offset.v : Vector3(0, 0, 0).v);
+	loc = sh->getUniformLocation("u_vertex_quantized");
+	if (loc != -1)
+		glUniform1i(loc, packed ? 1 : 0);
+
 	if (vertex_location != -1)
 	{
 		glEnableVertexAttribArray(vertex_location);
 		if (vertices_vbo_id || interleaved_vbo_id)
 		{
 			glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : vertices_vbo_id);
-			glVertexAttribPointer(vertex_location, 3, GL_FLOAT, GL_FALSE, spacing, 0);
+			glVertexAttribPointer(vertex_location, 3, quantized ? GL_SHORT : GL_FLOAT, GL_FALSE, spacing, 0);
 		}
+		else if (quantized_vertices.size())
+			glVertexAttribPointer(vertex_location, 3, GL_SHORT, GL_FALSE, spacing, quantized_vertices[0].vertex);
 		else
 			glVertexAttribPointer(vertex_location, 3, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].vertex : &vertices[0]);
 		checkGLErrors();
 	}
 
 	normal_location = -1;
-	if (normals.size() || spacing)
+	if (hasStream(MESH_STREAM_NORMALS) || spacing)
 	{
 		normal_location = sh->getAttribLocation("a_normal");
 		if (normal_location != -1)
@@ -158,8 +211,13 @@ void Mesh::enableBuffers(Shader* sh)
 			if (normals_vbo_id || interleaved_vbo_id)
 			{
 				glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : normals_vbo_id);
-				glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, spacing, (void*)offset_normal);
+				if (quantized)
+					glVertexAttribPointer(normal_location, 2, GL_SHORT, GL_FALSE, spacing, (void*)offset_normal);
+				else
+					glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, spacing, (void*)offset_normal);
 			}
+			else if (quantized_vertices.size())
+				glVertexAttribPointer(normal_location, 2, GL_SHORT, GL_FALSE, spacing, quantized_vertices[0].normal);
 			else
 				glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].normal : &normals[0]);
 		}
@@ -167,7 +225,7 @@ void Mesh::enableBuffers(Shader* sh)
 	}
 
 	uv_location = -1;
-	if (uvs.size() || spacing)
+	if (hasStream(MESH_STREAM_UVS) || spacing)
 	{
 		uv_location = sh->getAttribLocation("a_coord");
 		if (uv_location != -1)
@@ -176,8 +234,10 @@ void Mesh::enableBuffers(Shader* sh)
 			if (uvs_vbo_id || interleaved_vbo_id)
 			{
 				glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : uvs_vbo_id);
-				glVertexAttribPointer(uv_location, 2, GL_FLOAT, GL_FALSE, spacing, (void*)offset_uv);
+				glVertexAttribPointer(uv_location, 2, quantized ? GL_HALF_FLOAT : GL_FLOAT, GL_FALSE, spacing, (void*)offset_uv);
 			}
+			else if (quantized_vertices.size())
+				glVertexAttribPointer(uv_location, 2, GL_HALF_FLOAT, GL_FALSE, spacing, quantized_vertices[0].uv);
 			else
 				glVertexAttribPointer(uv_location, 2, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].uv : &uvs[0]);
 		}
@@ -185,7 +245,7 @@ void Mesh::enableBuffers(Shader* sh)
 	}
 
 	uv1_location = -1;
-	if (m_uvs1.size())
+	if (hasStream(MESH_STREAM_UVS1))
 	{
 		uv1_location = sh->getAttribLocation("a_coord1");
 		if (uv1_location != -1)
@@ -203,7 +263,7 @@ void Mesh::enableBuffers(Shader* sh)
 	}
 
 	color_location = -1;
-	if (colors.size())
+	if (hasStream(MESH_STREAM_COLORS))
 	{
 		color_location = sh->getAttribLocation("a_color");
 		if (color_location != -1)
@@ -221,7 +281,7 @@ void Mesh::enableBuffers(Shader* sh)
 	}
 
 	bones_location = -1;
-	if (bones.size())
+	if (hasStream(MESH_STREAM_BONES))
 	{
 		bones_location = sh->getAttribLocation("a_bones");
 		if (bones_location != -1)
@@ -237,7 +297,7 @@ void Mesh::enableBuffers(Shader* sh)
 		}
 	}
 	weights_location = -1;
-	if (weights.size())
+	if (hasStream(MESH_STREAM_WEIGHTS))
 	{
 		weights_location = sh->getAttribLocation("a_weights");
 		if (weights_location != -1)
@@ -246,7 +306,10 @@ void Mesh::enableBuffers(Shader* sh)
 			if (weights_vbo_id)
 			{
 				glBindBuffer(GL_ARRAY_BUFFER, weights_vbo_id);
-				glVertexAttribPointer(weights_location, 4, GL_FLOAT, GL_FALSE, 0, NULL);
+				if (quantized)
+					glVertexAttribPointer(weights_location, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, NULL);
+				else
+					glVertexAttribPointer(weights_location, 4, GL_FLOAT, GL_FALSE, 0, NULL);
 			}
 			else
 				glVertexAttribPointer(weights_location, 4, GL_FLOAT, GL_FALSE, 0, &weights[0]);
@@ -255,7 +318,7 @@ void Mesh::enableBuffers(Shader* sh)
 
 }
 
-void Mesh::render(unsigned int primitive, int submesh_id, int num_instances)
+void Mesh::render(unsigned int primitive, int submesh_id, int num_instances, int lod)
 {
     //return;
 
@@ -265,14 +328,17 @@ void Mesh::render(unsigned int primitive, int submesh_id, int num_instances)
 		assert(0 && "no shader or shader not compiled or enabled");
 		return;
 	}
-	assert((interleaved.size() || vertices.size()) && "No vertices in this mesh");
+	assert(getNumVertices() && "No vertices in this mesh");
+
+	if (GTR::DrawCapture::recording)
+		GTR::DrawCapture::recording->recordDraw(this, primitive, submesh_id, lod);
 
 	//bind buffers to attribute locations
 	enableBuffers(shader);
 	checkGLErrors();
 
 	//draw call
-	drawCall(primitive, submesh_id, num_instances);
+	drawCall(primitive, submesh_id, num_instances, lod);
 	checkGLErrors();
 
 	//unbind them
@@ -280,33 +346,52 @@ void Mesh::render(unsigned int primitive, int submesh_id, int num_instances)
 	checkGLErrors();
 }
 
-void Mesh::drawCall(unsigned int primitive, int submesh_id, int num_instances)
+void Mesh::drawCall(unsigned int primitive, int submesh_id, int num_instances, int lod)
 {
-	int start = 0; //in primitives
-	int size = (int)vertices.size();
-	if (m_indices.size())
-		size = (int)m_indices.size();
-	else
-	if (interleaved.size())
-		size = (int)interleaved.size();
+	int start = 0; //in vertices or indices
+	int size = (int)getNumVertices();
+	if (getNumIndices())
+		size = (int)getNumIndices();
 
 	if (submesh_id > -1)
 	{
 		assert(submesh_id < submeshes.size() && "this mesh doesnt have as many submeshes");
 		sSubmeshInfo& submesh = submeshes[submesh_id];
 		start = submesh.start;
-		size = submesh.start + submesh.length;
+		size = submesh.length;
+	}
+
+	//the LODs are other ranges of indices, in the VBO after the full mesh
+	const unsigned int* indices = m_indices.size() ? &m_indices[0] : NULL;
+	if (lod > 0 && lod < getNumLODs() && (indices_vbo_id || lod_indices.size()))
+	{
+		int num_ranges = submeshes.size() ? (int)submeshes.size() : 1;
+		sMeshLOD* level = &lods[(lod - 1) * num_ranges];
+		if (submesh_id > -1)
+		{
+			start = level[submesh_id].start;
+			size = level[submesh_id].length;
+		}
+		else
+		{
+			start = level[0].start;
+			size = level[num_ranges - 1].start + level[num_ranges - 1].length - start;
+		}
+		if (indices_vbo_id)
+			start += (int)getNumIndices();
+		else
+			indices = &lod_indices[0];
 	}
 
 	//DRAW
-	if (m_indices.size())
+	if (getNumIndices())
 	{
 		if (num_instances > 0)
 		{
 			assert(indices_vbo_id && "indices must be uploaded to the GPU");
 			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
 			#ifdef OPENGL_ES3
-				glDrawElementsInstanced(primitive, size, GL_UNSIGNED_INT, (void*)(start + sizeof(Vector3u)), num_instances);
+				glDrawElementsInstanced(primitive, size, indices_type, (void*)(start * getIndexSize()), num_instances);
             #else
 				assert(0 && "not supported in OpenGL ES2");
             #endif
@@ -318,13 +403,13 @@ void Mesh::drawCall(unsigned int primitive, int submesh_id, int num_instances)
 			{
 				/*if (size != 90)*/ {
 					glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
-					glDrawElements(primitive, size, GL_UNSIGNED_INT,(void *) (start * sizeof(Vector3u)));
+					glDrawElements(primitive, size, indices_type, (void*)(start * getIndexSize()));
 					glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 				}
 				checkGLErrors();
 			}
 			else
-				glDrawElements(primitive, size, GL_UNSIGNED_INT, (void*)(&m_indices[0] + start)); //no multiply, its a vector3u pointer)
+				glDrawElements(primitive, size, GL_UNSIGNED_INT, (void*)(indices + start)); //no multiply, its an unsigned int pointer
 		}
 	}
 	else
@@ -409,6 +494,7 @@ void Mesh::renderInstanced(unsigned int primitive, const Matrix44* instanced_mod
 void Mesh::renderFixedPipeline(int primitive)
 {
 	assert((vertices.size() || interleaved.size()) && "No vertices in this mesh");
+	assert(!quantized && "the fixed pipeline cannot decode the quantized vertices");
 
 	int interleave_offset = interleaved.size() ? sizeof(tInterleaved) : 0;
 	int offset_normal = sizeof(Vector3);
@@ -499,9 +585,47 @@ void Mesh::renderAnimated( unsigned int primitive, Skeleton* skeleton )
 #define GL_ARRAY_BUFFER_ARB GL_ARRAY_BUFFER
 #define GL_STATIC_DRAW_ARB GL_STATIC_DRAW
 
-void Mesh::uploadToVRAM()
+//the weights are rounded keeping the sum
+static void quantizeWeights(const Vector4* weights_data, unsigned int num, std::vector<Vector4ub>& result_weights)
+{
+	result_weights.resize(num);
+	for (unsigned int i = 0; i < num; ++i)
+	{
+		const Vector4& w = weights_data[i];
+		int sum = 0, largest = 0;
+		for (int j = 0; j < 4; ++j)
+		{
+			result_weights[i].v[j] = (uint8)clamp(floorf(w.v[j] * 255.0f + 0.5f), 0.0f, 255.0f);
+			sum += result_weights[i].v[j];
+			if (w.v[j] > w.v[largest])
+				largest = j;
+		}
+		if (sum && fabsf(w.x + w.y + w.z + w.w - 1.0f) < 0.01f)
+			result_weights[i].v[largest] = (uint8)clamp((float)(result_weights[i].v[largest] + 255 - sum), 0.0f, 255.0f);
+	}
+}
+
+//one VBO from the vectors or from the mapped .mbin
+static void uploadStream(unsigned int& vbo_id, unsigned int target, const void* data, size_t bytes)
 {
-	assert(vertices.size() || interleaved.size());
+	if (!bytes)
+		return;
+	if (vbo_id == 0)
+		glGenBuffersARB(1, &vbo_id);
+	glBindBufferARB(target, vbo_id);
+	glBufferDataARB(target, bytes, data, GL_STATIC_DRAW_ARB);
+}
+
+void Mesh::uploadToVRAM(bool quantize)
+{
+	assert(getNumVertices());
+
+	//GL only works in the main thread, meshes loaded by the workers are uploaded later
+	if (!AsyncLoader::isMainThread())
+	{
+		AsyncLoader::enqueue([this, quantize]() { uploadToVRAM(quantize); });
+		return;
+	}
 
 	if (glGenBuffersARB == nullptr)
 	{
@@ -509,94 +633,186 @@ void Mesh::uploadToVRAM()
 		exit(0);
 	}
 
-	if (interleaved.size())
+	size_t bytes;
+	const void* data;
+	std::vector<tQuantized> packed_vertices;
+	std::vector<Vector4ub> quantized_weights;
+	quantized = hasStream(MESH_STREAM_QUANTIZED);
+	if (quantized)
+	{
+		// Vertex,Normal,UV quantized when loaded
+		data = getStreamData(MESH_STREAM_QUANTIZED, bytes);
+		uploadStream(interleaved_vbo_id, GL_ARRAY_BUFFER_ARB, data, bytes);
+		data = getStreamData(MESH_STREAM_WEIGHTS, bytes);
+		quantizeWeights((const Vector4*)data, bytes == getNumVertices() * sizeof(Vector4) ? getNumVertices() : 0, quantized_weights);
+	}
+	else if (quantize && quantizeVertices(packed_vertices, quantized_weights))
+	{
+		// Vertex,Normal,UV in 16 bytes
+		quantized = true;
+		uploadStream(interleaved_vbo_id, GL_ARRAY_BUFFER_ARB, &packed_vertices[0], packed_vertices.size() * sizeof(tQuantized));
+	}
+	else if (hasStream(MESH_STREAM_INTERLEAVED))
 	{
 		// Vertex,Normal,UV
-		if (interleaved_vbo_id == 0)
-			glGenBuffersARB(1, &interleaved_vbo_id);
-		glBindBufferARB(GL_ARRAY_BUFFER_ARB, interleaved_vbo_id);
-		glBufferDataARB(GL_ARRAY_BUFFER_ARB, interleaved.size() * sizeof(tInterleaved), &interleaved[0], GL_STATIC_DRAW_ARB);
+		data = getStreamData(MESH_STREAM_INTERLEAVED, bytes);
+		uploadStream(interleaved_vbo_id, GL_ARRAY_BUFFER_ARB, data, bytes);
 	}
 	else
 	{
 		// Vertices
-		if (vertices_vbo_id == 0)
-			glGenBuffersARB(1, &vertices_vbo_id);
-		glBindBufferARB(GL_ARRAY_BUFFER_ARB, vertices_vbo_id);
-		glBufferDataARB(GL_ARRAY_BUFFER_ARB, vertices.size() * sizeof(Vector3), &vertices[0], GL_STATIC_DRAW_ARB);
-
+		data = getStreamData(MESH_STREAM_VERTICES, bytes);
+		uploadStream(vertices_vbo_id, GL_ARRAY_BUFFER_ARB, data, bytes);
 		// UVs
-		if (uvs.size())
-		{
-			if (uvs_vbo_id == 0)
-				glGenBuffersARB(1, &uvs_vbo_id);
-			glBindBufferARB(GL_ARRAY_BUFFER_ARB, uvs_vbo_id);
-			glBufferDataARB(GL_ARRAY_BUFFER_ARB, uvs.size() * sizeof(Vector2), &uvs[0], GL_STATIC_DRAW_ARB);
-		}
-
+		data = getStreamData(MESH_STREAM_UVS, bytes);
+		uploadStream(uvs_vbo_id, GL_ARRAY_BUFFER_ARB, data, bytes);
 		// Normals
-		if (normals.size())
-		{
-			if (normals_vbo_id == 0)
-				glGenBuffersARB(1, &normals_vbo_id);
-			glBindBufferARB(GL_ARRAY_BUFFER_ARB, normals_vbo_id);
-			glBufferDataARB(GL_ARRAY_BUFFER_ARB, normals.size() * sizeof(Vector3), &normals[0], GL_STATIC_DRAW_ARB);
-		}
+		data = getStreamData(MESH_STREAM_NORMALS, bytes);
+		uploadStream(normals_vbo_id, GL_ARRAY_BUFFER_ARB, data, bytes);
 	}
 
 	// UVs
-	if (m_uvs1.size())
-	{
-		if (uvs1_vbo_id == 0)
-			glGenBuffersARB(1, &uvs1_vbo_id);
-		glBindBufferARB(GL_ARRAY_BUFFER_ARB, uvs1_vbo_id);
-		glBufferDataARB(GL_ARRAY_BUFFER_ARB, m_uvs1.size() * sizeof(Vector2), &m_uvs1[0], GL_STATIC_DRAW_ARB);
-	}
+	data = getStreamData(MESH_STREAM_UVS1, bytes);
+	uploadStream(uvs1_vbo_id, GL_ARRAY_BUFFER_ARB, data, bytes);
 
 	// Colors
-	if (colors.size())
-	{
-		if (colors_vbo_id == 0)
-			glGenBuffersARB(1, &colors_vbo_id);
-		glBindBufferARB(GL_ARRAY_BUFFER_ARB, colors_vbo_id);
-		glBufferDataARB(GL_ARRAY_BUFFER_ARB, colors.size() * sizeof(Vector4), &colors[0], GL_STATIC_DRAW_ARB);
-	}
+	data = getStreamData(MESH_STREAM_COLORS, bytes);
+	uploadStream(colors_vbo_id, GL_ARRAY_BUFFER_ARB, data, bytes);
 
-	if (bones.size())
-	{
-		if (bones_vbo_id == 0)
-			glGenBuffersARB(1, &bones_vbo_id);
-		glBindBufferARB(GL_ARRAY_BUFFER_ARB, bones_vbo_id);
-		glBufferDataARB(GL_ARRAY_BUFFER_ARB, bones.size() * sizeof(Vector4ub), &bones[0], GL_STATIC_DRAW_ARB);
-	}
-	if (weights.size())
+	data = getStreamData(MESH_STREAM_BONES, bytes);
+	uploadStream(bones_vbo_id, GL_ARRAY_BUFFER_ARB, data, bytes);
+	if (quantized_weights.size())
+		uploadStream(weights_vbo_id, GL_ARRAY_BUFFER_ARB, &quantized_weights[0], quantized_weights.size() * sizeof(Vector4ub));
+	else
 	{
-		if (weights_vbo_id == 0)
-			glGenBuffersARB(1, &weights_vbo_id);
-		glBindBufferARB(GL_ARRAY_BUFFER_ARB, weights_vbo_id);
-		glBufferDataARB(GL_ARRAY_BUFFER_ARB, weights.size() * sizeof(Vector4), &weights[0], GL_STATIC_DRAW_ARB);
+		data = getStreamData(MESH_STREAM_WEIGHTS, bytes);
+		uploadStream(weights_vbo_id, GL_ARRAY_BUFFER_ARB, data, bytes);
 	}
 
 	glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
 
-	// Indices
-	if (m_indices.size())
-	{
-		if (indices_vbo_id == 0)
-			glGenBuffersARB(1, &indices_vbo_id);
-		glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
-		glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER, m_indices.size() * sizeof(unsigned int), &m_indices[0], GL_STATIC_DRAW_ARB);
+	// Indices, 16 bits when possible (the CPU and the .mbin keep 32), followed by the ones of the LODs
+	data = getStreamData(MESH_STREAM_INDICES, bytes);
+	size_t lod_bytes = 0;
+	const unsigned int* lod_data = bytes ? (const unsigned int*)getStreamData(MESH_STREAM_LOD_INDICES, lod_bytes) : NULL;
+	size_t num_indices = bytes / sizeof(unsigned int);
+	size_t num_lod_indices = lod_bytes / sizeof(unsigned int);
+	indices_type = GL_UNSIGNED_INT;
+	if (bytes && getNumVertices() <= 65536)
+	{
+		const unsigned int* indices = (const unsigned int*)data;
+		std::vector<unsigned short> short_indices(num_indices + num_lod_indices);
+		for (size_t i = 0; i < num_indices; ++i)
+			short_indices[i] = (unsigned short)indices[i];
+		for (size_t i = 0; i < num_lod_indices; ++i)
+			short_indices[num_indices + i] = (unsigned short)lod_data[i];
+		indices_type = GL_UNSIGNED_SHORT;
+		uploadStream(indices_vbo_id, GL_ELEMENT_ARRAY_BUFFER, &short_indices[0], short_indices.size() * sizeof(unsigned short));
+	}
+	else if (num_lod_indices)
+	{
+		std::vector<unsigned int> all_indices((const unsigned int*)data, (const unsigned int*)data + num_indices);
+		all_indices.insert(all_indices.end(), lod_data, lod_data + num_lod_indices);
+		uploadStream(indices_vbo_id, GL_ELEMENT_ARRAY_BUFFER, &all_indices[0], all_indices.size() * sizeof(unsigned int));
 	}
+	else
+		uploadStream(indices_vbo_id, GL_ELEMENT_ARRAY_BUFFER, data, bytes);
 	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER, 0);
 
 	checkGLErrors();
 	//clear buffers to save memory
 }
 
+//error bounds of the quantized vertices, over them the mesh is uploaded with floats
+const float MAX_QUANTIZED_POSITION_ERROR = 0.0001f; //relative to the largest side of the box
+const float MAX_QUANTIZED_NORMAL_ERROR = 0.001f;
+const float MAX_QUANTIZED_UV_ERROR = 1.0f / 1024.0f; //half a texel of a 512 texture, the halfs reach it with uvs over 4
+
+bool Mesh::quantizeVertices(std::vector<tQuantized>& result, std::vector<Vector4ub>& result_weights)
+{
+	unsigned int num = getNumVertices();
+	size_t bytes, normals_bytes, uvs_bytes, weights_bytes;
+	const tInterleaved* interleaved_data = (const tInterleaved*)getStreamData(MESH_STREAM_INTERLEAVED, bytes);
+	const Vector3* vertices_data = (const Vector3*)getStreamData(MESH_STREAM_VERTICES, bytes);
+	const Vector3* normals_data = (const Vector3*)getStreamData(MESH_STREAM_NORMALS, normals_bytes);
+	const Vector2* uvs_data = (const Vector2*)getStreamData(MESH_STREAM_UVS, uvs_bytes);
+	const Vector4* weights_data = (const Vector4*)getStreamData(MESH_STREAM_WEIGHTS, weights_bytes);
+	if (!interleaved_data && (!vertices_data || normals_bytes != num * sizeof(Vector3) || uvs_bytes != num * sizeof(Vector2)))
+		return false; //only the meshes with positions, normals and uvs
+
+	Vector3 min_pos = interleaved_data ? interleaved_data[0].vertex : vertices_data[0];
+	Vector3 max_pos = min_pos;
+	for (unsigned int i = 1; i < num; ++i)
+	{
+		const Vector3& v = interleaved_data ? interleaved_data[i].vertex : vertices_data[i];
+		min_pos.setMin(v);
+		max_pos.setMax(v);
+	}
+	Vector3 center = (min_pos + max_pos) * 0.5f;
+	Vector3 halfsize = max_pos - center;
+	float size = std::max(halfsize.x, std::max(halfsize.y, halfsize.z)) * 2.0f;
+	Vector3 inv_halfsize(halfsize.x > 0 ? 1.0f / halfsize.x : 0, halfsize.y > 0 ? 1.0f / halfsize.y : 0, halfsize.z > 0 ? 1.0f / halfsize.z : 0);
+	Vector3 scale = halfsize * (1.0f / 32767.0f);
+
+	float position_error = 0, normal_error = 0, uv_error = 0;
+	result.resize(num);
+	for (unsigned int i = 0; i < num; ++i)
+	{
+		const Vector3& v = interleaved_data ? interleaved_data[i].vertex : vertices_data[i];
+		const Vector3& n = interleaved_data ? interleaved_data[i].normal : normals_data[i];
+		const Vector2& uv = interleaved_data ? interleaved_data[i].uv : uvs_data[i];
+		tQuantized& q = result[i];
+
+		Vector3 local = v - center;
+		for (int j = 0; j < 3; ++j)
+		{
+			q.vertex[j] = quantizeSnorm16(local.v[j] * inv_halfsize.v[j]);
+			position_error = std::max(position_error, fabsf(q.vertex[j] * scale.v[j] - local.v[j]));
+		}
+		q.vertex[3] = 0;
+
+		float length = (float)n.length();
+		if (length > 0)
+		{
+			Vector3 normal = n * (1.0f / length);
+			encodeOctahedral(normal, q.normal);
+			normal_error = std::max(normal_error, (float)(decodeOctahedral(q.normal) - normal).length());
+		}
+		else
+			q.normal[0] = q.normal[1] = 0;
+
+		for (int j = 0; j < 2; ++j)
+		{
+			q.uv[j] = floatToHalf(uv.value[j]);
+			uv_error = std::max(uv_error, fabsf(halfToFloat(q.uv[j]) - uv.value[j]));
+		}
+	}
+
+	//the comparisons are false with nans
+	if (!(position_error <= MAX_QUANTIZED_POSITION_ERROR * size) || !(normal_error <= MAX_QUANTIZED_NORMAL_ERROR) || !(uv_error <= MAX_QUANTIZED_UV_ERROR))
+	{
+		std::cout << "[WARN] mesh not quantized, error over the bounds: " << name << " position: " << position_error << " normal: " << normal_error << " uv: " << uv_error << std::endl;
+		result.clear();
+		return false;
+	}
+
+	quantizeWeights(weights_data, weights_bytes == num * sizeof(Vector4) ? num : 0, result_weights);
+	quantized_scale = scale;
+	quantized_offset = center;
+	return true;
+}
+
 bool Mesh::createCollisionModel(bool is_static)
 {
 	if (collision_model)
 		return true;
+	unpackBin();
+
+	//the quantized vertices are decoded, the collision model keeps its own copy anyway
+	std::vector<Vector3> decoded(quantized_vertices.size());
+	for (unsigned int i = 0; i < decoded.size(); ++i)
+		decoded[i] = decodePosition(quantized_vertices[i]);
+	const std::vector<Vector3>& positions = decoded.size() ? decoded : vertices;
 
 	CollisionModel3D* collision_model = newCollisionModel3D(is_static);
 
@@ -615,9 +831,9 @@ bool Mesh::createCollisionModel(bool is_static)
 		else
 		for (unsigned int i = 0; i < m_indices.size(); i+=3)
 		{
-			auto v1 = vertices[m_indices[i+0]];
-			auto v2 = vertices[m_indices[i+1]];
-			auto v3 = vertices[m_indices[i+2]];
+			auto v1 = positions[m_indices[i+0]];
+			auto v2 = positions[m_indices[i+1]];
+			auto v3 = positions[m_indices[i+2]];
 			collision_model->addTriangle(v1.v, v2.v, v3.v);
 		}
 	}
@@ -632,14 +848,14 @@ bool Mesh::createCollisionModel(bool is_static)
 			collision_model->addTriangle(v1.vertex.v, v2.vertex.v, v3.vertex.v);
 		}
 	}
-	else if (vertices.size()) //non interleaved
+	else if (positions.size()) //non interleaved
 	{
-		collision_model->setTriangleNumber((int)vertices.size() / 3);
-		for (unsigned int i = 0; i < (int)vertices.size(); i+=3)
+		collision_model->setTriangleNumber((int)positions.size() / 3);
+		for (unsigned int i = 0; i < (int)positions.size(); i+=3)
 		{
-			auto v1 = vertices[i];
-			auto v2 = vertices[i + 1];
-			auto v3 = vertices[i + 2];
+			auto v1 = positions[i];
+			auto v2 = positions[i + 1];
+			auto v3 = positions[i + 2];
 			collision_model->addTriangle(v1.v, v2.v, v3.v);
 		}
 	}
@@ -714,6 +930,7 @@ bool Mesh::testSphereCollision(Matrix44 model, Vector3 center, float radius, Vec
 
 bool Mesh::interleaveBuffers()
 {
+	unpackBin();
 	if (!vertices.size() || !normals.size() || !uvs.size())
 		return false;
 
@@ -735,6 +952,218 @@ bool Mesh::interleaveBuffers()
 	return true;
 }
 
+template<typename T>
+static void addWeldStream(std::vector<sVertexStream>& streams, const std::vector<T>& stream)
+{
+	if (stream.size())
+		streams.push_back({ &stream[0], sizeof(T), sizeof(T) });
+}
+
+//the vertex i goes to remap[i], the ones with -1 are removed
+template<typename T>
+static void remapStream(std::vector<T>& stream, const std::vector<unsigned int>& remap, unsigned int num_vertices)
+{
+	if (!stream.size())
+		return;
+	std::vector<T> result(num_vertices);
+	for (unsigned int i = 0; i < stream.size(); ++i)
+		if (remap[i] != 0xFFFFFFFF)
+			result[remap[i]] = stream[i];
+	stream.swap(result);
+}
+
+//the interleaved and quantized vertices are copied to floats for the overdraw, the stats and the simplification
+static const Vector3* getPositions(Mesh* mesh, std::vector<Vector3>& copied_positions)
+{
+	if (mesh->vertices.size())
+		return &mesh->vertices[0];
+	unsigned int num_vertices = mesh->getNumVertices();
+	copied_positions.resize(num_vertices);
+	for (unsigned int i = 0; i < num_vertices; ++i)
+		copied_positions[i] = mesh->interleaved.size() ? mesh->interleaved[i].vertex : mesh->decodePosition(mesh->quantized_vertices[i]);
+	return &copied_positions[0];
+}
+
+bool Mesh::optimize()
+{
+	unpackBin();
+	unsigned int num_vertices = getNumVertices();
+	if (!num_vertices)
+		return false;
+
+	//the vertices are welded comparing all the streams
+	size_t sizes[] = { interleaved.size(), vertices.size(), quantized_vertices.size(), normals.size(), uvs.size(), m_uvs1.size(), colors.size(), bones.size(), weights.size() };
+	for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+		if (sizes[i] && sizes[i] != num_vertices)
+		{
+			std::cout << "[WARN] Mesh streams with different sizes, not optimized: " << (filename.size() ? filename : name) << std::endl;
+			return false;
+		}
+	std::vector<sVertexStream> streams;
+	addWeldStream(streams, interleaved);
+	addWeldStream(streams, vertices);
+	addWeldStream(streams, quantized_vertices);
+	addWeldStream(streams, normals);
+	addWeldStream(streams, uvs);
+	addWeldStream(streams, m_uvs1);
+	addWeldStream(streams, colors);
+	addWeldStream(streams, bones);
+	addWeldStream(streams, weights);
+
+	std::vector<Vector3> copied_positions;
+	double time = getTimeHighRes();
+	if (!m_indices.size()) //triangle soup
+	{
+		m_indices.resize(num_vertices);
+		for (unsigned int i = 0; i < num_vertices; ++i)
+			m_indices[i] = i;
+	}
+	size_t num_indices = m_indices.size();
+	sMeshOptStats before = {};
+	if (optimize_stats)
+		before = MeshOptimizer::computeStats(&m_indices[0], num_indices, getPositions(this, copied_positions), num_vertices);
+
+	unsigned int input_vertices = num_vertices;
+	std::vector<unsigned int> remap;
+	auto applyRemap = [&](unsigned int num_remapped) {
+		for (size_t i = 0; i < num_indices; ++i)
+			m_indices[i] = remap[m_indices[i]];
+		remapStream(interleaved, remap, num_remapped);
+		remapStream(vertices, remap, num_remapped);
+		remapStream(quantized_vertices, remap, num_remapped);
+		remapStream(normals, remap, num_remapped);
+		remapStream(uvs, remap, num_remapped);
+		remapStream(m_uvs1, remap, num_remapped);
+		remapStream(colors, remap, num_remapped);
+		remapStream(bones, remap, num_remapped);
+		remapStream(weights, remap, num_remapped);
+		num_vertices = num_remapped;
+	};
+	applyRemap(MeshOptimizer::weld(remap, streams, num_vertices));
+
+	//the triangles only move inside their submesh, so the ranges stay valid
+	std::vector<sSubmeshInfo> ranges = submeshes;
+	if (!ranges.size())
+	{
+		ranges.resize(1);
+		ranges[0].start = 0;
+		ranges[0].length = (int)num_indices;
+	}
+	const Vector3* positions = getPositions(this, copied_positions);
+	for (int i = 0; i < ranges.size(); ++i)
+	{
+		sSubmeshInfo& range = ranges[i];
+		if (range.start % 3 || range.length % 3 || range.start + range.length > num_indices)
+			continue;
+		MeshOptimizer::optimizeVertexCache(&m_indices[range.start], range.length, num_vertices);
+		MeshOptimizer::optimizeOverdraw(&m_indices[range.start], range.length, positions, num_vertices);
+	}
+
+	applyRemap(MeshOptimizer::optimizeVertexFetch(remap, &m_indices[0], num_indices, num_vertices));
+
+	std::cout << "[OPT] Vertices: " << input_vertices << "->" << num_vertices;
+	if (optimize_stats)
+	{
+		sMeshOptStats after = MeshOptimizer::computeStats(&m_indices[0], num_indices, getPositions(this, copied_positions), num_vertices);
+		std::cout << " ACMR: " << before.acmr << "->" << after.acmr << " ATVR: " << before.atvr << "->" << after.atvr << " Overdraw: " << before.overdraw << "->" << after.overdraw;
+	}
+	std::cout << " (" << (getTimeHighRes() - time) << "ms) ";
+	return true;
+}
+
+//every level has half the triangles of the previous one, until the error or the reduction are not worth it
+const int MAX_MESH_LODS = 4; //including the full mesh
+const float LOD_REDUCTION = 0.5f;
+const float LOD_MIN_REDUCTION = 0.75f; //a level with more triangles (relative to the previous one) is discarded
+const float LOD_MAX_ERROR = 0.02f; //relative to the half diagonal of the box in the first level, doubled in every level
+const int LOD_MIN_TRIANGLES = 256; //smaller meshes are cheap enough
+const int LOD_MIN_SUBMESH_TRIANGLES = 32; //no level goes below it, so the small submeshes dont vanish with the larger errors
+
+bool Mesh::generateLODs()
+{
+	unpackBin();
+	lods.clear();
+	lod_indices.clear();
+	unsigned int num_vertices = getNumVertices();
+	size_t num_indices = m_indices.size();
+	float size = (float)box.halfsize.length(); //the radius is not set by all the loaders
+	if (!num_vertices || num_indices / 3 < LOD_MIN_TRIANGLES || size <= 0)
+		return false;
+
+	//every submesh is simplified alone so they keep their materials
+	std::vector<sSubmeshInfo> ranges = submeshes;
+	if (!ranges.size())
+	{
+		ranges.resize(1);
+		ranges[0].start = 0;
+		ranges[0].length = (int)num_indices;
+	}
+	for (int i = 0; i < ranges.size(); ++i)
+		if (ranges[i].start % 3 || ranges[i].length % 3 || ranges[i].start + ranges[i].length > num_indices)
+			return false;
+
+	double time = getTimeHighRes();
+	std::vector<Vector3> copied_positions;
+	const Vector3* positions = getPositions(this, copied_positions);
+	std::vector<unsigned int> simplified;
+	size_t previous_indices = num_indices;
+	std::cout << "[LOD] Faces: " << num_indices / 3;
+	for (int level = 1; level < MAX_MESH_LODS; ++level)
+	{
+		//always from the full mesh, so the errors dont accumulate
+		float reduction = powf(LOD_REDUCTION, (float)level);
+		float max_error = LOD_MAX_ERROR * size * (float)(1 << (level - 1));
+		size_t level_start = lod_indices.size();
+		for (int i = 0; i < ranges.size(); ++i)
+		{
+			sSubmeshInfo& range = ranges[i];
+			size_t target = std::max((size_t)(range.length * reduction) / 3 * 3, (size_t)std::min(range.length, LOD_MIN_SUBMESH_TRIANGLES * 3));
+			simplified.resize(range.length);
+			sMeshLOD lod;
+			size_t count = MeshOptimizer::simplify(&simplified[0], &m_indices[range.start], range.length, positions, num_vertices, target, max_error, &lod.error);
+			MeshOptimizer::optimizeVertexCache(&simplified[0], count, num_vertices);
+			lod.start = (int)lod_indices.size();
+			lod.length = (int)count;
+			lod_indices.insert(lod_indices.end(), simplified.begin(), simplified.begin() + count);
+			lods.push_back(lod);
+		}
+
+		//the chain stops when a level doesnt shrink enough (the submeshes reached their minimum or the error limit)
+		size_t level_indices = lod_indices.size() - level_start;
+		if (!level_indices || level_indices > previous_indices * LOD_MIN_REDUCTION)
+		{
+			lods.resize(lods.size() - ranges.size());
+			lod_indices.resize(level_start);
+			break;
+		}
+		std::cout << "->" << level_indices / 3;
+		previous_indices = level_indices;
+	}
+	std::cout << " (" << (getTimeHighRes() - time) << "ms) ";
+	return lods.size() > 0;
+}
+
+float Mesh::getLODError(int lod)
+{
+	if (lod <= 0 || lod >= getNumLODs())
+		return 0;
+	int num_ranges = submeshes.size() ? (int)submeshes.size() : 1;
+	float error = 0;
+	for (int i = 0; i < num_ranges; ++i)
+		error = std::max(error, lods[(lod - 1) * num_ranges + i].error);
+	return error;
+}
+
+unsigned int Mesh::getIndexSize()
+{
+	return indices_type == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+}
+
+struct sMeshBinStream {
+	unsigned int offset; //from the start of the mesh, aligned to MESH_BIN_ALIGNMENT
+	unsigned int size; //in bytes, 0 if the mesh doesnt have it
+};
+
 typedef struct 
 {
 	int version;
@@ -749,151 +1178,196 @@ typedef struct
 	int num_bones;
 	int num_submeshes;
 	Matrix44 bind_matrix;
-	char streams[8]; //Vertex/Interlaved|Normal|Uvs|Color|Indices|Bones|Weights|Extra|Uvs1
+	sMeshBinStream streams[NUM_MESH_STREAMS]; //by eMeshStream
+	Vector3 quantized_scale; //of MESH_STREAM_QUANTIZED
+	Vector3 quantized_offset;
+	sSourceInfo source; //the text file it was cooked from, zeros inside a .pbin
 	char extra[32]; //unused
 } sMeshInfo;
 
-bool Mesh::readBin(const char* filename, bool bFromNetwork)
+template<typename T>
+static void copyStream(std::vector<T>& vector, const unsigned char* start, const sMeshBinStream& stream)
 {
-	FILE *f;
-	assert(filename);
+	vector.resize(stream.size / sizeof(T));
+	if (stream.size)
+		memcpy((void*)&vector[0], start + stream.offset, stream.size);
+}
+
+template<typename T>
+static const void* getVectorData(std::vector<T>& vector, size_t& bytes)
+{
+	bytes = vector.size() * sizeof(T);
+	return bytes ? &vector[0] : NULL;
+}
 
-	struct stat stbuffer;
+const void* Mesh::getStreamData(eMeshStream stream, size_t& bytes)
+{
+	const void* data = NULL;
+	switch (stream)
+	{
+		case MESH_STREAM_INTERLEAVED: data = getVectorData(interleaved, bytes); break;
+		case MESH_STREAM_VERTICES: data = getVectorData(vertices, bytes); break;
+		case MESH_STREAM_NORMALS: data = getVectorData(normals, bytes); break;
+		case MESH_STREAM_UVS: data = getVectorData(uvs, bytes); break;
+		case MESH_STREAM_UVS1: data = getVectorData(m_uvs1, bytes); break;
+		case MESH_STREAM_COLORS: data = getVectorData(colors, bytes); break;
+		case MESH_STREAM_INDICES: data = getVectorData(m_indices, bytes); break;
+		case MESH_STREAM_BONES: data = getVectorData(bones, bytes); break;
+		case MESH_STREAM_WEIGHTS: data = getVectorData(weights, bytes); break;
+		case MESH_STREAM_QUANTIZED: data = getVectorData(quantized_vertices, bytes); break;
+		case MESH_STREAM_BONES_INFO: data = getVectorData(bones_info, bytes); break;
+		case MESH_STREAM_SUBMESHES: data = getVectorData(submeshes, bytes); break;
+		case MESH_STREAM_LOD_INDICES: data = getVectorData(lod_indices, bytes); break;
+		case MESH_STREAM_LODS: data = getVectorData(lods, bytes); break;
+		default: bytes = 0;
+	}
+	if (data || !bin_file)
+		return data;
+
+	const unsigned char* start = bin_file->data + bin_offset;
+	sMeshInfo* info = (sMeshInfo*)(start + 4);
+	bytes = info->streams[stream].size;
+	return bytes ? start + info->streams[stream].offset : NULL;
+}
 
-	stat(filename,&stbuffer);
-	f = fopen(filename,"rb");
-	if (f == NULL)
+//the streams are used from the mapped file (no copies) when they are only needed to upload them
+bool Mesh::readBin(const char* filename, bool bFromNetwork, const char* source)
+{
+	assert(filename);
+	std::shared_ptr<MappedFile> file(new MappedFile());
+	if (!file->open(filename))
 		return false;
+	if (source && file->size >= 4 + sizeof(sMeshInfo) && !isSourceUnchanged(source, ((sMeshInfo*)(file->data + 4))->source))
+		return false; //cooked again from the source
+	return readBin(file, 0);
+}
 
-	unsigned int size = (unsigned int)stbuffer.st_size;
-	char* data = new char[size];
-	fread(data,size,1,f);
-	fclose(f);
+bool Mesh::readBin(std::shared_ptr<MappedFile> file, size_t offset)
+{
+	const char* filename = file->filename.c_str();
+	const unsigned char* start = file->data + offset;
 
 	//watermark
-	if ( memcmp(data,"MBIN",4) != 0 )
+	if (offset + 4 + 2 * sizeof(int) > file->size || memcmp(start, "MBIN", 4) != 0)
 	{
 		std::cout << "[ERROR] loading BIN: invalid content: " << filename << std::endl;
 		return false;
 	}
 
-	char* pos = data + 4;
-	sMeshInfo info;
-	memcpy(&info,pos,sizeof(sMeshInfo));
-	pos += sizeof(sMeshInfo);
-
-	if(info.version != MESH_BIN_VERSION || info.header_bytes != sizeof(sMeshInfo) )
+	sMeshInfo* info = (sMeshInfo*)(start + 4);
+	if(info->version != MESH_BIN_VERSION || info->header_bytes != sizeof(sMeshInfo) || offset + 4 + sizeof(sMeshInfo) > file->size)
 	{
 		std::cout << "[WARN] loading BIN: old version: " << filename << std::endl;
 		return false;
 	}
 
-	if (info.streams[0] == 'I')
-	{
-		interleaved.resize(info.size);
-		memcpy((void*)&interleaved[0], pos, sizeof(tInterleaved) * info.size);
-		pos += sizeof(tInterleaved) * info.size;
-	}
-	else if (info.streams[0] == 'V')
-	{
-		vertices.resize(info.size);
-		memcpy((void*)&vertices[0], pos, sizeof(Vector3) * info.size);
-		pos += sizeof(Vector3) * info.size;
-	}
-
-	if (info.streams[1] == 'N')
-	{
-		normals.resize(info.size);
-		memcpy((void*)&normals[0],pos,sizeof(Vector3) * info.size);
-		pos += sizeof(Vector3) * info.size;
-	}
-
-	if (info.streams[2] == 'U')
-	{
-		uvs.resize(info.size);
-		memcpy((void*)&uvs[0],pos,sizeof(Vector2) * info.size);
-		pos += sizeof(Vector2) * info.size;
-	}
-
-	if (info.streams[3] == 'C')
-	{
-		colors.resize(info.size);
-		memcpy((void*)&colors[0],pos,sizeof(Vector4) * info.size);
-		pos += sizeof(Vector4) * info.size;
-	}
-
-	if (info.streams[4] == 'I')
+	size_t size = 4 + sizeof(sMeshInfo);
+	for (int i = 0; i < NUM_MESH_STREAMS; ++i)
 	{
-		m_indices.resize(info.num_indices);
-		memcpy((void*)&m_indices[0], pos, sizeof(unsigned int) * info.num_indices);
-		pos += sizeof(Vector3u) * info.num_indices;
+		sMeshBinStream& stream = info->streams[i];
+		if (stream.size && (stream.offset % MESH_BIN_ALIGNMENT || offset + stream.offset + stream.size > file->size))
+		{
+			std::cout << "[ERROR] loading BIN: corrupted streams: " << filename << std::endl;
+			return false;
+		}
+		size = std::max(size, (size_t)stream.offset + stream.size);
 	}
 
-	if (info.streams[5] == 'B')
+	aabb_max = info->aabb_max;
+	aabb_min = info->aabb_min;
+	box.center = info->center;
+	box.halfsize = info->halfsize;
+	radius = info->radius;
+	bind_matrix = info->bind_matrix;
+	if (info->streams[MESH_STREAM_QUANTIZED].size)
 	{
-		bones.resize(info.size);
-		memcpy((void*)&bones[0], pos, sizeof(Vector4ub) * info.size);
-		pos += sizeof(Vector4ub) * info.size;
+		quantized_scale = info->quantized_scale;
+		quantized_offset = info->quantized_offset;
 	}
+	copyStream(bones_info, start, info->streams[MESH_STREAM_BONES_INFO]);
+	copyStream(submeshes, start, info->streams[MESH_STREAM_SUBMESHES]);
+	copyStream(lods, start, info->streams[MESH_STREAM_LODS]);
 
-	if (info.streams[6] == 'W')
-	{
-		weights.resize(info.size);
-		memcpy((void*)&weights[0], pos, sizeof(Vector4) * info.size);
-		pos += sizeof(Vector4) * info.size;
-	}
+	bin_file = file;
+	bin_offset = offset;
+	bin_size = size;
+	bin_num_vertices = info->size;
+	bin_num_indices = info->num_indices;
 
-	if (info.streams[7] == 'u')
-	{
-		m_uvs1.resize(info.size);
-		memcpy((void*)&m_uvs1[0], pos, sizeof(Vector2) * info.size);
-		pos += sizeof(Vector2) * info.size;
-	}
+	//without VBOs the vectors are used to render
+	if (!use_mapped_bin || !auto_upload_to_vram)
+		return unpackBin();
 
-	if (info.num_bones)
+	//the upload is done in the main thread, a worker reads the pages before
+	if (!AsyncLoader::isMainThread())
 	{
-		bones_info.resize(info.num_bones);
-		memcpy((void*)&bones_info[0], pos, sizeof(BoneInfo) * info.num_bones);
-		pos += sizeof(BoneInfo) * info.num_bones;
+		volatile unsigned char sum = 0;
+		for (size_t pos = 0; pos < size; pos += 4096)
+			sum += start[pos];
 	}
+	return true;
+}
 
-	aabb_max = info.aabb_max;
-	aabb_min = info.aabb_min;
-	box.center = info.center;
-	box.halfsize = info.halfsize;
-	radius = info.radius;
-	bind_matrix = info.bind_matrix;
-
-	submeshes.resize(info.num_submeshes);
-	memcpy(&submeshes[0], pos, sizeof(sSubmeshInfo) * info.num_submeshes);
-	pos += sizeof(sSubmeshInfo) * info.num_submeshes;
+bool Mesh::unpackBin()
+{
+	if (!bin_file)
+		return false;
 
-	createCollisionModel();
+	const unsigned char* start = bin_file->data + bin_offset;
+	sMeshInfo* info = (sMeshInfo*)(start + 4);
+	copyStream(interleaved, start, info->streams[MESH_STREAM_INTERLEAVED]);
+	copyStream(vertices, start, info->streams[MESH_STREAM_VERTICES]);
+	copyStream(normals, start, info->streams[MESH_STREAM_NORMALS]);
+	copyStream(uvs, start, info->streams[MESH_STREAM_UVS]);
+	copyStream(m_uvs1, start, info->streams[MESH_STREAM_UVS1]);
+	copyStream(colors, start, info->streams[MESH_STREAM_COLORS]);
+	copyStream(m_indices, start, info->streams[MESH_STREAM_INDICES]);
+	copyStream(lod_indices, start, info->streams[MESH_STREAM_LOD_INDICES]);
+	copyStream(bones, start, info->streams[MESH_STREAM_BONES]);
+	copyStream(weights, start, info->streams[MESH_STREAM_WEIGHTS]);
+	copyStream(quantized_vertices, start, info->streams[MESH_STREAM_QUANTIZED]);
+
+	bin_file.reset();
+	bin_offset = bin_size = 0;
+	bin_num_vertices = bin_num_indices = 0;
 	return true;
 }
 
 bool Mesh::writeBin(const char* filename)
 {
-	assert( vertices.size() || interleaved.size() );
+	assert( getNumVertices() );
 	std::string s_filename = filename;
 	s_filename += ".mbin";
 
-	FILE* f = fopen(s_filename.c_str(),"wb");
+	std::string temp_filename = s_filename + ".tmp"; //moved over the .mbin when complete, it can be mapped meanwhile
+	FILE* f = fopen(temp_filename.c_str(),"wb");
 	if (f == NULL)
 	{
 		std::cout << "[ERROR] cannot write mesh BIN: " << s_filename.c_str() << std::endl;
 		return false;
 	}
 
-	//watermark
-	fwrite("MBIN",sizeof(char),4,f);
+	bool written = writeBin(f, filename);
+	fclose(f);
+	if (!written || !replaceFile(temp_filename.c_str(), s_filename.c_str()))
+	{
+		std::cout << "[ERROR] cannot write mesh BIN: " << s_filename.c_str() << std::endl;
+		remove(temp_filename.c_str());
+		return false;
+	}
+	return true;
+}
 
+bool Mesh::writeBin(FILE* f, const char* source)
+{
 	sMeshInfo info;
 	memset(&info, 0, sizeof(info));
+	if (source)
+		getSourceInfo(source, info.source);
 	info.version = MESH_BIN_VERSION;
 	info.header_bytes = sizeof(sMeshInfo);
-	info.size = interleaved.size() ? interleaved.size() : vertices.size();
-	info.num_indices = m_indices.size();
+	info.size = getNumVertices();
+	info.num_indices = getNumIndices();
 	info.aabb_max = aabb_max;
 	info.aabb_min = aabb_min;
 	info.center = box.center;
@@ -902,50 +1376,38 @@ bool Mesh::writeBin(const char* filename)
 	info.num_bones = bones_info.size();
 	info.bind_matrix = bind_matrix;
 	info.num_submeshes = submeshes.size();
+	info.quantized_scale = quantized_scale;
+	info.quantized_offset = quantized_offset;
 
-	info.streams[0] = interleaved.size() ? 'I' : 'V';
-	info.streams[1] = normals.size() ? 'N' : ' ';
-	info.streams[2] = uvs.size() ? 'U' : ' ';
-	info.streams[3] = colors.size() ? 'C' : ' ';
-	info.streams[4] = m_indices.size() ? 'I' : ' ';
-	info.streams[5] = bones.size() ? 'B' : ' ';
-	info.streams[6] = weights.size() ? 'W' : ' ';
-	info.streams[7] = m_uvs1.size() ? 'u' : ' '; //uv second set
+	//the streams go after the header, every one aligned
+	const void* data[NUM_MESH_STREAMS];
+	size_t offset = 4 + sizeof(sMeshInfo);
+	for (int i = 0; i < NUM_MESH_STREAMS; ++i)
+	{
+		size_t bytes;
+		data[i] = getStreamData((eMeshStream)i, bytes);
+		offset = (offset + MESH_BIN_ALIGNMENT - 1) & ~(size_t)(MESH_BIN_ALIGNMENT - 1);
+		info.streams[i].offset = bytes ? (unsigned int)offset : 0;
+		info.streams[i].size = (unsigned int)bytes;
+		offset += bytes;
+	}
 
-	//write info
+	//watermark and info
+	fwrite("MBIN",sizeof(char),4,f);
 	fwrite((void*)&info, sizeof(sMeshInfo),1, f);
 
 	//write streams
-	if (interleaved.size())
-		fwrite((void*)&interleaved[0], interleaved.size() * sizeof(tInterleaved), 1, f);
-	else
+	const char padding[MESH_BIN_ALIGNMENT] = { 0 };
+	long pos = 4 + sizeof(sMeshInfo);
+	for (int i = 0; i < NUM_MESH_STREAMS; ++i)
 	{
-		fwrite((void*)&vertices[0], vertices.size() * sizeof(Vector3), 1, f);
-		if (normals.size())
-			fwrite((void*)&normals[0], normals.size() * sizeof(Vector3), 1, f);
-		if (uvs.size())
-			fwrite((void*)&uvs[0], uvs.size() * sizeof(Vector2), 1, f);
+		if (!info.streams[i].size)
+			continue;
+		fwrite(padding, info.streams[i].offset - pos, 1, f);
+		fwrite(data[i], info.streams[i].size, 1, f);
+		pos = info.streams[i].offset + info.streams[i].size;
 	}
-
-	if (colors.size())
-		fwrite((void*)&colors[0], colors.size() * sizeof(Vector4), 1, f);
-
-	if (m_indices.size())
-		fwrite((void*)&m_indices[0], m_indices.size() * sizeof(unsigned int), 1, f);
-
-	if (bones.size())
-		fwrite((void*)&bones[0], bones.size() * sizeof(Vector4ub), 1, f);
-	if (weights.size())
-		fwrite((void*)&weights[0], weights.size() * sizeof(Vector4), 1, f);
-	if (bones_info.size())
-		fwrite((void*)&bones_info[0], bones_info.size() * sizeof(BoneInfo), 1, f);
-	if (m_uvs1.size())
-		fwrite((void*)&m_uvs1[0], m_uvs1.size() * sizeof(Vector2), 1, f);
-
-	fwrite((void*)&submeshes[0], submeshes.size() * sizeof(sSubmeshInfo), 1, f);
-
-	fclose(f);
-	return true;
+	return !ferror(f);
 }
 
 bool Mesh::loadASE(const char* filename)
@@ -955,14 +1417,14 @@ bool Mesh::loadASE(const char* filename)
 	int vId,aId,bId,cId;
 	float vtxX,vtxY,vtxZ;
 	float nX,nY,nZ;
-	TextParser t;
-	if (t.create(filename) == false)
+	TextScanner t;
+	if (!t.open(filename))
 		return false;
 
 	t.seek("*MESH_NUMVERTEX");
-	nVtx = t.getint();
+	nVtx = t.getInt();
 	t.seek("*MESH_NUMFACES");
-	nFcs = t.getint();
+	nFcs = t.getInt();
 
 	normals.resize(nFcs*3);
 	vertices.resize(nFcs*3);
@@ -980,10 +1442,10 @@ bool Mesh::loadASE(const char* filename)
 	for(count=0;count<nVtx;count++)
 	{
 		t.seek("*MESH_VERTEX");
-		vId = t.getint();
-		vtxX=(float)t.getfloat();
-		vtxY= (float)t.getfloat();
-		vtxZ= (float)t.getfloat();
+		vId = t.getInt();
+		vtxX=t.getFloat();
+		vtxY= t.getFloat();
+		vtxZ= t.getFloat();
 		Vector3 v(-vtxX,vtxZ,vtxY);
 		unique_vertices[count] = v;
 		aabb_min.setMin( v );
@@ -1003,17 +1465,17 @@ bool Mesh::loadASE(const char* filename)
 	{
 		t.seek("*MESH_FACE");
 		t.seek("A:");
-		aId = t.getint();
+		aId = t.getInt();
 		t.seek("B:");
-		bId = t.getint();
+		bId = t.getInt();
 		t.seek("C:");
-		cId = t.getint();
+		cId = t.getInt();
 		vertices[count*3 + 0] = unique_vertices[aId];
 		vertices[count*3 + 1] = unique_vertices[bId];
 		vertices[count*3 + 2] = unique_vertices[cId];
 
 		t.seek("*MESH_MTLID");
-		int current_mat = t.getint();
+		int current_mat = t.getInt();
 		if (current_mat != prev_mat)
 		{
 			submesh.length = count * 3 - submesh.start;
@@ -1028,271 +1490,511 @@ bool Mesh::loadASE(const char* filename)
 	submeshes.push_back(submesh);
 
 	t.seek("*MESH_NUMTVERTEX");
-	nVtx = t.getint();
+	nVtx = t.getInt();
 	std::vector<Vector2> unique_uvs;
 	unique_uvs.resize(nVtx);
 
 	for(count=0;count<nVtx;count++)
 	{
 		t.seek("*MESH_TVERT");
-		vId = t.getint();
-		vtxX= (float)t.getfloat();
-		vtxY= (float)t.getfloat();
+		vId = t.getInt();
+		vtxX= t.getFloat();
+		vtxY= t.getFloat();
 		unique_uvs[count]=Vector2(vtxX,vtxY);
 	}
 
 	t.seek("*MESH_NUMTVFACES");
-	nFcs = t.getint();
+	nFcs = t.getInt();
 	for(count=0;count<nFcs;count++)
 	{
 		t.seek("*MESH_TFACE");
-		t.getint(); //num face
-		uvs[count*3] = unique_uvs[ t.getint() ];
-		uvs[count*3+1] = unique_uvs[ t.getint() ];
-		uvs[count*3+2] = unique_uvs[ t.getint() ];
+		t.getInt(); //num face
+		uvs[count*3] = unique_uvs[ t.getInt() ];
+		uvs[count*3+1] = unique_uvs[ t.getInt() ];
+		uvs[count*3+2] = unique_uvs[ t.getInt() ];
 	}
 
 	//normals
 	for(count=0;count<nFcs;count++)
 	{
 		t.seek("*MESH_VERTEXNORMAL");
-		aId = t.getint();
-		nX = (float)t.getfloat();
-		nY = (float)t.getfloat();
-		nZ = (float)t.getfloat();
+		aId = t.getInt();
+		nX = t.getFloat();
+		nY = t.getFloat();
+		nZ = t.getFloat();
 		normals[count*3]=Vector3(-nX,nZ,nY);
 		t.seek("*MESH_VERTEXNORMAL");
-		aId = t.getint();
-		nX = (float)t.getfloat();
-		nY = (float)t.getfloat();
-		nZ = (float)t.getfloat();
+		aId = t.getInt();
+		nX = t.getFloat();
+		nY = t.getFloat();
+		nZ = t.getFloat();
 		normals[count*3+1]=Vector3(-nX,nZ,nY);
 		t.seek("*MESH_VERTEXNORMAL");
-		aId = t.getint();
-		nX = (float)t.getfloat();
-		nY = (float)t.getfloat();
-		nZ = (float)t.getfloat();
+		aId = t.getInt();
+		nX = t.getFloat();
+		nY = t.getFloat();
+		nZ = t.getFloat();
 		normals[count*3+2]=Vector3(-nX,nZ,nY);
 	}
 
 	return true;
 }
 
-bool Mesh::loadOBJ(const char* filename)
-{
-	std::string data;
-	if(!readFile(filename,data))
-		return false;
-	char* pos = &data[0];
-	char line[255];
-	int i = 0;
+//OBJ: the file is split in chunks at line boundaries parsed in parallel, the negative indices and
+//the submeshes depend on the previous chunks so they are resolved when merging them in order
+const size_t OBJ_CHUNK_SIZE = 1 << 20;
+
+struct sOBJSubmeshEvent {
+	size_t triangle; //in the chunk
+	bool is_group; //g or usemtl
+	char name[64];
+};
+
+struct sOBJChunk {
+	const char* start;
+	const char* end;
+	std::vector<Vector3> positions;
+	std::vector<Vector2> uvs;
+	std::vector<Vector3> normals;
+	std::vector<int> corners; //position, uv and normal of every corner of the triangles, -1 if missing
+	std::vector<size_t> relative; //corners with negative indices, they are relative to the elements before the chunk
+	std::vector<sOBJSubmeshEvent> events;
+	Vector3 aabb_min;
+	Vector3 aabb_max;
+};
 
-	std::vector<Vector3> indexed_positions;
-	std::vector<Vector3> indexed_normals;
-	std::vector<Vector2> indexed_uvs;
+static bool isOBJKeyword(const char* pos, const char* end, const char* keyword, size_t length)
+{
+	return pos + length < end && memcmp(pos, keyword, length) == 0 && (pos[length] == ' ' || pos[length] == '\t');
+}
 
+static void parseOBJChunk(sOBJChunk& chunk)
+{
 	const float max_float = 10000000;
-	const float min_float = -10000000;
-	aabb_min.set(max_float,max_float,max_float);
-	aabb_max.set(min_float,min_float,min_float);
-
-	unsigned int vertex_i = 0;
-
-	sSubmeshInfo submesh_info;
-	int last_submesh_vertex = 0;
-	memset(&submesh_info, 0, sizeof(submesh_info));
+	chunk.aabb_min.set(max_float, max_float, max_float);
+	chunk.aabb_max.set(-max_float, -max_float, -max_float);
 
-	//parse file
-	while(*pos != 0)
+	const char* pos = chunk.start;
+	while (pos < chunk.end)
 	{
-		if (*pos == '\n') pos++;
-		if (*pos == '\r') pos++;
-
-		//read one line
-		i = 0;
-		while(i < 255 && pos[i] != '\n' && pos[i] != '\r' && pos[i] != 0) i++;
-		memcpy(line,pos,i);
-		line[i] = 0;
-		pos = pos + i;
-
-		//std::cout << "Line: \"" << line << "\"" << std::endl;
-		if (*line == '#' || *line == 0) continue; //comment
+		const char* end = (const char*)memchr(pos, '\n', chunk.end - pos);
+		if (!end)
+			end = chunk.end;
+		while (pos < end && (*pos == ' ' || *pos == '\t'))
+			pos++;
 
-		//tokenize line
-		std::vector<std::string> tokens = tokenize(line," ");
-
-		if (tokens.empty()) continue;
-
-		if (tokens[0] == "v" && tokens.size() == 4)
+		if (isOBJKeyword(pos, end, "v", 1))
 		{
-			Vector3 v((float)atof(tokens[1].c_str()), (float)atof(tokens[2].c_str()), (float)atof(tokens[3].c_str()) );
-			indexed_positions.push_back(v);
-
-			aabb_min.setMin( v );
-			aabb_max.setMax( v );
+			Vector3 v;
+			pos = parseFloat(parseFloat(parseFloat(pos + 1, end, v.x), end, v.y), end, v.z);
+			chunk.positions.push_back(v);
+			chunk.aabb_min.setMin(v);
+			chunk.aabb_max.setMax(v);
 		}
-		else if (tokens[0] == "vt" && tokens.size() >= 3)
+		else if (isOBJKeyword(pos, end, "vt", 2))
 		{
-			Vector2 v((float)atof(tokens[1].c_str()), 1.0 - (float)atof(tokens[2].c_str()) );
-			indexed_uvs.push_back(v);
+			Vector2 v;
+			pos = parseFloat(parseFloat(pos + 2, end, v.x), end, v.y);
+			v.y = 1.0f - v.y;
+			chunk.uvs.push_back(v);
 		}
-		else if (tokens[0] == "vn" && tokens.size() == 4)
+		else if (isOBJKeyword(pos, end, "vn", 2))
 		{
-			Vector3 v((float)atof(tokens[1].c_str()), (float)atof(tokens[2].c_str()), (float)atof(tokens[3].c_str()) );
-			indexed_normals.push_back(v);
+			Vector3 v;
+			pos = parseFloat(parseFloat(parseFloat(pos + 2, end, v.x), end, v.y), end, v.z);
+			chunk.normals.push_back(v);
+		}
+		else if (isOBJKeyword(pos, end, "f", 1))
+		{
+			//polygons are triangulated as a fan from the first corner
+			int counts[3] = { (int)chunk.positions.size(), (int)chunk.uvs.size(), (int)chunk.normals.size() };
+			int first[3], prev[3], corner[3];
+			bool first_relative[3], prev_relative[3], corner_relative[3];
+			int num_corners = 0;
+			pos++;
+			while (true)
+			{
+				//v, v/vt, v//vn or v/vt/vn
+				const char* corner_start = pos;
+				for (int k = 0; k < 3; ++k)
+				{
+					corner[k] = -1;
+					corner_relative[k] = false;
+				}
+				for (int k = 0; k < 3; ++k)
+				{
+					int index = 0;
+					pos = parseInt(pos, end, index);
+					corner[k] = index > 0 ? index - 1 : index < 0 ? counts[k] + index : -1;
+					corner_relative[k] = index < 0;
+					if (pos == end || *pos != '/')
+						break;
+					pos++;
+				}
+				if (pos == corner_start)
+					break; //end of the line
+				if (num_corners >= 2)
+				{
+					int* tri[3] = { first, prev, corner };
+					bool* tri_relative[3] = { first_relative, prev_relative, corner_relative };
+					for (int j = 0; j < 3; ++j)
+						for (int k = 0; k < 3; ++k)
+						{
+							if (tri_relative[j][k])
+								chunk.relative.push_back(chunk.corners.size());
+							chunk.corners.push_back(tri[j][k]);
+						}
+				}
+				if (num_corners == 0)
+				{
+					memcpy(first, corner, sizeof(first));
+					memcpy(first_relative, corner_relative, sizeof(first_relative));
+				}
+				memcpy(prev, corner, sizeof(prev));
+				memcpy(prev_relative, corner_relative, sizeof(prev_relative));
+				num_corners++;
+			}
 		}
-		else if (tokens[0] == "s") //surface? it appears one time before the faces
+		else if (isOBJKeyword(pos, end, "g", 1) || isOBJKeyword(pos, end, "usemtl", 6))
 		{
-			//process mesh: ????
-			//if (uvs.size() == 0 && indexed_uvs.size() )
-			//	uvs.resize(1);
+			sOBJSubmeshEvent event;
+			event.triangle = chunk.corners.size() / 9;
+			event.is_group = *pos == 'g';
+			pos += event.is_group ? 1 : 6;
+			while (pos < end && (*pos == ' ' || *pos == '\t'))
+				pos++;
+			size_t length = 0;
+			while (pos + length < end && pos[length] != ' ' && pos[length] != '\t' && pos[length] != '\r' && length < sizeof(event.name) - 1)
+				length++;
+			memcpy(event.name, pos, length);
+			event.name[length] = 0;
+			chunk.events.push_back(event);
 		}
-		else if (tokens[0] == "usemtl") //surface? it appears one time before the faces
+		pos = end + 1;
+	}
+}
+
+bool Mesh::loadOBJ(const char* filename)
+{
+	MappedFile file;
+	if (!file.open(filename))
+	{
+		std::cerr << "::readFile: file not found " << filename << std::endl;
+		return false;
+	}
+
+	double time = getTimeHighRes();
+	parseOBJ((const char*)file.data, file.size, true);
+	double seconds = (getTimeHighRes() - time) * 0.001;
+	std::cout << "[" << (seconds > 0 ? file.size / seconds / (1024 * 1024) : 0) << "MB/s] ";
+	return true;
+}
+
+bool Mesh::parseOBJ(const char* data, size_t size, bool parallel)
+{
+	std::vector<sOBJChunk> chunks;
+	const char* end = data + size;
+	for (const char* pos = data; pos < end; )
+	{
+		const char* chunk_end = end;
+		if (size_t(end - pos) > OBJ_CHUNK_SIZE)
 		{
-			if (last_submesh_vertex != vertices.size())
+			chunk_end = (const char*)memchr(pos + OBJ_CHUNK_SIZE, '\n', end - pos - OBJ_CHUNK_SIZE);
+			chunk_end = chunk_end ? chunk_end + 1 : end;
+		}
+		chunks.resize(chunks.size() + 1);
+		chunks.back().start = pos;
+		chunks.back().end = chunk_end;
+		pos = chunk_end;
+	}
+
+	auto parseChunks = [&chunks](int first, int last) {
+		for (int i = first; i < last; ++i)
+			parseOBJChunk(chunks[i]);
+	};
+	if (parallel)
+		JobSystem::parallelFor((int)chunks.size(), 1, parseChunks);
+	else
+		parseChunks(0, (int)chunks.size());
+
+	//the elements of all the chunks together, the indices of every chunk start at its base
+	std::vector<Vector3> indexed_positions;
+	std::vector<Vector2> indexed_uvs;
+	std::vector<Vector3> indexed_normals;
+	std::vector<size_t> bases(chunks.size() * 4); //positions, uvs, normals and triangles before every chunk
+	size_t num_triangles = 0;
+	const float max_float = 10000000;
+	aabb_min.set(max_float, max_float, max_float);
+	aabb_max.set(-max_float, -max_float, -max_float);
+	for (int i = 0; i < chunks.size(); ++i)
+	{
+		sOBJChunk& chunk = chunks[i];
+		bases[i * 4 + 0] = indexed_positions.size();
+		bases[i * 4 + 1] = indexed_uvs.size();
+		bases[i * 4 + 2] = indexed_normals.size();
+		bases[i * 4 + 3] = num_triangles;
+		indexed_positions.insert(indexed_positions.end(), chunk.positions.begin(), chunk.positions.end());
+		indexed_uvs.insert(indexed_uvs.end(), chunk.uvs.begin(), chunk.uvs.end());
+		indexed_normals.insert(indexed_normals.end(), chunk.normals.begin(), chunk.normals.end());
+		num_triangles += chunk.corners.size() / 9;
+		if (chunk.positions.size())
+		{
+			aabb_min.setMin(chunk.aabb_min);
+			aabb_max.setMax(chunk.aabb_max);
+		}
+	}
+
+	//the corners missing or out of range get zeros
+	vertices.resize(num_triangles * 3);
+	uvs.resize(indexed_uvs.size() ? num_triangles * 3 : 0);
+	normals.resize(indexed_normals.size() ? num_triangles * 3 : 0);
+	std::atomic<int> num_invalid(0);
+	auto fillChunks = [&](int first, int last) {
+		for (int i = first; i < last; ++i)
+		{
+			sOBJChunk& chunk = chunks[i];
+			for (int j = 0; j < chunk.relative.size(); ++j)
+				chunk.corners[chunk.relative[j]] += (int)bases[i * 4 + chunk.relative[j] % 3];
+			size_t offset = bases[i * 4 + 3] * 3;
+			int invalid = 0;
+			for (size_t j = 0; j < chunk.corners.size(); j += 3)
 			{
-				submesh_info.length = vertices.size() - submesh_info.start;
-				last_submesh_vertex = vertices.size();
-				submeshes.push_back(submesh_info);
-				memset(&submesh_info, 0, sizeof(submesh_info));
-				strcpy(submesh_info.name, tokens[1].c_str());
-				submesh_info.start = last_submesh_vertex;
+				const int* corner = &chunk.corners[j];
+				Vector3& position = vertices[offset + j / 3];
+				if (corner[0] >= 0 && corner[0] < (int)indexed_positions.size())
+					position = indexed_positions[corner[0]];
+				else
+				{
+					position.set(0, 0, 0);
+					invalid++;
+				}
+				if (uvs.size())
+					uvs[offset + j / 3] = corner[1] >= 0 && corner[1] < (int)indexed_uvs.size() ? indexed_uvs[corner[1]] : Vector2();
+				if (normals.size())
+					normals[offset + j / 3] = corner[2] >= 0 && corner[2] < (int)indexed_normals.size() ? indexed_normals[corner[2]] : Vector3();
 			}
-			else
-				strcpy(submesh_info.material, tokens[1].c_str());
+			num_invalid += invalid;
 		}
-		else if (tokens[0] == "g") //surface? it appears one time before the faces
+	};
+	if (parallel)
+		JobSystem::parallelFor((int)chunks.size(), 1, fillChunks);
+	else
+		fillChunks(0, (int)chunks.size());
+	if (num_invalid)
+		std::cout << "[WARN] OBJ with " << num_invalid << " indices out of range ";
+
+	//the submeshes are split by g and usemtl once they have some triangles
+	sSubmeshInfo submesh_info;
+	int last_submesh_vertex = 0;
+	memset(&submesh_info, 0, sizeof(submesh_info));
+	for (int i = 0; i < chunks.size(); ++i)
+		for (int j = 0; j < chunks[i].events.size(); ++j)
 		{
-			if (last_submesh_vertex != vertices.size())
+			sOBJSubmeshEvent& event = chunks[i].events[j];
+			int vertex = (int)(bases[i * 4 + 3] + event.triangle) * 3;
+			if (last_submesh_vertex != vertex)
 			{
-				submesh_info.length = vertices.size() - submesh_info.start;
-				last_submesh_vertex = vertices.size();
+				submesh_info.length = vertex - submesh_info.start;
+				last_submesh_vertex = vertex;
 				submeshes.push_back(submesh_info);
 				memset(&submesh_info, 0, sizeof(submesh_info));
-				strcpy( submesh_info.name, tokens[1].c_str());
+				strcpy(submesh_info.name, event.name);
 				submesh_info.start = last_submesh_vertex;
 			}
+			else if (!event.is_group)
+				strcpy(submesh_info.material, event.name);
 		}
-		else if (tokens[0] == "f" && tokens.size() >= 4)
-		{
-			Vector3 v1,v2,v3;
-			v1.parseFromText( tokens[1].c_str(), '/' );
 
-			for (unsigned int iPoly = 2; iPoly < tokens.size() - 1; iPoly++)
+	box.center = (aabb_max + aabb_min) * 0.5;
+	box.halfsize = (aabb_max - box.center);
+	radius = (float)fmax( aabb_max.length(), aabb_min.length() );
+
+	submesh_info.length = (int)vertices.size() - last_submesh_vertex;
+	submeshes.push_back(submesh_info);
+	return true;
+}
+
+void Mesh::benchmarkOBJ(const char* filename)
+{
+	//a grid of 1024x1024 quads with the three streams, around 100MB
+	MappedFile file;
+	std::string generated;
+	if (!filename)
+	{
+		const int size = 1024;
+		char line[128];
+		generated.reserve(100 << 20);
+		for (int y = 0; y <= size; ++y)
+			for (int x = 0; x <= size; ++x)
+			{
+				snprintf(line, sizeof(line), "v %f %f %f\nvt %f %f\nvn 0.0 1.0 0.0\n", x / (float)size, 0.0f, y / (float)size, x / (float)size, y / (float)size);
+				generated += line;
+			}
+		for (int y = 0; y < size; ++y)
+			for (int x = 0; x < size; ++x)
 			{
-				v2.parseFromText( tokens[iPoly].c_str(), '/' );
-				v3.parseFromText( tokens[iPoly+1].c_str(), '/' );
+				int i = y * (size + 1) + x + 1;
+				snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", i, i, i, i + size + 1, i + size + 1, i + size + 1, i + size + 2, i + size + 2, i + size + 2, i + 1, i + 1, i + 1);
+				generated += line;
+			}
+	}
+	else if (!file.open(filename))
+	{
+		std::cout << "[ERROR] OBJ not found: " << filename << std::endl;
+		return;
+	}
+	const char* data = filename ? (const char*)file.data : generated.c_str();
+	size_t size = filename ? file.size : generated.size();
 
-				vertices.push_back( indexed_positions[ (unsigned int)(v1.x) -1 ] );
-				vertices.push_back( indexed_positions[ (unsigned int)(v2.x) -1] );
-				vertices.push_back( indexed_positions[ (unsigned int)(v3.x) -1] );
-				//triangles.push_back( VECTOR_INDICES_TYPE(vertex_i, vertex_i+1, vertex_i+2) ); //not needed
-				vertex_i += 3;
+	std::cout << " + OBJ parser benchmark: " << (filename ? filename : "generated grid") << " " << size / (1024.0 * 1024.0) << "MB (" << JobSystem::getNumThreads() << " threads)" << std::endl;
+	const int repetitions = 3;
+	double times[2];
+	for (int parallel = 0; parallel < 2; ++parallel)
+	{
+		for (int i = 0; i < repetitions; ++i)
+		{
+			Mesh mesh;
+			double start = getTimeHighRes();
+			mesh.parseOBJ(data, size, parallel != 0);
+			double time = getTimeHighRes() - start;
+			times[parallel] = i ? std::min(times[parallel], time) : time;
+		}
+		std::cout << "\t " << (parallel ? "parallel: " : "serial: ") << times[parallel] << "ms, " << size / (times[parallel] * 0.001) / (1024 * 1024) << "MB/s" << std::endl;
+	}
+	std::cout << "\t speedup x" << (times[0] / times[1]) << std::endl;
+}
 
-				if (indexed_uvs.size() > 0)
-				{
-					uvs.push_back( indexed_uvs[(unsigned int)(v1.y) -1] );
-					uvs.push_back( indexed_uvs[(unsigned int)(v2.y) -1] );
-					uvs.push_back( indexed_uvs[(unsigned int)(v3.y) -1] );
-				}
+void Mesh::benchmarkBin()
+{
+	//a grid of 1024x1024 quads with the three streams, written as .mbin and read back from the page cache
+	const int size = 1024;
+	Mesh grid;
+	for (int y = 0; y <= size; ++y)
+		for (int x = 0; x <= size; ++x)
+		{
+			grid.vertices.push_back(Vector3(x / (float)size, 0.0f, y / (float)size));
+			grid.normals.push_back(Vector3(0.0f, 1.0f, 0.0f));
+			grid.uvs.push_back(Vector2(x / (float)size, y / (float)size));
+		}
+	for (int y = 0; y < size; ++y)
+		for (int x = 0; x < size; ++x)
+		{
+			unsigned int i = y * (size + 1) + x;
+			unsigned int quad[6] = { i, i + size + 1, i + size + 2, i, i + size + 2, i + 1 };
+			grid.m_indices.insert(grid.m_indices.end(), quad, quad + 6);
+		}
+	grid.updateBoundingBox();
 
-				if (indexed_normals.size() > 0)
-				{
-					normals.push_back( indexed_normals[(unsigned int)(v1.z) -1] );
-					normals.push_back( indexed_normals[(unsigned int)(v2.z) -1] );
-					normals.push_back( indexed_normals[(unsigned int)(v3.z) -1] );
-				}
+	const char* filename = "data/benchmark"; //writeBin appends the extension
+	std::string s_filename = std::string(filename) + ".mbin";
+	if (!grid.writeBin(filename))
+		return;
+	unsigned long long bytes = 0;
+	long long mtime;
+	getFileInfo(s_filename.c_str(), bytes, mtime);
+
+	std::cout << " + MBIN load benchmark: " << bytes / (1024.0 * 1024.0) << "MB (" << (auto_upload_to_vram ? "read and upload" : "read") << ")" << std::endl;
+	bool mapped = use_mapped_bin;
+	const int repetitions = 3;
+	double times[2];
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		use_mapped_bin = pass != 0;
+		for (int i = 0; i < repetitions; ++i)
+		{
+			Mesh mesh;
+			double start = getTimeHighRes();
+			mesh.readBin(s_filename.c_str(), false, NULL);
+			if (auto_upload_to_vram)
+			{
+				mesh.uploadToVRAM(quantize_vertices);
+				glFinish();
 			}
+			double time = getTimeHighRes() - start;
+			times[pass] = i ? std::min(times[pass], time) : time;
 		}
+		std::cout << "\t " << (pass ? "mapped: " : "copied: ") << times[pass] << "ms, " << bytes / (times[pass] * 0.001) / (1024 * 1024) << "MB/s" << std::endl;
 	}
+	std::cout << "\t speedup x" << (times[0] / times[1]) << std::endl;
+	use_mapped_bin = mapped;
+	remove(s_filename.c_str());
+}
 
-	box.center = (aabb_max + aabb_min) * 0.5;
-	box.halfsize = (aabb_max - box.center);
-	radius = (float)fmax( aabb_max.length(), aabb_min.length() );
-
-	submesh_info.length = vertices.size() - last_submesh_vertex;
-	submeshes.push_back(submesh_info);
-	return true;
+//the buffers of the MESH format start with the number of values, the vectors are sized with it
+//(the separators after the values are skipped by the next read)
+template<typename T>
+static void readMESHBuffer(TextScanner& scanner, std::vector<T>& vector)
+{
+	int count = scanner.getInt();
+	vector.resize(count * sizeof(float) / sizeof(T));
+	if (vector.size())
+		scanner.getFloats((float*)&vector[0], vector.size() * sizeof(T) / sizeof(float));
 }
 
 bool Mesh::loadMESH(const char* filename)
 {
-	struct stat stbuffer;
-
-	FILE* f = fopen(filename, "rb");
-	if (f == NULL)
+	TextScanner scanner;
+	if (!scanner.open(filename))
 	{
 		std::cerr << "File not found: " << filename << std::endl;
 		return false;
 	}
-	stat(filename, &stbuffer);
-
-	unsigned int size = stbuffer.st_size;
-	char* data = new char[size + 1];
-	fread(data, size, 1, f);
-	fclose(f);
-	data[size] = 0;
-	char* pos = data;
 	char word[255];
 
-	while (*pos)
+	while (!scanner.eof())
 	{
-		char type = *pos;
-		pos++;
+		char type = scanner.getChar();
 		if (type == '-') //buffer
 		{
-			pos = fetchWord(pos, word);
-			std::string str(word);
-			if (str == "vertices")
-				pos = fetchBufferVec3(pos, vertices);
-			else if (str == "normals")
-				pos = fetchBufferVec3(pos, normals);
-			else if (str == "coords")
-				pos = fetchBufferVec2(pos, uvs);
-			else if (str == "colors")
-				pos = fetchBufferVec4(pos, colors);
-			else if (str == "bone_indices")
-				pos = fetchBufferVec4ub(pos, bones);
-			else if (str == "weights")
-				pos = fetchBufferVec4(pos, weights);
+			scanner.getWord(word, sizeof(word));
+			if (strcmp(word, "vertices") == 0)
+				readMESHBuffer(scanner, vertices);
+			else if (strcmp(word, "normals") == 0)
+				readMESHBuffer(scanner, normals);
+			else if (strcmp(word, "coords") == 0)
+				readMESHBuffer(scanner, uvs);
+			else if (strcmp(word, "colors") == 0)
+				readMESHBuffer(scanner, colors);
+			else if (strcmp(word, "bone_indices") == 0)
+			{
+				bones.resize(scanner.getInt() / 4);
+				for (int i = 0; i < bones.size(); ++i)
+					for (int j = 0; j < 4; ++j)
+						bones[i].v[j] = (uint8)scanner.getFloat();
+			}
+			else if (strcmp(word, "weights") == 0)
+				readMESHBuffer(scanner, weights);
 			else
-				pos = fetchEndLine(pos);
+				scanner.skipLine();
 		}
 		else if (type == '*') //buffer
 		{
-			pos = fetchWord(pos, word);
-			pos = fetchBufferVec3u(pos, m_indices);
+			scanner.getWord(word, sizeof(word));
+			m_indices.resize(scanner.getInt());
+			for (int i = 0; i < m_indices.size(); ++i)
+				m_indices[i] = (unsigned int)scanner.getFloat();
 		}
 		else if (type == '@') //info
 		{
-			pos = fetchWord(pos, word);
-			std::string str(word);
-			if (str == "bones")
+			scanner.getWord(word, sizeof(word));
+			if (strcmp(word, "bones") == 0)
 			{
-				pos = fetchWord(pos, word);
-				bones_info.resize(atof(word));
+				bones_info.resize(scanner.getInt());
 				for (int j = 0; j < bones_info.size(); ++j)
 				{
-					pos = fetchWord(pos, word);
-                    #if defined(GCC) || defined(__APPLE__) || defined( ANDROID ) || _PLATFORM_WASM
-                        strcpy(bones_info[j].name, word);
-                    #else
-                        strcpy_s(bones_info[j].name, 32, word);
-                    #endif
-                    pos = fetchMatrix44(pos, bones_info[j].bind_pose);
+					scanner.getField(bones_info[j].name, sizeof(bones_info[j].name));
+					scanner.getFloats(bones_info[j].bind_pose.m, 16);
 				}
 			}
-			else if (str == "bind_matrix")
-				pos = fetchMatrix44( pos, bind_matrix);
+			else if (strcmp(word, "bind_matrix") == 0)
+				scanner.getFloats(bind_matrix.m, 16);
 			else
-				pos = fetchEndLine(pos);
+				scanner.skipLine();
 		}
 		else
-			pos = fetchEndLine(pos);
+			scanner.skipLine();
 	}
 
-	delete[] data;
-
 	return true;
 }
 
@@ -1440,6 +2142,7 @@ void Mesh::createSubdividedPlane(float size, int subdivisions, bool centered )
 void Mesh::displace(Image* heightmap, float altitude)
 {
 	assert(heightmap && heightmap->data && "image without data");
+	unpackBin();
 	assert(uvs.size() && "cannot displace without uvs");
 
 	bool is_interleaved = interleaved.size() != 0;
@@ -1495,12 +2198,22 @@ void Mesh::updateBoundingBox()
 	else if (interleaved.size())
 	{
 		aabb_max = aabb_min = interleaved[0].vertex;
-		for (int i = 1; i < vertices.size(); ++i)
+		for (int i = 1; i < interleaved.size(); ++i)
 		{
 			aabb_min.setMin(interleaved[i].vertex);
 			aabb_max.setMax(interleaved[i].vertex);
 		}
 	}
+	else if (quantized_vertices.size())
+	{
+		aabb_max = aabb_min = decodePosition(quantized_vertices[0]);
+		for (int i = 1; i < quantized_vertices.size(); ++i)
+		{
+			Vector3 v = decodePosition(quantized_vertices[i]);
+			aabb_min.setMin(v);
+			aabb_max.setMax(v);
+		}
+	}
 	box.center = (aabb_max + aabb_min) * 0.5f;
 	box.halfsize = aabb_max - box.center;
 }
@@ -1559,14 +2272,116 @@ Mesh* Mesh::getQuad()
 Mesh* Mesh::Get(const char* filename, bool bFromNetwork, bool skip_load)
 {
 	assert(filename);
-	std::map<std::string, Mesh*>::iterator it = sMeshesLoaded.find(filename);
-	if (it != sMeshesLoaded.end())
-		return it->second;
+	{
+		std::lock_guard<std::recursive_mutex> lock(AsyncLoader::manager_mutex);
+		std::map<std::string, Mesh*>::iterator it = sMeshesLoaded.find(filename);
+		if (it != sMeshesLoaded.end())
+			return it->second;
+	}
 
 	if (skip_load)
 		return NULL;
 
 	Mesh* m = new Mesh();
+	if (!m->load(filename, bFromNetwork))
+	{
+		delete m;
+		return NULL;
+	}
+
+	m->registerMesh(filename);
+	return m;
+}
+
+//returns an empty mesh immediately (the renderer doesnt make render calls for meshes without vertices) and fills it when loaded
+Mesh* Mesh::GetAsync(const char* filename)
+{
+	assert(filename);
+	std::lock_guard<std::recursive_mutex> lock(AsyncLoader::manager_mutex);
+	std::map<std::string, Mesh*>::iterator it = sMeshesLoaded.find(filename);
+	if (it != sMeshesLoaded.end())
+		return it->second;
+
+	Mesh* mesh = new Mesh();
+	mesh->registerMesh(filename);
+	mesh->loadAsync(filename);
+	return mesh;
+}
+
+void Mesh::loadAsync(const char* filename)
+{
+	std::string name = filename;
+	AsyncLoader::num_loading++;
+	JobSystem::runBackground([this, name]() {
+		//loaded in a different mesh so the placeholder is never read while being filled
+		Mesh* loaded = new Mesh();
+		if (!loaded->load(name.c_str(), false))
+		{
+			delete loaded;
+			AsyncLoader::num_loading--;
+			return;
+		}
+		//queued after the upload of the buffers
+		AsyncLoader::enqueue([this, loaded]() {
+			swapData(loaded);
+			delete loaded;
+			AsyncLoader::num_loading--;
+		});
+	});
+}
+
+size_t Mesh::getCPUSize()
+{
+	return bin_size + vertices.size() * sizeof(Vector3) + normals.size() * sizeof(Vector3) + uvs.size() * sizeof(Vector2) + m_uvs1.size() * sizeof(Vector2) +
+		colors.size() * sizeof(Vector4) + interleaved.size() * sizeof(tInterleaved) + (m_indices.size() + lod_indices.size()) * sizeof(unsigned int) +
+		bones.size() * sizeof(Vector4ub) + weights.size() * sizeof(Vector4) + quantized_vertices.size() * sizeof(tQuantized);
+}
+
+//the buffers uploaded by uploadToVRAM
+size_t Mesh::getVRAMSize()
+{
+	//by eMeshStream
+	unsigned int vbos[] = { interleaved_vbo_id, vertices_vbo_id, normals_vbo_id, uvs_vbo_id, uvs1_vbo_id, colors_vbo_id, indices_vbo_id, bones_vbo_id, weights_vbo_id };
+	size_t size = 0;
+	for (int i = 0; i < sizeof(vbos) / sizeof(vbos[0]); ++i)
+	{
+		size_t bytes = 0;
+		if (quantized && (i == MESH_STREAM_INTERLEAVED || i == MESH_STREAM_WEIGHTS))
+			continue;
+		if (vbos[i])
+			getStreamData((eMeshStream)i, bytes);
+		if (i == MESH_STREAM_INDICES)
+		{
+			size_t lod_bytes = 0;
+			if (vbos[i])
+				getStreamData(MESH_STREAM_LOD_INDICES, lod_bytes);
+			bytes = (bytes + lod_bytes) / sizeof(unsigned int) * getIndexSize();
+		}
+		size += bytes;
+	}
+	if (quantized)
+		size += getNumVertices() * (sizeof(tQuantized) + (weights_vbo_id ? sizeof(Vector4ub) : 0));
+	return size;
+}
+
+//the bounding box and the submeshes are kept, the renderer skips the meshes without vertices
+void Mesh::evict()
+{
+	assert(filename.size() && AsyncLoader::isMainThread());
+	clear();
+	evicted = true;
+}
+
+void Mesh::reload()
+{
+	assert(evicted);
+	evicted = false;
+	loadAsync(filename.c_str());
+}
+
+bool Mesh::load(const char* filename, bool bFromNetwork)
+{
+	Mesh* m = this;
 	std::string name = filename;
 
 	//detect format
@@ -1583,9 +2398,11 @@ Mesh* Mesh::Get(const char* filename, bool bFromNetwork, bool skip_load)
 	else 
 	{
 		//if (ext.size()) std::cerr << "Unknown mesh format: " << filename << std::endl;
-		return NULL;
+		return false;
 	}
 
+	m->filename = filename;
+
 	//stats
 	double time = getTime();
 	std::cout << " + Mesh loading: " << filename << " ... ";
@@ -1595,9 +2412,11 @@ Mesh* Mesh::Get(const char* filename, bool bFromNetwork, bool skip_load)
 		binfilename = binfilename + ".mbin";
 
 	//try loading the binary version
-	if (use_binary && m->readBin(binfilename.c_str(), bFromNetwork) )
+	double bin_time = getTimeHighRes();
+	if (use_binary && m->readBin(binfilename.c_str(), bFromNetwork, file_format != FORMAT_MBIN ? filename : NULL) )
 	{
-		if (interleave_meshes && m->interleaved.size() == 0)
+		bool mapped = m->bin_file != NULL;
+		if (interleave_meshes && !m->hasStream(MESH_STREAM_INTERLEAVED) && m->hasStream(MESH_STREAM_NORMALS) && m->hasStream(MESH_STREAM_UVS))
 		{
 			std::cout << "[INTERL] ";
 			m->interleaveBuffers();
@@ -1606,12 +2425,17 @@ Mesh* Mesh::Get(const char* filename, bool bFromNetwork, bool skip_load)
 		if (auto_upload_to_vram)
 		{
 			std::cout << "[VRAM] ";
-			m->uploadToVRAM();
+			m->uploadToVRAM(quantize_vertices);
 		}
 
-		std::cout << "[OK BIN]  Faces: " << (m->interleaved.size() ? m->interleaved.size() : m->vertices.size()) / 3 << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
-		sMeshesLoaded[filename] = m;
-		return m;
+		//throughput of the read and the upload (queued if this is a worker), compare it with use_mapped_bin disabled
+		unsigned long long bytes = 0;
+		long long mtime;
+		getFileInfo(binfilename.c_str(), bytes, mtime);
+		double seconds = (getTimeHighRes() - bin_time) * 0.001;
+		std::cout << "[OK BIN" << (mapped ? " MAPPED" : "") << "]  Faces: " << (m->getNumIndices() ? m->getNumIndices() : m->getNumVertices()) / 3 << " Time: " << (getTime() - time) * 0.001 << "sec ";
+		std::cout << (seconds > 0 ? bytes / seconds / 1e9 : 0) << "GB/s" << std::endl;
+		return true;
 	}
 
 	assert(!bFromNetwork);
@@ -1627,11 +2451,16 @@ Mesh* Mesh::Get(const char* filename, bool bFromNetwork, bool skip_load)
 
 	if (!loaded)
 	{
-		delete m;
 		std::cout << "[ERROR]: Mesh not found" << std::endl;
-		return NULL;
+		return false;
 	}
 
+	//weld and reorder for the GPU caches, the .mbin stores the result
+	if (optimize_meshes)
+		m->optimize();
+	if (generate_lods)
+		m->generateLODs();
+
 	//to optimize, interleave the meshes
 	if (interleave_meshes)
 	{
@@ -1643,10 +2472,10 @@ Mesh* Mesh::Get(const char* filename, bool bFromNetwork, bool skip_load)
 	if (auto_upload_to_vram)
 	{
 		std::cout << "[VRAM] ";
-		m->uploadToVRAM();
+		m->uploadToVRAM(quantize_vertices);
 	}
 
-	std::cout << "[OK]  Faces: " << m->vertices.size() / 3 << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
+	std::cout << "[OK]  Faces: " << (m->getNumIndices() ? m->getNumIndices() : m->getNumVertices()) / 3 << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
 	if (use_binary)
 	{
 		std::cout << "\t\t Writing .BIN ... ";
@@ -1654,22 +2483,119 @@ Mesh* Mesh::Get(const char* filename, bool bFromNetwork, bool skip_load)
 		std::cout << "[OK]" << std::endl;
 	}
 
-	m->registerMesh(name);
-	return m;
+	return true;
+}
+
+//exchanges the geometry and the GPU buffers (keeps the name), used to replace placeholders
+void Mesh::swapData(Mesh* other)
+{
+	data_version++; //the box changed, the entities recompute their world bounds
+	filename.swap(other->filename);
+	submeshes.swap(other->submeshes);
+	vertices.swap(other->vertices);
+	normals.swap(other->normals);
+	uvs.swap(other->uvs);
+	m_uvs1.swap(other->m_uvs1);
+	colors.swap(other->colors);
+	interleaved.swap(other->interleaved);
+	quantized_vertices.swap(other->quantized_vertices);
+	m_indices.swap(other->m_indices);
+	lods.swap(other->lods);
+	lod_indices.swap(other->lod_indices);
+	bones.swap(other->bones);
+	weights.swap(other->weights);
+	bones_info.swap(other->bones_info);
+	std::swap(bind_matrix, other->bind_matrix);
+	std::swap(aabb_min, other->aabb_min);
+	std::swap(aabb_max, other->aabb_max);
+	std::swap(box, other->box);
+	std::swap(radius, other->radius);
+	std::swap(uv_density, other->uv_density);
+	std::swap(vertices_vbo_id, other->vertices_vbo_id);
+	std::swap(uvs_vbo_id, other->uvs_vbo_id);
+	std::swap(normals_vbo_id, other->normals_vbo_id);
+	std::swap(colors_vbo_id, other->colors_vbo_id);
+	std::swap(indices_vbo_id, other->indices_vbo_id);
+	std::swap(interleaved_vbo_id, other->interleaved_vbo_id);
+	std::swap(bones_vbo_id, other->bones_vbo_id);
+	std::swap(weights_vbo_id, other->weights_vbo_id);
+	std::swap(uvs1_vbo_id, other->uvs1_vbo_id);
+	std::swap(quantized, other->quantized);
+	std::swap(indices_type, other->indices_type);
+	std::swap(quantized_scale, other->quantized_scale);
+	std::swap(quantized_offset, other->quantized_offset);
+	std::swap(collision_model, other->collision_model);
+	bin_file.swap(other->bin_file);
+	std::swap(bin_offset, other->bin_offset);
+	std::swap(bin_size, other->bin_size);
+	std::swap(bin_num_vertices, other->bin_num_vertices);
+	std::swap(bin_num_indices, other->bin_num_indices);
+}
+
+//sqrt of the ratio between the area in uv space and the area in local space of all the triangles
+float Mesh::getUVDensity()
+{
+	if (uv_density >= 0)
+		return uv_density;
+
+	//read from the streams, the mapped meshes dont need to be unpacked
+	size_t bytes, uv_bytes, index_bytes;
+	const tInterleaved* interleaved_data = (const tInterleaved*)getStreamData(MESH_STREAM_INTERLEAVED, bytes);
+	const Vector3* vertices_data = (const Vector3*)getStreamData(MESH_STREAM_VERTICES, bytes);
+	const Vector2* uvs_data = (const Vector2*)getStreamData(MESH_STREAM_UVS, uv_bytes);
+	const tQuantized* quantized_data = (const tQuantized*)getStreamData(MESH_STREAM_QUANTIZED, bytes);
+	const unsigned int* indices_data = (const unsigned int*)getStreamData(MESH_STREAM_INDICES, index_bytes);
+
+	bool use_interleaved = interleaved_data != NULL;
+	int num_vertices = getNumVertices();
+	int num = indices_data ? (int)getNumIndices() : num_vertices;
+	double uv_area = 0, area = 0;
+	if (use_interleaved || quantized_data || (uvs_data && uv_bytes == num_vertices * sizeof(Vector2)))
+		for (int i = 0; i + 2 < num; i += 3)
+		{
+			int index[3];
+			for (int j = 0; j < 3; ++j)
+				index[j] = indices_data ? indices_data[i + j] : i + j;
+			Vector3 v[3];
+			Vector2 uv[3];
+			for (int j = 0; j < 3; ++j)
+			{
+				if (quantized_data)
+				{
+					const tQuantized& q = quantized_data[index[j]];
+					v[j] = decodePosition(q);
+					uv[j].set(halfToFloat(q.uv[0]), halfToFloat(q.uv[1]));
+					continue;
+				}
+				v[j] = use_interleaved ? interleaved_data[index[j]].vertex : vertices_data[index[j]];
+				uv[j] = use_interleaved ? interleaved_data[index[j]].uv : uvs_data[index[j]];
+			}
+			area += cross(v[1] - v[0], v[2] - v[0]).length() * 0.5;
+			uv_area += fabs((uv[1].x - uv[0].x) * (uv[2].y - uv[0].y) - (uv[2].x - uv[0].x) * (uv[1].y - uv[0].y)) * 0.5;
+		}
+
+	if (area > 0 && uv_area > 0)
+		uv_density = (float)sqrt(uv_area / area);
+	else
+		uv_density = radius > 0 ? 0.5f / radius : 1.0f; //assume the uvs cover the mesh once
+	return uv_density;
 }
 
 void Mesh::registerMesh( std::string name )
 {
+	std::lock_guard<std::recursive_mutex> lock(AsyncLoader::manager_mutex);
 	this->name = name;
 	sMeshesLoaded[name] = this;
 }
 
 void Mesh::Release()
 {
-	for (auto m : sMeshesLoaded)
+	std::lock_guard<std::recursive_mutex> lock(AsyncLoader::manager_mutex);
+	std::map<std::string, Mesh*> meshes;
+	meshes.swap(sMeshesLoaded); //the dtor removes them from the manager
+	for (auto m : meshes)
 	{
         stdlog("Destroy mesh: " + m.first );
 		delete m.second;
 	}
-	sMeshesLoaded.clear();
 }
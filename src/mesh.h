@@ -3,16 +3,39 @@
 
 #include <vector>
 #include "framework.h"
+#include "assetmanager.h"
 
 #include <map>
 #include <string>
+#include <memory>
 
 class Shader; //for binding
+class MappedFile; //for the .mbin
 class Image; //for displace
 class Skeleton; //for skinned meshes
 
 //version from 11/5/2020
-#define MESH_BIN_VERSION 11 //this is used to regenerate bins if the format changes
+#define MESH_BIN_VERSION 16 //this is used to regenerate bins if the format changes
+#define MESH_BIN_ALIGNMENT 16 //of every stream in the .mbin, from the start of the mesh
+
+//streams stored in a .mbin, the first ones match the VBOs
+enum eMeshStream {
+	MESH_STREAM_INTERLEAVED,
+	MESH_STREAM_VERTICES,
+	MESH_STREAM_NORMALS,
+	MESH_STREAM_UVS,
+	MESH_STREAM_UVS1,
+	MESH_STREAM_COLORS,
+	MESH_STREAM_INDICES,
+	MESH_STREAM_BONES,
+	MESH_STREAM_WEIGHTS,
+	MESH_STREAM_QUANTIZED, //uploaded to the interleaved VBO
+	MESH_STREAM_BONES_INFO,
+	MESH_STREAM_SUBMESHES,
+	MESH_STREAM_LOD_INDICES,
+	MESH_STREAM_LODS,
+	NUM_MESH_STREAMS
+};
 
 struct BoneInfo {
 	char name[32]; //max 32 chars per bone name
@@ -27,17 +50,32 @@ struct sSubmeshInfo
 	int length;//in primitive
 };
 
-class Mesh
+//simplified indices of a submesh (or the whole mesh), they use the same vertices
+struct sMeshLOD
+{
+	int start; //in lod_indices
+	int length;
+	float error; //max distance to the full mesh, in local units
+};
+
+class Mesh : public Asset
 {
 public:
 	static std::map<std::string, Mesh*> sMeshesLoaded;
-	static bool use_binary; //always load the binary version of a mesh when possible
+	static unsigned int data_version; //increased every time a mesh gets new geometry in place (swapData), to invalidate the cached bounds
+	static bool use_binary; //the text formats are cooked to a .mbin and it is loaded instead while the text file doesnt change
+	static bool use_mapped_bin; //the .mbin is mapped and uploaded from the file, the CPU vectors are only filled when needed
 	static bool interleave_meshes; //loaded meshes will me automatically interleaved
 	static bool auto_upload_to_vram; //loaded meshes will be stored in the VRAM
+	static bool quantize_vertices; //loaded meshes are uploaded with tQuantized vertices and 8 bits weights (when the error is within the bounds)
+	static bool optimize_meshes; //loaded triangle soups are welded and reordered for the GPU caches (see MeshOptimizer)
+	static bool optimize_stats; //optimize measures the caches and the overdraw before and after, slow (for debugging)
+	static bool generate_lods; //loaded meshes get simplified versions for the distance (see generateLODs)
 	static long num_meshes_rendered;
 	static long num_triangles_rendered;
 
 	std::string name;
+	std::string filename; //file it was loaded from, empty for the meshes created in code or from a gltf
 
 	std::vector<sSubmeshInfo> submeshes; //contains info about every submesh
 
@@ -55,19 +93,40 @@ public:
 
 	std::vector< tInterleaved > interleaved; //to render interleaved
 
+	//compact vertex in VRAM, 16 bytes instead of 32 (the CPU vectors keep the floats)
+	struct tQuantized {
+		short vertex[4]; //in the quantization box, w is unused (keeps the normal aligned)
+		short normal[2]; //octahedral encoding
+		unsigned short uv[2]; //half floats
+	};
+
+	std::vector< tQuantized > quantized_vertices; //loaded already quantized (KHR_mesh_quantization), decoded with quantized_scale and quantized_offset
+
 	std::vector<unsigned int> m_indices; //for indexed meshes
 
+	//levels of detail, lods[(level - 1) * max(1, submeshes) + submesh], the ranges of a level are consecutive in lod_indices
+	std::vector<sMeshLOD> lods;
+	std::vector<unsigned int> lod_indices; //uploaded after m_indices in the same VBO
+
 	//for animated meshes
 	std::vector< Vector4ub > bones; //tells which bones afect the vertex (4 max)
 	std::vector< Vector4 > weights; //tells how much affect every bone
 	std::vector< BoneInfo > bones_info; //tells 
 	Matrix44 bind_matrix;
 
+	//mapped .mbin while the vertex vectors are empty (see unpackBin)
+	std::shared_ptr<MappedFile> bin_file;
+	size_t bin_offset; //where the mesh starts in bin_file (a .pbin contains many meshes)
+	size_t bin_size;
+	unsigned int bin_num_vertices;
+	unsigned int bin_num_indices;
+
 	Vector3 aabb_min;
 	Vector3	aabb_max;
 	BoundingBox box;
 
 	float radius;
+	float uv_density; //uv units per local unit, computed the first time it is needed (-1 until then)
 
 	unsigned int vertices_vbo_id;
 	unsigned int uvs_vbo_id;
@@ -79,27 +138,45 @@ public:
 	unsigned int bones_vbo_id;
 	unsigned int weights_vbo_id;
 	unsigned int uvs1_vbo_id;
+	unsigned int indices_type; //of the indices VBO, GL_UNSIGNED_SHORT when the vertices fit in 16 bits
+
+	//the VBOs have tQuantized vertices, the shaders rebuild the position with u_vertex_scale and u_vertex_offset
+	bool quantized;
+	Vector3 quantized_scale;
+	Vector3 quantized_offset;
+	Vector3 decodePosition(const tQuantized& v) { return Vector3(v.vertex[0] * quantized_scale.x, v.vertex[1] * quantized_scale.y, v.vertex[2] * quantized_scale.z) + quantized_offset; }
 
 	Mesh();
 	~Mesh();
 
 	void clear();
 
-	void render( unsigned int primitive, int submesh_id = -1, int num_instances = 0 );
+	void render( unsigned int primitive, int submesh_id = -1, int num_instances = 0, int lod = 0 );
 	void renderInstanced(unsigned int primitive, const Matrix44* instanced_models, int number);
 	void renderBounding( const Matrix44& model, bool world_bounding = true );
 	void renderFixedPipeline(int primitive); //sloooooooow
 	//void renderAnimated(unsigned int primitive, Skeleton *sk);
 
 	void enableBuffers(Shader* shader);
-	void drawCall(unsigned int primitive, int submesh_id, int num_instances);
+	void drawCall(unsigned int primitive, int submesh_id, int num_instances, int lod = 0);
 	void disableBuffers(Shader* shader);
 
-	bool readBin(const char* filename, bool bFromNetwork);
+	bool readBin(const char* filename, bool bFromNetwork, const char* source = NULL); //source is the text file, the bin is ignored if it changed
+	bool readBin(std::shared_ptr<MappedFile> file, size_t offset); //a mesh stored inside other file
 	bool writeBin(const char* filename);
+	bool writeBin(FILE* f, const char* source = NULL); //at the current position of the file, that must be aligned to MESH_BIN_ALIGNMENT
+	bool unpackBin(); //copies the streams of the mapped file to the vectors, call it before reading or editing them
+
+	//the data of a stream, from the vectors or from the mapped .mbin
+	const void* getStreamData(eMeshStream stream, size_t& bytes);
+	bool hasStream(eMeshStream stream) { size_t bytes; getStreamData(stream, bytes); return bytes > 0; }
 
 	unsigned int getNumSubmeshes() { return (unsigned int)submeshes.size(); }
-	unsigned int getNumVertices() { return (unsigned int)interleaved.size() ? (unsigned int)interleaved.size() : (unsigned int)vertices.size(); }
+	unsigned int getNumVertices() { return interleaved.size() ? (unsigned int)interleaved.size() : vertices.size() ? (unsigned int)vertices.size() : quantized_vertices.size() ? (unsigned int)quantized_vertices.size() : bin_num_vertices; }
+	unsigned int getNumIndices() { return m_indices.size() ? (unsigned int)m_indices.size() : bin_num_indices; }
+	unsigned int getIndexSize(); //in bytes, in the indices VBO
+	int getNumLODs() { return 1 + (int)(lods.size() / (submeshes.size() ? submeshes.size() : 1)); } //the full mesh is the level 0
+	float getLODError(int lod); //the max of its submeshes, 0 for the level 0
 
 	//collision testing
 	void* collision_model;
@@ -110,8 +187,14 @@ public:
 
 	//loader
 	static Mesh* Get(const char* filename, bool bFromNetwork, bool skip_load = false);
+	static Mesh* GetAsync(const char* filename); //returns an empty mesh that gets the data once loaded in a worker thread
+	bool load(const char* filename, bool bFromNetwork); //load without using the manager
+	void swapData(Mesh* other);
+	void loadAsync(const char* filename); //loads in a worker and swaps the data in the main thread
 	static void Release();
 	void registerMesh(std::string name);
+	static void benchmarkOBJ(const char* filename = NULL); //throughput of the OBJ parser in one and all the threads, NULL parses a generated grid
+	static void benchmarkBin(); //throughput of the .mbin loads with use_mapped_bin disabled and enabled, from a generated grid
 
 	//create help meshes
 	void createQuad(float center_x, float center_y, float w, float h, bool flip_uvs);
@@ -124,14 +207,25 @@ public:
 	static Mesh* getQuad(); //get global quad
 
 	void updateBoundingBox();
+	float getUVDensity(); //used to know the texture resolution needed on screen
+
+	//memory budgets (AssetManager)
+	size_t getCPUSize();
+	size_t getVRAMSize();
+	void evict(); //frees the buffers, it renders nothing until reloaded
+	void reload(); //from its file, in a worker
 
 	//optimize meshes
-	void uploadToVRAM();
+	void uploadToVRAM(bool quantize = false);
 	bool interleaveBuffers();
+	bool optimize(); //welds the vertices and reorders triangles and vertices
+	bool generateLODs(); //simplifies the indexed triangles to up to 3 more levels, false if the mesh is too small or cant be reduced
+	bool quantizeVertices(std::vector<tQuantized>& result, std::vector<Vector4ub>& result_weights); //false if the mesh cant be quantized or the error is over the bounds
 
 private:
 	bool loadASE(const char* filename);
 	bool loadOBJ(const char* filename);
+	bool parseOBJ(const char* data, size_t size, bool parallel); //in place, the data doesnt need to end in zero
 	bool loadMESH(const char* filename); //personal format used for animations
 };
 
@@ -0,0 +1,868 @@
+#include "meshoptdecoder.h"
+#include "utils.h"
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+//the groups of bytes are unpacked with pshufb, the functions using it are compiled for SSSE3 and called after checking the CPU
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define MESHOPT_SSSE3
+	#include <tmmintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define SSSE3_TARGET
+	#else
+		#define SSSE3_TARGET __attribute__((target("ssse3")))
+	#endif
+#endif
+
+bool MeshoptDecoder::use_simd = true;
+
+const unsigned char VERTEX_HEADER = 0xa0;
+const unsigned char INDEX_HEADER = 0xe0;
+const unsigned char SEQUENCE_HEADER = 0xd0;
+
+const size_t VERTEX_BLOCK_SIZE_BYTES = 8192;
+const size_t VERTEX_BLOCK_MAX_SIZE = 256;
+const size_t BYTE_GROUP_SIZE = 16;
+const size_t BYTE_GROUP_DECODE_LIMIT = 24; //the most a group can read: 8 bytes of 4 bits and 16 escaped
+const size_t TAIL_MAX_SIZE = 32; //the last vertex at the end of the stream, padded so the groups can be read without checks
+
+//the codeaux byte of the triangles with new vertices, the encoder stores its table in the last 16 bytes
+const unsigned char CODEAUX_TABLE[16] = { 0x00, 0x76, 0x87, 0x56, 0x67, 0x78, 0xa9, 0x86, 0x65, 0x89, 0x68, 0x98, 0x01, 0x69, 0x00, 0x00 };
+
+//vertices per block, the bytes of a block fit in 8KB
+static size_t getVertexBlockSize(size_t vertex_size)
+{
+	size_t result = (VERTEX_BLOCK_SIZE_BYTES / vertex_size) & ~(BYTE_GROUP_SIZE - 1);
+	return result < VERTEX_BLOCK_MAX_SIZE ? result : VERTEX_BLOCK_MAX_SIZE;
+}
+
+static unsigned char unzigzag8(unsigned char v)
+{
+	return (unsigned char)(-(v & 1) ^ (v >> 1));
+}
+
+//the values that dont fit in the bits (all ones) are read from the bytes after the group
+static const unsigned char* decodeBytesGroup(const unsigned char* data, unsigned char* buffer, int bitslog2)
+{
+	switch (bitslog2)
+	{
+	case 0:
+		memset(buffer, 0, BYTE_GROUP_SIZE);
+		return data;
+	case 1:
+	case 2:
+	{
+		int bits = 1 << bitslog2;
+		size_t per_byte = 8 / bits;
+		unsigned char sentinel = (unsigned char)((1 << bits) - 1);
+		const unsigned char* data_var = data + BYTE_GROUP_SIZE / per_byte;
+		for (size_t i = 0; i < BYTE_GROUP_SIZE; ++i)
+		{
+			unsigned char enc = (data[i / per_byte] >> (8 - bits * (i % per_byte + 1))) & sentinel;
+			buffer[i] = enc == sentinel ? *data_var++ : enc;
+		}
+		return data_var;
+	}
+	default:
+		memcpy(buffer, data, BYTE_GROUP_SIZE);
+		return data + BYTE_GROUP_SIZE;
+	}
+}
+
+#ifdef MESHOPT_SSSE3
+//for every mask of 8 escaped values: the byte of the escaped area each one reads (0x80 zeroes the rest) and how many
+static unsigned char group_shuffle[256][8];
+static unsigned char group_count[256];
+
+static bool buildGroupTables()
+{
+	for (int mask = 0; mask < 256; ++mask)
+	{
+		unsigned char count = 0;
+		for (int i = 0; i < 8; ++i)
+		{
+			bool escaped = (mask >> i) & 1;
+			group_shuffle[mask][i] = escaped ? count : 0x80;
+			count += escaped ? 1 : 0;
+		}
+		group_count[mask] = count;
+	}
+	return true;
+}
+
+static bool group_tables_built = buildGroupTables();
+
+SSSE3_TARGET static const unsigned char* decodeBytesGroupSSSE3(const unsigned char* data, unsigned char* buffer, int bitslog2)
+{
+	__m128i sel, rest;
+	switch (bitslog2)
+	{
+	case 0:
+		_mm_storeu_si128((__m128i*)buffer, _mm_setzero_si128());
+		return data;
+	case 1:
+	{
+		//every byte is spread in 4 (two shifts and interleaves), the order is from the high bits to the low ones
+		int sel2_bits;
+		memcpy(&sel2_bits, data, 4);
+		__m128i sel2 = _mm_cvtsi32_si128(sel2_bits);
+		__m128i sel22 = _mm_unpacklo_epi8(_mm_srli_epi16(sel2, 4), sel2);
+		__m128i sel2222 = _mm_unpacklo_epi8(_mm_srli_epi16(sel22, 2), sel22);
+		sel = _mm_and_si128(sel2222, _mm_set1_epi8(3));
+		rest = _mm_loadu_si128((const __m128i*)(data + 4));
+		data += 4;
+		break;
+	}
+	case 2:
+	{
+		__m128i sel4 = _mm_loadl_epi64((const __m128i*)data);
+		__m128i sel44 = _mm_unpacklo_epi8(_mm_srli_epi16(sel4, 4), sel4);
+		sel = _mm_and_si128(sel44, _mm_set1_epi8(15));
+		rest = _mm_loadu_si128((const __m128i*)(data + 8));
+		data += 8;
+		break;
+	}
+	default:
+		_mm_storeu_si128((__m128i*)buffer, _mm_loadu_si128((const __m128i*)data));
+		return data + BYTE_GROUP_SIZE;
+	}
+
+	//the escaped values are packed after the group, the shuffle of the second half starts after the ones of the first
+	__m128i sentinel = bitslog2 == 1 ? _mm_set1_epi8(3) : _mm_set1_epi8(15);
+	__m128i escaped = _mm_cmpeq_epi8(sel, sentinel);
+	int mask = _mm_movemask_epi8(escaped);
+	unsigned char mask0 = (unsigned char)(mask & 255);
+	unsigned char mask1 = (unsigned char)(mask >> 8);
+	__m128i shuffle0 = _mm_loadl_epi64((const __m128i*)group_shuffle[mask0]);
+	__m128i shuffle1 = _mm_add_epi8(_mm_loadl_epi64((const __m128i*)group_shuffle[mask1]), _mm_set1_epi8(group_count[mask0]));
+	__m128i shuffle = _mm_unpacklo_epi64(shuffle0, shuffle1);
+	__m128i result = _mm_or_si128(_mm_shuffle_epi8(rest, shuffle), _mm_andnot_si128(escaped, sel));
+	_mm_storeu_si128((__m128i*)buffer, result);
+	return data + group_count[mask0] + group_count[mask1];
+}
+
+static bool checkSSSE3()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 9)) != 0;
+#else
+	return __builtin_cpu_supports("ssse3") != 0;
+#endif
+}
+
+static bool cpu_has_ssse3 = checkSSSE3();
+#endif
+
+bool MeshoptDecoder::hasSIMD()
+{
+#ifdef MESHOPT_SSSE3
+	return cpu_has_ssse3;
+#else
+	return false;
+#endif
+}
+
+//header of 2 bits per group (from the low bits) followed by the groups, NULL if the data ends before
+static const unsigned char* decodeBytes(const unsigned char* data, const unsigned char* data_end, unsigned char* buffer, size_t buffer_size, bool simd)
+{
+	const unsigned char* header = data;
+	size_t num_groups = buffer_size / BYTE_GROUP_SIZE;
+	size_t header_size = (num_groups + 3) / 4;
+	if (size_t(data_end - data) < header_size)
+		return NULL;
+	data += header_size;
+
+	for (size_t i = 0; i < num_groups; ++i)
+	{
+		if (size_t(data_end - data) < BYTE_GROUP_DECODE_LIMIT)
+			return NULL;
+		int bitslog2 = (header[i / 4] >> ((i % 4) * 2)) & 3;
+#ifdef MESHOPT_SSSE3
+		if (simd)
+		{
+			data = decodeBytesGroupSSSE3(data, buffer + i * BYTE_GROUP_SIZE, bitslog2);
+			continue;
+		}
+#endif
+		data = decodeBytesGroup(data, buffer + i * BYTE_GROUP_SIZE, bitslog2);
+	}
+	return data;
+}
+
+//every byte of the vertex is a stream of zigzag deltas with the previous vertex, written directly in the destination
+static const unsigned char* decodeVertexBlock(const unsigned char* data, const unsigned char* data_end, unsigned char* vertex_data, size_t vertex_count, size_t vertex_size, unsigned char* last_vertex, bool simd)
+{
+	unsigned char buffer[VERTEX_BLOCK_MAX_SIZE];
+	size_t vertex_count_aligned = (vertex_count + BYTE_GROUP_SIZE - 1) & ~(BYTE_GROUP_SIZE - 1);
+
+	for (size_t k = 0; k < vertex_size; ++k)
+	{
+		data = decodeBytes(data, data_end, buffer, vertex_count_aligned, simd);
+		if (!data)
+			return NULL;
+
+		unsigned char p = last_vertex[k];
+		unsigned char* dst = vertex_data + k;
+		for (size_t i = 0; i < vertex_count; ++i, dst += vertex_size)
+		{
+			p += unzigzag8(buffer[i]);
+			*dst = p;
+		}
+		last_vertex[k] = p;
+	}
+	return data;
+}
+
+bool MeshoptDecoder::decodeVertexBuffer(void* destination, size_t vertex_count, size_t vertex_size, const unsigned char* buffer, size_t buffer_size)
+{
+	if (vertex_size == 0 || vertex_size > 256 || vertex_size % 4)
+		return false;
+	const unsigned char* data = buffer;
+	const unsigned char* data_end = buffer + buffer_size;
+	if (buffer_size < 1 + vertex_size || (data[0] & 0xf0) != VERTEX_HEADER || (data[0] & 0x0f) > 0)
+		return false;
+	data++;
+
+	//the deltas of the first block are from the first vertex, stored in the tail
+	unsigned char last_vertex[256];
+	memcpy(last_vertex, data_end - vertex_size, vertex_size);
+
+	bool simd = use_simd && hasSIMD();
+	size_t block_size = getVertexBlockSize(vertex_size);
+	for (size_t offset = 0; offset < vertex_count; offset += block_size)
+	{
+		size_t count = std::min(block_size, vertex_count - offset);
+		data = decodeVertexBlock(data, data_end, (unsigned char*)destination + offset * vertex_size, count, vertex_size, last_vertex, simd);
+		if (!data)
+			return false;
+	}
+
+	size_t tail_size = std::max(vertex_size, TAIL_MAX_SIZE);
+	return size_t(data_end - data) == tail_size;
+}
+
+static unsigned int decodeVByte(const unsigned char*& data)
+{
+	unsigned char lead = *data++;
+	if (lead < 128)
+		return lead;
+
+	//up to 5 bytes of 7 bits, from the low ones
+	unsigned int result = lead & 127;
+	unsigned int shift = 7;
+	for (int i = 0; i < 4; ++i)
+	{
+		unsigned char group = *data++;
+		result |= unsigned(group & 127) << shift;
+		shift += 7;
+		if (group < 128)
+			break;
+	}
+	return result;
+}
+
+//the free indices are zigzag deltas with the previous free index
+static unsigned int decodeIndex(const unsigned char*& data, unsigned int last)
+{
+	unsigned int v = decodeVByte(data);
+	unsigned int d = (v >> 1) ^ -int(v & 1);
+	return last + d;
+}
+
+static void writeIndex(void* destination, size_t i, size_t index_size, unsigned int index)
+{
+	if (index_size == 2)
+		((unsigned short*)destination)[i] = (unsigned short)index;
+	else
+		((unsigned int*)destination)[i] = index;
+}
+
+static void writeTriangle(void* destination, size_t i, size_t index_size, unsigned int a, unsigned int b, unsigned int c)
+{
+	writeIndex(destination, i + 0, index_size, a);
+	writeIndex(destination, i + 1, index_size, b);
+	writeIndex(destination, i + 2, index_size, c);
+}
+
+//the pushes must match the ones of the encoder exactly, the vertex is only pushed if cond
+static void pushEdgeFifo(unsigned int fifo[16][2], unsigned int a, unsigned int b, size_t& offset)
+{
+	fifo[offset][0] = a;
+	fifo[offset][1] = b;
+	offset = (offset + 1) & 15;
+}
+
+static void pushVertexFifo(unsigned int fifo[16], unsigned int v, size_t& offset, int cond = 1)
+{
+	fifo[offset] = v;
+	offset = (offset + cond) & 15;
+}
+
+bool MeshoptDecoder::decodeIndexBuffer(void* destination, size_t index_count, size_t index_size, const unsigned char* buffer, size_t buffer_size)
+{
+	if (index_count % 3 || (index_size != 2 && index_size != 4))
+		return false;
+	//header, a code per triangle and the codeaux table
+	if (buffer_size < 1 + index_count / 3 + 16 || (buffer[0] & 0xf0) != INDEX_HEADER)
+		return false;
+	int version = buffer[0] & 0x0f;
+	if (version > 1)
+		return false;
+
+	unsigned int edgefifo[16][2];
+	unsigned int vertexfifo[16];
+	memset(edgefifo, -1, sizeof(edgefifo));
+	memset(vertexfifo, -1, sizeof(vertexfifo));
+	size_t edgefifooffset = 0;
+	size_t vertexfifooffset = 0;
+	unsigned int next = 0;
+	unsigned int last = 0;
+	int fecmax = version >= 1 ? 13 : 15; //version 1 uses 13 and 14 for last-1 and last+1
+
+	//a triangle reads at most 16 bytes (codeaux and 3 vbytes), so the table works as padding
+	const unsigned char* code = buffer + 1;
+	const unsigned char* data = code + index_count / 3;
+	const unsigned char* data_safe_end = buffer + buffer_size - 16;
+	const unsigned char* codeaux_table = data_safe_end;
+
+	for (size_t i = 0; i < index_count; i += 3)
+	{
+		if (data > data_safe_end)
+			return false;
+
+		unsigned char codetri = *code++;
+		if (codetri < 0xf0)
+		{
+			//shares an edge with a recent triangle, the third vertex is new, recent or free
+			int fe = codetri >> 4;
+			unsigned int a = edgefifo[(edgefifooffset - 1 - fe) & 15][0];
+			unsigned int b = edgefifo[(edgefifooffset - 1 - fe) & 15][1];
+			int fec = codetri & 15;
+			unsigned int c;
+			if (fec < fecmax)
+			{
+				int fec0 = fec == 0;
+				c = fec0 ? next : vertexfifo[(vertexfifooffset - 1 - fec) & 15];
+				next += fec0;
+				pushVertexFifo(vertexfifo, c, vertexfifooffset, fec0);
+			}
+			else
+			{
+				//fec - (fec ^ 3) turns 13 and 14 into -1 and 1
+				c = last = (fec != 15) ? last + (fec - (fec ^ 3)) : decodeIndex(data, last);
+				pushVertexFifo(vertexfifo, c, vertexfifooffset);
+			}
+			writeTriangle(destination, i, index_size, a, b, c);
+			pushEdgeFifo(edgefifo, c, b, edgefifooffset);
+			pushEdgeFifo(edgefifo, a, c, edgefifooffset);
+		}
+		else
+		{
+			//no shared edge: the first vertex is new and the other two come from the codeaux byte (the table or the data)
+			unsigned int a, b, c;
+			int feb, fec;
+			if (codetri < 0xfe)
+			{
+				unsigned char codeaux = codeaux_table[codetri & 15];
+				feb = codeaux >> 4;
+				fec = codeaux & 15;
+				a = next++;
+				b = feb == 0 ? next++ : vertexfifo[(vertexfifooffset - feb) & 15];
+				c = fec == 0 ? next++ : vertexfifo[(vertexfifooffset - fec) & 15];
+			}
+			else
+			{
+				unsigned char codeaux = *data++;
+				int fea = codetri == 0xfe ? 0 : 15;
+				feb = codeaux >> 4;
+				fec = codeaux & 15;
+				if (codeaux == 0) //restart of the indices
+					next = 0;
+				a = fea == 0 ? next++ : 0;
+				b = feb == 0 ? next++ : vertexfifo[(vertexfifooffset - feb) & 15];
+				c = fec == 0 ? next++ : vertexfifo[(vertexfifooffset - fec) & 15];
+				if (fea == 15)
+					last = a = decodeIndex(data, last);
+				if (feb == 15)
+					last = b = decodeIndex(data, last);
+				if (fec == 15)
+					last = c = decodeIndex(data, last);
+			}
+			writeTriangle(destination, i, index_size, a, b, c);
+			pushVertexFifo(vertexfifo, a, vertexfifooffset);
+			pushVertexFifo(vertexfifo, b, vertexfifooffset, feb == 0 || feb == 15);
+			pushVertexFifo(vertexfifo, c, vertexfifooffset, fec == 0 || fec == 15);
+			pushEdgeFifo(edgefifo, b, a, edgefifooffset);
+			pushEdgeFifo(edgefifo, c, b, edgefifooffset);
+			pushEdgeFifo(edgefifo, a, c, edgefifooffset);
+		}
+	}
+
+	//all the data has been read up to the table
+	return data == data_safe_end;
+}
+
+bool MeshoptDecoder::decodeIndexSequence(void* destination, size_t index_count, size_t index_size, const unsigned char* buffer, size_t buffer_size)
+{
+	if (index_size != 2 && index_size != 4)
+		return false;
+	//header, at least a byte per index and 4 of padding
+	if (buffer_size < 1 + index_count + 4 || (buffer[0] & 0xf0) != SEQUENCE_HEADER || (buffer[0] & 0x0f) > 1)
+		return false;
+
+	const unsigned char* data = buffer + 1;
+	const unsigned char* data_safe_end = buffer + buffer_size - 4;
+	unsigned int last[2] = { 0, 0 };
+	for (size_t i = 0; i < index_count; ++i)
+	{
+		if (data >= data_safe_end)
+			return false;
+		//the low bit chooses which of the two last indices is the base of the delta
+		unsigned int v = decodeVByte(data);
+		unsigned int current = v & 1;
+		v >>= 1;
+		unsigned int d = (v >> 1) ^ -int(v & 1);
+		last[current] += d;
+		writeIndex(destination, i, index_size, last[current]);
+	}
+	return data == data_safe_end;
+}
+
+template<typename T>
+static void decodeOct(T* data, size_t count)
+{
+	const float max = float((1 << (sizeof(T) * 8 - 1)) - 1);
+	for (size_t i = 0; i < count; ++i, data += 4)
+	{
+		//z is reconstructed from x and y (the third component stores the one), the fourth one is kept
+		float x = float(data[0]);
+		float y = float(data[1]);
+		float z = float(data[2]) - fabsf(x) - fabsf(y);
+		float t = z >= 0 ? 0 : z;
+		x += x >= 0 ? t : -t;
+		y += y >= 0 ? t : -t;
+		float s = max / sqrtf(x * x + y * y + z * z);
+		data[0] = T(int(x * s + (x >= 0 ? 0.5f : -0.5f)));
+		data[1] = T(int(y * s + (y >= 0 ? 0.5f : -0.5f)));
+		data[2] = T(int(z * s + (z >= 0 ? 0.5f : -0.5f)));
+	}
+}
+
+void MeshoptDecoder::decodeFilterOct(void* data, size_t count, size_t stride)
+{
+	if (stride == 4)
+		decodeOct((signed char*)data, count);
+	else if (stride == 8)
+		decodeOct((short*)data, count);
+}
+
+void MeshoptDecoder::decodeFilterQuat(void* data, size_t count, size_t stride)
+{
+	if (stride != 8)
+		return;
+	short* q = (short*)data;
+	const float scale = 1.0f / sqrtf(2.0f);
+	for (size_t i = 0; i < count; ++i, q += 4)
+	{
+		//the fourth component has the scale in the high bits and the index of the reconstructed one in the low two
+		int sf = q[3] | 3;
+		float ss = scale / float(sf);
+		float x = float(q[0]) * ss;
+		float y = float(q[1]) * ss;
+		float z = float(q[2]) * ss;
+		float ww = 1.0f - x * x - y * y - z * z;
+		float w = sqrtf(ww >= 0 ? ww : 0);
+
+		int qc = q[3] & 3;
+		short xf = short(int(x * 32767.0f + (x >= 0 ? 0.5f : -0.5f)));
+		short yf = short(int(y * 32767.0f + (y >= 0 ? 0.5f : -0.5f)));
+		short zf = short(int(z * 32767.0f + (z >= 0 ? 0.5f : -0.5f)));
+		short wf = short(int(w * 32767.0f + 0.5f));
+		q[(qc + 1) & 3] = xf;
+		q[(qc + 2) & 3] = yf;
+		q[(qc + 3) & 3] = zf;
+		q[(qc + 0) & 3] = wf;
+	}
+}
+
+void MeshoptDecoder::decodeFilterExp(void* data, size_t count, size_t stride)
+{
+	unsigned int* values = (unsigned int*)data;
+	size_t num_values = count * (stride / 4);
+	for (size_t i = 0; i < num_values; ++i)
+	{
+		//signed 24 bits of mantissa and 8 of exponent, the float is m * 2^e
+		unsigned int v = values[i];
+		int m = int(v << 8) >> 8;
+		int e = int(v) >> 24;
+		float f = ldexpf(float(m), e);
+		memcpy(&values[i], &f, 4);
+	}
+}
+
+//** ENCODERS FOR THE BENCHMARK: the synthetic streams are encoded as gltfpack does, the assets are encoded offline
+
+static void encodeVByte(std::vector<unsigned char>& data, unsigned int v)
+{
+	do
+	{
+		data.push_back((unsigned char)((v & 127) | (v > 127 ? 128 : 0)));
+		v >>= 7;
+	} while (v);
+}
+
+static void encodeIndex(std::vector<unsigned char>& data, unsigned int index, unsigned int last)
+{
+	unsigned int d = index - last;
+	encodeVByte(data, (d << 1) ^ (unsigned int)(int(d) >> 31));
+}
+
+static void encodeBytesGroup(std::vector<unsigned char>& data, const unsigned char* group, int bitslog2)
+{
+	if (bitslog2 == 0)
+		return;
+	if (bitslog2 == 3)
+	{
+		data.insert(data.end(), group, group + BYTE_GROUP_SIZE);
+		return;
+	}
+	int bits = 1 << bitslog2;
+	size_t per_byte = 8 / bits;
+	unsigned char sentinel = (unsigned char)((1 << bits) - 1);
+	for (size_t i = 0; i < BYTE_GROUP_SIZE; i += per_byte)
+	{
+		unsigned char byte = 0;
+		for (size_t k = 0; k < per_byte; ++k)
+			byte |= std::min(group[i + k], sentinel) << (8 - bits * (k + 1));
+		data.push_back(byte);
+	}
+	for (size_t i = 0; i < BYTE_GROUP_SIZE; ++i)
+		if (group[i] >= sentinel)
+			data.push_back(group[i]);
+}
+
+//the smallest of the four sizes of every group
+static void encodeBytes(std::vector<unsigned char>& data, const unsigned char* buffer, size_t buffer_size)
+{
+	size_t num_groups = buffer_size / BYTE_GROUP_SIZE;
+	size_t header = data.size();
+	data.resize(data.size() + (num_groups + 3) / 4, 0);
+	for (size_t i = 0; i < num_groups; ++i)
+	{
+		const unsigned char* group = buffer + i * BYTE_GROUP_SIZE;
+		int best = 3;
+		size_t best_size = BYTE_GROUP_SIZE;
+		for (int bitslog2 = 2; bitslog2 >= 1; --bitslog2)
+		{
+			int bits = 1 << bitslog2;
+			size_t size = BYTE_GROUP_SIZE * bits / 8;
+			for (size_t j = 0; j < BYTE_GROUP_SIZE; ++j)
+				size += group[j] >= (1 << bits) - 1 ? 1 : 0;
+			if (size <= best_size)
+			{
+				best = bitslog2;
+				best_size = size;
+			}
+		}
+		if (std::count(group, group + BYTE_GROUP_SIZE, 0) == BYTE_GROUP_SIZE)
+			best = 0;
+		data[header + i / 4] |= (unsigned char)(best << ((i % 4) * 2));
+		encodeBytesGroup(data, group, best);
+	}
+}
+
+static std::vector<unsigned char> encodeVertexBuffer(const unsigned char* vertices, size_t vertex_count, size_t vertex_size)
+{
+	std::vector<unsigned char> data;
+	data.push_back(VERTEX_HEADER);
+	unsigned char last_vertex[256];
+	memcpy(last_vertex, vertices, vertex_size);
+
+	unsigned char buffer[VERTEX_BLOCK_MAX_SIZE];
+	size_t block_size = getVertexBlockSize(vertex_size);
+	for (size_t offset = 0; offset < vertex_count; offset += block_size)
+	{
+		size_t count = std::min(block_size, vertex_count - offset);
+		size_t count_aligned = (count + BYTE_GROUP_SIZE - 1) & ~(BYTE_GROUP_SIZE - 1);
+		const unsigned char* block = vertices + offset * vertex_size;
+		for (size_t k = 0; k < vertex_size; ++k)
+		{
+			memset(buffer, 0, sizeof(buffer));
+			unsigned char p = last_vertex[k];
+			for (size_t i = 0; i < count; ++i)
+			{
+				unsigned char d = (unsigned char)(block[i * vertex_size + k] - p);
+				buffer[i] = (unsigned char)((d << 1) ^ ((signed char)d >> 7));
+				p = block[i * vertex_size + k];
+			}
+			encodeBytes(data, buffer, count_aligned);
+		}
+		memcpy(last_vertex, block + (count - 1) * vertex_size, vertex_size);
+	}
+
+	data.resize(data.size() + std::max(vertex_size, TAIL_MAX_SIZE) - vertex_size, 0);
+	data.insert(data.end(), vertices, vertices + vertex_size);
+	return data;
+}
+
+//index of v in the fifo from the most recent one, -1 if not there
+static int findVertexFifo(const unsigned int fifo[16], unsigned int v, size_t offset)
+{
+	for (int i = 0; i < 16; ++i)
+		if (fifo[(offset - 1 - i) & 15] == v)
+			return i;
+	return -1;
+}
+
+static int findEdgeFifo(const unsigned int fifo[16][2], unsigned int a, unsigned int b, unsigned int c, size_t offset)
+{
+	for (int i = 0; i < 16; ++i)
+	{
+		const unsigned int* e = fifo[(offset - 1 - i) & 15];
+		if (e[0] == a && e[1] == b)
+			return (i << 2) | 0;
+		if (e[0] == b && e[1] == c)
+			return (i << 2) | 1;
+		if (e[0] == c && e[1] == a)
+			return (i << 2) | 2;
+	}
+	return -1;
+}
+
+//version 1 of the index codec, the triangles can be rotated
+static std::vector<unsigned char> encodeIndexBuffer(const unsigned int* indices, size_t index_count)
+{
+	const unsigned int order[3][3] = { { 0, 1, 2 }, { 1, 2, 0 }, { 2, 0, 1 } };
+	unsigned int edgefifo[16][2];
+	unsigned int vertexfifo[16];
+	memset(edgefifo, -1, sizeof(edgefifo));
+	memset(vertexfifo, -1, sizeof(vertexfifo));
+	size_t edgefifooffset = 0;
+	size_t vertexfifooffset = 0;
+	unsigned int next = 0;
+	unsigned int last = 0;
+	const int fecmax = 13;
+
+	std::vector<unsigned char> code(1, INDEX_HEADER | 1);
+	std::vector<unsigned char> data;
+	for (size_t i = 0; i < index_count; i += 3)
+	{
+		const unsigned int* tri = indices + i;
+		int fer = findEdgeFifo(edgefifo, tri[0], tri[1], tri[2], edgefifooffset);
+		if (fer >= 0 && (fer >> 2) < 15)
+		{
+			const unsigned int* o = order[fer & 3];
+			unsigned int a = tri[o[0]], b = tri[o[1]], c = tri[o[2]];
+			int fc = findVertexFifo(vertexfifo, c, vertexfifooffset);
+			int fec = (fc >= 1 && fc < fecmax) ? fc : (c == next) ? (next++, 0) : 15;
+			if (fec == 15 && c + 1 == last)
+				fec = 13, last = c;
+			else if (fec == 15 && c == last + 1)
+				fec = 14, last = c;
+			code.push_back((unsigned char)(((fer >> 2) << 4) | fec));
+			if (fec == 15)
+				encodeIndex(data, c, last), last = c;
+			if (fec == 0 || fec >= fecmax)
+				pushVertexFifo(vertexfifo, c, vertexfifooffset);
+			pushEdgeFifo(edgefifo, c, b, edgefifooffset);
+			pushEdgeFifo(edgefifo, a, c, edgefifooffset);
+		}
+		else
+		{
+			//rotated so the new vertex is the first one
+			int rotation = tri[1] == next ? 1 : tri[2] == next ? 2 : 0;
+			const unsigned int* o = order[rotation];
+			unsigned int a = tri[o[0]], b = tri[o[1]], c = tri[o[2]];
+			bool reset = a == 0 && b == 1 && c == 2 && next > 0;
+			if (reset)
+			{
+				next = 0;
+				memset(vertexfifo, -1, sizeof(vertexfifo));
+			}
+			int fb = findVertexFifo(vertexfifo, b, vertexfifooffset);
+			int fc = findVertexFifo(vertexfifo, c, vertexfifooffset);
+			int fea = (a == next) ? (next++, 0) : 15;
+			int feb = (fb >= 0 && fb < 14) ? fb + 1 : (b == next) ? (next++, 0) : 15;
+			int fec = (fc >= 0 && fc < 14) ? fc + 1 : (c == next) ? (next++, 0) : 15;
+			unsigned char codeaux = (unsigned char)((feb << 4) | fec);
+			int table_index = -1;
+			for (int j = 0; j < 14 && table_index < 0; ++j)
+				if (CODEAUX_TABLE[j] == codeaux)
+					table_index = j;
+			if (fea == 0 && table_index >= 0 && !reset)
+				code.push_back((unsigned char)(0xf0 | table_index));
+			else
+			{
+				code.push_back((unsigned char)(0xfe | (fea ? 1 : 0)));
+				data.push_back(codeaux);
+			}
+			if (fea == 15)
+				encodeIndex(data, a, last), last = a;
+			if (feb == 15)
+				encodeIndex(data, b, last), last = b;
+			if (fec == 15)
+				encodeIndex(data, c, last), last = c;
+			pushVertexFifo(vertexfifo, a, vertexfifooffset);
+			pushVertexFifo(vertexfifo, b, vertexfifooffset, feb == 0 || feb == 15);
+			pushVertexFifo(vertexfifo, c, vertexfifooffset, fec == 0 || fec == 15);
+			pushEdgeFifo(edgefifo, b, a, edgefifooffset);
+			pushEdgeFifo(edgefifo, c, b, edgefifooffset);
+			pushEdgeFifo(edgefifo, a, c, edgefifooffset);
+		}
+	}
+
+	code.insert(code.end(), data.begin(), data.end());
+	code.insert(code.end(), CODEAUX_TABLE, CODEAUX_TABLE + 16);
+	return code;
+}
+
+static std::vector<unsigned char> encodeIndexSequence(const unsigned int* indices, size_t index_count)
+{
+	std::vector<unsigned char> data(1, SEQUENCE_HEADER | 1);
+	unsigned int last[2] = { 0, 0 };
+	unsigned int current = 0;
+	for (size_t i = 0; i < index_count; ++i)
+	{
+		//the base is the closest of the two last indices
+		unsigned int index = indices[i];
+		unsigned int d0 = index - last[0], d1 = index - last[1];
+		unsigned int a0 = (unsigned int)abs(int(d0)), a1 = (unsigned int)abs(int(d1));
+		current = a1 < a0 ? 1 : a1 == a0 ? current : 0;
+		unsigned int d = index - last[current];
+		unsigned int v = (d << 1) ^ (unsigned int)(int(d) >> 31);
+		encodeVByte(data, (v << 1) | current);
+		last[current] = index;
+	}
+	data.resize(data.size() + 4, 0);
+	return data;
+}
+
+//same triangles, the decoded ones can be rotated
+static bool sameTriangles(const unsigned int* a, const unsigned int* b, size_t index_count)
+{
+	for (size_t i = 0; i < index_count; i += 3)
+	{
+		const unsigned int* x = a + i;
+		const unsigned int* y = b + i;
+		bool same = false;
+		for (int r = 0; r < 3 && !same; ++r)
+			same = x[0] == y[r] && x[1] == y[(r + 1) % 3] && x[2] == y[(r + 2) % 3];
+		if (!same)
+			return false;
+	}
+	return true;
+}
+
+static void printResult(const char* name, bool ok, double time, size_t bytes)
+{
+	std::cout << "\t " << name << ": " << (ok ? "" : "[ERROR] wrong result, ") << time << "ms, " << bytes / (time * 0.001) / (1024 * 1024) << "MB/s" << std::endl;
+}
+
+template<typename F>
+static double measure(F func)
+{
+	const int repetitions = 5;
+	double best = 0;
+	for (int i = 0; i < repetitions; ++i)
+	{
+		double start = getTimeHighRes();
+		func();
+		double time = getTimeHighRes() - start;
+		best = i ? std::min(best, time) : time;
+	}
+	return best;
+}
+
+void MeshoptDecoder::benchmark()
+{
+	std::cout << " + Meshopt decoder benchmark (SSSE3 " << (hasSIMD() ? "supported" : "not supported") << ")" << std::endl;
+
+	//streams of the meshoptimizer tests, the two versions of the index codec
+	const unsigned char index_data_v0[] = { 0xe0, 0xf0, 0x10, 0xfe, 0xff, 0xf0, 0x0c, 0xff, 0x02, 0x02, 0x02, 0x00, 0x76, 0x87, 0x56, 0x67, 0x78, 0xa9, 0x86, 0x65, 0x89, 0x68, 0x98, 0x01, 0x69, 0x00, 0x00 };
+	const unsigned int index_result_v0[] = { 0, 1, 2, 2, 1, 3, 4, 6, 5, 7, 8, 9 };
+	const unsigned char index_data_v1[] = { 0xe1, 0xf0, 0x10, 0xfe, 0x1f, 0x3d, 0x00, 0x0a, 0x00, 0x76, 0x87, 0x56, 0x67, 0x78, 0xa9, 0x86, 0x65, 0x89, 0x68, 0x98, 0x01, 0x69, 0x00, 0x00 };
+	const unsigned int index_result_v1[] = { 0, 1, 2, 2, 1, 3, 0, 1, 2, 2, 1, 5, 2, 1, 4 };
+	unsigned int decoded[15];
+	bool ok_v0 = decodeIndexBuffer(decoded, 12, 4, index_data_v0, sizeof(index_data_v0)) && memcmp(decoded, index_result_v0, sizeof(index_result_v0)) == 0;
+	bool ok_v1 = decodeIndexBuffer(decoded, 15, 4, index_data_v1, sizeof(index_data_v1)) && memcmp(decoded, index_result_v1, sizeof(index_result_v1)) == 0;
+	//truncated streams must fail without reading outside
+	bool ok_truncated = !decodeIndexBuffer(decoded, 15, 4, index_data_v1, sizeof(index_data_v1) - 1);
+	std::cout << "\t reference streams: " << (ok_v0 && ok_v1 && ok_truncated ? "OK" : "[ERROR] wrong result") << std::endl;
+
+	//filters: known values
+	signed char oct[4] = { 0, 0, 127, 5 };
+	decodeFilterOct(oct, 1, 4);
+	short quat[4] = { 0, 0, 0, 3 }; //identity with w reconstructed in the last component
+	decodeFilterQuat(quat, 1, 8);
+	unsigned int exp[2] = { (0xffu << 24) | 3, (2u << 24) | 0xfffffd };
+	decodeFilterExp(exp, 1, 8);
+	float expf[2];
+	memcpy(expf, exp, 8);
+	bool ok_filters = oct[0] == 0 && oct[1] == 0 && oct[2] == 127 && oct[3] == 5 && quat[3] == 32767 && quat[0] == 0 && expf[0] == 1.5f && expf[1] == -12.0f;
+	std::cout << "\t filters: " << (ok_filters ? "OK" : "[ERROR] wrong result") << std::endl;
+
+	//a grid of 1024x1024 vertices as gltfpack writes it: position as 4 shorts, normal as 4 chars and uv as 2 shorts
+	const int size = 1024;
+	const size_t vertex_size = 16;
+	size_t num_vertices = (size + 1) * (size + 1);
+	std::vector<unsigned char> vertices(num_vertices * vertex_size);
+	for (int y = 0; y <= size; ++y)
+		for (int x = 0; x <= size; ++x)
+		{
+			short v[8] = { short(x * 16), short(int(sinf(x * 0.05f) * cosf(y * 0.05f) * 1000)), short(y * 16), 0, 0, 0, short(x * 32), short(y * 32) };
+			unsigned char* vertex = &vertices[(y * (size + 1) + x) * vertex_size];
+			memcpy(vertex, v, vertex_size);
+			vertex[8] = 0;
+			vertex[9] = 127;
+			vertex[10] = (unsigned char)(x & 7); //some noise in the normals
+			vertex[11] = (unsigned char)((x * 7919 + y * 104729) >> 3); //and random bytes, so all the group sizes are used
+		}
+	std::vector<unsigned char> encoded_vertices = encodeVertexBuffer(&vertices[0], num_vertices, vertex_size);
+	std::cout << "\t vertices: " << vertices.size() / (1024.0 * 1024.0) << "MB encoded in " << encoded_vertices.size() / (1024.0 * 1024.0) << "MB" << std::endl;
+
+	std::vector<unsigned char> result(vertices.size());
+	bool simd = use_simd;
+	for (int s = 0; s < (hasSIMD() ? 2 : 1); ++s)
+	{
+		use_simd = s != 0;
+		bool ok = true;
+		double time = measure([&]() { ok = decodeVertexBuffer(&result[0], num_vertices, vertex_size, &encoded_vertices[0], encoded_vertices.size()) && ok; });
+		ok = ok && result == vertices;
+		printResult(s ? "vertex codec (SSSE3)" : "vertex codec (scalar)", ok, time, vertices.size());
+	}
+	use_simd = simd;
+	//missing bytes in the tail
+	bool ok_tail = !decodeVertexBuffer(&result[0], num_vertices, vertex_size, &encoded_vertices[0], encoded_vertices.size() - 1);
+	std::cout << "\t truncated vertices: " << (ok_tail ? "OK" : "[ERROR] accepted") << std::endl;
+
+	//the triangles of the grid, in rows
+	std::vector<unsigned int> indices;
+	indices.reserve(size * size * 6);
+	for (int y = 0; y < size; ++y)
+		for (int x = 0; x < size; ++x)
+		{
+			unsigned int i = y * (size + 1) + x;
+			unsigned int quad[6] = { i, i + size + 1, i + 1, i + 1, i + size + 1, i + size + 2 };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	std::vector<unsigned char> encoded_indices = encodeIndexBuffer(&indices[0], indices.size());
+	std::vector<unsigned int> decoded_indices(indices.size());
+	bool ok = true;
+	double time = measure([&]() { ok = decodeIndexBuffer(&decoded_indices[0], indices.size(), 4, &encoded_indices[0], encoded_indices.size()) && ok; });
+	ok = ok && sameTriangles(&indices[0], &decoded_indices[0], indices.size());
+	std::cout << "\t indices: " << indices.size() * 4 / (1024.0 * 1024.0) << "MB encoded in " << encoded_indices.size() / (1024.0 * 1024.0) << "MB" << std::endl;
+	printResult("index codec", ok, time, indices.size() * 4);
+
+	std::vector<unsigned char> encoded_sequence = encodeIndexSequence(&indices[0], indices.size());
+	ok = true;
+	time = measure([&]() { ok = decodeIndexSequence(&decoded_indices[0], indices.size(), 4, &encoded_sequence[0], encoded_sequence.size()) && ok; });
+	ok = ok && decoded_indices == indices;
+	printResult("index sequence codec", ok, time, indices.size() * 4);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#ifndef MESHOPTDECODER_H
+#define MESHOPTDECODER_H
+
+#include <cstddef>
+
+//Decoders of the EXT_meshopt_compression buffer views (the codecs of meshoptimizer, the ones gltfpack writes).
+//The vertex codec stores the deltas between vertices byte by byte in groups of 16 of 0, 2, 4 or 8 bits,
+//those groups are unpacked with SSSE3 when the CPU has it. The index codec stores the triangles with FIFOs
+//of the recent edges and vertices. They write directly in the destination and dont use GL, so they can run in any thread.
+class MeshoptDecoder {
+public:
+	static bool use_simd; //false forces the scalar path (only used if the CPU supports it)
+
+	//vertex_size must be a multiple of 4 and up to 256 bytes, false if the data is corrupted or truncated
+	static bool decodeVertexBuffer(void* destination, size_t vertex_count, size_t vertex_size, const unsigned char* buffer, size_t buffer_size);
+	//index_size is the size of the destination (2 or 4), the encoded data doesnt depend on it
+	static bool decodeIndexBuffer(void* destination, size_t index_count, size_t index_size, const unsigned char* buffer, size_t buffer_size);
+	static bool decodeIndexSequence(void* destination, size_t index_count, size_t index_size, const unsigned char* buffer, size_t buffer_size);
+
+	//filters applied in place after decoding the vertices
+	static void decodeFilterOct(void* data, size_t count, size_t stride); //snorm8x4 or snorm16x4 octahedral normals
+	static void decodeFilterQuat(void* data, size_t count, size_t stride); //snorm16x4 quaternions, the largest component is reconstructed
+	static void decodeFilterExp(void* data, size_t count, size_t stride); //floats as 24 bits of mantissa and 8 of exponent
+
+	static bool hasSIMD();
+
+	//checks the decoders with known streams and synthetic encoded grids, shows the throughput in the console
+	static void benchmark();
+};
+
+#endif
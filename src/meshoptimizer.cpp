@@ -0,0 +1,765 @@
+#include "meshoptimizer.h"
+#include "utils.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cfloat>
+
+//Forsyth scores, the cache modelled is larger than the simulated one so it works for any GPU
+const int FORSYTH_CACHE_SIZE = 32;
+const float FORSYTH_CACHE_DECAY = 1.5f;
+const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+const float FORSYTH_VALENCE_SCALE = 2.0f;
+const float FORSYTH_VALENCE_POWER = 0.5f;
+
+const int OVERDRAW_RESOLUTION = 256;
+const unsigned int UNUSED_VERTEX = 0xFFFFFFFF;
+
+static float getVertexScore(int cache_position, unsigned int remaining)
+{
+	if (!remaining)
+		return -1.0f; //no triangles left, it doesnt matter anymore
+	float score = 0;
+	if (cache_position >= 0)
+	{
+		//the vertices of the last triangle get a fixed score, so the next triangle doesnt always use them
+		if (cache_position < 3)
+			score = FORSYTH_LAST_TRIANGLE_SCORE;
+		else
+			score = powf(1.0f - (cache_position - 3) / (float)(FORSYTH_CACHE_SIZE - 3), FORSYTH_CACHE_DECAY);
+	}
+	//the vertices with few triangles left go first, so they leave the cache sooner
+	return score + FORSYTH_VALENCE_SCALE * powf((float)remaining, -FORSYTH_VALENCE_POWER);
+}
+
+unsigned int MeshOptimizer::weld(std::vector<unsigned int>& remap, const std::vector<sVertexStream>& streams, unsigned int num_vertices)
+{
+	size_t vertex_size = 0;
+	for (int i = 0; i < streams.size(); ++i)
+		vertex_size += streams[i].size;
+
+	//the attributes of every vertex together, so they are compared and hashed at once
+	std::vector<uint8> packed(num_vertices * vertex_size);
+	for (unsigned int i = 0; i < num_vertices; ++i)
+	{
+		uint8* dst = &packed[i * vertex_size];
+		for (int j = 0; j < streams.size(); ++j)
+		{
+			memcpy(dst, (const uint8*)streams[j].data + i * streams[j].stride, streams[j].size);
+			dst += streams[j].size;
+		}
+	}
+
+	//open addressing, at least twice the slots than vertices
+	size_t table_size = 1;
+	while (table_size < num_vertices * 2)
+		table_size *= 2;
+	std::vector<unsigned int> table(table_size, UNUSED_VERTEX);
+
+	remap.resize(num_vertices);
+	unsigned int num_unique = 0;
+	for (unsigned int i = 0; i < num_vertices; ++i)
+	{
+		const uint8* key = &packed[i * vertex_size];
+		size_t slot = hashFNV1a(key, vertex_size) & (table_size - 1);
+		while (table[slot] != UNUSED_VERTEX && memcmp(&packed[table[slot] * vertex_size], key, vertex_size) != 0)
+			slot = (slot + 1) & (table_size - 1);
+		if (table[slot] == UNUSED_VERTEX)
+		{
+			table[slot] = i;
+			remap[i] = num_unique++;
+		}
+		else
+			remap[i] = remap[table[slot]];
+	}
+	return num_unique;
+}
+
+void MeshOptimizer::optimizeVertexCache(unsigned int* indices, size_t num_indices, unsigned int num_vertices)
+{
+	size_t num_triangles = num_indices / 3;
+	if (num_triangles < 2)
+		return;
+
+	//triangles of every vertex, the emitted ones are removed from the lists
+	std::vector<unsigned int> offsets(num_vertices + 1, 0);
+	for (size_t i = 0; i < num_indices; ++i)
+		offsets[indices[i] + 1]++;
+	for (unsigned int i = 0; i < num_vertices; ++i)
+		offsets[i + 1] += offsets[i];
+	std::vector<unsigned int> remaining(num_vertices);
+	for (unsigned int i = 0; i < num_vertices; ++i)
+		remaining[i] = offsets[i + 1] - offsets[i];
+	std::vector<unsigned int> adjacency(num_indices);
+	{
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < num_indices; ++i)
+			adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+	}
+
+	std::vector<int> cache_position(num_vertices, -1);
+	std::vector<float> vertex_score(num_vertices);
+	for (unsigned int i = 0; i < num_vertices; ++i)
+		vertex_score[i] = getVertexScore(-1, remaining[i]);
+	std::vector<float> triangle_score(num_triangles);
+	std::vector<bool> emitted(num_triangles, false);
+	int best = 0;
+	for (size_t i = 0; i < num_triangles; ++i)
+	{
+		unsigned int* tri = &indices[i * 3];
+		triangle_score[i] = vertex_score[tri[0]] + vertex_score[tri[1]] + vertex_score[tri[2]];
+		if (triangle_score[i] > triangle_score[best])
+			best = (int)i;
+	}
+
+	std::vector<unsigned int> result;
+	result.reserve(num_indices);
+	unsigned int cache[FORSYTH_CACHE_SIZE + 3];
+	int cache_size = 0;
+	size_t next_triangle = 0; //to continue when no triangle uses the vertices in the cache
+
+	for (size_t n = 0; n < num_triangles; ++n)
+	{
+		if (best == -1)
+		{
+			while (emitted[next_triangle])
+				next_triangle++;
+			best = (int)next_triangle;
+		}
+
+		unsigned int tri[3] = { indices[best * 3], indices[best * 3 + 1], indices[best * 3 + 2] };
+		result.insert(result.end(), tri, tri + 3);
+		emitted[best] = true;
+		for (int k = 0; k < 3; ++k)
+		{
+			unsigned int* list = &adjacency[offsets[tri[k]]];
+			unsigned int& count = remaining[tri[k]];
+			for (unsigned int j = 0; j < count; ++j)
+				if (list[j] == (unsigned int)best)
+				{
+					list[j] = list[count - 1];
+					count--;
+					break;
+				}
+		}
+
+		//the triangle goes first, the rest are pushed back (and out after FORSYTH_CACHE_SIZE)
+		unsigned int new_cache[FORSYTH_CACHE_SIZE + 3];
+		int new_size = 0;
+		for (int k = 0; k < 3; ++k)
+			if (std::find(new_cache, new_cache + new_size, tri[k]) == new_cache + new_size)
+				new_cache[new_size++] = tri[k];
+		for (int i = 0; i < cache_size; ++i)
+			if (cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+				new_cache[new_size++] = cache[i];
+
+		//the scores change for the vertices in the cache and for the ones that left it
+		best = -1;
+		float best_score = -FLT_MAX;
+		for (int i = 0; i < new_size; ++i)
+		{
+			unsigned int v = new_cache[i];
+			int position = i < FORSYTH_CACHE_SIZE ? i : -1;
+			cache_position[v] = position;
+			float score = getVertexScore(position, remaining[v]);
+			float delta = score - vertex_score[v];
+			vertex_score[v] = score;
+			for (unsigned int j = offsets[v]; j < offsets[v] + remaining[v]; ++j)
+			{
+				unsigned int t = adjacency[j];
+				triangle_score[t] += delta;
+				if (triangle_score[t] > best_score)
+				{
+					best_score = triangle_score[t];
+					best = (int)t;
+				}
+			}
+		}
+		cache_size = std::min(new_size, FORSYTH_CACHE_SIZE);
+		memcpy(cache, new_cache, cache_size * sizeof(unsigned int));
+	}
+
+	memcpy(indices, &result[0], num_indices * sizeof(unsigned int));
+}
+
+void MeshOptimizer::optimizeOverdraw(unsigned int* indices, size_t num_indices, const Vector3* positions, unsigned int num_vertices)
+{
+	size_t num_triangles = num_indices / 3;
+	if (num_triangles < 2)
+		return;
+
+	//the clusters start where the cache is flushed (the three vertices miss), reordering them keeps the hits inside
+	std::vector<unsigned int> starts;
+	{
+		std::vector<unsigned int> timestamps(num_vertices, 0);
+		unsigned int time = CACHE_SIZE + 1;
+		for (size_t i = 0; i < num_triangles; ++i)
+		{
+			int misses = 0;
+			for (int k = 0; k < 3; ++k)
+			{
+				unsigned int v = indices[i * 3 + k];
+				if (time - timestamps[v] > CACHE_SIZE)
+				{
+					timestamps[v] = time++;
+					misses++;
+				}
+			}
+			if (i == 0 || misses == 3)
+				starts.push_back((unsigned int)i);
+		}
+	}
+	if (starts.size() < 2)
+		return;
+	starts.push_back((unsigned int)num_triangles);
+
+	struct sCluster {
+		unsigned int start;
+		unsigned int end;
+		Vector3 centroid;
+		Vector3 normal;
+		float area;
+		float sort_key;
+	};
+	std::vector<sCluster> clusters(starts.size() - 1);
+	Vector3 mesh_centroid;
+	float mesh_area = 0;
+	for (int i = 0; i < clusters.size(); ++i)
+	{
+		sCluster& cluster = clusters[i];
+		cluster.start = starts[i];
+		cluster.end = starts[i + 1];
+		cluster.area = 0;
+		for (unsigned int t = cluster.start; t < cluster.end; ++t)
+		{
+			const Vector3& a = positions[indices[t * 3]];
+			const Vector3& b = positions[indices[t * 3 + 1]];
+			const Vector3& c = positions[indices[t * 3 + 2]];
+			Vector3 normal = (b - a).cross(c - a); //its length is twice the area
+			float area = (float)normal.length();
+			cluster.normal = cluster.normal + normal;
+			cluster.centroid = cluster.centroid + (a + b + c) * (area / 3.0f);
+			cluster.area += area;
+		}
+		mesh_centroid = mesh_centroid + cluster.centroid;
+		mesh_area += cluster.area;
+		if (cluster.area > 0)
+			cluster.centroid = cluster.centroid * (1.0f / cluster.area);
+	}
+	if (mesh_area > 0)
+		mesh_centroid = mesh_centroid * (1.0f / mesh_area);
+
+	//the ones facing out of the mesh are more likely to occlude the others
+	for (int i = 0; i < clusters.size(); ++i)
+	{
+		sCluster& cluster = clusters[i];
+		float length = (float)cluster.normal.length();
+		cluster.sort_key = length > 0 ? (cluster.centroid - mesh_centroid).dot(cluster.normal) / length : 0;
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), [](const sCluster& a, const sCluster& b) { return a.sort_key > b.sort_key; });
+
+	std::vector<unsigned int> result;
+	result.reserve(num_indices);
+	for (int i = 0; i < clusters.size(); ++i)
+		result.insert(result.end(), indices + clusters[i].start * 3, indices + clusters[i].end * 3);
+	memcpy(indices, &result[0], num_triangles * 3 * sizeof(unsigned int));
+}
+
+unsigned int MeshOptimizer::optimizeVertexFetch(std::vector<unsigned int>& remap, const unsigned int* indices, size_t num_indices, unsigned int num_vertices)
+{
+	remap.assign(num_vertices, UNUSED_VERTEX);
+	unsigned int num_used = 0;
+	for (size_t i = 0; i < num_indices; ++i)
+		if (remap[indices[i]] == UNUSED_VERTEX)
+			remap[indices[i]] = num_used++;
+	return num_used;
+}
+
+//pixels shaded and covered looking at the mesh along one axis, the triangles are drawn in order with depth test
+static void rasterizeOverdraw(const unsigned int* indices, size_t num_indices, const Vector3* positions, const Vector3& center, float scale, int view, double& shaded, double& covered)
+{
+	const int res = OVERDRAW_RESOLUTION;
+	int axis = view / 2;
+	Vector3 front, up;
+	front.v[axis] = (view % 2) ? -1.0f : 1.0f;
+	up.v[axis == 1 ? 2 : 1] = 1.0f;
+	Vector3 right = front.cross(up); //right x up = -front, like a camera, so front faces are counter clockwise
+
+	std::vector<float> zbuffer(res * res, FLT_MAX);
+	shaded = covered = 0;
+	for (size_t i = 0; i + 2 < num_indices; i += 3)
+	{
+		Vector3 p[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			Vector3 local = positions[indices[i + k]] - center;
+			p[k].set(local.dot(right) * scale + res * 0.5f, local.dot(up) * scale + res * 0.5f, local.dot(front));
+		}
+		float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+		if (area <= 0)
+			continue; //back facing or degenerated
+
+		int min_x = std::max(0, (int)floorf(std::min(p[0].x, std::min(p[1].x, p[2].x))));
+		int max_x = std::min(res - 1, (int)ceilf(std::max(p[0].x, std::max(p[1].x, p[2].x))));
+		int min_y = std::max(0, (int)floorf(std::min(p[0].y, std::min(p[1].y, p[2].y))));
+		int max_y = std::min(res - 1, (int)ceilf(std::max(p[0].y, std::max(p[1].y, p[2].y))));
+		for (int y = min_y; y <= max_y; ++y)
+			for (int x = min_x; x <= max_x; ++x)
+			{
+				float px = x + 0.5f, py = y + 0.5f;
+				float w0 = (p[2].x - p[1].x) * (py - p[1].y) - (p[2].y - p[1].y) * (px - p[1].x);
+				float w1 = (p[0].x - p[2].x) * (py - p[2].y) - (p[0].y - p[2].y) * (px - p[2].x);
+				float w2 = (p[1].x - p[0].x) * (py - p[0].y) - (p[1].y - p[0].y) * (px - p[0].x);
+				if (w0 < 0 || w1 < 0 || w2 < 0)
+					continue;
+				float z = (w0 * p[0].z + w1 * p[1].z + w2 * p[2].z) / area;
+				float& depth = zbuffer[y * res + x];
+				if (z < depth)
+				{
+					depth = z;
+					shaded++;
+				}
+			}
+	}
+	for (int i = 0; i < res * res; ++i)
+		if (zbuffer[i] != FLT_MAX)
+			covered++;
+}
+
+sMeshOptStats MeshOptimizer::computeStats(const unsigned int* indices, size_t num_indices, const Vector3* positions, unsigned int num_vertices)
+{
+	sMeshOptStats stats;
+	memset(&stats, 0, sizeof(stats));
+	size_t num_triangles = num_indices / 3;
+	if (!num_triangles)
+		return stats;
+
+	std::vector<unsigned int> timestamps(num_vertices, 0);
+	unsigned int time = CACHE_SIZE + 1;
+	unsigned int misses = 0, num_used = 0;
+	Vector3 min_pos = positions[indices[0]], max_pos = min_pos;
+	for (size_t i = 0; i < num_triangles * 3; ++i)
+	{
+		unsigned int v = indices[i];
+		if (!timestamps[v])
+		{
+			num_used++;
+			min_pos.setMin(positions[v]);
+			max_pos.setMax(positions[v]);
+		}
+		if (time - timestamps[v] > CACHE_SIZE)
+		{
+			timestamps[v] = time++;
+			misses++;
+		}
+	}
+	stats.acmr = misses / (float)num_triangles;
+	stats.atvr = misses / (float)num_used;
+
+	Vector3 size = max_pos - min_pos;
+	float max_size = std::max(size.x, std::max(size.y, size.z));
+	if (max_size <= 0)
+		return stats;
+	Vector3 center = (min_pos + max_pos) * 0.5f;
+	float scale = (OVERDRAW_RESOLUTION - 1) / max_size;
+
+	double shaded[6], covered[6];
+	JobSystem::parallelFor(6, 1, [&](int first, int last) {
+		for (int view = first; view < last; ++view)
+			rasterizeOverdraw(indices, num_triangles * 3, positions, center, scale, view, shaded[view], covered[view]);
+	});
+	double total_shaded = 0, total_covered = 0;
+	for (int i = 0; i < 6; ++i)
+	{
+		total_shaded += shaded[i];
+		total_covered += covered[i];
+	}
+	stats.overdraw = total_covered > 0 ? (float)(total_shaded / total_covered) : 0;
+	return stats;
+}
+
+//** SIMPLIFICATION ***************************************
+
+//the vertices in the border of a hole and in a seam (same position, different attributes) can only move along it
+enum eVertexKind { KIND_MANIFOLD, KIND_BORDER, KIND_SEAM, KIND_LOCKED };
+
+//from (row) to (column)
+const bool CAN_COLLAPSE[4][4] = {
+	{ true, true, true, true },
+	{ false, true, false, false },
+	{ false, false, true, false },
+	{ false, false, false, false },
+};
+
+//the open edges cost more to move, so the silhouettes of the holes are kept
+const float SIMPLIFY_EDGE_WEIGHT = 10.0f;
+//the collapse is rejected if a triangle normal turns more than ~75 degrees
+const float SIMPLIFY_FLIP_THRESHOLD = 0.25f;
+
+//symmetric matrix A, vector b and constant c of the sum of the squared distances to some planes
+struct sQuadric {
+	float a00, a11, a22, a10, a20, a21;
+	float b0, b1, b2;
+	float c;
+	float w;
+};
+
+static void addPlane(sQuadric& q, const Vector3& n, float d, float w)
+{
+	q.a00 += n.x * n.x * w; q.a11 += n.y * n.y * w; q.a22 += n.z * n.z * w;
+	q.a10 += n.y * n.x * w; q.a20 += n.z * n.x * w; q.a21 += n.z * n.y * w;
+	q.b0 += n.x * d * w; q.b1 += n.y * d * w; q.b2 += n.z * d * w;
+	q.c += d * d * w;
+	q.w += w;
+}
+
+static void addQuadric(sQuadric& q, const sQuadric& r)
+{
+	q.a00 += r.a00; q.a11 += r.a11; q.a22 += r.a22;
+	q.a10 += r.a10; q.a20 += r.a20; q.a21 += r.a21;
+	q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+	q.c += r.c;
+	q.w += r.w;
+}
+
+//mean squared distance from v to the planes
+static float quadricError(const sQuadric& q, const Vector3& v)
+{
+	float rx = q.a00 * v.x + q.a10 * v.y + q.a20 * v.z;
+	float ry = q.a10 * v.x + q.a11 * v.y + q.a21 * v.z;
+	float rz = q.a20 * v.x + q.a21 * v.y + q.a22 * v.z;
+	float r = rx * v.x + ry * v.y + rz * v.z + 2.0f * (q.b0 * v.x + q.b1 * v.y + q.b2 * v.z) + q.c;
+	return q.w > 0 ? fabsf(r) / q.w : 0.0f;
+}
+
+//directed edges a->b of the triangles, in CSR
+struct sEdgeAdjacency {
+	std::vector<unsigned int> offsets;
+	std::vector<unsigned int> targets;
+
+	void build(const unsigned int* indices, size_t num_indices, unsigned int num_vertices)
+	{
+		offsets.assign(num_vertices + 1, 0);
+		for (size_t i = 0; i < num_indices; ++i)
+			offsets[indices[i] + 1]++;
+		for (unsigned int i = 0; i < num_vertices; ++i)
+			offsets[i + 1] += offsets[i];
+		targets.resize(num_indices);
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i + 2 < num_indices; i += 3)
+			for (int k = 0; k < 3; ++k)
+				targets[fill[indices[i + k]]++] = indices[i + (k + 1) % 3];
+	}
+
+	bool hasEdge(unsigned int a, unsigned int b) const
+	{
+		for (unsigned int i = offsets[a]; i < offsets[a + 1]; ++i)
+			if (targets[i] == b)
+				return true;
+		return false;
+	}
+};
+
+struct sCollapse {
+	unsigned int v0, v1; //v0 moves to v1
+	float error;
+};
+
+//true if moving the vertex r0 (canonical) to the position of i1 turns over any of its triangles
+static bool hasTriangleFlips(const sEdgeAdjacency& triangles, const unsigned int* indices, const std::vector<unsigned int>& remap, const std::vector<Vector3>& positions, unsigned int r0, unsigned int i1)
+{
+	unsigned int r1 = remap[i1];
+	const Vector3& p1 = positions[i1];
+	for (unsigned int i = triangles.offsets[r0]; i < triangles.offsets[r0 + 1]; ++i)
+	{
+		const unsigned int* tri = indices + triangles.targets[i] * 3;
+		unsigned int a = remap[tri[0]], b = remap[tri[1]], c = remap[tri[2]];
+		if (a == r1 || b == r1 || c == r1)
+			continue; //collapses with the edge
+		//rotate so the moving vertex is the first
+		if (b == r0) { std::swap(a, b); std::swap(b, c); }
+		else if (c == r0) { std::swap(a, c); std::swap(b, c); }
+		const Vector3& pb = positions[b];
+		const Vector3& pc = positions[c];
+		Vector3 n0 = (pb - positions[a]).cross(pc - positions[a]);
+		Vector3 n1 = (pb - p1).cross(pc - p1);
+		if (n0.dot(n1) <= SIMPLIFY_FLIP_THRESHOLD * (float)n0.length() * (float)n1.length())
+			return true;
+	}
+	return false;
+}
+
+size_t MeshOptimizer::simplify(unsigned int* destination, const unsigned int* indices, size_t num_indices, const Vector3* positions, unsigned int num_vertices, size_t target_num_indices, float max_error, float* result_error)
+{
+	if (result_error)
+		*result_error = 0;
+	num_indices -= num_indices % 3;
+	memcpy(destination, indices, num_indices * sizeof(unsigned int));
+	if (num_indices <= target_num_indices || !num_vertices)
+		return num_indices;
+
+	//the errors are computed in a unit box so the limits dont depend on the scale
+	Vector3 min_pos = positions[indices[0]], max_pos = min_pos;
+	for (size_t i = 0; i < num_indices; ++i)
+	{
+		min_pos.setMin(positions[indices[i]]);
+		max_pos.setMax(positions[indices[i]]);
+	}
+	Vector3 size = max_pos - min_pos;
+	float extent = std::max(size.x, std::max(size.y, size.z));
+	if (extent <= 0)
+		return num_indices;
+	std::vector<Vector3> points(num_vertices);
+	for (unsigned int i = 0; i < num_vertices; ++i)
+		points[i] = (positions[i] - min_pos) * (1.0f / extent);
+
+	//remap[i] is the first vertex with the same position, wedge[i] the next one (a ring)
+	std::vector<unsigned int> remap;
+	std::vector<sVertexStream> streams(1);
+	streams[0].data = positions;
+	streams[0].size = sizeof(Vector3);
+	streams[0].stride = sizeof(Vector3);
+	unsigned int num_unique = weld(remap, streams, num_vertices);
+	std::vector<unsigned int> first(num_unique, UNUSED_VERTEX);
+	std::vector<unsigned int> wedge(num_vertices);
+	for (unsigned int i = 0; i < num_vertices; ++i)
+	{
+		unsigned int& f = first[remap[i]];
+		if (f == UNUSED_VERTEX)
+			f = i;
+		remap[i] = f;
+		wedge[i] = i;
+		if (f != i)
+		{
+			wedge[i] = wedge[f];
+			wedge[f] = i;
+		}
+	}
+
+	//the open edges (without the opposite one) of every vertex, the vertex itself if it has more than one
+	sEdgeAdjacency edges;
+	edges.build(destination, num_indices, num_vertices);
+	std::vector<unsigned int> open_in(num_vertices, UNUSED_VERTEX), open_out(num_vertices, UNUSED_VERTEX);
+	for (unsigned int v = 0; v < num_vertices; ++v)
+		for (unsigned int i = edges.offsets[v]; i < edges.offsets[v + 1]; ++i)
+		{
+			unsigned int t = edges.targets[i];
+			if (edges.hasEdge(t, v))
+				continue;
+			open_in[t] = (open_in[t] == UNUSED_VERTEX) ? v : t;
+			open_out[v] = (open_out[v] == UNUSED_VERTEX) ? t : v;
+		}
+
+	std::vector<uint8> kinds(num_vertices, KIND_LOCKED);
+	for (unsigned int i = 0; i < num_vertices; ++i)
+	{
+		if (remap[i] != i)
+		{
+			kinds[i] = kinds[remap[i]];
+			continue;
+		}
+		unsigned int oi = open_in[i], oo = open_out[i];
+		if (wedge[i] == i)
+		{
+			if (oi == UNUSED_VERTEX && oo == UNUSED_VERTEX)
+				kinds[i] = KIND_MANIFOLD;
+			else if (oi != UNUSED_VERTEX && oo != UNUSED_VERTEX && oi != i && oo != i)
+				kinds[i] = KIND_BORDER;
+		}
+		else if (wedge[wedge[i]] == i)
+		{
+			//two wedges, each with one open edge in and out and both sides joining the same vertices
+			unsigned int w = wedge[i];
+			unsigned int wi = open_in[w], wo = open_out[w];
+			bool valid = oi != UNUSED_VERTEX && oi != i && oo != UNUSED_VERTEX && oo != i && wi != UNUSED_VERTEX && wi != w && wo != UNUSED_VERTEX && wo != w;
+			if (valid && remap[oi] == remap[wo] && remap[oo] == remap[wi] && remap[oi] != remap[oo])
+				kinds[i] = KIND_SEAM;
+		}
+	}
+
+	//the planes of the triangles weighted by their area, and the planes perpendicular to the open edges
+	std::vector<sQuadric> quadrics(num_vertices);
+	memset(&quadrics[0], 0, num_vertices * sizeof(sQuadric));
+	for (size_t i = 0; i < num_indices; i += 3)
+	{
+		const unsigned int* tri = destination + i;
+		Vector3 normal = (points[tri[1]] - points[tri[0]]).cross(points[tri[2]] - points[tri[0]]);
+		float area = (float)normal.length();
+		if (area <= 0)
+			continue;
+		normal *= 1.0f / area;
+		float d = -normal.dot(points[tri[0]]);
+		for (int k = 0; k < 3; ++k)
+			addPlane(quadrics[remap[tri[k]]], normal, d, area);
+
+		for (int k = 0; k < 3; ++k)
+		{
+			unsigned int a = tri[k], b = tri[(k + 1) % 3];
+			if (open_out[a] != b)
+				continue;
+			Vector3 edge = points[b] - points[a];
+			float length = (float)edge.length();
+			if (length <= 0)
+				continue;
+			Vector3 edge_normal = edge.cross(normal);
+			edge_normal.normalize();
+			float edge_d = -edge_normal.dot(points[a]);
+			addPlane(quadrics[remap[a]], edge_normal, edge_d, length * length * SIMPLIFY_EDGE_WEIGHT);
+			addPlane(quadrics[remap[b]], edge_normal, edge_d, length * length * SIMPLIFY_EDGE_WEIGHT);
+		}
+	}
+
+	float error_limit = (max_error / extent) * (max_error / extent);
+	float worst_error = 0;
+	size_t count = num_indices;
+	sEdgeAdjacency triangles; //triangles of every canonical vertex
+	std::vector<sCollapse> collapses, applied;
+	std::vector<unsigned int> collapse_remap(num_vertices);
+	std::vector<uint8> locked(num_vertices);
+	size_t goal_limit = num_indices; //halved when a pass goes below the target
+
+	while (count > target_num_indices)
+	{
+		//the triangles of the canonical vertices, reusing the CSR of the edges
+		triangles.offsets.assign(num_vertices + 1, 0);
+		for (size_t i = 0; i < count; ++i)
+			triangles.offsets[remap[destination[i]] + 1]++;
+		for (unsigned int i = 0; i < num_vertices; ++i)
+			triangles.offsets[i + 1] += triangles.offsets[i];
+		triangles.targets.resize(count);
+		std::vector<unsigned int> fill(triangles.offsets.begin(), triangles.offsets.end() - 1);
+		for (size_t i = 0; i < count; ++i)
+			triangles.targets[fill[remap[destination[i]]]++] = (unsigned int)(i / 3);
+
+		//every edge once, in the cheapest direction allowed
+		collapses.clear();
+		for (size_t i = 0; i < count; i += 3)
+			for (int k = 0; k < 3; ++k)
+			{
+				unsigned int i0 = destination[i + k], i1 = destination[i + (k + 1) % 3];
+				unsigned int r0 = remap[i0], r1 = remap[i1];
+				if (r0 == r1)
+					continue;
+				uint8 k0 = kinds[i0], k1 = kinds[i1];
+				bool forward = CAN_COLLAPSE[k0][k1], backward = CAN_COLLAPSE[k1][k0];
+				if (!forward && !backward)
+					continue;
+				if (k0 == k1 && (k0 == KIND_BORDER || k0 == KIND_SEAM))
+				{
+					if (open_out[i0] != i1)
+						continue; //not along the border
+				}
+				else if (r0 > r1)
+					continue; //the opposite edge is also there
+				sCollapse c;
+				float e0 = forward ? quadricError(quadrics[r0], points[i1]) : FLT_MAX;
+				float e1 = backward ? quadricError(quadrics[r1], points[i0]) : FLT_MAX;
+				c.v0 = e0 <= e1 ? i0 : i1;
+				c.v1 = e0 <= e1 ? i1 : i0;
+				c.error = std::min(e0, e1);
+				collapses.push_back(c);
+			}
+		if (collapses.empty())
+			break;
+		std::sort(collapses.begin(), collapses.end(), [](const sCollapse& a, const sCollapse& b) { return a.error < b.error; });
+
+		//most collapses remove two triangles, the error of the expected last one limits the pass
+		//(many collapses get locked by the ones next to them, so it allows some more)
+		size_t triangle_goal = std::min((count - target_num_indices) / 3, goal_limit);
+		size_t edge_goal = triangle_goal / 2;
+		float error_goal = edge_goal < collapses.size() ? 1.5f * collapses[edge_goal].error : FLT_MAX;
+
+		for (unsigned int i = 0; i < num_vertices; ++i)
+			collapse_remap[i] = i;
+		memset(&locked[0], 0, num_vertices);
+		size_t num_collapsed = 0;
+		float pass_error = 0;
+		applied.clear();
+		for (size_t i = 0; i < collapses.size(); ++i)
+		{
+			const sCollapse& c = collapses[i];
+			if (c.error > error_limit || num_collapsed >= triangle_goal)
+				break;
+			if (c.error > error_goal && num_collapsed > triangle_goal / 6)
+				break;
+			unsigned int i0 = c.v0, i1 = c.v1;
+			unsigned int r0 = remap[i0], r1 = remap[i1];
+			if (locked[r0] || locked[r1])
+				continue;
+			if (hasTriangleFlips(triangles, destination, remap, points, r0, i1))
+				continue;
+
+			if (kinds[i0] == KIND_SEAM)
+			{
+				//the other side of the seam moves to the other side
+				collapse_remap[i0] = i1;
+				collapse_remap[wedge[i0]] = wedge[i1];
+			}
+			else
+			{
+				unsigned int v = i0;
+				do
+				{
+					collapse_remap[v] = i1;
+					v = wedge[v];
+				} while (v != i0);
+			}
+			applied.push_back(c);
+			locked[r0] = locked[r1] = 1;
+			num_collapsed += kinds[i0] == KIND_BORDER ? 1 : 2;
+			pass_error = std::max(pass_error, c.error);
+		}
+		if (!num_collapsed)
+			break;
+
+		//some collapses remove more triangles than counted (the last ones of a border), the target is a minimum:
+		//the pass is repeated with less collapses, so the small meshes dont vanish
+		size_t remaining = 0;
+		for (size_t i = 0; i < count; i += 3)
+		{
+			unsigned int a = collapse_remap[destination[i]];
+			unsigned int b = collapse_remap[destination[i + 1]];
+			unsigned int c = collapse_remap[destination[i + 2]];
+			if (a != b && b != c && a != c)
+				remaining += 3;
+		}
+		if (remaining < target_num_indices || !remaining)
+		{
+			if (triangle_goal <= 1)
+				break;
+			goal_limit = triangle_goal / 2;
+			continue;
+		}
+		worst_error = std::max(worst_error, pass_error);
+		for (size_t i = 0; i < applied.size(); ++i)
+			addQuadric(quadrics[remap[applied[i].v1]], quadrics[remap[applied[i].v0]]);
+
+		//the borders continue to the vertex where they collapsed
+		for (unsigned int i = 0; i < num_vertices; ++i)
+			if (open_out[i] != UNUSED_VERTEX)
+			{
+				unsigned int next = collapse_remap[open_out[i]];
+				open_out[i] = (next == i) ? collapse_remap[open_out[open_out[i]]] : next;
+			}
+
+		size_t write = 0;
+		for (size_t i = 0; i < count; i += 3)
+		{
+			unsigned int a = collapse_remap[destination[i]];
+			unsigned int b = collapse_remap[destination[i + 1]];
+			unsigned int c = collapse_remap[destination[i + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+			destination[write++] = a;
+			destination[write++] = b;
+			destination[write++] = c;
+		}
+		count = write;
+	}
+
+	if (result_error)
+		*result_error = sqrtf(worst_error) * extent;
+	return count;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include "framework.h"
+#include <vector>
+
+//one attribute of the vertices, size bytes every stride bytes
+struct sVertexStream {
+	const void* data;
+	size_t size;
+	size_t stride;
+};
+
+struct sMeshOptStats {
+	float acmr;		//average cache misses per triangle (FIFO of CACHE_SIZE), 3 is the worst, 0.5 the best for regular grids
+	float atvr;		//cache misses per vertex, 1 is the best
+	float overdraw;	//pixels shaded per pixel covered, from the 6 axis directions
+};
+
+//Optimizes indexed triangle lists for the GPU. The triangle order is chosen for the post-transform
+//vertex cache (Forsyth) and then in clusters for the overdraw (Tipsify), the vertices are ordered by
+//their first use so the fetches are sequential. The LODs are made collapsing the edges with the smallest
+//quadric error (Garland-Heckbert). It doesnt use GL, so it can run in any thread.
+class MeshOptimizer {
+public:
+	static const int CACHE_SIZE = 16; //FIFO simulated for the stats, the size of the older GPUs
+
+	//remap[i] is the index of the vertex i in the unique vertices (equal bytes in all the streams), returns the number of unique vertices
+	static unsigned int weld(std::vector<unsigned int>& remap, const std::vector<sVertexStream>& streams, unsigned int num_vertices);
+	//reorders the triangles in place
+	static void optimizeVertexCache(unsigned int* indices, size_t num_indices, unsigned int num_vertices);
+	//reorders the clusters of a cache optimized list, the ones facing outwards first (they occlude the rest)
+	static void optimizeOverdraw(unsigned int* indices, size_t num_indices, const Vector3* positions, unsigned int num_vertices);
+	//remap[i] is the new index of the vertex i in order of first use (-1 for the unused), returns the number of used vertices
+	static unsigned int optimizeVertexFetch(std::vector<unsigned int>& remap, const unsigned int* indices, size_t num_indices, unsigned int num_vertices);
+
+	//collapses edges in order of quadric error until target_num_indices or max_error (same units than the positions), never moves
+	//the borders and seams out of their edges. The target is a minimum, it keeps at least one triangle.
+	//Writes the indices to destination (num_indices max), returns the number written
+	static size_t simplify(unsigned int* destination, const unsigned int* indices, size_t num_indices, const Vector3* positions, unsigned int num_vertices, size_t target_num_indices, float max_error, float* result_error = NULL);
+
+	static sMeshOptStats computeStats(const unsigned int* indices, size_t num_indices, const Vector3* positions, unsigned int num_vertices);
+};
+
+#endif
@@ -0,0 +1,238 @@
+#include "mipmaps.h"
+#include "texture.h"
+#include "jobs.h"
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#define MIPMAPS_SSE
+	#include <xmmintrin.h>
+#endif
+
+//one level in linear space, always 4 floats per pixel so a pixel fits in a SIMD register
+struct sFloatLevel {
+	int width;
+	int height;
+	std::vector<float> data;
+	void resize(int w, int h) { width = w; height = h; data.resize(w * h * 4); }
+	float* pixel(int x, int y) { return &data[(y * width + x) * 4]; }
+};
+
+static const int KAISER_TAPS = 6;
+static float box_kernel[2] = { 0.5f, 0.5f };
+static float kaiser_kernel[KAISER_TAPS];
+static float srgb_to_linear[256];
+static const int LINEAR_TO_SRGB_SIZE = 4096;
+static uint8 linear_to_srgb[LINEAR_TO_SRGB_SIZE];
+
+static double besselI0(double x)
+{
+	double sum = 1, term = 1;
+	for (int k = 1; k < 20; ++k)
+	{
+		term *= (x * 0.5 / k) * (x * 0.5 / k);
+		sum += term;
+	}
+	return sum;
+}
+
+static bool initTables()
+{
+	for (int i = 0; i < 256; ++i)
+	{
+		float v = i / 255.0f;
+		srgb_to_linear[i] = v <= 0.04045f ? v / 12.92f : powf((v + 0.055f) / 1.055f, 2.4f);
+	}
+	for (int i = 0; i < LINEAR_TO_SRGB_SIZE; ++i)
+	{
+		float v = i / (float)(LINEAR_TO_SRGB_SIZE - 1);
+		float s = v <= 0.0031308f ? v * 12.92f : 1.055f * powf(v, 1.0f / 2.4f) - 0.055f;
+		linear_to_srgb[i] = (uint8)(clamp(s, 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+
+	//2:1 decimation, the taps are at -2.5 .. 2.5 source pixels from the center of the new pixel
+	const double alpha = 4.0;
+	double sum = 0;
+	for (int i = 0; i < KAISER_TAPS; ++i)
+	{
+		double x = i - (KAISER_TAPS - 1) * 0.5;
+		double t = x / (KAISER_TAPS * 0.5);
+		double sinc = fabs(x) < 1e-6 ? 1.0 : sin(M_PI * x * 0.5) / (M_PI * x * 0.5);
+		double window = t * t < 1 ? besselI0(alpha * sqrt(1.0 - t * t)) / besselI0(alpha) : 0;
+		kaiser_kernel[i] = (float)(sinc * window);
+		sum += kaiser_kernel[i];
+	}
+	for (int i = 0; i < KAISER_TAPS; ++i)
+		kaiser_kernel[i] /= (float)sum;
+	return true;
+}
+
+//filters and halves one dimension: out[i] = sum(kernel[k] * in[2i + k - (taps/2 - 1)]), clamped on the borders
+static void downsampleRows(sFloatLevel& src, sFloatLevel& dst, bool horizontal, const float* kernel, int taps)
+{
+	int w = horizontal ? std::max(1, src.width / 2) : src.width;
+	int h = horizontal ? src.height : std::max(1, src.height / 2);
+	dst.resize(w, h);
+	int src_size = horizontal ? src.width : src.height;
+	int first = -(taps / 2 - 1);
+
+	JobSystem::parallelFor(h, std::max(1, h / (JobSystem::getNumThreads() * 4)), [&](int start, int end) {
+		for (int y = start; y < end; ++y)
+			for (int x = 0; x < w; ++x)
+			{
+				int center = (horizontal ? x : y) * 2 + first;
+#ifdef MIPMAPS_SSE
+				__m128 acc = _mm_setzero_ps();
+				for (int k = 0; k < taps; ++k)
+				{
+					int i = std::min(std::max(center + k, 0), src_size - 1);
+					const float* p = horizontal ? src.pixel(i, y) : src.pixel(x, i);
+					acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(p), _mm_set1_ps(kernel[k])));
+				}
+				//the negative lobes can overshoot
+				acc = _mm_min_ps(_mm_max_ps(acc, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+				_mm_storeu_ps(dst.pixel(x, y), acc);
+#else
+				float acc[4] = { 0,0,0,0 };
+				for (int k = 0; k < taps; ++k)
+				{
+					int i = std::min(std::max(center + k, 0), src_size - 1);
+					const float* p = horizontal ? src.pixel(i, y) : src.pixel(x, i);
+					for (int c = 0; c < 4; ++c)
+						acc[c] += p[c] * kernel[k];
+				}
+				float* out = dst.pixel(x, y);
+				for (int c = 0; c < 4; ++c)
+					out[c] = clamp(acc[c], 0.0f, 1.0f);
+#endif
+			}
+	});
+}
+
+static void normalizeNormals(sFloatLevel& level)
+{
+	for (int i = 0, num = level.width * level.height; i < num; ++i)
+	{
+		float* p = &level.data[i * 4];
+		Vector3 n(p[0] * 2.0f - 1.0f, p[1] * 2.0f - 1.0f, p[2] * 2.0f - 1.0f);
+		float len = n.length();
+		if (len < 1e-6f)
+			continue;
+		n = n * (1.0f / len);
+		p[0] = n.x * 0.5f + 0.5f;
+		p[1] = n.y * 0.5f + 0.5f;
+		p[2] = n.z * 0.5f + 0.5f;
+	}
+}
+
+//fraction of pixels that pass the alpha test
+static float computeCoverage(const float* alpha, int num, float scale, float cutoff)
+{
+	int passed = 0;
+	for (int i = 0; i < num; ++i)
+		if (alpha[i * 4] * scale > cutoff)
+			passed++;
+	return passed / (float)num;
+}
+
+//scale for the alpha of a level that gives the coverage of the first level (binary search)
+static float findCoverageScale(const sFloatLevel& level, float cutoff, float target)
+{
+	const float* alpha = &level.data[3];
+	int num = level.width * level.height;
+	float low = 0, high = 4;
+	float best_scale = 1, best_error = fabsf(computeCoverage(alpha, num, 1.0f, cutoff) - target);
+	for (int i = 0; i < 10 && best_error > 0; ++i)
+	{
+		float scale = (low + high) * 0.5f;
+		float coverage = computeCoverage(alpha, num, scale, cutoff);
+		if (fabsf(coverage - target) < best_error)
+		{
+			best_error = fabsf(coverage - target);
+			best_scale = scale;
+		}
+		if (coverage < target)
+			low = scale;
+		else
+			high = scale;
+	}
+	return best_scale;
+}
+
+MipChain::~MipChain()
+{
+	clear();
+}
+
+void MipChain::clear()
+{
+	for (int i = 0; i < levels.size(); ++i)
+		delete levels[i];
+	levels.clear();
+}
+
+bool MipChain::canBuild(Image* image)
+{
+	return image->data && (image->num_channels == 3 || image->num_channels == 4) &&
+		isPowerOfTwo(image->width) && isPowerOfTwo(image->height) && image->width * image->height > 1;
+}
+
+void MipChain::build(Image* image, const sMipOptions& options)
+{
+	assert(canBuild(image));
+	static bool tables_ready = initTables(); //thread safe
+	clear();
+
+	bool srgb = options.srgb && !options.normalmap;
+	int nc = image->num_channels;
+	const float* kernel = options.kaiser ? kaiser_kernel : box_kernel;
+	int taps = options.kaiser ? KAISER_TAPS : 2;
+
+	sFloatLevel current, temp;
+	current.resize(image->width, image->height);
+	for (int i = 0, num = image->width * image->height; i < num; ++i)
+	{
+		const uint8* in = image->data + i * nc;
+		float* out = &current.data[i * 4];
+		for (int c = 0; c < 3; ++c)
+			out[c] = srgb ? srgb_to_linear[in[c]] : in[c] / 255.0f;
+		out[3] = nc == 4 ? in[3] / 255.0f : 1.0f;
+	}
+
+	bool keep_coverage = options.alpha_cutoff > 0 && nc == 4;
+	float target_coverage = keep_coverage ? computeCoverage(&current.data[3], image->width * image->height, 1.0f, options.alpha_cutoff) : 0;
+
+	while (current.width > 1 || current.height > 1)
+	{
+		//separable filter, the dimensions of 1 pixel are not halved
+		if (current.width > 1)
+		{
+			downsampleRows(current, temp, true, kernel, taps);
+			std::swap(current, temp);
+		}
+		if (current.height > 1)
+		{
+			downsampleRows(current, temp, false, kernel, taps);
+			std::swap(current, temp);
+		}
+		if (options.normalmap)
+			normalizeNormals(current);
+
+		//the alpha scale only affects this level, the next one is filtered from the original values
+		float alpha_scale = keep_coverage ? findCoverageScale(current, options.alpha_cutoff, target_coverage) : 1.0f;
+
+		Image* level = new Image();
+		level->resize(current.width, current.height, nc);
+		for (int i = 0, num = current.width * current.height; i < num; ++i)
+		{
+			const float* in = &current.data[i * 4];
+			uint8* out = level->data + i * nc;
+			for (int c = 0; c < 3; ++c)
+				out[c] = srgb ? linear_to_srgb[(int)(in[c] * (LINEAR_TO_SRGB_SIZE - 1) + 0.5f)] : (uint8)(in[c] * 255.0f + 0.5f);
+			if (nc == 4)
+				out[3] = (uint8)(clamp(in[3] * alpha_scale, 0.0f, 1.0f) * 255.0f + 0.5f);
+		}
+		levels.push_back(level);
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+#ifndef MIPMAPS_H
+#define MIPMAPS_H
+
+#include <vector>
+
+class Image;
+
+//how the pixels are used, changes the filtering of the mips
+struct sMipOptions {
+	bool srgb;			//color, filtered in linear space
+	bool normalmap;		//the filtered normals are normalized again (implies linear)
+	bool kaiser;		//Kaiser windowed sinc, sharper than the 2x2 box filter
+	float alpha_cutoff;	//alpha test threshold of a MASK material, the coverage of every level is kept like in the first one (0 to disable)
+	sMipOptions() : srgb(true), normalmap(false), kaiser(true), alpha_cutoff(0) {}
+};
+
+//Mip levels of an image (power of two sizes, RGB or RGBA bytes) built on the CPU.
+//The levels are filtered from a float copy in linear space, so every level is computed
+//from the previous one without accumulating the rounding errors.
+class MipChain {
+public:
+	std::vector<Image*> levels; //levels[0] is the second level (half size), the last one is 1x1
+
+	MipChain() {}
+	~MipChain();
+
+	static bool canBuild(Image* image);
+	//the rows are filtered in parallel, it can be called from any thread
+	void build(Image* image, const sMipOptions& options = sMipOptions());
+	void clear();
+};
+
+#endif
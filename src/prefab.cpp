@@ -11,14 +11,18 @@
 #include "utils.h"
 #include "framework.h"
 #include "application.h"
+#include "asyncloader.h"
+#include "jobs.h"
+#include "impostor.h"
 
 #include <iostream>
+#include <algorithm>
 
 using namespace GTR;
 
-int Node::s_NodeID = 0;
+std::atomic<int> Node::s_NodeID(0);
 
-Node::Node() : parent(NULL), mesh(NULL), material(NULL), visible(true), layers(0xFF)
+Node::Node() : parent(NULL), mesh(NULL), material(NULL), visible(true), layers(0xFF), transform_dirty(true), children_dirty(false), structure_dirty(false), flat_index(-1)
 {
 	m_Id = s_NodeID++;
 }
@@ -28,11 +32,27 @@ Node::~Node()
 	assert(parent == NULL); //cannot delete a node that has a parent
 	clear();
 
-	//delete mesh;
-	//delete material;
+	//the assets are freed by the AssetManager when not referenced
+	setMesh(nullptr);
+	setMaterial(nullptr);
+}
+
+void Node::setMesh(Mesh* mesh)
+{
+	if (mesh)
+		mesh->addRef();
+	if (this->mesh)
+		this->mesh->release();
+	this->mesh = mesh;
+}
 
-	mesh = nullptr;
-	material = nullptr;
+void Node::setMaterial(Material* material)
+{
+	if (material)
+		material->addRef();
+	if (this->material)
+		this->material->release();
+	this->material = material;
 }
 
 void Node::clear()
@@ -43,18 +63,67 @@ void Node::clear()
 		children[i]->parent = NULL;
 		delete children[i];
 	}
+	if (children.size())
+	{
+		structure_dirty = true;
+		markParentsDirty();
+	}
 	children.resize(0);
 }
 
 BoundingBox Node::getBoundingBox()
 {
-	aabb.center.set(0, 0, 0);
-	aabb.halfsize.set(0, 0, 0);
+	BoundingBox box;
+	box.center.set(0, 0, 0);
+	box.halfsize.set(0, 0, 0);
+	if (mesh)
+		box = mesh->box;
+	for (int i = 0; i < children.size(); ++i)
+		box = mergeBoundingBoxes( children[i]->getBoundingBox(), box );
+	return transformBoundingBox(model, box);
+}
+
+void Node::markDirty()
+{
+	//if it was already dirty all the children are dirty too
+	if (!transform_dirty)
+	{
+		transform_dirty = true;
+		for (int i = 0; i < children.size(); ++i)
+			children[i]->markDirty();
+	}
+	markParentsDirty();
+}
+
+void Node::markParentsDirty()
+{
+	for (Node* node = this; node && !node->children_dirty; node = node->parent)
+		node->children_dirty = true;
+}
+
+void Node::updateGlobalMatrix()
+{
+	if (parent)
+		global_model = model * parent->getGlobalMatrix();
+	else
+		global_model = model;
 	if (mesh)
-		aabb = mesh->box;
+		aabb = transformBoundingBox(global_model, mesh->box);
+	transform_dirty = false;
+}
+
+bool Node::updateTransforms()
+{
+	if (!transform_dirty && !children_dirty)
+		return false;
+
+	//parents are updated first, so the parent global matrix is already valid
+	if (transform_dirty)
+		updateGlobalMatrix();
 	for (int i = 0; i < children.size(); ++i)
-		aabb = mergeBoundingBoxes( children[i]->getBoundingBox(), aabb );
-	return transformBoundingBox(model, aabb);
+		children[i]->updateTransforms();
+	children_dirty = false;
+	return true;
 }
 
 void Node::removeChild(Node* child)
@@ -67,6 +136,9 @@ void Node::removeChild(Node* child)
 			continue;
 		child->parent = NULL;
 		children.erase(children.begin() + i);
+		child->markDirty();
+		structure_dirty = true;
+		markParentsDirty();
 		return;
 	}
 }
@@ -100,7 +172,7 @@ bool Node::testRay(const Ray& ray, Vector3& result, int layers, float max_dist)
 	bool collided = false;
 	if (mesh)
 	{
-		collided = mesh->testRayCollision( getGlobalMatrix(), ray.origin, ray.direction, collision, normal, max_dist );
+		collided = mesh->testRayCollision( getGlobalMatrix().toMatrix44(), ray.origin, ray.direction, collision, normal, max_dist );
 		if (collided)
 			max_dist = ray.origin.distance(collision);
 	}
@@ -126,8 +198,8 @@ void Node::operator = (const Node& node)
 	Node* old_parent = parent;
 	clear(); //remove any children
 
-	mesh = node.mesh;
-	material = node.material;
+	setMesh(node.mesh);
+	setMaterial(node.material);
 	name = node.name;
 	visible = node.visible;
 	layers = node.layers;
@@ -142,6 +214,7 @@ void Node::operator = (const Node& node)
 		*new_child = *child;
 		addChild(new_child);
 	}
+	markDirty();
 }
 
 void Node::renderInMenu()
@@ -152,7 +225,11 @@ void Node::renderInMenu()
 	ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.75f, 0.75f, 0.75f, 1.0f));
 
 	//Model edit
-	ImGuiMatrix44(model, "Model");
+	Matrix44 old_model = model.toMatrix44();
+	Matrix44 edit_model = old_model;
+	ImGuiMatrix44(edit_model, "Model");
+	if (memcmp(old_model.m, edit_model.m, sizeof(Matrix44)) != 0)
+		setModel(edit_model);
 
 	//Material
 	if (material && ImGui::TreeNode(material, "Material"))
@@ -177,14 +254,35 @@ void Node::renderInMenu()
 #endif
 }
 
+void sFlatNodes::clear()
+{
+	parent.clear();
+	local.clear();
+	world.clear();
+	mesh.clear();
+	material.clear();
+	bounds.clear();
+	flags.clear();
+	nodes.clear();
+}
+
+bool Prefab::compile_prefabs = true;
+bool Prefab::use_binary = true;
+
 Prefab::Prefab()
 {
+	transform_version = 0;
+	mesh_version = 0;
+	impostor = NULL;
 }
 
 Prefab::~Prefab()
 {
+	if (impostor)
+		delete impostor;
 	if (name.size())
 	{
+		std::lock_guard<std::recursive_mutex> lock(AsyncLoader::manager_mutex);
 		auto it = sPrefabsLoaded.find(name);
 		if (it != sPrefabsLoaded.end())
 			sPrefabsLoaded.erase(it);
@@ -196,19 +294,179 @@ void Prefab::updateBounding()
 	bounding = root.getBoundingBox();
 }
 
+static int countNodes(Node* node)
+{
+	int num = 1;
+	for (int i = 0; i < node->children.size(); ++i)
+		num += countNodes(node->children[i]);
+	return num;
+}
+
+size_t Prefab::getCPUSize()
+{
+	size_t flat_node = sizeof(int) + sizeof(Matrix34) * 2 + sizeof(Mesh*) + sizeof(Material*) + sizeof(BoundingBox) + sizeof(uint8) + sizeof(Node*);
+	return sizeof(Prefab) + (countNodes(&root) - 1) * sizeof(Node) + flat.size() * flat_node;
+}
+
+//copies the changes of the dirty nodes to the flat arrays, returns false if the tree structure changed
+static bool syncFlatNodes(sFlatNodes& flat, Node* node)
+{
+	if (node->structure_dirty || node->flat_index == -1 || node->flat_index >= flat.size() || flat.nodes[node->flat_index] != node)
+		return false;
+	if (!node->transform_dirty && !node->children_dirty)
+		return true;
+
+	int index = node->flat_index;
+	if (node->transform_dirty || memcmp(flat.local[index].m, node->model.m, sizeof(Matrix34)) != 0)
+	{
+		flat.local[index] = node->model;
+		flat.flags[index] |= FLAT_DIRTY;
+	}
+	if (node->visible)
+		flat.flags[index] &= ~FLAT_HIDDEN;
+	else
+		flat.flags[index] |= FLAT_HIDDEN;
+	flat.mesh[index] = node->mesh;
+	flat.material[index] = node->material;
+
+	for (int i = 0; i < node->children.size(); ++i)
+		if (!syncFlatNodes(flat, node->children[i]))
+			return false;
+	node->children_dirty = false;
+	return true;
+}
+
+static void addFlatNode(sFlatNodes& flat, Node* node, int parent)
+{
+	int index = flat.size();
+	node->flat_index = index;
+	node->structure_dirty = false;
+	node->children_dirty = false;
+
+	flat.parent.push_back(parent);
+	flat.local.push_back(node->model);
+	flat.world.push_back(node->global_model);
+	flat.mesh.push_back(node->mesh);
+	flat.material.push_back(node->material);
+	flat.bounds.push_back(node->aabb);
+	flat.flags.push_back(FLAT_DIRTY | (node->visible ? 0 : FLAT_HIDDEN));
+	flat.nodes.push_back(node);
+
+	for (int i = 0; i < node->children.size(); ++i)
+		addFlatNode(flat, node->children[i], index);
+}
+
+bool Prefab::updateTransforms()
+{
+	//the async meshes change their box when loaded
+	if (mesh_version != Mesh::data_version)
+	{
+		mesh_version = Mesh::data_version;
+		root.markDirty();
+	}
+
+	if (!root.transform_dirty && !root.children_dirty)
+		return false;
+
+	if (isCompiled())
+	{
+		if (syncFlatNodes(flat, &root))
+			updateFlatTransforms();
+		else
+			compile(); //nodes were added or removed
+	}
+	else
+		root.updateTransforms();
+
+	transform_version++;
+	updateBounding();
+	return true;
+}
+
+void Prefab::compile()
+{
+	int num_nodes = flat.size();
+	flat.clear();
+	if (num_nodes)
+		flat.nodes.reserve(num_nodes);
+	addFlatNode(flat, &root, -1);
+	updateFlatTransforms();
+}
+
+//parents are always before their children, so one pass is enough
+void Prefab::updateFlatTransforms()
+{
+	int num = flat.size();
+	for (int i = 0; i < num; ++i)
+	{
+		int parent = flat.parent[i];
+		uint8& flags = flat.flags[i];
+
+		bool parent_visible = parent == -1 || (flat.flags[parent] & FLAT_VISIBLE);
+		if (parent_visible && !(flags & FLAT_HIDDEN))
+			flags |= FLAT_VISIBLE;
+		else
+			flags &= ~FLAT_VISIBLE;
+
+		if (!(flags & FLAT_DIRTY))
+			continue;
+		if (parent == -1)
+			flat.world[i] = flat.local[i];
+		else
+			flat.world[i] = flat.local[i] * flat.world[parent];
+		if (flat.mesh[i])
+			flat.bounds[i] = transformBoundingBox(flat.world[i], flat.mesh[i]->box);
+	}
+
+	//keep the nodes in sync for the ones using the Node API
+	for (int i = 0; i < num; ++i)
+	{
+		if (!(flat.flags[i] & FLAT_DIRTY))
+			continue;
+		Node* node = flat.nodes[i];
+		node->global_model = flat.world[i];
+		node->aabb = flat.bounds[i];
+		node->transform_dirty = false;
+		flat.flags[i] &= ~FLAT_DIRTY;
+	}
+}
+
 std::map<std::string, Prefab*> Prefab::sPrefabsLoaded;
 
+//the cooked version is used while the gltf doesnt change, the first load cooks it
+static Prefab* loadPrefab(const char* filename)
+{
+	double start = getTimeHighRes();
+	Prefab* prefab = Prefab::use_binary ? Prefab::readBin(filename) : NULL;
+	if (prefab)
+	{
+		std::cout << " + Prefab loaded from PBIN: " << filename << " Time: " << getTimeHighRes() - start << "ms" << std::endl;
+		return prefab;
+	}
+
+	prefab = loadGLTF(filename);
+	if (!prefab)
+		return NULL;
+	double time = getTimeHighRes() - start;
+	bool cooked = Prefab::use_binary && prefab->writeBin(filename);
+	std::cout << " + Prefab loaded from GLTF: " << filename << " Time: " << time << "ms" << (cooked ? " [PBIN written]" : "") << std::endl;
+	return prefab;
+}
+
 Prefab* Prefab::Get(const char* filename)
 {
 	assert(filename);
-	std::map<std::string, Prefab*>::iterator it = sPrefabsLoaded.find(filename);
-	if (it != sPrefabsLoaded.end())
-		return it->second;
+	{
+		std::lock_guard<std::recursive_mutex> lock(AsyncLoader::manager_mutex);
+		std::map<std::string, Prefab*>::iterator it = sPrefabsLoaded.find(filename);
+		if (it != sPrefabsLoaded.end())
+			return it->second;
+	}
 
 	Prefab* prefab = nullptr;
 	{
 		if (!prefab)
-			prefab = loadGLTF(filename);
+			prefab = loadPrefab(filename);
 		if (!prefab) {
 			std::cout << "[ERROR]: Prefab not found" << std::endl;
 			return NULL;
@@ -217,16 +475,74 @@ Prefab* Prefab::Get(const char* filename)
 
 	std::string name = filename;
 	prefab->registerPrefab(name);
-	prefab->updateBounding();
+	prefab->updateTransforms();
+	if (compile_prefabs)
+		prefab->compile();
+	return prefab;
+}
+
+Prefab* Prefab::GetAsync(const char* filename)
+{
+	assert(filename);
+	std::lock_guard<std::recursive_mutex> lock(AsyncLoader::manager_mutex);
+	std::map<std::string, Prefab*>::iterator it = sPrefabsLoaded.find(filename);
+	if (it != sPrefabsLoaded.end())
+		return it->second;
+
+	//registered empty, so it renders nothing until the main thread moves the loaded nodes into it
+	Prefab* prefab = new Prefab();
+	prefab->registerPrefab(filename);
+
+	std::string name = filename;
+	AsyncLoader::num_loading++;
+	JobSystem::runBackground([prefab, name]() {
+		Prefab* loaded = loadPrefab(name.c_str());
+		if (!loaded)
+		{
+			std::cout << "[ERROR]: Prefab not found " << name << std::endl;
+			AsyncLoader::num_loading--;
+			return;
+		}
+		//queued after the uploads of its meshes and textures
+		AsyncLoader::enqueue([prefab, loaded]() {
+			prefab->takeNodes(loaded);
+			delete loaded;
+			AsyncLoader::num_loading--;
+		});
+	});
 	return prefab;
 }
 
 void Prefab::registerPrefab(std::string name)
 {
+	std::lock_guard<std::recursive_mutex> lock(AsyncLoader::manager_mutex);
 	this->name = name;
 	sPrefabsLoaded[name] = this;
 }
 
+void Prefab::takeNodes(Prefab* other)
+{
+	root.clear();
+	root.name = other->root.name;
+	root.setMesh(other->root.mesh);
+	root.setMaterial(other->root.material);
+	root.visible = other->root.visible;
+	root.setModel(other->root.model);
+
+	std::vector<Node*> children = other->root.children;
+	other->root.children.clear();
+	for (int i = 0; i < children.size(); ++i)
+	{
+		children[i]->parent = NULL;
+		root.addChild(children[i]);
+	}
+
+	updateNodesByName();
+	updateTransforms();
+	if (compile_prefabs)
+		compile();
+}
+
 Node* Prefab::getNodeByName(const char* name)
 {
 	auto it = nodes_by_name.find(name);
@@ -249,3 +565,368 @@ void Prefab::updateNodesByName()
 	nodes_by_name.clear();
 	updateInDepth(nodes_by_name, &root);
 }
+
+//cooked prefab (.pbin): "PBIN" watermark, this header, the tables (textures, materials, meshes and nodes),
+//the strings and the meshes (every one like a .mbin, aligned to MESH_BIN_ALIGNMENT)
+struct sPrefabBinHeader {
+	int version;
+	int header_bytes;
+	sSourceInfo source; //the gltf, to detect changes
+	int num_textures;
+	int num_materials;
+	int num_meshes;
+	int num_nodes;
+	unsigned int strings_offset; //zero terminated, referenced by the offset from here (0 is the empty string)
+	unsigned int strings_size;
+};
+
+//the pixels are not in the .pbin, textures are found by name or loaded from their .tbin
+struct sPrefabBinTexture {
+	unsigned int name; //empty for the embedded images without name
+	unsigned int bin_filename; //empty if it wasnt cooked
+};
+
+struct sPrefabBinSampler {
+	int texture; //-1 for none
+	int uv_channel;
+};
+
+const int NUM_PREFAB_BIN_SAMPLERS = 6;
+
+struct sPrefabBinMaterial {
+	unsigned int name;
+	int alpha_mode;
+	float alpha_cutoff;
+	int two_sided;
+	Vector4 color;
+	float roughness_factor;
+	float metallic_factor;
+	Vector3 emissive_factor;
+	sPrefabBinSampler samplers[NUM_PREFAB_BIN_SAMPLERS]; //in the order of getSamplers
+};
+
+struct sPrefabBinMesh {
+	unsigned int name;
+	unsigned int offset; //from the start of the file
+};
+
+//parents are always before their children, the first one is the root
+struct sPrefabBinNode {
+	unsigned int name;
+	int parent;
+	Matrix34 model;
+	int visible;
+	int layers;
+	int mesh; //-1 for none
+	int material;
+};
+
+static void getSamplers(Material* material, Sampler* samplers[NUM_PREFAB_BIN_SAMPLERS])
+{
+	samplers[0] = &material->color_texture;
+	samplers[1] = &material->emissive_texture;
+	samplers[2] = &material->opacity_texture;
+	samplers[3] = &material->metallic_roughness_texture;
+	samplers[4] = &material->occlusion_texture;
+	samplers[5] = &material->normal_texture;
+}
+
+Prefab* Prefab::readBin(const char* filename)
+{
+	std::string binfilename = std::string(filename) + ".pbin";
+	std::shared_ptr<MappedFile> file(new MappedFile());
+	if (!file->open(binfilename.c_str()))
+		return NULL;
+
+	sPrefabBinHeader* header = (sPrefabBinHeader*)(file->data + 4);
+	if (file->size < 4 + sizeof(sPrefabBinHeader) || memcmp(file->data, "PBIN", 4) != 0)
+	{
+		std::cout << "[ERROR] loading PBIN: invalid content: " << binfilename << std::endl;
+		return NULL;
+	}
+	if (header->version != PREFAB_BIN_VERSION || header->header_bytes != sizeof(sPrefabBinHeader) || !isSourceUnchanged(filename, header->source))
+		return NULL; //old version or the gltf changed, it will be cooked again
+
+	size_t tables_size = header->num_textures * sizeof(sPrefabBinTexture) + header->num_materials * sizeof(sPrefabBinMaterial) +
+		header->num_meshes * sizeof(sPrefabBinMesh) + header->num_nodes * sizeof(sPrefabBinNode);
+	if (header->num_textures < 0 || header->num_materials < 0 || header->num_meshes < 0 || header->num_nodes < 1 ||
+		4 + sizeof(sPrefabBinHeader) + tables_size > header->strings_offset || !header->strings_size ||
+		(size_t)header->strings_offset + header->strings_size > file->size || file->data[header->strings_offset + header->strings_size - 1] != 0)
+	{
+		std::cout << "[ERROR] loading PBIN: corrupted tables: " << binfilename << std::endl;
+		return NULL;
+	}
+
+	sPrefabBinTexture* bin_textures = (sPrefabBinTexture*)(file->data + 4 + sizeof(sPrefabBinHeader));
+	sPrefabBinMaterial* bin_materials = (sPrefabBinMaterial*)(bin_textures + header->num_textures);
+	sPrefabBinMesh* bin_meshes = (sPrefabBinMesh*)(bin_materials + header->num_materials);
+	sPrefabBinNode* bin_nodes = (sPrefabBinNode*)(bin_meshes + header->num_meshes);
+	const char* strings = (const char*)file->data + header->strings_offset;
+	auto getString = [&](unsigned int offset) { return offset < header->strings_size ? strings + offset : ""; };
+
+	//textures first, if one is missing nothing is created and the gltf is loaded again
+	std::vector<Texture*> textures(header->num_textures, NULL);
+	for (int i = 0; i < header->num_textures; ++i)
+	{
+		const char* name = getString(bin_textures[i].name);
+		const char* bin = getString(bin_textures[i].bin_filename);
+		Texture* texture = name[0] ? Texture::Find(name) : NULL;
+		if (!texture && bin[0])
+		{
+			//the images in files are validated with the image, the embedded ones were validated with the gltf (there is no file with their name)
+			std::shared_ptr<MappedFile> cooked = Texture::readBin(name, bin);
+			if (cooked)
+			{
+				texture = new Texture();
+				texture->loadFromBin(cooked);
+				if (name[0])
+					texture->setName(name);
+			}
+		}
+		if (!texture && name[0])
+			texture = Texture::Get(name);
+		if (!texture)
+		{
+			std::cout << "[WARN] loading PBIN: texture not found, the gltf will be loaded: " << (name[0] ? name : bin) << std::endl;
+			return NULL;
+		}
+		textures[i] = texture;
+	}
+
+	std::vector<Material*> materials(header->num_materials, NULL);
+	for (int i = 0; i < header->num_materials; ++i)
+	{
+		sPrefabBinMaterial& info = bin_materials[i];
+		const char* name = getString(info.name);
+		Material* material = name[0] ? Material::Get(name) : NULL;
+		if (!material)
+		{
+			material = new Material();
+			if (name[0])
+				material->registerMaterial(name);
+			material->alpha_mode = (eAlphaMode)info.alpha_mode;
+			material->alpha_cutoff = info.alpha_cutoff;
+			material->two_sided = info.two_sided != 0;
+			material->color = info.color;
+			material->roughness_factor = info.roughness_factor;
+			material->metallic_factor = info.metallic_factor;
+			material->emissive_factor = info.emissive_factor;
+			Sampler* samplers[NUM_PREFAB_BIN_SAMPLERS];
+			getSamplers(material, samplers);
+			for (int j = 0; j < NUM_PREFAB_BIN_SAMPLERS; ++j)
+			{
+				int texture = info.samplers[j].texture;
+				if (texture >= 0 && texture < header->num_textures)
+					samplers[j]->setTexture(textures[texture]);
+				samplers[j]->uv_channel = info.samplers[j].uv_channel;
+			}
+		}
+		materials[i] = material;
+	}
+
+	//the meshes keep the file mapped and upload from it, like the .mbin
+	std::vector<Mesh*> meshes(header->num_meshes, NULL);
+	for (int i = 0; i < header->num_meshes; ++i)
+	{
+		const char* name = getString(bin_meshes[i].name);
+		Mesh* mesh = name[0] ? Mesh::Get(name, false, true) : NULL;
+		if (!mesh)
+		{
+			mesh = new Mesh();
+			if (!mesh->readBin(file, bin_meshes[i].offset))
+			{
+				delete mesh;
+				return NULL; //the assets already created are freed by the AssetManager
+			}
+			mesh->uploadToVRAM(Mesh::quantize_vertices);
+			if (name[0])
+				mesh->registerMesh(name);
+		}
+		meshes[i] = mesh;
+	}
+
+	Prefab* prefab = new Prefab();
+	std::vector<Node*> nodes(header->num_nodes, NULL);
+	for (int i = 0; i < header->num_nodes; ++i)
+	{
+		sPrefabBinNode& info = bin_nodes[i];
+		Node* node = i == 0 ? &prefab->root : new Node();
+		node->name = getString(info.name);
+		node->model = info.model;
+		node->visible = info.visible != 0;
+		node->layers = info.layers;
+		if (info.mesh >= 0 && info.mesh < header->num_meshes)
+			node->setMesh(meshes[info.mesh]);
+		if (info.material >= 0 && info.material < header->num_materials)
+			node->setMaterial(materials[info.material]);
+		if (i > 0)
+			nodes[(info.parent >= 0 && info.parent < i) ? info.parent : 0]->addChild(node);
+		nodes[i] = node;
+	}
+
+	prefab->updateNodesByName();
+	prefab->updateBounding();
+	return prefab;
+}
+
+static unsigned int addString(std::vector<char>& strings, const std::string& str)
+{
+	if (str.empty())
+		return 0;
+	unsigned int offset = (unsigned int)strings.size();
+	strings.insert(strings.end(), str.begin(), str.end());
+	strings.push_back(0);
+	return offset;
+}
+
+template<typename T>
+static int addAsset(std::vector<T*>& assets, T* asset)
+{
+	if (!asset)
+		return -1;
+	auto it = std::find(assets.begin(), assets.end(), asset);
+	if (it != assets.end())
+		return (int)(it - assets.begin());
+	assets.push_back(asset);
+	return (int)assets.size() - 1;
+}
+
+static void flattenNodes(std::vector<Node*>& nodes, std::vector<int>& parents, Node* node, int parent)
+{
+	int index = (int)nodes.size();
+	nodes.push_back(node);
+	parents.push_back(parent);
+	for (int i = 0; i < node->children.size(); ++i)
+		flattenNodes(nodes, parents, node->children[i], index);
+}
+
+bool Prefab::writeBin(const char* filename)
+{
+	sPrefabBinHeader header = {};
+	header.version = PREFAB_BIN_VERSION;
+	header.header_bytes = sizeof(sPrefabBinHeader);
+	if (!getSourceInfo(filename, header.source))
+		return false;
+
+	std::vector<Node*> nodes;
+	std::vector<int> parents;
+	flattenNodes(nodes, parents, &root, -1);
+
+	std::vector<char> strings(1, 0);
+	std::vector<Texture*> textures;
+	std::vector<Material*> materials;
+	std::vector<Mesh*> meshes;
+
+	std::vector<sPrefabBinNode> bin_nodes(nodes.size());
+	for (int i = 0; i < nodes.size(); ++i)
+	{
+		Node* node = nodes[i];
+		sPrefabBinNode& info = bin_nodes[i]; //value-initialized by the vector
+		info.name = addString(strings, node->name);
+		info.parent = parents[i];
+		info.model = node->model;
+		info.visible = node->visible ? 1 : 0;
+		info.layers = node->layers;
+		info.mesh = addAsset(meshes, node->mesh);
+		info.material = addAsset(materials, node->material);
+	}
+
+	std::vector<sPrefabBinMaterial> bin_materials(materials.size());
+	for (int i = 0; i < materials.size(); ++i)
+	{
+		Material* material = materials[i];
+		sPrefabBinMaterial& info = bin_materials[i]; //value-initialized by the vector
+		info.name = addString(strings, material->name);
+		info.alpha_mode = material->alpha_mode;
+		info.alpha_cutoff = material->alpha_cutoff;
+		info.two_sided = material->two_sided ? 1 : 0;
+		info.color = material->color;
+		info.roughness_factor = material->roughness_factor;
+		info.metallic_factor = material->metallic_factor;
+		info.emissive_factor = material->emissive_factor;
+		Sampler* samplers[NUM_PREFAB_BIN_SAMPLERS];
+		getSamplers(material, samplers);
+		for (int j = 0; j < NUM_PREFAB_BIN_SAMPLERS; ++j)
+		{
+			info.samplers[j].texture = addAsset(textures, samplers[j]->texture);
+			info.samplers[j].uv_channel = samplers[j]->uv_channel;
+		}
+	}
+
+	std::vector<sPrefabBinTexture> bin_textures(textures.size());
+	for (int i = 0; i < textures.size(); ++i)
+	{
+		Texture* texture = textures[i];
+		if (texture->filename.empty() && texture->bin_filename.empty())
+		{
+			std::cout << "[WARN] cannot cook PBIN, a texture has no file: " << filename << std::endl;
+			return false;
+		}
+		bin_textures[i].name = addString(strings, texture->filename);
+		bin_textures[i].bin_filename = addString(strings, texture->bin_filename);
+	}
+
+	std::vector<sPrefabBinMesh> bin_meshes(meshes.size());
+	for (int i = 0; i < meshes.size(); ++i)
+	{
+		if (!meshes[i]->getNumVertices())
+			return false; //still loading
+		bin_meshes[i].name = addString(strings, meshes[i]->name);
+		bin_meshes[i].offset = 0; //known once written
+	}
+
+	header.num_textures = (int)bin_textures.size();
+	header.num_materials = (int)bin_materials.size();
+	header.num_meshes = (int)bin_meshes.size();
+	header.num_nodes = (int)bin_nodes.size();
+	long meshes_table = 4 + sizeof(sPrefabBinHeader) + bin_textures.size() * sizeof(sPrefabBinTexture) + bin_materials.size() * sizeof(sPrefabBinMaterial);
+	header.strings_offset = (unsigned int)(meshes_table + bin_meshes.size() * sizeof(sPrefabBinMesh) + bin_nodes.size() * sizeof(sPrefabBinNode));
+	header.strings_size = (unsigned int)strings.size();
+
+	std::string binfilename = std::string(filename) + ".pbin";
+	std::string temp_filename = binfilename + ".tmp"; //moved over the .pbin when complete, it can be mapped meanwhile
+	FILE* f = fopen(temp_filename.c_str(), "wb");
+	if (f == NULL)
+	{
+		std::cout << "[ERROR] cannot write prefab BIN: " << binfilename << std::endl;
+		return false;
+	}
+
+	fwrite("PBIN", sizeof(char), 4, f);
+	fwrite(&header, sizeof(header), 1, f);
+	if (bin_textures.size())
+		fwrite(&bin_textures[0], sizeof(sPrefabBinTexture), bin_textures.size(), f);
+	if (bin_materials.size())
+		fwrite(&bin_materials[0], sizeof(sPrefabBinMaterial), bin_materials.size(), f);
+	if (bin_meshes.size())
+		fwrite(&bin_meshes[0], sizeof(sPrefabBinMesh), bin_meshes.size(), f);
+	fwrite(&bin_nodes[0], sizeof(sPrefabBinNode), bin_nodes.size(), f);
+	fwrite(&strings[0], 1, strings.size(), f);
+
+	//the meshes go at the end, then their offsets are updated in the table
+	const char padding[MESH_BIN_ALIGNMENT] = { 0 };
+	bool written = true;
+	for (int i = 0; i < meshes.size() && written; ++i)
+	{
+		long pos = ftell(f);
+		long aligned = (pos + MESH_BIN_ALIGNMENT - 1) & ~(long)(MESH_BIN_ALIGNMENT - 1);
+		fwrite(padding, aligned - pos, 1, f);
+		bin_meshes[i].offset = (unsigned int)aligned;
+		written = meshes[i]->writeBin(f);
+	}
+	if (written && bin_meshes.size())
+	{
+		fseek(f, meshes_table, SEEK_SET);
+		fwrite(&bin_meshes[0], sizeof(sPrefabBinMesh), bin_meshes.size(), f);
+	}
+	written = written && !ferror(f);
+	fclose(f);
+
+	if (!written || !replaceFile(temp_filename.c_str(), binfilename.c_str()))
+	{
+		std::cout << "[ERROR] cannot write prefab BIN: " << binfilename << std::endl;
+		remove(temp_filename.c_str());
+		return false;
+	}
+	return true;
+}
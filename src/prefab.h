@@ -4,10 +4,13 @@
 #include <cassert>
 #include <map>
 #include <string>
+#include <atomic>
 
 #include "material.h"
 #include "scene.h"
 
+#define PREFAB_BIN_VERSION 2 //this is used to regenerate the .pbin if the format changes
+
 //forward declaration
 class Mesh;
 class Texture;
@@ -15,6 +18,8 @@ class Camera;
 
 namespace GTR {
 
+	class Impostor;
+
 	class Primitive {
 	public:
 		Material* material;
@@ -26,7 +31,7 @@ namespace GTR {
 	class Node
 	{
 	public:
-		static int s_NodeID;
+		static std::atomic<int> s_NodeID;
 		int m_Id;
 
 	public:
@@ -41,10 +46,16 @@ namespace GTR {
 		//std::vector<Primitive*> primitives;
 		Material* material;
 
-		Matrix44 model;	//the matrix that defines where is the object (in relation to its parent)
-		Matrix44 global_model;	//the matrix that defines where is the object (in relation to the world)
+		Matrix34 model;	//the matrix that defines where is the object (in relation to its parent), call markDirty after changing it
+		Matrix34 global_model;	//the matrix that defines where is the object (in relation to the world), cached
 
-		BoundingBox aabb; //node bounding box in world space
+		BoundingBox aabb; //node mesh bounding box in world space, cached with the global_model
+
+		//dirty flags: global_model and aabb are only recomputed for the nodes that changed
+		bool transform_dirty; //model (or a parent model) changed since the last update
+		bool children_dirty; //some node below this one changed
+		bool structure_dirty; //children were added or removed
+		int flat_index; //position in the flattened prefab, -1 if not compiled
 
 		//info to create the tree
 		Node* parent;
@@ -70,17 +81,32 @@ namespace GTR {
 			assert(child->parent == NULL);
 			children.push_back(child);
 			child->parent = this;
+			child->markDirty();
+			structure_dirty = true;
 		}
 		void removeChild(Node* child);
 
+		//keep a reference to the assets (AssetManager)
+		void setMesh(Mesh* mesh);
+		void setMaterial(Material* material);
+
+		//changes the local transform and flags the subtree to be updated
+		void setModel(const Matrix34& m) { model = m; markDirty(); }
+		void setVisible(bool v) { visible = v; markParentsDirty(); }
+		void markDirty();
+		void markParentsDirty();
+
+		//recomputes global_model and aabb of the dirty nodes below this one, returns true if something changed
+		bool updateTransforms();
+
 		//compute the global matrix taking into account its parent
-		Matrix44 getGlobalMatrix(bool fast = false) { 
-			if (parent)
-				global_model = model * (fast ? parent->global_model : parent->getGlobalMatrix());
-			else
-				global_model = model;
+		//fast returns the cached one (valid after updateTransforms), otherwise it is only recomputed if dirty
+		const Matrix34& getGlobalMatrix(bool fast = false) { 
+			if (transform_dirty && !fast)
+				updateGlobalMatrix();
 			return global_model;
 		}
+		void updateGlobalMatrix();
 
 		bool testRay(const Ray& ray, Vector3& result, int layers = 0xFF, float max_dist = 3.4e+38F);
 		Vector3 localToGlobal(Vector3 v) { return global_model * v; }
@@ -88,11 +114,34 @@ namespace GTR {
 		void operator = (const Node& node);
 	};
 
+	enum eFlatNodeFlags {
+		FLAT_VISIBLE = 1,	//the node and all its parents are visible
+		FLAT_HIDDEN = 2,	//the node itself is not visible
+		FLAT_DIRTY = 4		//world matrix must be recomputed
+	};
+
+	//the node tree stored in arrays in parent-before-child order, so updates and culling are linear passes
+	struct sFlatNodes {
+		std::vector<int> parent; //index of the parent, -1 for the root
+		std::vector<Matrix34> local;
+		std::vector<Matrix34> world;
+		std::vector<Mesh*> mesh;
+		std::vector<Material*> material;
+		std::vector<BoundingBox> bounds; //world bounding box of the mesh
+		std::vector<uint8> flags; //eFlatNodeFlags
+		std::vector<Node*> nodes; //to sync the changes done using the Node API
+
+		int size() { return (int)parent.size(); }
+		void clear();
+	};
+
 	//a Prefab represent a set of objects in a tree structure
 	//used to load info from GLTF files
-	class Prefab
+	class Prefab : public Asset
 	{
 	public:
+		static bool compile_prefabs; //build the flat representation after loading
+		static bool use_binary; //the gltf is cooked to a .pbin (nodes, materials, meshes and texture references), next loads dont parse it
 
 		std::string name;
 		std::map<std::string, Node*> nodes_by_name;
@@ -101,6 +150,22 @@ namespace GTR {
 		//root node which contains the tree
 		Node root;
 		BoundingBox bounding;
+		unsigned int transform_version; //increased every time a node transform changes, to invalidate caches
+		unsigned int mesh_version; //Mesh::data_version of the last update, the bounds are recomputed when a mesh gets its data
+
+		//flattened tree, empty if the prefab is not compiled
+		sFlatNodes flat;
+
+		//captures to draw it from far away, created by the renderer the first time it needs them
+		Impostor* impostor;
+
+		//updates the dirty nodes, does nothing if nothing changed
+		bool updateTransforms();
+
+		//builds the flat arrays from the node tree
+		void compile();
+		bool isCompiled() { return flat.size() > 0; }
+		void updateFlatTransforms();
 
 		//dtor
 		Prefab();
@@ -108,12 +173,18 @@ namespace GTR {
 
 		void updateBounding();
 		void updateNodesByName();
+		size_t getCPUSize(); //nodes and flat arrays, for the AssetManager
 		Node* getNodeByName(const char* name);
 
 				//Manager to cache loaded prefabs
 		static std::map<std::string, Prefab*> sPrefabsLoaded;
 		static Prefab* Get(const char* filename);
+		static Prefab* GetAsync(const char* filename); //returns an empty prefab that receives the nodes once loaded
 		void registerPrefab(std::string name);
+		void takeNodes(Prefab* other); //moves the nodes of other to this prefab
+
+		static Prefab* readBin(const char* filename); //rebuilds the prefab from the .pbin of the gltf if it is still valid, NULL otherwise
+		bool writeBin(const char* filename);
 	};
 
 };
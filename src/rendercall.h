@@ -45,9 +45,10 @@ namespace GTR {
 			}
 		};
 
-		Matrix44 node_model;
+		Matrix34 node_model;
 		Node* node;		//Node te mesh, material
 		float distance;
+		int lod;		//level of detail of the mesh (see Mesh::lods)
 		//void RenderCall::RenderCall();
 
 		//Guardar les dades de mesh, material, flags, model... enlloc de passar-les al shader.
@@ -12,16 +12,31 @@
 
 #include "rendercall.h"
 #include "application.h"
+#include "drawcapture.h"
+#include "jobs.h"
+#include "texturestreamer.h"
+#include "assetmanager.h"
+#include "impostor.h"
 #include <algorithm>
 
 
 using namespace GTR;
 
+//prefabs captured per frame, the rest keep their meshes until the next frames
+const int MAX_IMPOSTOR_BAKES = 2;
+
 Renderer::Renderer() {
 
 	render_mode = eRenderMode::MULTI_PATH;
 	use_shadowmap = 1;
 	show_shadowmap = 0;
+	use_lods = true;
+	lod_pixel_error = 1.0f;
+	lod_hysteresis = 0.25f;
+	shadow_lod_bias = 1;
+	use_impostors = true;
+	impostor_pixels = 32.0f;
+	capture_frames = 0;
 }
 
 
@@ -32,12 +47,14 @@ void Renderer::getSceneRenderCalls(GTR::Scene* scene, Camera* camera)
 
 	this->renderCall_vector.clear();
 	this->renderCall_blend_vector.clear();
+	this->renderCall_shadow_vector.clear();
 
 	// Clear the color and the depth buffer
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	checkGLErrors();
 
 	//render entities
+	prefab_entities.clear();
 	for (int i = 0; i < scene->entities.size(); ++i)
 	{
 		BaseEntity* ent = scene->entities[i];
@@ -48,10 +65,113 @@ void Renderer::getSceneRenderCalls(GTR::Scene* scene, Camera* camera)
 		if (ent->entity_type == PREFAB)
 		{
 			PrefabEntity* pent = (GTR::PrefabEntity*)ent;
-			if(pent->prefab)
-				renderPrefab(ent->model, pent->prefab, camera);
+			if (pent->prefab)
+			{
+				pent->prefab->updateTransforms(); //prefabs can be shared, so they are updated before the parallel part
+				prefab_entities.push_back(pent);
+			}
+		}
+
+	}
+
+	//every entity updates its world matrices (only if something moved) and culls its nodes in parallel
+	int num_entities = (int)prefab_entities.size();
+	if (entity_calls.size() < num_entities)
+	{
+		entity_calls.resize(num_entities);
+		entity_blend_calls.resize(num_entities);
+		entity_shadow_calls.resize(num_entities);
+		entity_impostor.resize(num_entities);
+	}
+	//the debug modes (normals, uvs...) always show the meshes
+	bool impostors_enabled = use_impostors && (render_mode == SINGLE_PATH || render_mode == MULTI_PATH);
+	JobSystem::parallelFor(num_entities, 4, [&](int start, int end) {
+		for (int i = start; i < end; ++i)
+		{
+			entity_calls[i].clear();
+			entity_blend_calls[i].clear();
+			entity_shadow_calls[i].clear();
+			entity_impostor[i] = impostors_enabled ? selectImpostor(prefab_entities[i], camera) : IMPOSTOR_NONE;
+			if (entity_impostor[i] == IMPOSTOR_CULLED)
+				continue; //its nodes are not even updated
+			prefab_entities[i]->updateNodeInstances(false);
+			if (entity_impostor[i] == IMPOSTOR_VISIBLE)
+				addShadowCasters(prefab_entities[i], camera, entity_shadow_calls[i]); //the quads dont cast shadows
+			else
+				renderPrefabEntity(prefab_entities[i], camera, entity_calls[i], entity_blend_calls[i]);
 		}
+	});
+
+	//the quads go to the batch of their prefab in entity order, the missing impostors are baked here (GL)
+	int num_bakes = 0;
+	for (int i = 0; i < num_entities; ++i)
+	{
+		renderCall_vector.insert(renderCall_vector.end(), entity_calls[i].begin(), entity_calls[i].end());
+		renderCall_blend_vector.insert(renderCall_blend_vector.end(), entity_blend_calls[i].begin(), entity_blend_calls[i].end());
+		renderCall_shadow_vector.insert(renderCall_shadow_vector.end(), entity_shadow_calls[i].begin(), entity_shadow_calls[i].end());
 
+		Prefab* prefab = prefab_entities[i]->prefab;
+		if (entity_impostor[i] == IMPOSTOR_VISIBLE)
+		{
+			if (!prefab->impostor->getNumInstances())
+				impostors.push_back(prefab->impostor);
+			prefab->impostor->addInstance(prefab_entities[i]->model, camera);
+		}
+		else if (entity_impostor[i] == IMPOSTOR_PENDING && num_bakes < MAX_IMPOSTOR_BAKES)
+		{
+			if (!prefab->impostor)
+				prefab->impostor = new Impostor(prefab);
+			if (!prefab->impostor->isReady())
+			{
+				prefab->impostor->bake();
+				num_bakes++;
+			}
+		}
+	}
+}
+
+//adds the render calls of an entity using the world matrices cached in the entity
+void Renderer::renderPrefabEntity(GTR::PrefabEntity* entity, Camera* camera, std::vector<RenderCall>& calls, std::vector<RenderCall>& blend_calls)
+{
+	for (int i = 0; i < entity->node_instances.size(); ++i)
+	{
+		sNodeInstance& instance = entity->node_instances[i];
+
+		//the async meshes are empty until loaded (Mesh::render asserts with no vertices), the evicted ones go on to be reloaded
+		if (!instance.node->mesh->getNumVertices() && !instance.node->mesh->evicted)
+			continue;
+
+		//if bounding box is inside the camera frustum then the object is probably visible
+		if (!camera->testBoxInFrustum(instance.world_bounding.center, instance.world_bounding.halfsize))
+			continue;
+
+		float dist = camera->eye.distance(instance.world_bounding.center);
+		instance.lod = use_lods ? selectLOD(instance.node->mesh, instance.world_bounding, instance.lod, camera) : 0;
+		RenderCall temp_data = { instance.model, instance.node, dist, instance.lod };
+		if (!(instance.node->material->alpha_mode == GTR::eAlphaMode::BLEND))
+			calls.push_back(temp_data);
+		else
+			blend_calls.push_back(temp_data);
+	}
+}
+
+void Renderer::addShadowCasters(GTR::PrefabEntity* entity, Camera* camera, std::vector<RenderCall>& calls)
+{
+	for (int i = 0; i < entity->node_instances.size(); ++i)
+	{
+		sNodeInstance& instance = entity->node_instances[i];
+		Mesh* mesh = instance.node->mesh;
+		if (!mesh->getNumVertices() && !mesh->evicted)
+			continue;
+		//the shadow maps only have the opaque nodes, culled with the camera like the rest
+		if (instance.node->material->alpha_mode == GTR::eAlphaMode::BLEND)
+			continue;
+		if (!camera->testBoxInFrustum(instance.world_bounding.center, instance.world_bounding.halfsize))
+			continue;
+
+		float dist = camera->eye.distance(instance.world_bounding.center);
+		RenderCall temp_data = { instance.model, instance.node, dist, use_lods ? mesh->getNumLODs() - 1 : 0 };
+		calls.push_back(temp_data);
 	}
 }
 
@@ -59,21 +179,23 @@ void Renderer::getSceneRenderCalls(GTR::Scene* scene, Camera* camera)
 void Renderer::renderPrefab(const Matrix44& model, GTR::Prefab* prefab, Camera* camera)
 {
 	assert(prefab && "PREFAB IS NULL");
+	//update the nodes that changed
+	prefab->updateTransforms();
 	//assign the model to the root node
-	renderNode(model, &prefab->root, camera);
+	renderNode(Matrix34(model), &prefab->root, camera);
 }
 
 //renders a node of the prefab and its children
-void Renderer::renderNode(const Matrix44& prefab_model, GTR::Node* node, Camera* camera)
+void Renderer::renderNode(const Matrix34& prefab_model, GTR::Node* node, Camera* camera)
 {
 	if (!node->visible)
 		return;
 
 	//compute global matrix
-	Matrix44 node_model = node->getGlobalMatrix(true) * prefab_model;
+	Matrix34 node_model = node->getGlobalMatrix(true) * prefab_model;
 
-	//does this node have a mesh? then we must render it
-	if (node->mesh && node->material)
+	//does this node have a mesh? then we must render it (the async ones are empty until loaded)
+	if (node->mesh && node->material && (node->mesh->getNumVertices() || node->mesh->evicted))
 	{
 		//compute the bounding box of the object in world space (by using the mesh bounding box transformed to world space)
 		BoundingBox world_bounding = transformBoundingBox(node_model,node->mesh->box);
@@ -83,7 +205,7 @@ void Renderer::renderNode(const Matrix44& prefab_model, GTR::Node* node, Camera*
 		{
 
 			float dist = camera->eye.distance(world_bounding.center);
-			RenderCall temp_data = { node_model, node, dist };
+			RenderCall temp_data = { node_model, node, dist, 0 };
 			/*if(node->material->alpha_mode== GTR::eAlphaMode::NO_ALPHA)
 				this->renderCall_vector.push_back(temp_data);
 			else
@@ -100,6 +222,51 @@ void Renderer::renderNode(const Matrix44& prefab_model, GTR::Node* node, Camera*
 		renderNode(prefab_model, node->children[i], camera);
 }
 
+uint8 GTR::Renderer::selectImpostor(GTR::PrefabEntity* entity, Camera* camera)
+{
+	Prefab* prefab = entity->prefab;
+	BoundingBox world_bounding = transformBoundingBox(entity->model, prefab->bounding);
+	float radius = (float)world_bounding.halfsize.length();
+	if (radius <= 0)
+		return IMPOSTOR_NONE;
+
+	float pixels = camera->getScreenRadius(world_bounding.center, radius, (float)Application::instance->window_height);
+	if (pixels >= impostor_pixels)
+		return IMPOSTOR_NONE;
+	if (!prefab->impostor || !prefab->impostor->isReady())
+		return IMPOSTOR_PENDING;
+	if (!camera->testBoxInFrustum(world_bounding.center, world_bounding.halfsize))
+		return IMPOSTOR_CULLED;
+	return IMPOSTOR_VISIBLE;
+}
+
+//coarsest level with the error under max_pixels
+static int getLODUnderError(Mesh* mesh, float pixels_per_unit, float max_pixels)
+{
+	int lod = 0;
+	for (int i = 1; i < mesh->getNumLODs() && mesh->getLODError(i) * pixels_per_unit <= max_pixels; ++i)
+		lod = i;
+	return lod;
+}
+
+int GTR::Renderer::selectLOD(Mesh* mesh, const BoundingBox& world_bounding, int current_lod, Camera* camera)
+{
+	if (mesh->getNumLODs() < 2)
+		return 0;
+
+	//pixels per local unit, from the radius of the box on screen
+	float radius = (float)mesh->box.halfsize.length();
+	if (radius <= 0)
+		return 0;
+	float pixels = camera->getScreenRadius(world_bounding.center, (float)world_bounding.halfsize.length(), (float)Application::instance->window_height);
+	float pixels_per_unit = pixels / radius;
+
+	//it only changes if the current one is outside the margins
+	int finest = getLODUnderError(mesh, pixels_per_unit, lod_pixel_error * (1.0f - lod_hysteresis));
+	int coarsest = getLODUnderError(mesh, pixels_per_unit, lod_pixel_error * (1.0f + lod_hysteresis));
+	return std::max(finest, std::min(current_lod, coarsest));
+}
+
 void GTR::Renderer::orderRenderCalls()
 {
 	std::sort(this->renderCall_vector.begin(), this->renderCall_vector.end(), RenderCall::orderer_distance());
@@ -108,14 +275,27 @@ void GTR::Renderer::orderRenderCalls()
 
 void GTR::Renderer::renderRenderCall(Camera* camera)
 {
+	//before the capture, the batches are rebuilt every frame so they cannot be replayed
+	renderImpostors(camera);
+
+	//record the commands sent to GL to replay them later (F9)
+	if (capture_frames > 0)
+		DrawCapture::start();
 
 	for (int i = 0; i < this->renderCall_vector.size(); ++i) {			//Render directe del vector de renderCalls opacs, "ordenat"
 		
-		this->renderMeshWithMaterial(this->renderCall_vector[i].node_model, this->renderCall_vector[i].node->mesh, this->renderCall_vector[i].node->material, camera);
+		this->renderMeshWithMaterial(this->renderCall_vector[i].node_model.toMatrix44(), this->renderCall_vector[i].node->mesh, this->renderCall_vector[i].node->material, camera, this->renderCall_vector[i].lod);
 	}
 	for (int i = 0; i < this->renderCall_blend_vector.size(); ++i) {			//Render directe del vector de renderCalls blend, "ordenat"
 		
-		this->renderMeshWithMaterial(this->renderCall_blend_vector[i].node_model, this->renderCall_blend_vector[i].node->mesh, this->renderCall_blend_vector[i].node->material, camera);
+		this->renderMeshWithMaterial(this->renderCall_blend_vector[i].node_model.toMatrix44(), this->renderCall_blend_vector[i].node->mesh, this->renderCall_blend_vector[i].node->material, camera, this->renderCall_blend_vector[i].lod);
+	}
+
+	if (DrawCapture::recording)
+	{
+		DrawCapture::recording->endFrame();
+		if (--capture_frames <= 0)
+			DrawCapture::stop(capture_filename);
 	}
 
 	//Draw the floor grid, helpful to have a reference point
@@ -125,6 +305,38 @@ void GTR::Renderer::renderRenderCall(Camera* camera)
 
 }
 
+void GTR::Renderer::renderImpostors(Camera* camera)
+{
+	Shader* shader = Shader::Get("impostor");
+	if (shader && impostors.size())
+	{
+		GTR::Scene* scene = GTR::Scene::instance;
+
+		glEnable(GL_DEPTH_TEST);
+		glDisable(GL_BLEND);
+		glDisable(GL_CULL_FACE);
+
+		shader->enable();
+		shader->setUniform("u_viewprojection", camera->viewprojection_matrix);
+		shader->setUniform("u_ambient_light", scene->ambient_light);
+		uploadLights(scene, shader);
+
+		for (int i = 0; i < impostors.size(); ++i)
+		{
+			FBO* fbo = impostors[i]->fbo;
+			shader->setUniform("u_texture", fbo->color_textures[0], 0);
+			shader->setUniform("u_normal_texture", fbo->color_textures[1], 1);
+			shader->setUniform("u_depth_texture", fbo->depth_texture, 2);
+			impostors[i]->batch->render(GL_TRIANGLES);
+		}
+		shader->disable();
+	}
+
+	for (int i = 0; i < impostors.size(); ++i)
+		impostors[i]->clearBatch();
+	impostors.clear();
+}
+
 void GTR::Renderer::generateShadowMaps(GTR::Scene* scene)
 {
 	//GTR::Scene* scene = GTR::Scene::instance;
@@ -158,9 +370,13 @@ void GTR::Renderer::generateShadowMaps(GTR::Scene* scene)
 		glColorMask(false, false, false, false);
 		glClear(GL_DEPTH_BUFFER_BIT);
 
-		for (int j = 0; j < this->renderCall_vector.size(); ++j) {			
+		int num_calls = (int)this->renderCall_vector.size();
+		for (int j = 0; j < num_calls + this->renderCall_shadow_vector.size(); ++j) {			
 			
-			this->renderShadowMap(this->renderCall_vector[j].node_model, this->renderCall_vector[j].node->mesh, this->renderCall_vector[j].node->material, light->light_camera);
+			//the shadows can use a coarser LOD than the screen, the impostors already come with the coarsest
+			RenderCall& rc = j < num_calls ? this->renderCall_vector[j] : this->renderCall_shadow_vector[j - num_calls];
+			int lod = use_lods ? std::min(rc.lod + shadow_lod_bias, rc.node->mesh->getNumLODs() - 1) : 0;
+			this->renderShadowMap(rc.node_model.toMatrix44(), rc.node->mesh, rc.node->material, light->light_camera, lod);
 		}
 
 		light->fbo->unbind();
@@ -169,8 +385,9 @@ void GTR::Renderer::generateShadowMaps(GTR::Scene* scene)
 	}
 	
 }
-void GTR::Renderer::renderShadowMap(const Matrix44 model, Mesh* mesh, GTR::Material* material, Camera* camera)
+void GTR::Renderer::renderShadowMap(const Matrix44 model, Mesh* mesh, GTR::Material* material, Camera* camera, int lod)
 {
+	AssetManager::use(mesh); //reloads it if it was evicted
 	if (!mesh || !mesh->getNumVertices() || !material)
 		return;
 	assert(glGetError() == GL_NO_ERROR);
@@ -211,7 +428,7 @@ void GTR::Renderer::renderShadowMap(const Matrix44 model, Mesh* mesh, GTR::Mater
 	shader->setUniform("u_time", t);
 	shader->setUniform("u_alpha_cutoff", material->alpha_mode == GTR::eAlphaMode::MASK ? material->alpha_cutoff : 0);
 
-	mesh->render(GL_TRIANGLES);
+	mesh->render(GL_TRIANGLES, -1, 0, lod);
 
 	shader->disable();
 
@@ -244,8 +461,11 @@ void GTR::Renderer::showShadowMap(GTR::LightEntity* light)
 }
 
 //renders a mesh given its transform and material
-void Renderer::renderMeshWithMaterial(const Matrix44 model, Mesh* mesh, GTR::Material* material, Camera* camera)
+void Renderer::renderMeshWithMaterial(const Matrix44 model, Mesh* mesh, GTR::Material* material, Camera* camera, int lod)
 {
+	AssetManager::use(mesh); //reloads it if it was evicted
+	AssetManager::use(material);
+
 	//in case there is nothing to do
 	if (!mesh || !mesh->getNumVertices() || !material )
 		return;
@@ -257,6 +477,9 @@ void Renderer::renderMeshWithMaterial(const Matrix44 model, Mesh* mesh, GTR::Mat
 	Shader* shader = NULL;
 	GTR::Scene* scene = GTR::Scene::instance;	//Per tenir background i ambient light
 
+	//the streamed textures need the mips for the size on screen of this mesh
+	TextureStreamer::requestMaterial(model, mesh, material, camera);
+
 	Texture* color_texture = material->color_texture.texture;
 	if (color_texture == NULL)
 		color_texture = Texture::getWhiteTexture(); //a 1x1 white texture
@@ -335,11 +558,11 @@ void Renderer::renderMeshWithMaterial(const Matrix44 model, Mesh* mesh, GTR::Mat
 	
 	if (scene->light_entities.size()>0 && this->render_mode== eRenderMode::MULTI_PATH) {
 		
-		renderMeshWithMaterialMulti(model, mesh, material, camera, scene, shader, normalmap_flag);
+		renderMeshWithMaterialMulti(model, mesh, material, camera, scene, shader, normalmap_flag, lod);
 	}
 	else if(scene->light_entities.size() > 0 && this->render_mode == eRenderMode::SINGLE_PATH) {
 
-		renderMeshWithMaterialSingle(model,mesh,material,camera,scene,shader,normalmap_flag);
+		renderMeshWithMaterialSingle(model,mesh,material,camera,scene,shader,normalmap_flag,lod);
 	}
 	else {
 		//this is used to say which is the alpha threshold to what we should not paint a pixel on the screen (to cut polygons according to texture alpha)
@@ -355,7 +578,7 @@ void Renderer::renderMeshWithMaterial(const Matrix44 model, Mesh* mesh, GTR::Mat
 		shader->setUniform("u_alpha_cutoff", material->alpha_mode == GTR::eAlphaMode::MASK ? material->alpha_cutoff : 0);
 
 		//do the draw call that renders the mesh into the screen
-		mesh->render(GL_TRIANGLES);
+		mesh->render(GL_TRIANGLES, -1, 0, lod);
 
 	}
 	
@@ -366,9 +589,20 @@ void Renderer::renderMeshWithMaterial(const Matrix44 model, Mesh* mesh, GTR::Mat
 	glDisable(GL_BLEND);
 }
 
-void GTR::Renderer::renderMeshWithMaterialSingle(const Matrix44 model, Mesh* mesh, GTR::Material* material, Camera* camera,Scene* scene, Shader* shader, int normalmap_flag)
+void GTR::Renderer::renderMeshWithMaterialSingle(const Matrix44 model, Mesh* mesh, GTR::Material* material, Camera* camera,Scene* scene, Shader* shader, int normalmap_flag, int lod)
 {
+	uploadLights(scene, shader);
 
+	//this is used to say which is the alpha threshold to what we should not paint a pixel on the screen (to cut polygons according to texture alpha)
+	shader->setUniform("u_alpha_cutoff", material->alpha_mode == GTR::eAlphaMode::MASK ? material->alpha_cutoff : 0);
+	shader->setUniform("u_normalmap_flag", normalmap_flag);
+
+	//do the draw call that renders the mesh into the screen
+	mesh->render(GL_TRIANGLES, -1, 0, lod);
+}
+
+void GTR::Renderer::uploadLights(Scene* scene, Shader* shader)
+{
 	Vector3 light_color[GTR::Scene::max_lights] = {};
 	float light_intensity[GTR::Scene::max_lights] = {};
 	float light_max_dist[GTR::Scene::max_lights] = {};
@@ -410,16 +644,9 @@ void GTR::Renderer::renderMeshWithMaterialSingle(const Matrix44 model, Mesh* mes
 	//shader->setUniform("u_light_direction", scene->light_entities[i]->model.frontVector());
 
 	shader->setUniform("u_num_lights", (int)scene->light_entities.size());
-
-	//this is used to say which is the alpha threshold to what we should not paint a pixel on the screen (to cut polygons according to texture alpha)
-	shader->setUniform("u_alpha_cutoff", material->alpha_mode == GTR::eAlphaMode::MASK ? material->alpha_cutoff : 0);
-	shader->setUniform("u_normalmap_flag", normalmap_flag);
-
-	//do the draw call that renders the mesh into the screen
-	mesh->render(GL_TRIANGLES);
 }
 
-void GTR::Renderer::renderMeshWithMaterialMulti(const Matrix44 model, Mesh* mesh, GTR::Material* material, Camera* camera, Scene* scene, Shader* shader,int normalmap_flag)
+void GTR::Renderer::renderMeshWithMaterialMulti(const Matrix44 model, Mesh* mesh, GTR::Material* material, Camera* camera, Scene* scene, Shader* shader,int normalmap_flag, int lod)
 {
 	glDepthFunc(GL_LEQUAL);		//Permet pintar al mateix depth
 
@@ -471,7 +698,7 @@ void GTR::Renderer::renderMeshWithMaterialMulti(const Matrix44 model, Mesh* mesh
 		shader->setUniform("u_normalmap_flag", normalmap_flag);
 
 		//do the draw call that renders the mesh into the screen
-		mesh->render(GL_TRIANGLES);
+		mesh->render(GL_TRIANGLES, -1, 0, lod);
 
 	}
 
@@ -24,6 +24,16 @@ namespace GTR {
 	class Prefab;
 	class Material;
 	class RenderCall;
+	class Impostor;
+
+	enum eImpostorState {
+		IMPOSTOR_NONE,		//near enough, rendered with its meshes
+		IMPOSTOR_VISIBLE,	//rendered as an impostor
+		IMPOSTOR_CULLED,	//small enough but outside the frustum
+		IMPOSTOR_PENDING	//small enough, rendered with its meshes until its impostor is baked
+	};
+
+	const char* const capture_filename = "data/capture.rcap";
 	
 	// This class is in charge of rendering anything in our system.
 	// Separating the render from anything else makes the code cleaner
@@ -35,8 +45,24 @@ namespace GTR {
 		eRenderMode render_mode;
 		bool use_shadowmap;
 		bool show_shadowmap;
+		bool use_lods;
+		float lod_pixel_error; //max error on screen of the LOD chosen, in pixels
+		float lod_hysteresis; //relative margin of the error to change the LOD again, so it doesnt pop back and forth
+		int shadow_lod_bias; //levels coarser in the shadow maps than on screen
+		bool use_impostors;
+		float impostor_pixels; //prefab entities with a smaller radius on screen are drawn as impostors
 		std::vector<GTR::RenderCall> renderCall_vector;
 		std::vector<GTR::RenderCall> renderCall_blend_vector;
+		std::vector<GTR::RenderCall> renderCall_shadow_vector; //only cast shadows: the meshes of the impostors, at their coarsest LOD
+		int capture_frames; //frames left to record into capture_filename
+
+		//per entity render calls, filled in parallel and merged in entity order
+		std::vector<GTR::PrefabEntity*> prefab_entities;
+		std::vector<std::vector<GTR::RenderCall>> entity_calls;
+		std::vector<std::vector<GTR::RenderCall>> entity_blend_calls;
+		std::vector<std::vector<GTR::RenderCall>> entity_shadow_calls;
+		std::vector<uint8> entity_impostor; //eImpostorState
+		std::vector<GTR::Impostor*> impostors; //with instances this frame
 
 		Renderer();
 
@@ -46,24 +72,41 @@ namespace GTR {
 		//renders several elements of the scene
 		void getSceneRenderCalls(GTR::Scene* scene, Camera* camera);
 	
+		//to render a prefab entity (using its cached node instances), adds the visible nodes to the lists
+		void renderPrefabEntity(GTR::PrefabEntity* entity, Camera* camera, std::vector<GTR::RenderCall>& calls, std::vector<GTR::RenderCall>& blend_calls);
+		//the opaque visible nodes of an entity drawn as an impostor, with their coarsest LOD for the shadow maps
+		void addShadowCasters(GTR::PrefabEntity* entity, Camera* camera, std::vector<GTR::RenderCall>& calls);
+
 		//to render a whole prefab (with all its nodes)
 		void renderPrefab(const Matrix44& model, GTR::Prefab* prefab, Camera* camera);
 
 		//to render one node from the prefab and its children
-		void renderNode(const Matrix44& model, GTR::Node* node, Camera* camera);
+		void renderNode(const Matrix34& model, GTR::Node* node, Camera* camera);
 
 		void orderRenderCalls();
 
+		//the coarsest LOD of the mesh that looks like the full one at the size of world_bounding on screen
+		int selectLOD(Mesh* mesh, const BoundingBox& world_bounding, int current_lod, Camera* camera);
+
+		//if the entity is small enough on screen to be drawn as an impostor (eImpostorState)
+		uint8 selectImpostor(GTR::PrefabEntity* entity, Camera* camera);
+
+		//one draw call per prefab with the quads of all its impostors, then clears the batches
+		void renderImpostors(Camera* camera);
+
 		//to render one mesh given its material and transformation matrix
-		void renderMeshWithMaterial(const Matrix44 model, Mesh* mesh, GTR::Material* material, Camera* camera);
-		void renderMeshWithMaterialSingle(const Matrix44 model, Mesh* mesh, GTR::Material* material, Camera* camera, Scene* scene, Shader* shader, int normalmap_flag);
-		void renderMeshWithMaterialMulti(const Matrix44 model, Mesh* mesh, GTR::Material* material, Camera* camera, Scene* scene, Shader* shader, int normalmap_flag);
+		void renderMeshWithMaterial(const Matrix44 model, Mesh* mesh, GTR::Material* material, Camera* camera, int lod = 0);
+		void renderMeshWithMaterialSingle(const Matrix44 model, Mesh* mesh, GTR::Material* material, Camera* camera, Scene* scene, Shader* shader, int normalmap_flag, int lod = 0);
+		void renderMeshWithMaterialMulti(const Matrix44 model, Mesh* mesh, GTR::Material* material, Camera* camera, Scene* scene, Shader* shader, int normalmap_flag, int lod = 0);
+
+		//the arrays of the lights of the scene for the single pass shaders
+		void uploadLights(Scene* scene, Shader* shader);
 	
 		void renderRenderCall(Camera* camera);
 
 		void generateShadowMaps(GTR::Scene* scene);
 
-		void renderShadowMap(const Matrix44 model, Mesh* mesh, GTR::Material* material, Camera* camera);
+		void renderShadowMap(const Matrix44 model, Mesh* mesh, GTR::Material* material, Camera* camera, int lod = 0);
 
 		void showShadowMaps( int w, int h);
 
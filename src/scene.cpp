@@ -2,6 +2,7 @@
 #include "utils.h"
 
 #include "prefab.h"
+#include "mesh.h"
 #include "extra/cJSON.h"
 
 GTR::Scene* GTR::Scene::instance = NULL;
@@ -165,6 +166,79 @@ GTR::PrefabEntity::PrefabEntity()
 {
 	entity_type = PREFAB;
 	prefab = NULL;
+	cached_prefab = NULL;
+	cached_version = 0;
+	cached_mesh_version = 0;
+}
+
+GTR::PrefabEntity::~PrefabEntity()
+{
+	if (prefab)
+		prefab->release(); //the AssetManager frees it if no other entity uses it
+}
+
+//overwrites the instance of the last update, it keeps its LOD if it is the same node
+static void setNodeInstance(std::vector<GTR::sNodeInstance>& instances, size_t& count, GTR::Node* node, const Matrix34& model, Mesh* mesh)
+{
+	if (count == instances.size())
+	{
+		instances.push_back(GTR::sNodeInstance());
+		instances.back().node = NULL;
+	}
+	GTR::sNodeInstance& instance = instances[count++];
+	if (instance.node != node)
+		instance.lod = 0;
+	instance.node = node;
+	instance.model = model;
+	instance.world_bounding = transformBoundingBox(model, mesh->box);
+}
+
+static void addNodeInstances(std::vector<GTR::sNodeInstance>& instances, size_t& count, GTR::Node* node, const Matrix34& model)
+{
+	if (!node->visible)
+		return;
+	if (node->mesh && node->material)
+		setNodeInstance(instances, count, node, node->global_model * model, node->mesh);
+	for (int i = 0; i < node->children.size(); ++i)
+		addNodeInstances(instances, count, node->children[i], model);
+}
+
+void GTR::PrefabEntity::updateNodeInstances(bool update_prefab)
+{
+	if (!prefab)
+	{
+		node_instances.clear();
+		return;
+	}
+
+	if (update_prefab)
+		prefab->updateTransforms();
+
+	//nothing moved since last frame
+	if (cached_prefab == prefab && cached_version == prefab->transform_version && cached_mesh_version == Mesh::data_version && memcmp(cached_model.m, model.m, sizeof(Matrix44)) == 0)
+		return;
+
+	size_t count = 0;
+	Matrix34 entity_model = model;
+	if (prefab->isCompiled())
+	{
+		//linear pass over the flattened prefab
+		sFlatNodes& flat = prefab->flat;
+		for (int i = 0; i < flat.size(); ++i)
+		{
+			if (!(flat.flags[i] & FLAT_VISIBLE) || !flat.mesh[i] || !flat.material[i])
+				continue;
+			setNodeInstance(node_instances, count, flat.nodes[i], flat.world[i] * entity_model, flat.mesh[i]);
+		}
+	}
+	else
+		addNodeInstances(node_instances, count, &prefab->root, entity_model);
+	node_instances.resize(count);
+
+	cached_prefab = prefab;
+	cached_version = prefab->transform_version;
+	cached_mesh_version = Mesh::data_version;
+	cached_model = model;
 }
 
 void GTR::PrefabEntity::configure(cJSON* json)		//Modificar per altres entitats
@@ -172,7 +246,9 @@ void GTR::PrefabEntity::configure(cJSON* json)		//Modificar per altres entitats
 	if (cJSON_GetObjectItem(json, "filename"))
 	{
 		filename = cJSON_GetObjectItem(json, "filename")->valuestring;
-		prefab = GTR::Prefab::Get( (std::string("data/") + filename).c_str());
+		prefab = GTR::Prefab::GetAsync( (std::string("data/") + filename).c_str()); //loaded in the workers, empty until ready
+		if (prefab)
+			prefab->addRef();
 	}
 }
 
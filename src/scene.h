@@ -33,6 +33,7 @@ namespace GTR {
 
 	class Scene;
 	class Prefab;
+	class Node;
 
 	//represents one element of the scene (could be lights, prefabs, cameras, etc)
 	class BaseEntity
@@ -49,16 +50,36 @@ namespace GTR {
 		virtual void configure(cJSON* json) {}
 	};
 
+	//world transform of one node of the prefab for a given entity
+	struct sNodeInstance {
+		Node* node;
+		Matrix34 model; //node global matrix * entity model
+		BoundingBox world_bounding;
+		int lod; //level of detail of the last frame, the next one only changes past a margin
+	};
+
 	//represents one prefab in the scene
 	class PrefabEntity : public GTR::BaseEntity
 	{
 	public:
 		std::string filename;
 		Prefab* prefab;
+
+		//visible nodes with mesh in world space, only rebuilt when the entity or the prefab moves
+		std::vector<sNodeInstance> node_instances;
 		
 		PrefabEntity();
+		virtual ~PrefabEntity();
 		virtual void renderInMenu();
 		virtual void configure(cJSON* json);
+
+		void updateNodeInstances(bool update_prefab = true); //pass false if the prefab was already updated this frame
+
+	private:
+		Prefab* cached_prefab;
+		unsigned int cached_version;
+		unsigned int cached_mesh_version; //Mesh::data_version, the placeholders receive their box when loaded
+		Matrix44 cached_model;
 	};
 
 	class LightEntity : public GTR::BaseEntity{
@@ -8,6 +8,11 @@
 #include <locale>
 
 #include "texture.h"
+#include "drawcapture.h"
+#include "assetmanager.h"
+
+//stores the uniform in the draw capture when recording (see drawcapture.h)
+#define CAPTURE_UNIFORM(type, components, count, values) if (GTR::DrawCapture::recording) GTR::DrawCapture::recording->recordUniform(varname, GTR::type, components, count, values)
 
 std::string Shader::s_shader_atlas_filename;
 std::map<std::string, std::string> Shader::s_shaders_atlas;
@@ -128,6 +133,7 @@ Shader* Shader::Get(const char* vsf, const char* psf, const char* macros)
 	Shader* sh = new Shader();
 	if (!sh->load( vsf,psf, macros ))
 		return NULL;
+	sh->name = name;
 	s_Shaders[name] = sh;
 	return sh;
 }
@@ -247,6 +253,7 @@ bool Shader::LoadAtlas(const char* filename)
 		if(it == s_Shaders.end())
 		{
 			shader = new Shader();
+			shader->name = name;
 			s_Shaders[ name ] = shader;
 		}
 		else
@@ -444,6 +451,8 @@ void Shader::enable()
 		return;
 
 	current = this;
+	if (GTR::DrawCapture::recording)
+		GTR::DrawCapture::recording->recordShader(this);
 
 	glUseProgram(program);
     GLuint err = glGetError();
@@ -564,10 +573,20 @@ int Shader::getUniformLocation(const char* varname)
 
 void Shader::setTexture(const char* varname, Texture* tex, int slot)
 {
+	//the slot uniform is part of the texture command, dont record it twice
+	GTR::DrawCapture* capture = GTR::DrawCapture::recording;
+	if (capture)
+		capture->recordTexture(varname, tex, slot);
+	GTR::DrawCapture::recording = NULL;
+
+	AssetManager::use(tex); //an evicted texture binds the placeholder until reloaded
+
 	glActiveTexture(GL_TEXTURE0 + slot);
 	glBindTexture(tex->texture_type, tex->texture_id);
 	setUniform1(varname, slot);
 	glActiveTexture(GL_TEXTURE0 + slot);
+
+	GTR::DrawCapture::recording = capture;
 }
 
 /*
@@ -583,6 +602,8 @@ void Shader::setTexture(const char* varname, unsigned int tex)
 
 void Shader::setUniform1(const char* varname, bool input1)
 {
+	int value = input1;
+	CAPTURE_UNIFORM(CAP_INT, 1, 1, &value);
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform1i(loc, input1);
@@ -591,6 +612,7 @@ void Shader::setUniform1(const char* varname, bool input1)
 
 void Shader::setUniform1(const char* varname, int input1)
 {
+	CAPTURE_UNIFORM(CAP_INT, 1, 1, &input1);
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
 	glUniform1i(loc, input1);
@@ -599,6 +621,8 @@ void Shader::setUniform1(const char* varname, int input1)
 
 void Shader::setUniform2(const char* varname, int input1, int input2)
 {
+	int values[2] = { input1, input2 };
+	CAPTURE_UNIFORM(CAP_INT, 2, 1, values);
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
 	glUniform2i(loc, input1, input2);
@@ -607,6 +631,8 @@ void Shader::setUniform2(const char* varname, int input1, int input2)
 
 void Shader::setUniform3(const char* varname, int input1, int input2, int input3)
 {
+	int values[3] = { input1, input2, input3 };
+	CAPTURE_UNIFORM(CAP_INT, 3, 1, values);
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
 	glUniform3i(loc, input1, input2, input3);
@@ -615,6 +641,8 @@ void Shader::setUniform3(const char* varname, int input1, int input2, int input3
 
 void Shader::setUniform4(const char* varname, const int input1, const int input2, const int input3, const int input4)
 {
+	int values[4] = { input1, input2, input3, input4 };
+	CAPTURE_UNIFORM(CAP_INT, 4, 1, values);
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
 	glUniform4i(loc, input1, input2, input3, input4);
@@ -623,6 +651,7 @@ void Shader::setUniform4(const char* varname, const int input1, const int input2
 
 void Shader::setUniform1Array(const char* varname, const int* input, const int count)
 {
+	CAPTURE_UNIFORM(CAP_INT, 1, count, input);
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
 	glUniform1iv(loc,count,input);
@@ -631,6 +660,7 @@ void Shader::setUniform1Array(const char* varname, const int* input, const int c
 
 void Shader::setUniform2Array(const char* varname, const int* input, const int count)
 {
+	CAPTURE_UNIFORM(CAP_INT, 2, count, input);
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
 	glUniform2iv(loc,count,input);
@@ -639,6 +669,7 @@ void Shader::setUniform2Array(const char* varname, const int* input, const int c
 
 void Shader::setUniform3Array(const char* varname, const int* input, const int count)
 {
+	CAPTURE_UNIFORM(CAP_INT, 3, count, input);
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
 	glUniform3iv(loc,count,input);
@@ -647,6 +678,7 @@ void Shader::setUniform3Array(const char* varname, const int* input, const int c
 
 void Shader::setUniform4Array(const char* varname, const int* input, const int count)
 {
+	CAPTURE_UNIFORM(CAP_INT, 4, count, input);
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
 	glUniform4iv(loc,count,input);
@@ -655,6 +687,7 @@ void Shader::setUniform4Array(const char* varname, const int* input, const int c
 
 void Shader::setUniform1(const char* varname, const float input1)
 {
+	CAPTURE_UNIFORM(CAP_FLOAT, 1, 1, &input1);
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
 	glUniform1f(loc, input1);
@@ -663,6 +696,8 @@ void Shader::setUniform1(const char* varname, const float input1)
 
 void Shader::setUniform2(const char* varname, const float input1, const float input2)
 {
+	float values[2] = { input1, input2 };
+	CAPTURE_UNIFORM(CAP_FLOAT, 2, 1, values);
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
 	glUniform2f(loc, input1, input2);
@@ -671,6 +706,8 @@ void Shader::setUniform2(const char* varname, const float input1, const float in
 
 void Shader::setUniform3(const char* varname, const float input1, const float input2, const float input3)
 {
+	float values[3] = { input1, input2, input3 };
+	CAPTURE_UNIFORM(CAP_FLOAT, 3, 1, values);
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
 	glUniform3f(loc, input1, input2, input3);
@@ -679,6 +716,8 @@ void Shader::setUniform3(const char* varname, const float input1, const float in
 
 void Shader::setUniform4(const char* varname, const float input1, const float input2, const float input3, const float input4)
 {
+	float values[4] = { input1, input2, input3, input4 };
+	CAPTURE_UNIFORM(CAP_FLOAT, 4, 1, values);
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
 	glUniform4f(loc, input1, input2, input3, input4);
@@ -687,6 +726,7 @@ void Shader::setUniform4(const char* varname, const float input1, const float in
 
 void Shader::setUniform1Array(const char* varname, const float* input, const int count)
 {
+	CAPTURE_UNIFORM(CAP_FLOAT, 1, count, input);
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
 	glUniform1fv(loc,count,input);
@@ -695,6 +735,7 @@ void Shader::setUniform1Array(const char* varname, const float* input, const int
 
 void Shader::setUniform2Array(const char* varname, const float* input, const int count)
 {
+	CAPTURE_UNIFORM(CAP_FLOAT, 2, count, input);
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
 	glUniform2fv(loc,count,input);
@@ -703,6 +744,7 @@ void Shader::setUniform2Array(const char* varname, const float* input, const int
 
 void Shader::setUniform3Array(const char* varname, const float* input, const int count)
 {
+	CAPTURE_UNIFORM(CAP_FLOAT, 3, count, input);
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
 	glUniform3fv(loc,count,input);
@@ -711,6 +753,7 @@ void Shader::setUniform3Array(const char* varname, const float* input, const int
 
 void Shader::setUniform4Array(const char* varname, const float* input, const int count)
 {
+	CAPTURE_UNIFORM(CAP_FLOAT, 4, count, input);
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
 	glUniform4fv(loc,count,input);
@@ -719,6 +762,7 @@ void Shader::setUniform4Array(const char* varname, const float* input, const int
 
 void Shader::setMatrix44(const char* varname, const float* m)
 {
+	CAPTURE_UNIFORM(CAP_MATRIX44, 16, 1, m);
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
 	glUniformMatrix4fv(loc, 1, GL_FALSE, m);
@@ -727,6 +771,7 @@ void Shader::setMatrix44(const char* varname, const float* m)
 
 void Shader::setMatrix44( const char* varname, const Matrix44 &m )
 {
+	CAPTURE_UNIFORM(CAP_MATRIX44, 16, 1, m.m);
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
 	glUniformMatrix4fv(loc, 1, GL_FALSE, m.m);
@@ -735,6 +780,7 @@ void Shader::setMatrix44( const char* varname, const Matrix44 &m )
 
 void Shader::setMatrix44Array( const char* varname, Matrix44* m_array, int num )
 {
+	CAPTURE_UNIFORM(CAP_MATRIX44, 16, num, m_array);
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniformMatrix4fv(loc, num, GL_FALSE, (GLfloat*)m_array);
@@ -938,6 +984,7 @@ Shader* Shader::getDefaultShader(std::string name)
 
 
 	Shader* sh = new Shader();
+	sh->name = name;
 	if (!sh->compileFromMemory(vs, fs))
 	{
 		assert(0 && "error in default shader");
@@ -105,6 +105,7 @@ public:
 	std::string getInfoLog() const;
 	bool hasInfoLog() const;
 	bool compiled;
+	std::string name; //name used to register it in s_Shaders
 
 	void setMacros(const char * macros);
 
@@ -0,0 +1,128 @@
+#include "textscanner.h"
+
+#include <cstring>
+#include <algorithm>
+
+//without branches, the control characters are separators too
+static inline bool isSeparator(char c)
+{
+	return ((unsigned char)c <= ' ') | (c == ',');
+}
+
+TextScanner::TextScanner()
+{
+	start = pos = end = NULL;
+}
+
+bool TextScanner::open(const char* filename)
+{
+	if (!file.open(filename))
+		return false;
+	set((const char*)file.data, file.size);
+	return true;
+}
+
+void TextScanner::set(const char* data, size_t size)
+{
+	start = pos = data;
+	end = data + size;
+}
+
+bool TextScanner::eof()
+{
+	skipSeparators();
+	return pos >= end;
+}
+
+void TextScanner::skipSeparators()
+{
+	while (pos < end && isSeparator(*pos))
+		pos++;
+}
+
+void TextScanner::skipLine()
+{
+	const char* line_end = (const char*)memchr(pos, '\n', end - pos);
+	pos = line_end ? line_end + 1 : end;
+}
+
+bool TextScanner::seek(const char* word)
+{
+	size_t length = strlen(word);
+	while (pos + length <= end)
+	{
+		const char* found = (const char*)memchr(pos, word[0], end - pos - length + 1);
+		if (!found)
+			break;
+		pos = found + 1;
+		if (memcmp(found, word, length) == 0 && (found == start || isSeparator(found[-1])) && (found + length == end || isSeparator(found[length])))
+		{
+			pos = found + length;
+			return true;
+		}
+	}
+	pos = end;
+	return false;
+}
+
+char TextScanner::getChar()
+{
+	skipSeparators();
+	return pos < end ? *pos++ : 0;
+}
+
+size_t TextScanner::getWord(char* word, size_t max_size)
+{
+	skipSeparators();
+	const char* word_start = pos;
+	while (pos < end && !isSeparator(*pos))
+		pos++;
+	size_t length = std::min((size_t)(pos - word_start), max_size - 1);
+	memcpy(word, word_start, length);
+	word[length] = 0;
+	return length;
+}
+
+size_t TextScanner::getField(char* field, size_t max_size)
+{
+	skipSeparators();
+	const char* field_start = pos;
+	while (pos < end && *pos != ',' && *pos != '\n' && *pos != '\r')
+		pos++;
+	size_t length = std::min((size_t)(pos - field_start), max_size - 1);
+	memcpy(field, field_start, length);
+	field[length] = 0;
+	return length;
+}
+
+int TextScanner::getInt()
+{
+	skipSeparators();
+	int value = 0;
+	const char* next = parseInt(pos, end, value);
+	if (next == pos) //not a number, skipped so the loops dont get stuck
+		while (pos < end && !isSeparator(*pos))
+			pos++;
+	else
+		pos = next;
+	return value;
+}
+
+float TextScanner::getFloat()
+{
+	skipSeparators();
+	float value = 0;
+	const char* next = parseFloat(pos, end, value);
+	if (next == pos)
+		while (pos < end && !isSeparator(*pos))
+			pos++;
+	else
+		pos = next;
+	return value;
+}
+
+void TextScanner::getFloats(float* values, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		values[i] = getFloat();
+}
@@ -0,0 +1,34 @@
+#pragma once
+#ifndef TEXTSCANNER_H
+#define TEXTSCANNER_H
+
+#include "utils.h"
+
+//Reads the text formats (ASE, MESH, SKANIM) in place from a mapped file, the words are not copied
+//to parse them and nothing is allocated. Spaces, tabs, new lines and commas separate the words.
+class TextScanner {
+public:
+	const char* start;
+	const char* pos;
+	const char* end;
+
+	TextScanner();
+	bool open(const char* filename); //maps the file, false if not found
+	void set(const char* data, size_t size); //text already in memory, it doesnt need to end in zero
+	bool eof();
+
+	void skipSeparators();
+	void skipLine();
+	bool seek(const char* word); //moves after the next occurrence of the whole word, false if not found (it stays at the end)
+	char getChar(); //the next character after the separators, 0 at the end
+	size_t getWord(char* word, size_t max_size); //returns the length, the words longer than max_size - 1 are cut
+	size_t getField(char* field, size_t max_size); //until a comma or the end of the line, it can contain spaces (not at the start)
+	int getInt();
+	float getFloat();
+	void getFloats(float* values, size_t count);
+
+private:
+	MappedFile file;
+};
+
+#endif
@@ -10,6 +10,10 @@
 #include "shader.h"
 #include "extra/picopng.h"
 #include "extra/jpgd.h"
+#include "asyncloader.h"
+#include "jobs.h"
+#include "bcencoder.h"
+#include "texturestreamer.h"
 #include <cassert>
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -62,6 +66,10 @@ std::map<std::string, Texture*> Texture::sTexturesLoaded;
 int Texture::default_mag_filter = GL_LINEAR;
 int Texture::default_min_filter = GL_LINEAR_MIPMAP_LINEAR;
 FBO* Texture::global_fbo = NULL;
+bool Texture::use_binary = true;
+bool Texture::use_compression = true;
+bool Texture::use_bc7 = false;
+static bool bc_supported[8] = { false }; //by eBCFormat, filled by checkCompressionSupport
 
 Texture::Texture()
 {
@@ -73,17 +81,32 @@ Texture::Texture()
 	format = 0;
 	type = 0;
 	texture_type = GL_TEXTURE_2D;
+	placeholder = false;
+	resident_level = streamed_level = needed_level = 0;
+	needed_frame = 0;
+	stream_pending = false;
+	bin_size = 0;
 }
 
 Texture::Texture(unsigned int width, unsigned int height, unsigned int format, unsigned int type, bool mipmaps, Uint8* data, unsigned int internal_format)
 {
 	texture_id = 0;
+	placeholder = false;
+	resident_level = streamed_level = needed_level = 0;
+	needed_frame = 0;
+	stream_pending = false;
+	bin_size = 0;
 	create(width, height, format, type, mipmaps, data, internal_format);
 }
 
 Texture::Texture(Image* img)
 {
 	texture_id = 0;
+	placeholder = false;
+	resident_level = streamed_level = needed_level = 0;
+	needed_frame = 0;
+	stream_pending = false;
+	bin_size = 0;
 	create(img->width, img->height, img->num_channels == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, true, img->data);
 }
 
@@ -96,15 +119,24 @@ void Texture::clear()
 {
 	glBindTexture(this->texture_type, 0);
 
-	//external textures are handled by an outside system (like Android OS)
-	if( texture_type != GL_TEXTURE_EXTERNAL_OES)
+	if (stream_file)
+	{
+		TextureStreamer::remove(this);
+		stream_file.reset();
+	}
+
+	//external textures are handled by an outside system (like Android OS), placeholders belong to another texture
+	if( texture_type != GL_TEXTURE_EXTERNAL_OES && !placeholder)
 		glDeleteTextures(1, &texture_id);
+	placeholder = false;
 
 	stdlog("Destroy texture: " + filename );
 	texture_id = 0;
+	bin_size = 0;
 
 	if (filename.size())
 	{
+		std::lock_guard<std::recursive_mutex> lock(AsyncLoader::manager_mutex);
 		auto it = sTexturesLoaded.find(filename);
 		if (it != sTexturesLoaded.end())
 			sTexturesLoaded.erase(it);
@@ -113,6 +145,7 @@ void Texture::clear()
 
 void Texture::Release()
 {
+	std::lock_guard<std::recursive_mutex> lock(AsyncLoader::manager_mutex);
 	std::vector<Texture *> texs;
 
 	for (auto mp : sTexturesLoaded)
@@ -217,6 +250,7 @@ void Texture::createCubemap(unsigned int width, unsigned int height, Uint8** dat
 Texture* Texture::Find(const char* filename)
 {
 	assert(filename);
+	std::lock_guard<std::recursive_mutex> lock(AsyncLoader::manager_mutex);
 	auto it = sTexturesLoaded.find(filename);
 	if (it != sTexturesLoaded.end())
 		return it->second;
@@ -240,25 +274,97 @@ Texture* Texture::Get(const char* filename, bool mipmaps, bool wrap)
 	return texture;
 }
 
+//returns a texture using the placeholder immediately, the image is decoded in a worker and uploaded by the main thread
+Texture* Texture::GetAsync(const char* filename, bool mipmaps, bool wrap)
+{
+	std::lock_guard<std::recursive_mutex> lock(AsyncLoader::manager_mutex);
+	Texture* texture = Find(filename);
+	if (texture)
+		return texture;
+
+	texture = new Texture();
+	texture->usePlaceholder();
+	texture->setName(filename);
+
+	std::string name = filename;
+	AsyncLoader::num_loading++;
+	JobSystem::runBackground([texture, name, mipmaps, wrap]() {
+		std::shared_ptr<MappedFile> bin = use_binary ? readBin(name.c_str()) : NULL;
+		if (bin)
+		{
+			AsyncLoader::enqueue([texture, bin, mipmaps, wrap]() {
+				texture->loadFromBin(bin, mipmaps, wrap);
+				AsyncLoader::num_loading--;
+			});
+			return;
+		}
+		Image* image = new Image();
+		int found = image->load(name.c_str());
+		if (found != 1)
+		{
+			std::cout << "[ERROR] Texture " << (found == -1 ? "format not supported: " : "not found: ") << name << std::endl;
+			delete image;
+			AsyncLoader::num_loading--;
+			return;
+		}
+		//once cooked it is uploaded from the file, the mips are already there
+		bin = use_binary && writeBin(name.c_str(), image) ? readBin(name.c_str()) : NULL;
+		if (bin)
+		{
+			delete image;
+			AsyncLoader::enqueue([texture, bin, mipmaps, wrap]() {
+				texture->loadFromBin(bin, mipmaps, wrap);
+				AsyncLoader::num_loading--;
+			});
+			return;
+		}
+		texture->loadFromImage(image, mipmaps, wrap); //queues the upload
+		delete image;
+		AsyncLoader::enqueue([]() { AsyncLoader::num_loading--; });
+	});
+	return texture;
+}
+
+//the texture shows the white texture until it gets its own data
+void Texture::usePlaceholder()
+{
+	Texture* white = getWhiteTexture(); //created by the main thread before any async load
+	if (texture_id && !placeholder)
+		clear();
+	texture_id = white->texture_id;
+	texture_type = white->texture_type;
+	width = white->width;
+	height = white->height;
+	placeholder = true;
+}
+
+void Texture::setName(const char* name)
+{
+	std::lock_guard<std::recursive_mutex> lock(AsyncLoader::manager_mutex);
+	filename = name;
+	sTexturesLoaded[filename] = this;
+}
+
 bool Texture::load(const char* filename, bool mipmaps, bool wrap, unsigned int type)
 {
-	std::string str = filename;
-	std::string ext = str.substr(str.size() - 4, 4);
-	Image* image = NULL;
 	double time = getTime();
 
 	std::cout << " + Texture loading: " << filename << " ... ";
 
-	image = new Image();
-	bool found = false;
+	//try the cooked version
+	bool cook = use_binary && type == GL_UNSIGNED_BYTE;
+	std::shared_ptr<MappedFile> bin = cook ? readBin(filename) : NULL;
+	if (bin)
+	{
+		loadFromBin(bin, mipmaps, wrap);
+		setName(filename);
+		std::cout << "[OK BIN] Size: " << width << "x" << height << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
+		return true;
+	}
 
-	if (ext == ".tga" || ext == ".TGA")
-		found = image->loadTGA(filename);
-	else if (ext == ".png" || ext == ".PNG")
-		found = image->loadPNG(filename);
-	else if (ext == ".jpg" || ext == ".JPG" || ext == "JPEG" || ext == "jpeg")
-		found = image->loadJPG(filename);
-	else
+	Image image;
+	int found = image.load(filename);
+	if (found == -1)
 	{
 		std::cout << "[ERROR]: unsupported format" << std::endl;
 		return false; //unsupported file type
@@ -270,7 +376,18 @@ bool Texture::load(const char* filename, bool mipmaps, bool wrap, unsigned int t
 		return false;
 	}
 
-	loadFromImage(image,mipmaps,wrap,type);
+	float psnr = 0;
+	bin = cook && writeBin(filename, &image, sMipOptions(), NULL, &psnr) ? readBin(filename) : NULL;
+	if (bin)
+	{
+		std::cout << "[TBIN";
+		if (psnr)
+			std::cout << " PSNR: " << psnr << "dB";
+		std::cout << "] ";
+		loadFromBin(bin, mipmaps, wrap);
+	}
+	else
+		loadFromImage(&image,mipmaps,wrap,type);
 	this->filename = filename;
 	setName(filename);
 
@@ -279,8 +396,48 @@ bool Texture::load(const char* filename, bool mipmaps, bool wrap, unsigned int t
 	return true;
 }
 
-void Texture::loadFromImage(Image* image, bool mipmaps, bool wrap, unsigned int type)
+void Texture::loadFromImage(Image* image, bool mipmaps, bool wrap, unsigned int type, const sMipOptions& mip_options)
 {
+	//the mips are filtered in the CPU instead of using glGenerateMipmap, in the worker when loading asynchronously
+	MipChain* chain = NULL;
+	if (mipmaps && type == GL_UNSIGNED_BYTE && MipChain::canBuild(image))
+	{
+		chain = new MipChain();
+		chain->build(image, mip_options);
+	}
+
+	//GL only works in the main thread: the pixels are moved to an upload task and the placeholder is used meanwhile
+	if (!AsyncLoader::isMainThread())
+	{
+		Image* pixels = new Image();
+		pixels->width = image->width;
+		pixels->height = image->height;
+		pixels->num_channels = image->num_channels;
+		pixels->origin_topleft = image->origin_topleft;
+		pixels->data = image->data;
+		image->data = NULL;
+		image->width = image->height = 0;
+		usePlaceholder();
+		width = (float)pixels->width;
+		height = (float)pixels->height;
+		AsyncLoader::enqueue([this, pixels, chain, mipmaps, wrap, type]() {
+			loadFromImage(pixels, chain ? false : mipmaps, wrap, type);
+			if (chain)
+				uploadMipChain(chain, wrap);
+			delete chain;
+			delete pixels;
+		});
+		return;
+	}
+	if (chain) //the first level is uploaded without mips and the chain is added after it
+		mipmaps = false;
+
+	//stop using the placeholder texture id
+	if (placeholder)
+	{
+		texture_id = 0;
+		placeholder = false;
+	}
 
 	unsigned int internal_format = 0;
 	if (type == GL_FLOAT)
@@ -298,6 +455,403 @@ void Texture::loadFromImage(Image* image, bool mipmaps, bool wrap, unsigned int
 	//if (mipmaps)
 	//	generateMipmaps();
 	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (chain)
+	{
+		uploadMipChain(chain, wrap);
+		delete chain;
+	}
+}
+
+void Texture::uploadMipChain(MipChain* chain, bool wrap)
+{
+	assert(texture_type == GL_TEXTURE_2D && type == GL_UNSIGNED_BYTE);
+	glBindTexture(this->texture_type, texture_id);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int i = 0; i < chain->levels.size(); ++i)
+	{
+		Image* level = chain->levels[i];
+		glTexImage2D(this->texture_type, i + 1, format, level->width, level->height, 0, format, GL_UNSIGNED_BYTE, level->data);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	this->mipmaps = true;
+	glTexParameteri(this->texture_type, GL_TEXTURE_MAX_LEVEL, (int)chain->levels.size());
+	glTexParameteri(this->texture_type, GL_TEXTURE_MIN_FILTER, Texture::default_min_filter);
+	glTexParameteri(this->texture_type, GL_TEXTURE_WRAP_S, wrap ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+	glTexParameteri(this->texture_type, GL_TEXTURE_WRAP_T, wrap ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+	glBindTexture(this->texture_type, 0);
+	assert(checkGLErrors() && "Error uploading mipmaps");
+}
+
+//uploads all the levels of a cooked texture straight from the mapped file
+void Texture::loadFromBin(std::shared_ptr<MappedFile> file, bool mipmaps, bool wrap)
+{
+	sTextureBinHeader* header = (sTextureBinHeader*)(file->data + 4);
+	sTextureBinLevel* levels = (sTextureBinLevel*)(file->data + 4 + header->header_bytes);
+	bin_filename = file->filename; //before the upload, the cooked prefabs reference it
+
+	if (!AsyncLoader::isMainThread())
+	{
+		usePlaceholder();
+		width = (float)header->width;
+		height = (float)header->height;
+		AsyncLoader::enqueue([this, file, mipmaps, wrap]() { loadFromBin(file, mipmaps, wrap); });
+		return;
+	}
+
+	if (placeholder)
+	{
+		texture_id = 0;
+		placeholder = false;
+	}
+	else if (texture_id)
+		clear();
+
+	int num_levels = mipmaps ? header->num_levels : 1;
+	this->width = (float)header->width;
+	this->height = (float)header->height;
+	this->depth = 0;
+	this->format = header->format;
+	this->internal_format = 0;
+	this->type = GL_UNSIGNED_BYTE;
+	this->texture_type = GL_TEXTURE_2D;
+	this->mipmaps = num_levels > 1;
+
+	//streamed: only the levels up to the initial size, the finer ones are uploaded when needed
+	int first_level = 0;
+	if (this->mipmaps && TextureStreamer::enabled)
+		while (first_level < num_levels - 1 && std::max(levels[first_level].width, levels[first_level].height) > TextureStreamer::initial_size)
+			first_level++;
+
+	glGenTextures(1, &texture_id);
+	glBindTexture(this->texture_type, texture_id);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1); //small RGB levels have rows that are not multiple of 4
+	for (int i = first_level; i < num_levels; ++i)
+	{
+		if (header->compressed)
+			glCompressedTexImage2D(this->texture_type, i, format, levels[i].width, levels[i].height, 0, levels[i].size, file->data + levels[i].offset);
+		else
+			glTexImage2D(this->texture_type, i, format, levels[i].width, levels[i].height, 0, format, GL_UNSIGNED_BYTE, file->data + levels[i].offset);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	glTexParameteri(this->texture_type, GL_TEXTURE_BASE_LEVEL, first_level);
+	glTexParameteri(this->texture_type, GL_TEXTURE_MAX_LEVEL, num_levels - 1);
+	glTexParameteri(this->texture_type, GL_TEXTURE_MAG_FILTER, Texture::default_mag_filter);
+	glTexParameteri(this->texture_type, GL_TEXTURE_MIN_FILTER, this->mipmaps ? Texture::default_min_filter : GL_LINEAR);
+	glTexParameteri(this->texture_type, GL_TEXTURE_WRAP_S, (this->mipmaps && wrap) ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+	glTexParameteri(this->texture_type, GL_TEXTURE_WRAP_T, (this->mipmaps && wrap) ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+	glBindTexture(this->texture_type, 0);
+	assert(checkGLErrors() && "Error uploading texture");
+
+	this->wrapS = this->wrapT = (this->mipmaps && wrap) ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+	bin_size = 0;
+	for (int i = first_level; i < num_levels; ++i)
+		bin_size += levels[i].size;
+
+	if (first_level > 0)
+	{
+		stream_file = file; //keeps the file mapped
+		resident_level = streamed_level = needed_level = first_level;
+		stream_pending = false;
+		TextureStreamer::add(this);
+	}
+}
+
+int Texture::getNumLevels()
+{
+	if (!stream_file)
+		return mipmaps ? 1 + (int)log2f((float)std::max(width, height)) : 1;
+	return ((sTextureBinHeader*)(stream_file->data + 4))->num_levels;
+}
+
+sTextureBinLevel* Texture::getLevelInfo(int level)
+{
+	assert(stream_file && level >= 0 && level < getNumLevels());
+	sTextureBinHeader* header = (sTextureBinHeader*)(stream_file->data + 4);
+	sTextureBinLevel* levels = (sTextureBinLevel*)(stream_file->data + 4 + header->header_bytes);
+	return &levels[level];
+}
+
+void Texture::uploadLevel(int level)
+{
+	assert(stream_file && level < resident_level);
+	sTextureBinHeader* header = (sTextureBinHeader*)(stream_file->data + 4);
+	sTextureBinLevel* info = getLevelInfo(level);
+
+	glBindTexture(this->texture_type, texture_id);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (header->compressed)
+		glCompressedTexImage2D(this->texture_type, level, format, info->width, info->height, 0, info->size, stream_file->data + info->offset);
+	else
+		glTexImage2D(this->texture_type, level, format, info->width, info->height, 0, format, GL_UNSIGNED_BYTE, stream_file->data + info->offset);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(this->texture_type, GL_TEXTURE_BASE_LEVEL, level);
+	glBindTexture(this->texture_type, 0);
+	resident_level = level;
+}
+
+void Texture::evictLevels(int level)
+{
+	assert(stream_file && level >= resident_level);
+	sTextureBinHeader* header = (sTextureBinHeader*)(stream_file->data + 4);
+
+	//the levels are specified again with no data, the driver frees their memory
+	glBindTexture(this->texture_type, texture_id);
+	glTexParameteri(this->texture_type, GL_TEXTURE_BASE_LEVEL, level);
+	for (int i = resident_level; i < level; ++i)
+	{
+		if (header->compressed)
+			glCompressedTexImage2D(this->texture_type, i, format, 0, 0, 0, 0, NULL);
+		else
+			glTexImage2D(this->texture_type, i, format, 0, 0, 0, format, GL_UNSIGNED_BYTE, NULL);
+	}
+	glBindTexture(this->texture_type, 0);
+	resident_level = level;
+}
+
+size_t Texture::getCPUSize()
+{
+	size_t size = image.data ? image.width * image.height * image.num_channels : 0;
+	if (stream_file)
+		size += stream_file->size; //mapped
+	return size;
+}
+
+size_t Texture::getVRAMSize()
+{
+	if (!texture_id || placeholder)
+		return 0;
+	if (stream_file)
+	{
+		size_t size = 0;
+		for (int i = resident_level; i < getNumLevels(); ++i)
+			size += getLevelInfo(i)->size;
+		return size;
+	}
+	if (bin_size)
+		return bin_size;
+
+	//estimated from the format
+	int channels = 4;
+	if (format == GL_RED || format == GL_DEPTH_COMPONENT)
+		channels = 1;
+	else if (format == GL_RG)
+		channels = 2;
+	else if (format == GL_RGB)
+		channels = 3;
+	int bytes = type == GL_FLOAT ? 4 : (type == GL_HALF_FLOAT || type == GL_UNSIGNED_SHORT) ? 2 : 1;
+	size_t size = (size_t)width * (size_t)height * channels * bytes;
+	if (texture_type == GL_TEXTURE_CUBE_MAP)
+		size *= 6;
+	if (mipmaps)
+		size += size / 3;
+	return size;
+}
+
+//only the textures uploaded from a cooked file can be loaded again
+bool Texture::canEvict()
+{
+	return texture_id && !placeholder && !evicted && !stream_pending && texture_type == GL_TEXTURE_2D && bin_filename.size();
+}
+
+void Texture::evict()
+{
+	assert(canEvict() && AsyncLoader::isMainThread());
+	if (stream_file)
+	{
+		TextureStreamer::remove(this);
+		stream_file.reset();
+	}
+	glDeleteTextures(1, &texture_id);
+	texture_id = 0;
+	bin_size = 0;
+
+	float w = width, h = height;
+	usePlaceholder();
+	width = w; //keeps the size of the original for the ones asking
+	height = h;
+	evicted = true;
+}
+
+void Texture::reload()
+{
+	assert(evicted);
+	evicted = false;
+	std::string name = bin_filename;
+	bool wrap = wrapS == GL_REPEAT;
+	AsyncLoader::num_loading++;
+	JobSystem::runBackground([this, name, wrap]() {
+		//the pages are read here so the upload doesnt wait for the disk
+		std::shared_ptr<MappedFile> file(new MappedFile());
+		if (!file->open(name.c_str()))
+		{
+			std::cout << "[ERROR] Texture cannot be reloaded: " << name << std::endl;
+			AsyncLoader::num_loading--;
+			return;
+		}
+		volatile unsigned char sum = 0;
+		for (size_t pos = 0; pos < file->size; pos += 4096)
+			sum += file->data[pos];
+		AsyncLoader::enqueue([this, file, wrap]() {
+			loadFromBin(file, mipmaps, wrap);
+			AsyncLoader::num_loading--;
+		});
+	});
+}
+
+//the cooked file is valid if the source has the same size and date, or the same content when the date changed (copies, checkouts)
+std::shared_ptr<MappedFile> Texture::readBin(const char* filename, const char* binfilename)
+{
+	std::string s_binfilename = binfilename ? binfilename : std::string(filename) + ".tbin";
+	std::shared_ptr<MappedFile> file(new MappedFile());
+	if (!file->open(s_binfilename.c_str()))
+		return NULL;
+
+	sTextureBinHeader* header = (sTextureBinHeader*)(file->data + 4);
+	if (file->size < 4 + sizeof(sTextureBinHeader) || memcmp(file->data, "TBIN", 4) != 0)
+	{
+		std::cout << "[ERROR] loading TBIN: invalid content: " << s_binfilename << std::endl;
+		return NULL;
+	}
+	if (header->version != TEXTURE_BIN_VERSION || header->header_bytes != sizeof(sTextureBinHeader))
+		return NULL; //old version, it will be cooked again
+
+	//cooked with other compression settings or for another GPU
+	bool compress = use_compression && isCompressionSupported(BC1);
+	if ((header->compressed != BC_NONE) != compress || (header->compressed && !isCompressionSupported(header->compressed)))
+		return NULL;
+
+	if (!isSourceUnchanged(filename, header->source))
+		return NULL;
+
+	sTextureBinLevel* levels = (sTextureBinLevel*)(file->data + 4 + header->header_bytes);
+	if (header->num_levels < 1 || 4 + header->header_bytes + header->num_levels * sizeof(sTextureBinLevel) > file->size)
+		return NULL;
+	sTextureBinLevel& last = levels[header->num_levels - 1];
+	if (last.offset + last.size > file->size)
+		return NULL;
+	return file;
+}
+
+void Texture::checkCompressionSupport()
+{
+	GLint major = 0, minor = 0, num_extensions = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+	for (int i = 0; i < num_extensions; ++i)
+	{
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (!strcmp(extension, "GL_EXT_texture_compression_s3tc"))
+			bc_supported[BC1] = bc_supported[BC3] = true;
+		else if (!strcmp(extension, "GL_ARB_texture_compression_bptc"))
+			bc_supported[BC7] = true;
+	}
+	bc_supported[BC5] = major >= 3; //RGTC is core since 3.0
+	if (major > 4 || (major == 4 && minor >= 2))
+		bc_supported[BC7] = true;
+}
+
+bool Texture::isCompressionSupported(int bc_format)
+{
+	return bc_format > BC_NONE && bc_format <= BC7 && bc_supported[bc_format];
+}
+
+//writes the pixels of the image and its mips (power of two sizes only), block compressed if enabled
+bool Texture::writeBin(const char* filename, Image* image, const sMipOptions& mip_options, const char* binfilename, float* psnr)
+{
+	assert(image->data && (image->num_channels == 3 || image->num_channels == 4));
+
+	sTextureBinHeader header;
+	memset(&header, 0, sizeof(header));
+	header.version = TEXTURE_BIN_VERSION;
+	header.header_bytes = sizeof(sTextureBinHeader);
+	if (!getSourceInfo(filename, header.source))
+		return false;
+	header.width = image->width;
+	header.height = image->height;
+	header.num_channels = image->num_channels;
+	header.format = image->num_channels == 3 ? GL_RGB : GL_RGBA;
+	header.compressed = BC_NONE;
+	if (use_compression && isCompressionSupported(BC1))
+	{
+		eBCFormat bc = BC1;
+		if (mip_options.normalmap)
+			bc = BC5;
+		else if (image->num_channels == 4)
+		{
+			for (int i = 0, num = image->width * image->height; i < num && bc == BC1; ++i)
+				if (image->data[i * 4 + 3] != 255)
+					bc = use_bc7 && isCompressionSupported(BC7) ? BC7 : BC3;
+		}
+		if (isCompressionSupported(bc))
+		{
+			header.compressed = bc;
+			header.format = BCEncoder::getGLFormat(bc);
+		}
+	}
+	eBCFormat bc = (eBCFormat)header.compressed;
+	MipChain chain;
+	if (MipChain::canBuild(image))
+		chain.build(image, mip_options);
+	header.num_levels = 1 + (int)chain.levels.size();
+
+	std::vector<sTextureBinLevel> levels(header.num_levels);
+	unsigned int offset = 4 + sizeof(sTextureBinHeader) + header.num_levels * sizeof(sTextureBinLevel);
+	for (int i = 0; i < header.num_levels; ++i)
+	{
+		sTextureBinLevel& level = levels[i];
+		level.width = image->width >> i ? image->width >> i : 1;
+		level.height = image->height >> i ? image->height >> i : 1;
+		level.size = bc ? BCEncoder::getCompressedSize(bc, level.width, level.height) : level.width * level.height * image->num_channels;
+		level.offset = (offset + 15) & ~15;
+		offset = level.offset + level.size;
+	}
+
+	std::string s_binfilename = binfilename ? binfilename : std::string(filename) + ".tbin";
+	std::string temp_filename = s_binfilename + ".tmp"; //moved over the .tbin when complete, it can be mapped meanwhile
+	FILE* f = fopen(temp_filename.c_str(), "wb");
+	if (f == NULL)
+	{
+		std::cout << "[ERROR] cannot write texture BIN: " << s_binfilename << std::endl;
+		return false;
+	}
+
+	static const char padding[16] = { 0 };
+	fwrite("TBIN", sizeof(char), 4, f);
+	fwrite(&header, sizeof(sTextureBinHeader), 1, f);
+	fwrite(&levels[0], sizeof(sTextureBinLevel), levels.size(), f);
+	offset = 4 + sizeof(sTextureBinHeader) + header.num_levels * sizeof(sTextureBinLevel);
+
+	std::vector<uint8> blocks;
+	if (psnr)
+		*psnr = 0;
+	for (int i = 0; i < header.num_levels; ++i)
+	{
+		Image* current = i == 0 ? image : chain.levels[i - 1];
+		uint8* pixels = current->data;
+		if (bc)
+		{
+			blocks.resize(levels[i].size);
+			BCEncoder::compress(bc, current->data, current->width, current->height, current->num_channels, &blocks[0]);
+			if (i == 0 && psnr)
+				*psnr = BCEncoder::computePSNR(bc, current->data, current->width, current->height, current->num_channels, &blocks[0]);
+			pixels = &blocks[0];
+		}
+		fwrite(padding, 1, levels[i].offset - offset, f);
+		fwrite(pixels, 1, levels[i].size, f);
+		offset = levels[i].offset + levels[i].size;
+	}
+	bool written = !ferror(f);
+	fclose(f);
+	if (!written || !replaceFile(temp_filename.c_str(), s_binfilename.c_str()))
+	{
+		std::cout << "[ERROR] cannot write texture BIN: " << s_binfilename << std::endl;
+		remove(temp_filename.c_str());
+		return false;
+	}
+	return true;
 }
 
 void Texture::upload(Image* img)
@@ -643,6 +1197,20 @@ void Image::fromTexture(Texture* texture)
 
 //TGA format from: http://www.paulbourke.net/dataformats/tga/
 //also on https://gshaw.ca/closecombat/formats/tga.html
+//detects the format from the extension, returns 1 if loaded, 0 if not found and -1 if the format is not supported
+int Image::load(const char* filename)
+{
+	std::string str = filename;
+	std::string ext = str.size() > 4 ? str.substr(str.size() - 4, 4) : str;
+	if (ext == ".tga" || ext == ".TGA")
+		return loadTGA(filename) ? 1 : 0;
+	if (ext == ".png" || ext == ".PNG")
+		return loadPNG(filename) ? 1 : 0;
+	if (ext == ".jpg" || ext == ".JPG" || ext == "JPEG" || ext == "jpeg")
+		return loadJPG(filename) ? 1 : 0;
+	return -1;
+}
+
 bool Image::loadTGA(const char* filename)
 {
 	GLubyte TGAheader[12] = {0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0};
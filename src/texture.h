@@ -6,13 +6,18 @@
 
 #include "includes.h"
 #include "framework.h"
+#include "mipmaps.h"
+#include "assetmanager.h"
+#include "utils.h"
 #include <map>
 #include <string>
+#include <memory>
 #include <cassert>
 
 class Shader;
 class FBO;
 class Texture;
+class MappedFile;
 
 #ifndef OPENGL_ES3
 #define GL_RGBA32F 0x8814
@@ -65,6 +70,7 @@ public:
 	void fromTexture(Texture* texture);
 	void fromScreen(int width, int height);
 
+	int load(const char* filename); //any supported format, can be called from any thread
 	bool loadTGA(const char* filename);
 	bool loadPNG(const char* filename, bool flip_y = true);
 	bool loadPNG(std::vector<unsigned char>& buffer, bool flip_y = false);
@@ -96,13 +102,38 @@ public:
 };
 
 
+#define TEXTURE_BIN_VERSION 3 //this is used to regenerate the .tbin if the format changes
+
+//cooked texture (.tbin): "TBIN" watermark, this header, one sTextureBinLevel per mip and the pixels of every level
+struct sTextureBinHeader {
+	int version;
+	int header_bytes;
+	sSourceInfo source; //the source image, to detect changes
+	int width;
+	int height;
+	int num_channels;
+	int num_levels;
+	unsigned int format; //GL_RGB, GL_RGBA or the GL compressed format
+	unsigned int compressed; //eBCFormat, 0 if the pixels are raw bytes
+};
+
+struct sTextureBinLevel {
+	int width;
+	int height;
+	unsigned int offset; //from the start of the file, aligned to 16 bytes
+	unsigned int size;
+};
+
 // TEXTURE CLASS
-class Texture
+class Texture : public Asset
 {
 public:
 	static int default_mag_filter;
 	static int default_min_filter;
 	static FBO* global_fbo;
+	static bool use_binary; //images are cooked to a .tbin with all the mips, next loads read it instead of decoding
+	static bool use_compression; //the cooked images are block compressed: BC1, BC3/BC7 with alpha, BC5 for normalmaps
+	static bool use_bc7; //BC7 instead of BC3 for the images with alpha, better quality but slower to cook
 
 	//a general struct to store all the information about a TGA file
 
@@ -120,10 +151,23 @@ public:
 	unsigned int internal_format;
 	unsigned int texture_type; //GL_TEXTURE_2D, GL_TEXTURE_CUBE, GL_TEXTURE_2D_ARRAY
 	bool mipmaps;
+	bool placeholder; //texture_id belongs to the placeholder texture while the async load finishes
 
 	unsigned int wrapS;
 	unsigned int wrapT;
 
+	//mip streaming (TextureStreamer), only for the textures loaded from a .tbin
+	std::shared_ptr<MappedFile> stream_file;
+	int resident_level; //finest level in VRAM
+	int streamed_level; //first level uploaded with the texture, the coarser ones are never evicted
+	int needed_level; //finest level requested by the renderer
+	long needed_frame;
+	bool stream_pending; //a level is being read
+
+	//memory budgets (AssetManager)
+	std::string bin_filename; //cooked file it was uploaded from, to reload it after an eviction
+	size_t bin_size; //bytes uploaded from the cooked file
+
 	//original data info
 	Image image;
 
@@ -159,17 +203,39 @@ public:
 
 	//load without using the manager
 	bool load(const char* filename, bool mipmaps = true, bool wrap = true, unsigned int type = GL_UNSIGNED_BYTE);
-	void loadFromImage(Image* image, bool mipmaps = true, bool wrap = true, unsigned int type = GL_UNSIGNED_BYTE);
+	void loadFromImage(Image* image, bool mipmaps = true, bool wrap = true, unsigned int type = GL_UNSIGNED_BYTE, const sMipOptions& mip_options = sMipOptions());
+	void loadFromBin(std::shared_ptr<MappedFile> file, bool mipmaps = true, bool wrap = true);
+
+	//cooked textures, both can be called from any thread
+	static std::shared_ptr<MappedFile> readBin(const char* filename, const char* binfilename = NULL); //maps the .tbin of the image if it is still valid, NULL otherwise
+	//binfilename is filename + ".tbin" by default, psnr returns the quality of the compression (0 if not compressed)
+	static bool writeBin(const char* filename, Image* image, const sMipOptions& mip_options = sMipOptions(), const char* binfilename = NULL, float* psnr = NULL);
+	//queries the compressed formats of the GPU, must be called from the main thread before loading textures
+	static void checkCompressionSupport();
+	static bool isCompressionSupported(int bc_format);
 
 	//load using the manager (caching loaded ones to avoid reloading them)
 	static Texture* Get(const char* filename, bool mipmaps = true, bool wrap = true);
+	static Texture* GetAsync(const char* filename, bool mipmaps = true, bool wrap = true);
 	static Texture* Find(const char* filename);
-	void setName(const char* name) {
-		filename = name;
-		sTexturesLoaded[filename] = this;
-	}
+	void setName(const char* name);
+	void usePlaceholder();
 
 	void generateMipmaps();
+	void uploadMipChain(MipChain* chain, bool wrap = true); //all the levels after the first one
+
+	//streamed levels
+	int getNumLevels();
+	sTextureBinLevel* getLevelInfo(int level);
+	void uploadLevel(int level); //from the cooked file, it becomes the finest level
+	void evictLevels(int level); //frees the levels finer than level
+
+	//memory budgets
+	size_t getCPUSize();
+	size_t getVRAMSize();
+	bool canEvict();
+	void evict(); //frees the VRAM, it shows the placeholder until reloaded
+	void reload(); //from the cooked file, in a worker
 
 	//show the texture on the current viewport
 	void toViewport( Shader* shader = NULL );
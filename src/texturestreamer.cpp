@@ -0,0 +1,164 @@
+#include "texturestreamer.h"
+#include "texture.h"
+#include "mesh.h"
+#include "camera.h"
+#include "material.h"
+#include "application.h"
+#include "asyncloader.h"
+#include "jobs.h"
+#include "utils.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+bool TextureStreamer::enabled = true;
+int TextureStreamer::initial_size = 64;
+float TextureStreamer::vram_budget = 256.0f;
+size_t TextureStreamer::vram_used = 0;
+long TextureStreamer::frame = 0;
+
+static std::vector<Texture*> streamed_textures;
+
+static size_t getLevelsSize(Texture* texture, int first, int last)
+{
+	size_t size = 0;
+	for (int i = first; i < last; ++i)
+		size += texture->getLevelInfo(i)->size;
+	return size;
+}
+
+void TextureStreamer::add(Texture* texture)
+{
+	assert(AsyncLoader::isMainThread());
+	streamed_textures.push_back(texture);
+	vram_used += getLevelsSize(texture, texture->resident_level, texture->getNumLevels());
+}
+
+void TextureStreamer::remove(Texture* texture)
+{
+	auto it = std::find(streamed_textures.begin(), streamed_textures.end(), texture);
+	if (it == streamed_textures.end())
+		return;
+	vram_used -= getLevelsSize(texture, texture->resident_level, texture->getNumLevels());
+	streamed_textures.erase(it);
+}
+
+bool TextureStreamer::isStreamed(Texture* texture)
+{
+	return std::find(streamed_textures.begin(), streamed_textures.end(), texture) != streamed_textures.end();
+}
+
+int TextureStreamer::getNumTextures()
+{
+	return (int)streamed_textures.size();
+}
+
+void TextureStreamer::request(Texture* texture, int level)
+{
+	if (!texture || !texture->stream_file)
+		return;
+	if (texture->needed_frame != frame || level < texture->needed_level)
+		texture->needed_level = level;
+	texture->needed_frame = frame;
+}
+
+void TextureStreamer::requestMaterial(const Matrix44& model, Mesh* mesh, GTR::Material* material, Camera* camera)
+{
+	if (!enabled)
+		return;
+
+	Matrix44 m = model;
+	float scale = std::max(m.rightVector().length(), std::max(m.topVector().length(), m.frontVector().length()));
+	Vector3 center = m * mesh->box.center;
+	float local_radius = (float)mesh->box.halfsize.length(); //the radius is not set by all the loaders (glTF)
+	float radius = local_radius * scale;
+
+	//the radius in pixels of the viewport
+	float pixels = 0;
+	if (camera->eye.distance(center) > radius)
+		pixels = camera->getScreenRadius(center, radius, (float)Application::instance->window_height);
+
+	//texels covered by the radius of the mesh (in local space) against the pixels it covers
+	float texels = mesh->getUVDensity() * local_radius;
+	Texture* textures[4] = { material->color_texture.texture, material->metallic_roughness_texture.texture, material->normal_texture.texture, material->emissive_texture.texture };
+	for (int i = 0; i < 4; ++i)
+	{
+		Texture* texture = textures[i];
+		if (!texture || !texture->stream_file)
+			continue;
+		int level = 0;
+		if (pixels > 0)
+		{
+			float texels_per_pixel = texels * std::max(texture->width, texture->height) / pixels;
+			level = texels_per_pixel > 1 ? (int)log2f(texels_per_pixel) : 0;
+		}
+		request(texture, level);
+	}
+}
+
+//evicts the levels of the least recently needed textures until the bytes are freed
+static bool evictLRU(size_t bytes, Texture* except)
+{
+	std::vector<Texture*> candidates = streamed_textures;
+	std::sort(candidates.begin(), candidates.end(), [](Texture* a, Texture* b) { return a->needed_frame < b->needed_frame; });
+
+	size_t freed = 0;
+	for (int i = 0; i < candidates.size() && freed < bytes; ++i)
+	{
+		Texture* texture = candidates[i];
+		if (texture == except || texture->stream_pending)
+			continue;
+		//the textures on screen only lose the levels they dont need
+		bool on_screen = texture->needed_frame >= TextureStreamer::frame - 1;
+		int level = on_screen ? std::min(texture->needed_level, texture->streamed_level) : texture->streamed_level;
+		if (level <= texture->resident_level)
+			continue;
+		size_t size = getLevelsSize(texture, texture->resident_level, level);
+		texture->evictLevels(level);
+		TextureStreamer::vram_used -= size;
+		freed += size;
+	}
+	return freed >= bytes;
+}
+
+void TextureStreamer::update()
+{
+	frame++;
+	if (!enabled)
+		return;
+
+	size_t budget = (size_t)(vram_budget * 1024 * 1024);
+	for (int i = 0; i < streamed_textures.size(); ++i)
+	{
+		Texture* texture = streamed_textures[i];
+		if (texture->stream_pending || texture->needed_frame < frame - 2 || texture->needed_level >= texture->resident_level)
+			continue;
+
+		//one level finer per frame, the next frames will continue if needed
+		int level = texture->resident_level - 1;
+		size_t size = texture->getLevelInfo(level)->size;
+		if (vram_used + size > budget && !evictLRU(vram_used + size - budget, texture))
+			continue;
+
+		//the pages of the level are read by a worker, so the upload in the main thread doesnt wait for the disk
+		texture->stream_pending = true;
+		std::shared_ptr<MappedFile> file = texture->stream_file;
+		sTextureBinLevel info = *texture->getLevelInfo(level);
+		JobSystem::runBackground([texture, file, level, info]() {
+			volatile unsigned char sum = 0;
+			for (unsigned int pos = 0; pos < info.size; pos += 4096)
+				sum += file->data[info.offset + pos];
+			AsyncLoader::enqueue([texture, level, info]() {
+				if (!isStreamed(texture)) //released meanwhile
+					return;
+				texture->uploadLevel(level);
+				texture->stream_pending = false;
+				vram_used += info.size;
+			});
+		});
+	}
+
+	if (vram_used > budget)
+		evictLRU(vram_used - budget, NULL);
+}
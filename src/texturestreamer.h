@@ -0,0 +1,39 @@
+#pragma once
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <cstddef>
+
+class Texture;
+class Mesh;
+class Camera;
+class Matrix44;
+namespace GTR { class Material; }
+
+//Streams the mips of the cooked textures (.tbin): only the small levels are uploaded when a texture
+//is loaded, the renderer requests the level needed by every material from its size on screen and
+//the finer levels are read in the workers and uploaded one per texture and frame. When the budget is
+//exceeded the levels of the textures that were needed less recently are evicted.
+class TextureStreamer {
+public:
+	static bool enabled;
+	static int initial_size; //levels up to this size (in pixels) are uploaded with the texture
+	static float vram_budget; //in MB, for all the levels of the streamed textures
+	static size_t vram_used; //in bytes
+	static long frame;
+
+	static void add(Texture* texture); //called by the texture once it has uploaded the first levels
+	static void remove(Texture* texture);
+	static bool isStreamed(Texture* texture);
+	static int getNumTextures();
+
+	//the finest level needed by a texture this frame
+	static void request(Texture* texture, int level);
+	//estimates the level of the textures of a material from the size on screen of the mesh and its uv density
+	static void requestMaterial(const Matrix44& model, Mesh* mesh, GTR::Material* material, Camera* camera);
+
+	//once per frame from the main thread: streams in the requested levels and evicts if over budget
+	static void update();
+};
+
+#endif
@@ -4,7 +4,11 @@
 	#include <windows.h>
 #else
 	#include <sys/time.h>
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
 #endif
+#include <sys/stat.h>
 
 #include "includes.h"
 
@@ -15,6 +19,8 @@
 
 #include "extra/stb_easy_font.h"
 
+#include <chrono>
+
 long getTime()
 {
 	#ifdef WIN32
@@ -26,6 +32,12 @@ long getTime()
 	#endif
 }
 
+double getTimeHighRes()
+{
+	static auto start = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
 float * snapshot()
 {
 	GLint viewport[4];
@@ -137,6 +149,137 @@ bool readFileBin(const std::string& filename, std::vector<unsigned char>& buffer
 	return true;
 }
 
+bool getFileInfo(const char* filename, unsigned long long& size, long long& mtime)
+{
+	struct stat stbuffer;
+	if (stat(filename, &stbuffer) != 0)
+		return false;
+	size = (unsigned long long)stbuffer.st_size;
+	mtime = (long long)stbuffer.st_mtime;
+	return true;
+}
+
+unsigned long long hashFNV1a(const void* data, size_t size, unsigned long long hash)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+bool getSourceInfo(const char* filename, sSourceInfo& info)
+{
+	memset(&info, 0, sizeof(info));
+	MappedFile source;
+	if (!getFileInfo(filename, info.size, info.mtime) || !source.open(filename))
+		return false;
+	info.hash = hashFNV1a(source.data, source.size);
+	return true;
+}
+
+bool isSourceUnchanged(const char* filename, const sSourceInfo& info)
+{
+	unsigned long long size;
+	long long mtime;
+	if (!getFileInfo(filename, size, mtime))
+		return true;
+	if (size != info.size)
+		return false;
+	if (mtime == info.mtime)
+		return true;
+	MappedFile source;
+	return source.open(filename) && hashFNV1a(source.data, source.size) == info.hash;
+}
+
+bool replaceFile(const char* temp_filename, const char* filename)
+{
+#ifdef WIN32
+	return MoveFileExA(temp_filename, filename, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(temp_filename, filename) == 0;
+#endif
+}
+
+MappedFile::MappedFile()
+{
+	data = NULL;
+	size = 0;
+	file_handle = NULL;
+	map_handle = NULL;
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const char* filename)
+{
+	close();
+#ifdef WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (!view)
+	{
+		if (mapping)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	file_handle = file;
+	map_handle = mapping;
+	size = (size_t)file_size.QuadPart;
+#else
+	int fd = ::open(filename, O_RDONLY);
+	if (fd == -1)
+		return false;
+	struct stat stbuffer;
+	if (fstat(fd, &stbuffer) != 0 || stbuffer.st_size == 0)
+	{
+		::close(fd);
+		return false;
+	}
+	void* view = mmap(NULL, stbuffer.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); //the mapping keeps its own reference
+	if (view == MAP_FAILED)
+		return false;
+	size = (size_t)stbuffer.st_size;
+#endif
+	data = (unsigned char*)view;
+	this->filename = filename;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (!data)
+		return;
+#ifdef WIN32
+	UnmapViewOfFile(data);
+	CloseHandle((HANDLE)map_handle);
+	CloseHandle((HANDLE)file_handle);
+#else
+	munmap(data, size);
+#endif
+	data = NULL;
+	size = 0;
+	filename.clear();
+	file_handle = NULL;
+	map_handle = NULL;
+}
+
 bool checkGLErrors()
 {
 	#ifndef _DEBUG
@@ -240,6 +383,84 @@ bool drawText(float x, float y, std::string text, Vector3 c, float scale )
 	return true;
 }
 
+//exact powers of ten in a double, the mantissas up to 2^53 are exact too
+static const double POWERS_OF_TEN[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+const char* parseFloat(const char* pos, const char* end, float& value)
+{
+	const char* start = pos;
+	while (pos < end && (*pos == ' ' || *pos == '\t'))
+		pos++;
+	bool negative = pos < end && *pos == '-';
+	if (pos < end && (*pos == '-' || *pos == '+'))
+		pos++;
+
+	//the digits after the 19th dont fit in the mantissa, they only move the exponent
+	unsigned long long mantissa = 0;
+	int exponent = 0, digits = 0;
+	bool any = false;
+	for (; pos < end && *pos >= '0' && *pos <= '9'; ++pos, any = true)
+		if (digits < 19)
+		{
+			mantissa = mantissa * 10 + (*pos - '0');
+			digits += mantissa ? 1 : 0;
+		}
+		else
+			exponent++;
+	if (pos < end && *pos == '.')
+		for (++pos; pos < end && *pos >= '0' && *pos <= '9'; ++pos, any = true)
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*pos - '0');
+				digits += mantissa ? 1 : 0;
+				exponent--;
+			}
+	if (!any)
+		return start;
+	if (pos < end && (*pos == 'e' || *pos == 'E'))
+	{
+		const char* exp_pos = pos + 1;
+		bool exp_negative = exp_pos < end && *exp_pos == '-';
+		if (exp_pos < end && (*exp_pos == '-' || *exp_pos == '+'))
+			exp_pos++;
+		if (exp_pos < end && *exp_pos >= '0' && *exp_pos <= '9')
+		{
+			int e = 0;
+			for (; exp_pos < end && *exp_pos >= '0' && *exp_pos <= '9'; ++exp_pos)
+				e = e < 10000 ? e * 10 + (*exp_pos - '0') : e;
+			exponent += exp_negative ? -e : e;
+			pos = exp_pos;
+		}
+	}
+
+	double result = (double)mantissa;
+	if (exponent < 0)
+		result = exponent >= -22 ? result / POWERS_OF_TEN[-exponent] : result * pow(10.0, exponent);
+	else if (exponent > 0)
+		result = exponent <= 22 ? result * POWERS_OF_TEN[exponent] : result * pow(10.0, exponent);
+	value = (float)(negative ? -result : result);
+	return pos;
+}
+
+const char* parseInt(const char* pos, const char* end, int& value)
+{
+	const char* start = pos;
+	while (pos < end && (*pos == ' ' || *pos == '\t'))
+		pos++;
+	bool negative = pos < end && *pos == '-';
+	if (pos < end && (*pos == '-' || *pos == '+'))
+		pos++;
+	if (pos == end || *pos < '0' || *pos > '9')
+		return start;
+	long long result = 0;
+	for (; pos < end && *pos >= '0' && *pos <= '9'; ++pos)
+		result = result < 0x7FFFFFFF ? result * 10 + (*pos - '0') : result;
+	if (result > 0x7FFFFFFF)
+		result = 0x7FFFFFFF;
+	value = (int)(negative ? -result : result);
+	return pos;
+}
+
 std::vector<std::string> tokenize(const std::string& source, const char* delimiters, bool process_strings)
 {
 	std::vector<std::string> tokens;
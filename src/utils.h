@@ -15,9 +15,41 @@
 
 //General functions **************
 long getTime();
+double getTimeHighRes(); //in ms, with sub millisecond precision (for profiling)
 float * snapshot();
 bool readFile(const std::string& filename, std::string& content);
 bool readFileBin(const std::string& filename, std::vector<unsigned char>& buffer);
+bool getFileInfo(const char* filename, unsigned long long& size, long long& mtime); //false if it doesnt exist
+unsigned long long hashFNV1a(const void* data, size_t size, unsigned long long hash = 14695981039346656037ULL);
+
+//read-only view of a whole file mapped in memory, the OS pages it in on demand (no copies)
+class MappedFile {
+public:
+	unsigned char* data;
+	size_t size;
+	std::string filename;
+
+	MappedFile();
+	~MappedFile();
+	bool open(const char* filename);
+	void close();
+private:
+	void* file_handle;
+	void* map_handle;
+};
+
+//the file a cooked file was made from, to cook it again when it changes
+struct sSourceInfo {
+	unsigned long long size;
+	long long mtime;
+	unsigned long long hash; //FNV-1a of the file, only compared when the mtime differs
+};
+bool getSourceInfo(const char* filename, sSourceInfo& info); //false if it cant be read
+bool isSourceUnchanged(const char* filename, const sSourceInfo& info); //true if it doesnt exist, the cooked file is used as it is
+
+//the cooked files are written to a temporary file and moved over the old one once complete,
+//so a reader mapping it at the same time never sees it half written
+bool replaceFile(const char* temp_filename, const char* filename);
 
 //generic purposes fuctions
 void drawGrid();
@@ -32,6 +64,9 @@ std::string getPath();
 Vector2 getDesktopSize( int display_index = 0 );
 
 std::vector<std::string> tokenize(const std::string& source, const char* delimiters, bool process_strings = false);
+//in place parsing for the text loaders: skip spaces and tabs, return the position after the number (pos if there wasnt one)
+const char* parseFloat(const char* pos, const char* end, float& value);
+const char* parseInt(const char* pos, const char* end, int& value);
 std::vector<std::string>& split(const std::string &s, char delim, std::vector<std::string> &elems);
 std::vector<std::string> split(const std::string &s, char delim);
 std::string join(std::vector<std::string>& strings, const char* delim);